@@ -0,0 +1,727 @@
+// heap_aggregate: reads the stats files of many runs, CSV or binary, several
+// files at a time, groups the runs by the settings in their headers and
+// writes, for every group and timestep, percentiles of every metric across
+// the group's runs.
+
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <map>
+#include <set>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "stats_writer.h"
+#include "tool_options.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Per-run settings that differ between otherwise identical runs, left out of the default grouping.
+constexpr const char* kPerRunKeys[] = {"host", "seed", "started", "command"};
+
+struct AggregateOptions {
+    std::vector<std::string> inputs; // Files, or directories searched for *.csv and *.bin.
+    std::string outputPath = "aggregate_stats.csv";
+    unsigned jobs = 0; // 0: one per hardware thread.
+    int64_t binSteps = 1;
+    std::vector<double> percentiles = {50, 90, 99};
+    std::vector<std::string> groupBy; // Empty: every key but kPerRunKeys and ignore.
+    std::vector<std::string> ignore;
+    bool showHelp = false;
+};
+
+// One run, reduced to the mean of every column over each bin of timesteps.
+struct RunSummary {
+    RunMetadata metadata;
+    std::vector<std::string> columns; // Without Time.
+    std::vector<double> means;        // bins x columns; NaN where the bin had no value.
+    std::vector<bool> binHasRow;
+    std::string error; // Why the file could not be read; empty on success.
+};
+
+bool parsePercentiles(std::string_view text, std::vector<double>& values) {
+    std::vector<std::string> items;
+    parseNames(text, items);
+    values.clear();
+    for (const std::string& item : items) {
+        double value = 0;
+        if (!parseNumber(std::string_view(item), value) || !(value >= 0 && value <= 100)) {
+            return false;
+        }
+        values.push_back(value);
+    }
+    return !values.empty();
+}
+
+bool parseAggregateOptions(int argc, char** argv, AggregateOptions& options, std::string& error) {
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--help" || arg == "-h") {
+            options.showHelp = true;
+            continue;
+        }
+        if (!arg.starts_with("--")) {
+            options.inputs.emplace_back(arg);
+            continue;
+        }
+        if (i + 1 >= argc) {
+            error = "unknown option or missing value: " + std::string(arg);
+            return false;
+        }
+        std::string_view value = argv[++i];
+
+        bool ok = true;
+        if (arg == "--output") {
+            options.outputPath = value;
+        } else if (arg == "--jobs") {
+            ok = parseNumber(value, options.jobs) && options.jobs > 0;
+        } else if (arg == "--bin-steps") {
+            ok = parseNumber(value, options.binSteps) && options.binSteps > 0;
+        } else if (arg == "--percentiles") {
+            ok = parsePercentiles(value, options.percentiles);
+        } else if (arg == "--group-by") {
+            parseNames(value, options.groupBy);
+        } else if (arg == "--ignore") {
+            parseNames(value, options.ignore);
+        } else {
+            error = "unknown option: " + std::string(arg);
+            return false;
+        }
+        if (!ok) {
+            error = "invalid value for " + std::string(arg) + ": " + std::string(value);
+            return false;
+        }
+    }
+    if (options.inputs.empty() && !options.showHelp) {
+        error = "no stats files given";
+        return false;
+    }
+    return true;
+}
+
+void printUsage(std::ostream& out, const char* program) {
+    out << "Usage: " << program << " [options] FILE|DIRECTORY...\n"
+        << "Groups the runs in the given stats files (CSV or binary; directories are\n"
+        << "searched for *.csv and *.bin) by the settings in their headers and writes\n"
+        << "percentiles of every metric across each group's runs, per timestep.\n"
+        << "  --group-by KEYS     Metadata keys that make up a group, comma-separated\n"
+        << "                      (default: all but host, seed, started and command)\n"
+        << "  --ignore KEYS       Further keys to leave out of the default grouping\n"
+        << "  --percentiles LIST  Percentiles to compute (default 50,90,99)\n"
+        << "  --bin-steps N       Average each run over bins of N timesteps first (default 1)\n"
+        << "  --jobs N            Files read at a time (default: one per hardware thread)\n"
+        << "  --output FILE       Percentiles CSV (default aggregate_stats.csv); the groups\n"
+        << "                      and their settings go to FILE_groups.csv next to it\n"
+        << "  --help              Show this message\n";
+}
+
+// Companion files (stats_arenas.csv, ...) and a sweep's configurations sit next to the runs.
+bool isCompanionFile(const fs::path& path) {
+    std::string stem = path.stem().string();
+    for (const char* suffix : {"_arenas", "_freeblocks", "_layout", "_configs", "_groups"}) {
+        if (stem.ends_with(suffix)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<fs::path> collectFiles(const std::vector<std::string>& inputs, std::string& error) {
+    std::vector<fs::path> files;
+    for (const std::string& input : inputs) {
+        std::error_code ec;
+        if (fs::is_directory(input, ec)) {
+            for (const auto& entry : fs::recursive_directory_iterator(input, ec)) {
+                std::string extension = entry.path().extension().string();
+                if (entry.is_regular_file() && (extension == ".csv" || extension == ".bin") &&
+                    !isCompanionFile(entry.path())) {
+                    files.push_back(entry.path());
+                }
+            }
+        } else if (isCompanionFile(input)) {
+            std::cerr << "Warning: skipping " << input << ": not a main stats file." << std::endl;
+        } else if (fs::exists(input, ec)) {
+            files.emplace_back(input);
+        } else {
+            error = "no such file or directory: " + input;
+            return {};
+        }
+        if (ec) {
+            error = "could not read " + input + ": " + ec.message();
+            return {};
+        }
+    }
+    std::sort(files.begin(), files.end());
+    files.erase(std::unique(files.begin(), files.end()), files.end());
+    return files;
+}
+
+/**
+ * @brief Adds rows to a RunSummary: sums and counts per bin and column,
+ * turned into means by finish().
+ */
+class BinAccumulator {
+public:
+    BinAccumulator(RunSummary& run, int64_t binSteps) : run_(run), binSteps_(binSteps) {}
+
+    void add(int64_t time, const double* values) {
+        if (time < 0) {
+            return;
+        }
+        size_t columns = run_.columns.size();
+        size_t bin = static_cast<size_t>(time / binSteps_);
+        if (bin >= run_.binHasRow.size()) {
+            run_.binHasRow.resize(bin + 1, false);
+            sums_.resize((bin + 1) * columns, 0.0);
+            counts_.resize((bin + 1) * columns, 0);
+        }
+        run_.binHasRow[bin] = true;
+        for (size_t c = 0; c < columns; ++c) {
+            if (!std::isnan(values[c])) {
+                sums_[bin * columns + c] += values[c];
+                ++counts_[bin * columns + c];
+            }
+        }
+    }
+
+    void finish() {
+        run_.means.resize(sums_.size());
+        for (size_t i = 0; i < sums_.size(); ++i) {
+            run_.means[i] = counts_[i] ? sums_[i] / counts_[i] : std::numeric_limits<double>::quiet_NaN();
+        }
+    }
+
+private:
+    RunSummary& run_;
+    int64_t binSteps_;
+    std::vector<double> sums_;
+    std::vector<uint32_t> counts_;
+};
+
+// Checks the column names of a run and splits off Time. Merged columns left in @p names are an error.
+bool takeColumns(RunSummary& run, std::vector<std::string> names, size_t& timeIndex) {
+    auto time = std::find(names.begin(), names.end(), "Time");
+    if (time == names.end()) {
+        run.error = "no Time column; not a main stats file";
+        return false;
+    }
+    for (const char* merged : {"Config", "Group"}) {
+        if (std::find(names.begin(), names.end(), merged) != names.end()) {
+            run.error = std::string("has a ") + merged + " column; give the runs it was merged from instead";
+            return false;
+        }
+    }
+    timeIndex = static_cast<size_t>(time - names.begin());
+    names.erase(time);
+    run.columns = std::move(names);
+    return true;
+}
+
+void readCsvRun(std::ifstream& in, RunSummary& run, int64_t binSteps) {
+    std::string line;
+    while (std::getline(in, line) && line.starts_with("# ")) {
+        size_t equals = line.find('=');
+        if (equals != std::string::npos) {
+            run.metadata.emplace_back(line.substr(2, equals - 2), line.substr(equals + 1));
+        }
+    }
+    std::vector<std::string> names;
+    parseNames(line, names);
+    size_t timeIndex = 0;
+    if (!takeColumns(run, names, timeIndex)) {
+        return;
+    }
+
+    BinAccumulator bins(run, binSteps);
+    std::vector<double> values(run.columns.size());
+    uint64_t lineNumber = run.metadata.size() + 1;
+    while (std::getline(in, line)) {
+        ++lineNumber;
+        if (line.empty()) {
+            continue;
+        }
+        std::string_view rest = line;
+        int64_t time = -1;
+        size_t column = 0;
+        bool ok = true;
+        for (size_t field = 0; ok && field <= run.columns.size(); ++field) {
+            size_t comma = rest.find(',');
+            std::string_view cell = rest.substr(0, comma);
+            rest = comma == std::string_view::npos ? std::string_view() : rest.substr(comma + 1);
+            if (field == timeIndex) {
+                ok = parseNumber(cell, time);
+            } else if (double& value = values[column++]; !parseNumber(cell, value)) {
+                value = std::numeric_limits<double>::quiet_NaN(); // An empty cell is a missing value.
+                ok = cell.empty();
+            }
+        }
+        if (!ok) {
+            run.error = "malformed row on line " + std::to_string(lineNumber);
+            return;
+        }
+        bins.add(time, values.data());
+    }
+    bins.finish();
+}
+
+// Splits one CSV line, undoing the quoting of fields with commas or quotes.
+std::vector<std::string> splitCsvLine(std::string_view line) {
+    std::vector<std::string> fields(1);
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (quoted && c == '"' && i + 1 < line.size() && line[i + 1] == '"') {
+            fields.back() += '"';
+            ++i;
+        } else if (c == '"') {
+            quoted = !quoted;
+        } else if (c == ',' && !quoted) {
+            fields.emplace_back();
+        } else {
+            fields.back() += c;
+        }
+    }
+    return fields;
+}
+
+/**
+ * @brief Reads the configurations file of a heap_sweep: the metadata of each
+ * merged run, from its meta.<key> columns. Configurations that were not
+ * merged (skipped or failed) have none and are left out.
+ * @return false if the file is missing or predates the meta.<key> columns.
+ */
+bool readSweepConfigs(const fs::path& path, std::map<int64_t, RunMetadata>& configs, std::string& error) {
+    std::ifstream in(path.string());
+    std::string line;
+    if (!in || !std::getline(in, line)) {
+        error = "its configurations file " + path.string() + " is missing";
+        return false;
+    }
+    std::vector<std::string> header = splitCsvLine(line);
+    if (header[0] != "Config" ||
+        std::none_of(header.begin(), header.end(), [](const std::string& name) { return name.starts_with("meta."); })) {
+        error = path.string() + " has no run metadata (meta.* columns); give the runs it was merged from instead";
+        return false;
+    }
+    while (std::getline(in, line)) {
+        if (line.empty()) {
+            continue;
+        }
+        std::vector<std::string> fields = splitCsvLine(line);
+        int64_t config = 0;
+        if (!parseNumber(std::string_view(fields[0]), config)) {
+            error = "malformed line in " + path.string();
+            return false;
+        }
+        RunMetadata metadata;
+        for (size_t c = 1; c < header.size() && c < fields.size(); ++c) {
+            if (header[c].starts_with("meta.") && !fields[c].empty()) {
+                metadata.emplace_back(header[c].substr(5), fields[c]);
+            }
+        }
+        if (!metadata.empty()) {
+            configs[config] = std::move(metadata);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Reads one binary stats file into @p runs: one run, or for a merged
+ * heap_sweep file one per configuration, split by its leading Config column
+ * and given the run's own metadata from the configurations file.
+ */
+void readBinaryRun(std::FILE* in, const fs::path& path, std::vector<RunSummary>& runs, int64_t binSteps) {
+    RunSummary file;
+    auto fail = [&](std::string error) {
+        file.error = std::move(error);
+        runs.push_back(std::move(file));
+    };
+    BinaryStatsPrologue prologue;
+    bool ok = std::fread(&prologue, sizeof(prologue), 1, in) == 1 &&
+              std::memcmp(prologue.magic, kBinaryStatsMagic, sizeof(prologue.magic)) == 0 &&
+              prologue.version >= 1 && prologue.version <= kBinaryStatsVersion &&
+              prologue.recordBytes == prologue.columnCount * sizeof(uint64_t);
+    std::vector<char> entries(size_t{ok ? prologue.columnCount : 0} * kBinaryColumnBytes);
+    ok = ok && std::fread(entries.data(), 1, entries.size(), in) == entries.size();
+    uint32_t metadataBytes = 0;
+    std::string text;
+    if (ok && prologue.version >= 2) {
+        ok = std::fread(&metadataBytes, sizeof(metadataBytes), 1, in) == 1 &&
+             metadataBytes <= prologue.headerBytes;
+        text.resize(ok ? metadataBytes : 0);
+        ok = ok && std::fread(text.data(), 1, text.size(), in) == text.size();
+    }
+    ok = ok && std::fseek(in, static_cast<long>(prologue.headerBytes), SEEK_SET) == 0;
+    if (!ok) {
+        return fail("not a binary stats file");
+    }
+    file.metadata = parseMetadataLines(text);
+
+    std::vector<std::string> names;
+    std::vector<char> types;
+    for (size_t c = 0; c < prologue.columnCount; ++c) {
+        const char* entry = entries.data() + c * kBinaryColumnBytes;
+        names.emplace_back(entry, strnlen(entry, kBinaryColumnBytes - 8));
+        types.push_back(entry[kBinaryColumnBytes - 8]);
+    }
+
+    // heap_sweep puts the configuration of each row in front, and the metadata
+    // of every configuration's run into the file its sweep.configs entry names.
+    const bool merged = !names.empty() && names[0] == "Config" && types[0] == 'i';
+    std::map<int64_t, RunMetadata> configs;
+    if (merged) {
+        auto entry = std::find_if(file.metadata.begin(), file.metadata.end(),
+                                  [](const auto& pair) { return pair.first == "sweep.configs"; });
+        if (entry == file.metadata.end()) {
+            return fail("has a Config column but no sweep.configs entry; give the runs it was merged from instead");
+        }
+        std::string error;
+        if (!readSweepConfigs(path.parent_path() / entry->second, configs, error)) {
+            return fail("a merged sweep, but " + error);
+        }
+        names.erase(names.begin());
+    }
+    size_t timeIndex = 0;
+    if (!takeColumns(file, names, timeIndex)) {
+        return runs.push_back(std::move(file));
+    }
+    const size_t firstColumn = merged ? 1 : 0;
+    timeIndex += firstColumn;
+    std::vector<double> values(file.columns.size());
+
+    const size_t first = runs.size();
+    std::map<int64_t, size_t> binsOf; // Config -> its BinAccumulator.
+    if (merged) {
+        for (auto& [config, metadata] : configs) {
+            binsOf[config] = runs.size() - first;
+            RunSummary& run = runs.emplace_back();
+            run.metadata = std::move(metadata);
+            run.columns = file.columns;
+        }
+    } else {
+        runs.push_back(std::move(file));
+    }
+    std::vector<BinAccumulator> bins;
+    for (size_t r = first; r < runs.size(); ++r) {
+        bins.emplace_back(runs[r], binSteps);
+    }
+
+    // Records are read a few thousand at a time; each column converted by its type.
+    constexpr size_t kChunkRecords = 4096;
+    std::vector<uint64_t> chunk(kChunkRecords * prologue.columnCount);
+    std::string error;
+    size_t records;
+    while (error.empty() && (records = std::fread(chunk.data(), prologue.recordBytes, kChunkRecords, in)) > 0) {
+        for (size_t r = 0; r < records; ++r) {
+            const uint64_t* record = chunk.data() + r * prologue.columnCount;
+            size_t target = 0;
+            if (merged) {
+                int64_t config;
+                std::memcpy(&config, &record[0], sizeof(config));
+                auto found = binsOf.find(config);
+                if (found == binsOf.end()) {
+                    error = "has rows of configuration " + std::to_string(config) +
+                            ", which its configurations file has no metadata for";
+                    break;
+                }
+                target = found->second;
+            }
+            int64_t time = 0;
+            size_t column = 0;
+            for (size_t c = firstColumn; c < prologue.columnCount; ++c) {
+                double value;
+                if (types[c] == 'i') {
+                    int64_t cell;
+                    std::memcpy(&cell, &record[c], sizeof(cell));
+                    value = static_cast<double>(cell);
+                    if (c == timeIndex) {
+                        time = cell;
+                        continue;
+                    }
+                } else if (types[c] == 'f') {
+                    std::memcpy(&value, &record[c], sizeof(value));
+                } else {
+                    value = static_cast<double>(record[c]);
+                }
+                values[column++] = value;
+            }
+            bins[target].add(time, values.data());
+        }
+    }
+    if (error.empty() && std::ferror(in)) {
+        error = "read error";
+    }
+    if (!error.empty()) {
+        bins.clear();
+        runs.resize(first);
+        file = RunSummary{};
+        return fail(error);
+    }
+    for (BinAccumulator& accumulator : bins) {
+        accumulator.finish();
+    }
+}
+
+// Reads the run (or, from a merged sweep, the runs) of one stats file into @p runs.
+void readRun(const fs::path& path, std::vector<RunSummary>& runs, int64_t binSteps) {
+    char magic[sizeof(kBinaryStatsMagic)] = {};
+    {
+        std::ifstream probe(path, std::ios::binary);
+        probe.read(magic, sizeof(magic));
+    }
+    if (std::memcmp(magic, kBinaryStatsMagic, sizeof(magic)) == 0) {
+        std::FILE* in = std::fopen(path.string().c_str(), "rb");
+        if (!in) {
+            runs.emplace_back().error = "could not open";
+            return;
+        }
+        readBinaryRun(in, path, runs, binSteps);
+        std::fclose(in);
+        return;
+    }
+    RunSummary& run = runs.emplace_back();
+    std::ifstream in(path);
+    if (!in) {
+        run.error = "could not open";
+        return;
+    }
+    readCsvRun(in, run, binSteps);
+}
+
+// Linear interpolation between the closest ranks, as numpy.percentile() does. @p values must be sorted.
+double percentile(const std::vector<double>& values, double p) {
+    double position = p / 100.0 * static_cast<double>(values.size() - 1);
+    size_t below = static_cast<size_t>(position);
+    size_t above = std::min(below + 1, values.size() - 1);
+    return values[below] + (values[above] - values[below]) * (position - static_cast<double>(below));
+}
+
+// 99.9 -> "99.9", 50 -> "50".
+std::string formatNumber(double value) {
+    char text[32];
+    auto [end, ec] = std::to_chars(text, text + sizeof(text), value);
+    return std::string(text, end);
+}
+
+// aggregate_stats.csv -> aggregate_stats_groups.csv
+fs::path groupsPath(const fs::path& output) {
+    fs::path path = output;
+    return path.replace_filename(output.stem().string() + "_groups.csv");
+}
+
+int runAggregate(const AggregateOptions& options) {
+    std::string error;
+    std::vector<fs::path> files = collectFiles(options.inputs, error);
+    if (!error.empty() || files.empty()) {
+        std::cerr << "Error: " << (error.empty() ? "no stats files found" : error) << "." << std::endl;
+        return 1;
+    }
+
+    unsigned jobs = options.jobs ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+    jobs = static_cast<unsigned>(std::min<size_t>(jobs, files.size()));
+    std::cout << "Reading " << files.size() << " stats files, " << jobs << " at a time..." << std::endl;
+    std::vector<std::vector<RunSummary>> fileRuns(files.size());
+    std::atomic<size_t> next{0};
+    auto reader = [&] {
+        for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < files.size();) {
+            readRun(files[i], fileRuns[i], options.binSteps);
+        }
+    };
+    std::vector<std::thread> readers;
+    for (unsigned j = 1; j < jobs; ++j) {
+        readers.emplace_back(reader);
+    }
+    reader();
+    for (std::thread& thread : readers) {
+        thread.join();
+    }
+    std::vector<RunSummary> runs;
+    std::vector<size_t> fileOf; // The file each run came from.
+    for (size_t i = 0; i < files.size(); ++i) {
+        for (RunSummary& run : fileRuns[i]) {
+            runs.push_back(std::move(run));
+            fileOf.push_back(i);
+        }
+    }
+    fileRuns.clear();
+
+    // Metric columns in the order they are first seen; the group key of each run.
+    size_t failed = 0;
+    std::vector<std::string> metrics;
+    std::unordered_map<std::string, size_t> metricIndex;
+    std::set<std::string> allKeys;
+    for (size_t i = 0; i < runs.size(); ++i) {
+        if (!runs[i].error.empty()) {
+            std::cerr << "Warning: skipping " << files[fileOf[i]].string() << ": " << runs[i].error << "." << std::endl;
+            ++failed;
+            continue;
+        }
+        for (const std::string& column : runs[i].columns) {
+            if (column != "SampleTrigger" && metricIndex.emplace(column, metrics.size()).second) {
+                metrics.push_back(column);
+            }
+        }
+        for (const auto& [key, value] : runs[i].metadata) {
+            allKeys.insert(key);
+        }
+    }
+    if (failed == runs.size()) {
+        std::cerr << "Error: none of the files could be read." << std::endl;
+        return 1;
+    }
+    std::vector<std::string> groupKeys = options.groupBy;
+    if (groupKeys.empty()) {
+        for (const std::string& key : allKeys) {
+            bool perRun = std::find(std::begin(kPerRunKeys), std::end(kPerRunKeys), key) != std::end(kPerRunKeys) ||
+                          std::find(options.ignore.begin(), options.ignore.end(), key) != options.ignore.end();
+            if (!perRun) {
+                groupKeys.push_back(key);
+            }
+        }
+    }
+
+    // Groups are numbered in the order of their settings; a key a run lacks counts as empty.
+    std::map<std::vector<std::string>, std::vector<size_t>> groups;
+    for (size_t i = 0; i < runs.size(); ++i) {
+        if (!runs[i].error.empty()) {
+            continue;
+        }
+        std::vector<std::string> values;
+        for (const std::string& key : groupKeys) {
+            auto entry = std::find_if(runs[i].metadata.begin(), runs[i].metadata.end(),
+                                      [&](const auto& pair) { return pair.first == key; });
+            values.push_back(entry == runs[i].metadata.end() ? std::string() : entry->second);
+        }
+        groups[values].push_back(i);
+    }
+
+    fs::path output = options.outputPath;
+    fs::path groupsFile = groupsPath(output);
+    std::ofstream out(output, std::ios::binary);
+    std::ofstream groupsOut(groupsFile, std::ios::binary);
+    if (!out || !groupsOut) {
+        std::cerr << "Error: Could not create " << output.string() << " / " << groupsFile.string() << "."
+                  << std::endl;
+        return 1;
+    }
+    std::vector<std::string> percentileNames;
+    for (double p : options.percentiles) {
+        percentileNames.push_back(formatNumber(p));
+    }
+    out << "# aggregate.runs=" << runs.size() - failed << "\n"
+        << "# aggregate.group_by=" << joinNames(groupKeys) << "\n"
+        << "# aggregate.percentiles=" << joinNames(percentileNames) << "\n"
+        << "# aggregate.bin_steps=" << options.binSteps << "\n"
+        << "Group,Time,Runs";
+    for (const std::string& metric : metrics) {
+        for (const std::string& p : percentileNames) {
+            out << ',' << metric << "_p" << p;
+        }
+    }
+    out << '\n';
+
+    groupsOut << "Group,Runs";
+    for (const std::string& key : groupKeys) {
+        groupsOut << ',' << csvField(key);
+    }
+    groupsOut << '\n';
+
+    size_t group = 0;
+    uint64_t rows = 0;
+    std::vector<double> values;
+    std::vector<std::vector<size_t>> columnOf; // Per run of the group: metric -> its column, or npos.
+    for (const auto& [settings, members] : groups) {
+        groupsOut << group << ',' << members.size();
+        for (const std::string& value : settings) {
+            groupsOut << ',' << csvField(value);
+        }
+        groupsOut << '\n';
+
+        size_t bins = 0;
+        columnOf.assign(members.size(), std::vector<size_t>(metrics.size(), std::string::npos));
+        for (size_t m = 0; m < members.size(); ++m) {
+            const RunSummary& run = runs[members[m]];
+            bins = std::max(bins, run.binHasRow.size());
+            for (size_t c = 0; c < run.columns.size(); ++c) {
+                if (auto found = metricIndex.find(run.columns[c]); found != metricIndex.end()) {
+                    columnOf[m][found->second] = c;
+                }
+            }
+        }
+        for (size_t bin = 0; bin < bins; ++bin) {
+            size_t present = 0;
+            for (size_t member : members) {
+                present += bin < runs[member].binHasRow.size() && runs[member].binHasRow[bin];
+            }
+            if (present == 0) {
+                continue;
+            }
+            out << group << ',' << static_cast<int64_t>(bin) * options.binSteps << ',' << present;
+            for (size_t metric = 0; metric < metrics.size(); ++metric) {
+                values.clear();
+                for (size_t m = 0; m < members.size(); ++m) {
+                    const RunSummary& run = runs[members[m]];
+                    size_t column = columnOf[m][metric];
+                    if (column != std::string::npos && bin < run.binHasRow.size()) {
+                        double value = run.means[bin * run.columns.size() + column];
+                        if (!std::isnan(value)) {
+                            values.push_back(value);
+                        }
+                    }
+                }
+                std::sort(values.begin(), values.end());
+                for (double p : options.percentiles) {
+                    out << ',';
+                    if (!values.empty()) {
+                        out << formatNumber(percentile(values, p));
+                    }
+                }
+            }
+            out << '\n';
+            ++rows;
+        }
+        ++group;
+    }
+    out.close();
+    groupsOut.close();
+    if (!out || !groupsOut) {
+        std::cerr << "Error: Could not write " << output.string() << " / " << groupsFile.string() << "."
+                  << std::endl;
+        return 1;
+    }
+    std::cout << "Aggregated " << runs.size() - failed << " runs into " << groups.size() << " groups: " << rows
+              << " rows in " << output.string() << ", the groups' settings in " << groupsFile.string() << "."
+              << std::endl;
+    return failed == 0 ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    AggregateOptions options;
+    std::string error;
+    if (!parseAggregateOptions(argc, argv, options, error)) {
+        std::cerr << "Error: " << error << "\n";
+        printUsage(std::cerr, argv[0]);
+        return 2;
+    }
+    if (options.showHelp) {
+        printUsage(std::cout, argv[0]);
+        return 0;
+    }
+    return runAggregate(options);
+}
@@ -1,81 +1,459 @@
+import mmap
+import struct
+import sys
+import warnings
+
+import numpy as np
 import pandas as pd
 import matplotlib.pyplot as plt
-import sys
 
-# Define the initial heap size from the C++ program in bytes.
-# This makes the script easier to maintain if you change the C++ code.
-INITIAL_HEAP_SIZE_BYTES = 20 * 1024 * 1024
+# numpy types for the column type codes in a binary stats header.
+BINARY_COLUMN_TYPES = {'i': '<i8', 'u': '<u8', 'f': '<f8'}
 
-def plot_fragmentation_data(csv_filepath="heap_fragmentation_stats.csv"):
+def load_stats(filepath):
     """
-    Reads heap fragmentation data from a CSV file and generates plots
-    based on user-defined metrics.
+    Loads a stats file written by heap_analyzer, in either format.
 
-    Args:
-        csv_filepath (str): The path to the CSV file generated by the C++ program.
+    Binary files (--format binary) are memory-mapped rather than parsed, so
+    even very long runs load instantly; see the README for the layout. The
+    run's settings from the file header end up in df.attrs['metadata'].
     """
-    try:
-        # Read the data from the CSV file into a pandas DataFrame.
-        df = pd.read_csv(csv_filepath)
-        print(f"Successfully loaded data from '{csv_filepath}'.")
-    except FileNotFoundError:
-        print(f"Error: The file '{csv_filepath}' was not found.")
-        print("Please run the C++ program first to generate the data file.")
-        sys.exit(1)
-    except pd.errors.EmptyDataError:
-        print(f"Error: The file '{csv_filepath}' is empty.")
+    with open(filepath, 'rb') as f:
+        head = f.read(24)
+    if not head.startswith(b'HEAPSTAT'):
+        metadata = {}
+        with open(filepath) as f:
+            for line in f:
+                if not line.startswith('# '):
+                    break
+                key, _, value = line[2:].rstrip('\n').partition('=')
+                metadata[key] = value
+        df = pd.read_csv(filepath, comment='#')
+        df.attrs['metadata'] = metadata
+        return df
+
+    records, metadata = map_binary_stats(filepath)
+    df = pd.DataFrame(records)
+    df.attrs['metadata'] = metadata
+    return df
+
+def map_binary_stats(filepath):
+    """
+    Memory-maps a binary stats file as a numpy record array without reading
+    it; only the pages of the rows and columns used are ever loaded.
+    Returns (records, metadata).
+    """
+    with open(filepath, 'rb') as f:
+        head = f.read(24)
+        version, record_bytes, header_bytes, column_count = struct.unpack_from('<4I', head, 8)
+        if version not in (1, 2):
+            raise ValueError(f"unsupported binary stats version {version}")
+        columns = f.read(column_count * 32)
+        metadata_text = b''
+        if version >= 2:
+            (metadata_bytes,) = struct.unpack('<I', f.read(4))
+            metadata_text = f.read(metadata_bytes)
+    fields = []
+    for i in range(column_count):
+        entry = columns[i * 32:(i + 1) * 32]
+        name = entry[:24].rstrip(b'\0').decode('ascii')
+        fields.append((name, BINARY_COLUMN_TYPES[chr(entry[24])]))
+    dtype = np.dtype(fields)
+    assert dtype.itemsize == record_bytes
+    records = np.memmap(filepath, dtype=dtype, mode='r', offset=header_bytes)
+    return records, dict(line.partition('=')[::2] for line in metadata_text.decode().splitlines())
+
+# Layout snapshot files (--layout-every), see layout_recorder.h.
+LAYOUT_MAGIC = b'HEAPLAYT'
+LAYOUT_RECORD = struct.Struct('<IiQQQ')
+# Holes between spans smaller than this are drawn as part of the heap;
+# larger ones (unmapped address space) are cut out of the picture.
+LAYOUT_GAP_BYTES = 1 << 20
+
+def _decode_varints(buf):
+    """Decodes back-to-back LEB128 varints into a uint64 array, without a Python loop."""
+    data = np.frombuffer(buf, dtype=np.uint8)
+    if data.size == 0:
+        return np.zeros(0, dtype=np.uint64)
+    last = (data & 0x80) == 0
+    starts = np.flatnonzero(np.concatenate(([True], last[:-1])))
+    # Which varint every byte belongs to, and the byte's position inside it.
+    owner = np.concatenate(([0], np.cumsum(last[:-1])))
+    position = np.arange(data.size) - starts[owner]
+    parts = (data & 0x7f).astype(np.uint64) << (7 * position).astype(np.uint64)
+    return np.add.reduceat(parts, starts)
+
+def _decode_spans(values):
+    """(address delta, size << 1 | busy) pairs -> address, size and busy arrays."""
+    address = np.cumsum(values[0::2], dtype=np.uint64)
+    return address, values[1::2] >> np.uint64(1), (values[1::2] & np.uint64(1)).astype(bool)
+
+def _layout_records(filepath):
+    """Yields (kind, time step, payload view, removed count) for every record of a layout file."""
+    with open(filepath, 'rb') as f:
+        data = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+    if data[:8] != LAYOUT_MAGIC:
+        raise ValueError(f"{filepath} is not a heap layout file")
+    _, header_bytes = struct.unpack_from('<2I', data, 8)
+    view = memoryview(data)
+    offset = header_bytes
+    while offset + LAYOUT_RECORD.size <= len(data):
+        kind, time_step, removed, added, payload_bytes = LAYOUT_RECORD.unpack_from(data, offset)
+        offset += LAYOUT_RECORD.size
+        yield chr(kind), time_step, view[offset:offset + payload_bytes], removed
+        offset += payload_bytes
+
+def iter_layout(filepath, steps=None):
+    """
+    Replays a layout file, yielding (time step, address, size, busy) arrays in
+    address order for each snapshot, or only for the time steps in `steps`.
+
+    Deltas are applied with array operations: removed spans are dropped by
+    address with np.isin, added ones are merged in with one sort.
+    """
+    address = np.zeros(0, dtype=np.uint64)
+    size = np.zeros(0, dtype=np.uint64)
+    busy = np.zeros(0, dtype=bool)
+    for kind, time_step, payload, removed in _layout_records(filepath):
+        values = _decode_varints(payload)
+        if kind == 'K':
+            address, size, busy = _decode_spans(values)
+        else:
+            gone, _, _ = _decode_spans(values[:2 * removed])
+            new_address, new_size, new_busy = _decode_spans(values[2 * removed:])
+            keep = ~np.isin(address, gone, assume_unique=True)
+            address = np.concatenate((address[keep], new_address))
+            size = np.concatenate((size[keep], new_size))
+            busy = np.concatenate((busy[keep], new_busy))
+            order = np.argsort(address, kind='stable')
+            address, size, busy = address[order], size[order], busy[order]
+        if steps is None or time_step in steps:
+            yield time_step, address, size, busy
+
+def _merge_regions(start, end):
+    """Merges [start, end) intervals closer than LAYOUT_GAP_BYTES into regions."""
+    order = np.argsort(start, kind='stable')
+    start, end = start[order], end[order]
+    reach = np.maximum.accumulate(end)
+    new_region = np.concatenate(([True], start[1:] > reach[:-1] + np.uint64(LAYOUT_GAP_BYTES)))
+    first = np.flatnonzero(new_region)
+    return start[first], np.maximum.reduceat(end, first)
+
+def render_layout(filepath, width=1024, max_rows=1024, output_filename='heap_layout.png'):
+    """
+    Draws a layout file as an address-space bitmap: one row per snapshot
+    (at most `max_rows`, evenly spaced), `width` columns over the heap's
+    address range, coloured by the share of each column that is free.
+
+    Large holes in the address space are cut out, so several heap regions sit
+    side by side. Each row costs a few array operations whatever the number of
+    blocks in the heap.
+    """
+    time_steps = np.array([time_step for _, time_step, _, _ in _layout_records(filepath)])
+    if time_steps.size == 0:
+        print(f"Error: '{filepath}' holds no snapshots.")
         sys.exit(1)
-    except KeyError as e:
-        print(f"Error: Missing expected column in CSV: {e}")
-        print("Please ensure you are using the updated C++ program that outputs the 'TotalUserRequested' column.")
+    picked = np.unique(np.linspace(0, time_steps.size - 1, min(max_rows, time_steps.size)).astype(int))
+    wanted = set(time_steps[picked].tolist())
+
+    frames = []
+    region_starts, region_ends = [], []
+    for time_step, address, size, busy in iter_layout(filepath, wanted):
+        end = address + size
+        starts, ends = _merge_regions(address, end) if address.size else (address, end)
+        region_starts.append(starts)
+        region_ends.append(ends)
+        frames.append((time_step, address[~busy], size[~busy]))
+
+    if not any(starts.size for starts in region_starts):
+        print(f"Error: every snapshot in '{filepath}' is empty.")
         sys.exit(1)
+    # Squeeze the address space down to the regions any snapshot used.
+    region_start, region_end = _merge_regions(np.concatenate(region_starts), np.concatenate(region_ends))
+    region_length = (region_end - region_start).astype(np.float64)
+    region_offset = np.concatenate(([0.0], np.cumsum(region_length)[:-1]))
+    total = region_length.sum()
+    edges = np.linspace(0.0, total, width + 1)
 
-    # --- Calculate the requested metrics ---
-    
-    # Metric 1: Total Occupied Space = Initial Heap Size - Total Free Space
-    # This shows how "full" the heap is with both useful data and all forms of waste.
-    df['Occupied_Memory'] = INITIAL_HEAP_SIZE_BYTES - df['TotalFree_Bytes']
+    def compact(address):
+        region = np.searchsorted(region_start, address, side='right') - 1
+        return region_offset[region] + (address - region_start[region]).astype(np.float64)
 
-    # Metric 2: Total Wasted Space = Initial Size - Free Space - User Requested Space
-    # This represents all memory that is not free and not holding useful data.
-    # It's the sum of internal fragmentation and heap management overhead.
-    df['Total_Waste'] = INITIAL_HEAP_SIZE_BYTES - df['TotalFree_Bytes'] - df['TotalUserRequested']
+    image = np.zeros((len(frames), width))
+    for row, (_, free_address, free_size) in enumerate(frames):
+        if free_address.size == 0:
+            continue
+        # Free bytes below each column edge: the spans wholly before it, plus
+        # the part of the one it falls in.
+        start = compact(free_address)
+        length = free_size.astype(np.float64)
+        before = np.concatenate(([0.0], np.cumsum(length)[:-1]))
+        span = np.searchsorted(start, edges, side='right') - 1
+        inside = np.clip(edges - start[np.maximum(span, 0)], 0.0, length[np.maximum(span, 0)])
+        covered = np.where(span >= 0, before[np.maximum(span, 0)] + inside, 0.0)
+        image[row] = np.diff(covered) / np.diff(edges)
 
+    fig, ax = plt.subplots(figsize=(14, 8))
+    shown = ax.imshow(image, aspect='auto', interpolation='nearest', cmap='magma', vmin=0.0, vmax=1.0,
+                      extent=[0, total / (1024 * 1024), frames[-1][0], frames[0][0]])
+    ax.set_title(f'Heap Layout Over Time ({time_steps.size} snapshots, {len(region_start)} regions)', fontsize=14)
+    ax.set_xlabel('Heap Address Space (MiB, holes removed)')
+    ax.set_ylabel('Time (Simulation Steps)')
+    fig.colorbar(shown, ax=ax, label='Free Share of Column')
+    plt.tight_layout()
+    plt.savefig(output_filename)
+    print(f"\nHeap layout saved as '{output_filename}'")
 
-    # --- Create the Plots ---
+# Metrics computed from the columns every stats file has: name -> (inputs, formula).
+# The formulas work on whole numpy arrays at once.
+DERIVED_METRICS = {
+    # Everything the allocator holds for the workload: requested, rounding and free space.
+    'Footprint_Bytes': (('TotalUserRequested', 'InternalFrag_Bytes', 'TotalFree_Bytes'),
+                        lambda c: c['TotalUserRequested'] + c['InternalFrag_Bytes'] + c['TotalFree_Bytes']),
+    # Internal plus external fragmentation.
+    'Total_Waste': (('InternalFrag_Bytes', 'TotalFree_Bytes'),
+                    lambda c: c['InternalFrag_Bytes'] + c['TotalFree_Bytes']),
+    # Share of the footprint that holds requested bytes.
+    'Utilization': (('TotalUserRequested', 'InternalFrag_Bytes', 'TotalFree_Bytes'),
+                    lambda c: c['TotalUserRequested'] /
+                    np.maximum(c['TotalUserRequested'] + c['InternalFrag_Bytes'] + c['TotalFree_Bytes'], 1)),
+}
 
-    # Create a figure and a set of 2 subplots arranged vertically.
-    fig, axes = plt.subplots(2, 1, figsize=(12, 12), sharex=True)
-    fig.suptitle('Custom Heap Fragmentation Analysis', fontsize=18, fontweight='bold')
+DEFAULT_METRICS = ('ExternalFrag_Ratio', 'Footprint_Bytes', 'Total_Waste', 'AllocLatency_p99_ns')
 
-    # Plot 1: Occupied Heap Space
-    axes[0].plot(df['Time'], df['Occupied_Memory'], color='darkcyan', marker='.', linestyle='-')
-    axes[0].set_title('Total Occupied Heap Space Over Time', fontsize=14)
-    axes[0].set_ylabel('Occupied Memory (Bytes)')
-    axes[0].grid(True, which='both', linestyle='--', linewidth=0.5)
-    axes[0].ticklabel_format(style='sci', axis='y', scilimits=(0,0)) # Use scientific notation
-    axes[0].axhline(y=INITIAL_HEAP_SIZE_BYTES, color='r', linestyle='--', label=f'Max Heap Size ({INITIAL_HEAP_SIZE_BYTES/1024/1024:.0f}MB)')
-    axes[0].legend()
+# Rows read at a time, so a run never has to fit in memory at once.
+CHUNK_ROWS = 1 << 20
 
+def open_stats(filepath):
+    """
+    Opens a stats file for column-wise reading without loading it: binary files
+    become a numpy memmap of records, CSV files a DataFrame. Either way
+    table[name] is one column. Returns (table, metadata).
+    """
+    with open(filepath, 'rb') as f:
+        is_binary = f.read(8) == b'HEAPSTAT'
+    if is_binary:
+        return map_binary_stats(filepath)
+    df = load_stats(filepath)
+    return df, df.attrs['metadata']
 
-    # Plot 2: Total Wasted Space (Internal Fragmentation + Overhead)
-    axes[1].plot(df['Time'], df['Total_Waste'], color='orangered', marker='.', linestyle='-')
-    axes[1].set_title('Total Wasted Space (Fragmentation + Overhead) Over Time', fontsize=14)
-    axes[1].set_xlabel('Time (Simulation Steps)')
-    axes[1].set_ylabel('Wasted Memory (Bytes)')
-    axes[1].grid(True, which='both', linestyle='--', linewidth=0.5)
-    axes[1].ticklabel_format(style='sci', axis='y', scilimits=(0,0))
+def column_names(table):
+    return list(table.dtype.names) if isinstance(table, np.ndarray) else list(table.columns)
 
+def column(table, name):
+    """One column as an array; a view into the file for memory-mapped tables."""
+    return table[name] if isinstance(table, np.ndarray) else table[name].to_numpy()
+
+def load_runs(paths):
+    """
+    Opens every file in `paths` as one or more runs. A merged heap_sweep file
+    is split into one run per Config, using only the Config column.
+    Returns a list of (label, table, first row, end row).
+    """
+    runs = []
+    for path in paths:
+        table, metadata = open_stats(path)
+        stem = path.rsplit('/', 1)[-1].rsplit('.', 1)[0]
+        if 'Config' not in column_names(table):
+            label = f"{stem} ({metadata['backend']})" if 'backend' in metadata else stem
+            runs.append((label, table, 0, len(table)))
+            continue
+        config = column(table, 'Config')
+        bounds = np.concatenate(([0], np.flatnonzero(np.diff(config)) + 1, [len(config)]))
+        for begin, end in zip(bounds[:-1], bounds[1:]):
+            runs.append((f"{stem} config {int(config[begin])}", table, int(begin), int(end)))
+    return runs
+
+def read_metric(table, name, begin, end):
+    """Yields (time, values) chunks of a column or derived metric over rows [begin, end)."""
+    inputs, formula = DERIVED_METRICS.get(name, ((name,), lambda c: c[name]))
+    for start in range(begin, end, CHUNK_ROWS):
+        stop = min(end, start + CHUNK_ROWS)
+        chunk = {n: np.asarray(column(table, n)[start:stop], dtype=np.float64) for n in inputs}
+        yield np.asarray(column(table, 'Time')[start:stop], dtype=np.float64), formula(chunk)
+
+def _minmax_blocks(y, k):
+    """Indices of the smallest and largest value of every block of k points, in order."""
+    usable = len(y) // k * k
+    picks = []
+    if usable:
+        blocks = y[:usable].reshape(-1, k)
+        offset = np.arange(blocks.shape[0]) * k
+        low = np.where(np.isnan(blocks), np.inf, blocks).argmin(axis=1) + offset
+        high = np.where(np.isnan(blocks), -np.inf, blocks).argmax(axis=1) + offset
+        picks.append(np.sort(np.stack((low, high), axis=1), axis=1).ravel())
+    if usable < len(y):
+        tail = y[usable:]
+        low = np.where(np.isnan(tail), np.inf, tail).argmin() + usable
+        high = np.where(np.isnan(tail), -np.inf, tail).argmax() + usable
+        picks.append(np.array(sorted((low, high))))
+    return np.concatenate(picks) if picks else np.zeros(0, dtype=int)
+
+def minmax_downsample(chunks, rows, points):
+    """
+    Keeps the minimum and maximum of every block of rows, so spikes survive.
+    `chunks` yields (x, y) arrays, `rows` is their total length.
+    """
+    k = max(1, -(-rows // max(points // 2, 1)))
+    xs, ys = [], []
+    carry_x = carry_y = np.zeros(0)
+    for x, y in chunks:
+        # Blocks must not straddle chunks, so leftovers wait for the next one.
+        x, y = np.concatenate((carry_x, x)), np.concatenate((carry_y, y))
+        usable = len(y) // k * k
+        pick = _minmax_blocks(y[:usable], k)
+        xs.append(x[pick])
+        ys.append(y[pick])
+        carry_x, carry_y = x[usable:], y[usable:]
+    pick = _minmax_blocks(carry_y, k)
+    xs.append(carry_x[pick])
+    ys.append(carry_y[pick])
+    x, y = np.concatenate(xs), np.concatenate(ys)
+    if len(x) == 0:
+        return x, y
+    # Where the min and max of a block are the same point it appears twice.
+    keep = np.concatenate(([True], np.diff(x) != 0))
+    return x[keep], y[keep]
+
+def lttb_downsample(x, y, points):
+    """
+    Largest-Triangle-Three-Buckets: keeps, per bucket, the point forming the
+    largest triangle with the previous pick and the next bucket's mean.
+    The loop is over buckets; each bucket is one array operation.
+    """
+    n = len(x)
+    if n <= points or points < 3:
+        return x, y
+    edges = np.linspace(1, n - 1, points - 1).astype(int)
+    counts = np.maximum(np.diff(edges), 1)
+    mean_x = np.add.reduceat(x[1:n - 1], edges[:-1] - 1) / counts
+    mean_y = np.add.reduceat(np.nan_to_num(y[1:n - 1]), edges[:-1] - 1) / counts
+    selected = np.empty(points, dtype=int)
+    selected[0], selected[-1] = 0, n - 1
+    a = 0
+    for bucket in range(points - 2):
+        lo, hi = edges[bucket], max(edges[bucket + 1], edges[bucket] + 1)
+        if bucket + 1 < points - 2:
+            next_x, next_y = mean_x[bucket + 1], mean_y[bucket + 1]
+        else:
+            next_x, next_y = x[-1], y[-1]
+        area = np.abs((x[a] - next_x) * (y[lo:hi] - y[a]) - (x[a] - x[lo:hi]) * (next_y - y[a]))
+        a = lo + int(np.nanargmax(area)) if np.any(np.isfinite(area)) else lo
+        selected[bucket + 1] = a
+    return x[selected], y[selected]
+
+def downsample(table, name, begin, end, points, method='minmax'):
+    """A metric of one run reduced to about `points` points, read chunk by chunk."""
+    rows = end - begin
+    if method == 'lttb':
+        # Min-max first, so LTTB only sees a few points per bucket (MinMaxLTTB).
+        x, y = minmax_downsample(read_metric(table, name, begin, end), rows, 4 * points)
+        return lttb_downsample(x, y, points)
+    return minmax_downsample(read_metric(table, name, begin, end), rows, points)
+
+def binned_mean(table, name, begin, end, edges):
+    """Mean of a metric over each Time bin given by `edges`, NaN where a bin is empty."""
+    sums = np.zeros(len(edges) - 1)
+    counts = np.zeros(len(edges) - 1)
+    for x, y in read_metric(table, name, begin, end):
+        bins = np.clip(np.searchsorted(edges, x, side='right') - 1, 0, len(edges) - 2)
+        valid = np.isfinite(y)
+        sums += np.bincount(bins[valid], weights=y[valid], minlength=len(sums))
+        counts += np.bincount(bins[valid], minlength=len(counts))
+    with np.errstate(invalid='ignore', divide='ignore'):
+        return sums / counts
+
+def plot_fragmentation_data(paths=("heap_fragmentation_stats.csv",), metrics=DEFAULT_METRICS, points=2000,
+                            method='minmax', output_filename='custom_fragmentation_analysis.png'):
+    """
+    Plots one or more runs, one panel per metric.
+
+    Every run is downsampled before plotting (min-max by default, or LTTB),
+    reading binary files through a memory map a chunk at a time, so long runs
+    and many runs cost about the same to draw as short ones. With several
+    runs, the 10th-90th percentile band and the median across runs are drawn
+    over the individual runs.
+
+    Args:
+        paths: CSV or binary stats files, including merged heap_sweep output.
+        metrics: Columns of the stats files, or names in DERIVED_METRICS.
+        points: Points per run and metric after downsampling.
+        method: 'minmax' or 'lttb'.
+    """
+    try:
+        runs = load_runs(paths)
+    except FileNotFoundError as e:
+        print(f"Error: The file '{e.filename}' was not found.")
+        print("Please run the C++ program first to generate the data file.")
+        sys.exit(1)
+    except pd.errors.EmptyDataError:
+        print("Error: A stats file is empty.")
+        sys.exit(1)
+    print(f"Loaded {len(runs)} run(s) from {len(paths)} file(s).")
+
+    available = set(column_names(runs[0][1]))
+    shown = [m for m in metrics if m in available or
+             (m in DERIVED_METRICS and set(DERIVED_METRICS[m][0]) <= available)]
+    missing = [m for m in metrics if m not in shown]
+    if missing:
+        print(f"Skipping metrics these files do not have: {', '.join(missing)}")
+    if not shown:
+        print("Error: none of the requested metrics are in the stats files.")
+        sys.exit(1)
+
+    fig, axes = plt.subplots(len(shown), 1, figsize=(12, 3.5 * len(shown)), sharex=True, squeeze=False)
+    fig.suptitle('Heap Fragmentation Analysis', fontsize=18, fontweight='bold')
+    many = len(runs) > 10
+    for ax, metric in zip(axes[:, 0], shown):
+        for label, table, begin, end in runs:
+            x, y = downsample(table, metric, begin, end, points, method)
+            ax.plot(x, y, linewidth=0.5 if many else 1.0, alpha=0.25 if many else 0.9,
+                    label=None if many else label)
+        if len(runs) > 1:
+            first = min(float(column(t, 'Time')[b]) for _, t, b, e in runs if e > b)
+            last = max(float(column(t, 'Time')[e - 1]) for _, t, b, e in runs if e > b)
+            edges = np.linspace(first, last + 1, min(points, 500) + 1)
+            means = np.vstack([binned_mean(t, metric, b, e, edges) for _, t, b, e in runs])
+            with warnings.catch_warnings():
+                # Bins no run reached are all-NaN columns.
+                warnings.simplefilter('ignore', RuntimeWarning)
+                low, median, high = np.nanpercentile(means, [10, 50, 90], axis=0)
+            centers = (edges[:-1] + edges[1:]) / 2
+            ax.fill_between(centers, low, high, color='black', alpha=0.15, label='p10-p90 of runs')
+            ax.plot(centers, median, color='black', linewidth=1.5, label='median of runs')
+        ax.set_title(metric, fontsize=13)
+        ax.grid(True, which='both', linestyle='--', linewidth=0.5)
+        ax.legend(fontsize=8, loc='best')
+    axes[-1, 0].set_xlabel('Time (Simulation Steps)')
 
     # Adjust layout to prevent titles and labels from overlapping.
     plt.tight_layout(rect=[0, 0, 1, 0.96])
 
     # Save the entire figure to a single PNG file.
-    output_filename = 'custom_fragmentation_analysis.png'
     plt.savefig(output_filename)
     print(f"\nPlot saved successfully as '{output_filename}'")
 
 if __name__ == '__main__':
-    # To run this script, you need pandas and matplotlib:
-    # pip install pandas matplotlib
-    plot_fragmentation_data()
+    # To run this script, you need numpy, pandas and matplotlib:
+    # pip install numpy pandas matplotlib
+    import argparse
+
+    parser = argparse.ArgumentParser(description='Plot heap_analyzer stats files or render a layout file.')
+    parser.add_argument('paths', nargs='*', default=['heap_fragmentation_stats.csv'],
+                        help='stats files (CSV, binary or merged sweep output), or one *_layout.bin')
+    parser.add_argument('--metric', action='append', dest='metrics',
+                        help=f"metric to plot, repeatable (default: {', '.join(DEFAULT_METRICS)}; "
+                             f"derived: {', '.join(DERIVED_METRICS)})")
+    parser.add_argument('--points', type=int, default=2000, help='points per run after downsampling')
+    parser.add_argument('--lttb', action='store_true', help='downsample with LTTB instead of min-max')
+    parser.add_argument('--output', help='PNG file to write')
+    args = parser.parse_args()
+
+    with open(args.paths[0], 'rb') as f:
+        is_layout = f.read(8) == LAYOUT_MAGIC
+    if is_layout:
+        render_layout(args.paths[0], output_filename=args.output or 'heap_layout.png')
+    else:
+        plot_fragmentation_data(args.paths, args.metrics or DEFAULT_METRICS, args.points,
+                                'lttb' if args.lttb else 'minmax',
+                                args.output or 'custom_fragmentation_analysis.png')
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string_view>
+
+#include "heap_backend.h"
+
+#if defined(_WIN32)
+#include "backends/win32_backend.h"
+#else
+#include "backends/glibc_backend.h"
+#endif
+#include "backends/pool_backend.h"
+#if defined(FRAGMENTATION_HAVE_JEMALLOC)
+#include "backends/jemalloc_backend.h"
+#endif
+#if defined(FRAGMENTATION_HAVE_MIMALLOC)
+#include "backends/mimalloc_backend.h"
+#endif
+#if defined(FRAGMENTATION_HAVE_TCMALLOC)
+#include "backends/tcmalloc_backend.h"
+#endif
+
+#if defined(_WIN32)
+using SystemBackend = Win32Backend;
+#else
+using SystemBackend = GlibcBackend;
+#endif
+
+template <HeapBackend... Backends>
+struct BackendList {
+    /**
+     * @brief Calls `visit.template operator()<B>()` for the backend named @p name.
+     * This is the only place the backend is chosen at runtime; everything the
+     * visitor instantiates is specialised for that one backend.
+     * @return false if no compiled-in backend has that name.
+     */
+    template <typename Visitor>
+    static bool dispatch(std::string_view name, Visitor&& visit) {
+        return ((name == Backends::name ? (visit.template operator()<Backends>(), true) : false) || ...);
+    }
+
+    template <typename Visitor>
+    static void forEach(Visitor&& visit) {
+        (visit.template operator()<Backends>(), ...);
+    }
+};
+
+// Every backend compiled into this build. The system allocator comes first and
+// is the default.
+using AvailableBackends = BackendList<SystemBackend, PoolBackend
+#if defined(FRAGMENTATION_HAVE_JEMALLOC)
+    , JemallocBackend
+#endif
+#if defined(FRAGMENTATION_HAVE_MIMALLOC)
+    , MimallocBackend
+#endif
+#if defined(FRAGMENTATION_HAVE_TCMALLOC)
+    , TcmallocBackend
+#endif
+>;
@@ -0,0 +1,259 @@
+#include "glibc_backend.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include <unistd.h>
+
+#include "huge_pages.h"
+#include "memory_usage.h"
+
+namespace {
+
+struct MalloptParameter {
+    std::string_view name;
+    int param;
+};
+
+constexpr MalloptParameter kMalloptParameters[] = {
+    {"mmap_max", M_MMAP_MAX},
+    {"mmap_threshold", M_MMAP_THRESHOLD},
+    {"trim_threshold", M_TRIM_THRESHOLD},
+    {"top_pad", M_TOP_PAD},
+    {"arena_max", M_ARENA_MAX},
+    {"arena_test", M_ARENA_TEST},
+    {"mxfast", M_MXFAST},
+    {"perturb", M_PERTURB},
+};
+
+// Layout of a malloc chunk on 64-bit glibc: prev_size and size words, then
+// the user data. A free chunk keeps its bin links (fd, bk, fd_nextsize,
+// bk_nextsize) in the first 32 bytes of that data; past them the contents are
+// dead and malloc_trim() may hand the pages back.
+constexpr size_t kChunkHeaderBytes = 2 * sizeof(size_t);
+constexpr size_t kFreeChunkLinksBytes = 4 * sizeof(void*);
+constexpr size_t kMinChunkBytes = 4 * sizeof(size_t);
+constexpr size_t kChunkAlignment = 2 * sizeof(size_t);
+constexpr size_t kPrevInUse = 0x1;
+constexpr size_t kIsMmapped = 0x2;
+constexpr size_t kNonMainArena = 0x4;
+constexpr size_t kChunkFlags = 0x7;
+
+// A chunk of any arena but the main one lives in a heap aligned to its
+// maximum size (HEAP_MAX_SIZE, 64 MiB on 64-bit glibc without hugetlb=2),
+// which starts with a heap_info whose first word points to the arena. The
+// arena's malloc_state holds the link to the next arena after its mutex,
+// flags, fastbins, top, last_remainder, bins and binmap (glibc 2.27 and up).
+constexpr uintptr_t kHeapMaxSize = uintptr_t{64} << 20;
+constexpr size_t kArenaNextOffset = 2160;
+// Key for the main arena, whose malloc_state is not reachable from a chunk.
+constexpr uintptr_t kMainArena = 1;
+// Bound on the walk along the arena list; glibc allows 8 per core by default.
+constexpr int kMaxArenas = 4096;
+
+// Start of the [heap] mapping in /proc/self/maps, or nullptr before the first brk.
+char* findHeapStart() {
+    std::FILE* maps = std::fopen("/proc/self/maps", "r");
+    if (!maps) {
+        return nullptr;
+    }
+    char line[512];
+    char* start = nullptr;
+    while (std::fgets(line, sizeof(line), maps)) {
+        if (std::strstr(line, "[heap]")) {
+            start = reinterpret_cast<char*>(std::strtoull(line, nullptr, 16));
+            break;
+        }
+    }
+    std::fclose(maps);
+    return start;
+}
+
+// The size word of a chunk, flags included.
+size_t sizeWord(const char* chunk) {
+    size_t word;
+    std::memcpy(&word, chunk + sizeof(size_t), sizeof(word));
+    return word;
+}
+
+} // namespace
+
+GlibcBackend::GlibcBackend() {
+    // By default malloc is told not to use mmap for large allocations, forcing
+    // them onto the main heap (sbrk), which makes fragmentation more visible.
+    // --tune mmap_max=N puts mmap back in play.
+    setTunable("mmap_max", 0);
+}
+
+bool GlibcBackend::setTunable(std::string_view name, long value) {
+    for (const MalloptParameter& parameter : kMalloptParameters) {
+        if (parameter.name != name) {
+            continue;
+        }
+        bool fits = value >= std::numeric_limits<int>::min() && value <= std::numeric_limits<int>::max();
+        if (!fits || mallopt(parameter.param, static_cast<int>(value)) == 0) {
+            throw std::runtime_error("mallopt(" + std::string(name) + ", " + std::to_string(value) + ") failed");
+        }
+        auto applied = std::find_if(settings_.begin(), settings_.end(),
+                                    [&](const auto& setting) { return setting.first == name; });
+        if (applied != settings_.end()) {
+            applied->second = value;
+        } else {
+            settings_.emplace_back(name, value);
+        }
+        return true;
+    }
+    return false;
+}
+
+void GlibcBackend::useHugePages() {
+    const char* tunables = std::getenv("GLIBC_TUNABLES");
+    if (!tunables || !std::strstr(tunables, "glibc.malloc.hugetlb=")) {
+        throw std::runtime_error("glibc only uses huge pages when started with GLIBC_TUNABLES=glibc.malloc.hugetlb=1");
+    }
+    if (transparentHugePageMode() == "never") {
+        throw std::runtime_error("transparent huge pages are disabled (/sys/kernel/mm/transparent_hugepage/enabled)");
+    }
+}
+
+HeapInfo GlibcBackend::inspect() {
+    if (!scanner_.sample(snapshot_)) {
+        return {};
+    }
+    // Sum free space over every arena, not just the main one.
+    HeapInfo info;
+    info.totalFree = snapshot_.totalFree;
+    info.biggestFreeBlock = snapshot_.biggestFreeBlock;
+    info.freeBlocks = snapshot_.freeBlocks;
+    info.arenas.reserve(snapshot_.arenas.size());
+    for (const ArenaFreeInfo& arena : snapshot_.arenas) {
+        info.arenas.push_back({arena.arena, arena.freeBytes, arena.biggestFreeBlock});
+    }
+    return info;
+}
+
+uintptr_t GlibcBackend::arenaOf(void* block) const {
+    size_t size = sizeWord(static_cast<const char*>(block) - kChunkHeaderBytes);
+    if (size & kIsMmapped) {
+        return 0;
+    }
+    if (!(size & kNonMainArena)) {
+        return kMainArena;
+    }
+    uintptr_t arena;
+    std::memcpy(&arena, reinterpret_cast<const void*>(reinterpret_cast<uintptr_t>(block) & ~(kHeapMaxSize - 1)),
+                sizeof(arena));
+    return arena;
+}
+
+int GlibcBackend::arenaNumber(uintptr_t arena) const {
+    if (arena == kMainArena) {
+        return 0;
+    }
+    if (arena == 0) {
+        return -1;
+    }
+    // malloc_info() starts at the main arena and follows the list. The main
+    // arena is the one entry not at the offset every per-thread arena has
+    // inside its heap, so count the steps from here to it and the length of
+    // the whole circle.
+    auto next = [](uintptr_t entry) {
+        uintptr_t link;
+        std::memcpy(&link, reinterpret_cast<const void*>(entry + kArenaNextOffset), sizeof(link));
+        return link;
+    };
+    const uintptr_t offsetInHeap = arena & (kHeapMaxSize - 1);
+    int toMain = -1;
+    int steps = 0;
+    uintptr_t entry = arena;
+    do {
+        if (toMain < 0 && (entry & (kHeapMaxSize - 1)) != offsetInHeap) {
+            toMain = steps;
+        }
+        entry = next(entry);
+        ++steps;
+    } while (entry != arena && steps < kMaxArenas);
+    if (entry != arena || toMain < 0) {
+        return -1;
+    }
+    return steps - toMain;
+}
+
+size_t GlibcBackend::residentFreeBytes() {
+    ResidencyCounter counter;
+    walkMainHeap([&](const char* chunk, size_t size, bool free) {
+        if (free) {
+            counter.add(chunk + kChunkHeaderBytes + kFreeChunkLinksBytes, chunk + size);
+        }
+        return true;
+    });
+    return counter.residentBytes();
+}
+
+void GlibcBackend::heapLayout(std::vector<HeapSpan>& spans) {
+    // Count first, so the buffer is sized before the walk that fills it: a
+    // reallocation halfway through would change the heap being walked.
+    size_t chunks = 0;
+    walkMainHeap([&](const char*, size_t, bool) {
+        ++chunks;
+        return true;
+    });
+    spans.clear();
+    spans.reserve(chunks + chunks / 8 + 16);
+    walkMainHeap([&](const char* chunk, size_t size, bool free) {
+        if (spans.size() == spans.capacity()) {
+            return false;
+        }
+        spans.push_back({reinterpret_cast<uintptr_t>(chunk), size, !free});
+        return true;
+    });
+}
+
+/**
+ * @brief Walks the chunks from the start of the heap to the break, calling
+ * @p visit(chunk, size, free) until it returns false.
+ *
+ * A chunk is free when the next one's PREV_INUSE bit is clear; the last one
+ * is the top chunk, which is always free. Anything that does not look like a
+ * chunk ends the walk rather than reading past the heap.
+ */
+template <typename Visit>
+void GlibcBackend::walkMainHeap(Visit&& visit) {
+    if (!heapStart_) {
+        heapStart_ = findHeapStart();
+        if (!heapStart_) {
+            return;
+        }
+    }
+    const char* end = static_cast<const char*>(sbrk(0));
+    const char* chunk = heapStart_ + (-reinterpret_cast<uintptr_t>(heapStart_) & (kChunkAlignment - 1));
+    while (chunk + kChunkHeaderBytes <= end) {
+        size_t size = sizeWord(chunk) & ~kChunkFlags;
+        if (size < kMinChunkBytes || size % kChunkAlignment != 0 || size > static_cast<size_t>(end - chunk)) {
+            break;
+        }
+        const char* next = chunk + size;
+        bool isTop = next + kChunkHeaderBytes > end;
+        if (!visit(chunk, size, isTop || !(sizeWord(next) & kPrevInUse)) || isTop) {
+            break;
+        }
+        chunk = next;
+    }
+}
+
+void GlibcBackend::describe(std::ostream& out) const {
+    for (const ArenaFreeInfo& arena : snapshot_.arenas) {
+        out << "Arena " << arena.arena
+            << ": free=" << arena.freeBytes
+            << " chunks=" << arena.freeChunks
+            << " top=" << arena.topBytes
+            << " biggest=" << arena.biggestFreeBlock
+            << " system=" << arena.systemCurrent << "\n";
+    }
+}
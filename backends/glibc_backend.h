@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <malloc.h>
+
+#include "heap_backend.h"
+#include "malloc_info_scanner.h"
+
+/**
+ * @brief The system allocator on Linux: glibc malloc/free.
+ *
+ * Free-space figures come from malloc_info(), whose XML is read by
+ * MallocInfoScanner. The usable size of each block comes from
+ * malloc_usable_size().
+ */
+class GlibcBackend {
+public:
+    static constexpr std::string_view name = "glibc";
+
+    GlibcBackend();
+
+    void* allocate(size_t size) { return std::malloc(size); }
+    void release(void* block) { std::free(block); }
+    size_t usableSize(void* block) const { return malloc_usable_size(block); }
+    void* reallocate(void* block, size_t size) { return std::realloc(block, size); }
+    void* allocateAligned(size_t size, size_t alignment) {
+        void* block = nullptr;
+        return posix_memalign(&block, alignment, size) == 0 ? block : nullptr;
+    }
+
+    HeapInfo inspect();
+
+    // The arena a block came from, read from its chunk header: the main arena,
+    // one of the mmap'd per-thread arenas, or none for an mmap'd chunk.
+    uintptr_t arenaOf(void* block) const;
+    // Where the arena stands in glibc's list of arenas, which is also the
+    // order malloc_info() numbers them in.
+    int arenaNumber(uintptr_t arena) const;
+
+    // Resident bytes inside the free chunks of the main arena's sbrk heap.
+    // Chunks parked in tcache or fastbins are marked in use by malloc and are
+    // not counted, nor are the mmap'd heaps of the other arenas.
+    size_t residentFreeBytes();
+    // The main arena's sbrk heap chunk by chunk, with the same caveats.
+    void heapLayout(std::vector<HeapSpan>& spans);
+    // malloc_trim(0): gives back the top of the heap and every free page inside it.
+    void trim() { malloc_trim(0); }
+    // glibc.malloc.hugetlb=1 only takes effect from startup, so this checks it
+    // was set (the driver restarts with it) and that THP is not disabled.
+    void useHugePages();
+
+    // mallopt() by name: mmap_max, mmap_threshold, trim_threshold, top_pad,
+    // arena_max, arena_test, mxfast or perturb.
+    bool setTunable(std::string_view name, long value);
+    std::vector<std::pair<std::string, long>> settings() const { return settings_; }
+
+    // Per-arena view of the most recent inspect() call.
+    void describe(std::ostream& out) const;
+
+private:
+    template <typename Visit>
+    void walkMainHeap(Visit&& visit);
+
+    MallocInfoScanner scanner_;
+    MallocInfoSnapshot snapshot_;
+    std::vector<std::pair<std::string, long>> settings_; // Everything setTunable() applied, in order.
+    char* heapStart_ = nullptr;                           // Start of [heap], found on first use.
+};
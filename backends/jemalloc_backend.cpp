@@ -0,0 +1,66 @@
+#include "jemalloc_backend.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+
+namespace {
+
+template <typename T>
+bool readStat(const char* name, T& value) {
+    size_t length = sizeof(value);
+    return mallctl(name, &value, &length, nullptr, 0) == 0;
+}
+
+} // namespace
+
+JemallocBackend::JemallocBackend() {
+    if (!readStat("arenas.nbins", binCount_) || !readStat("arenas.page", pageSize_)) {
+        throw std::runtime_error("jemalloc mallctl() is unavailable");
+    }
+}
+
+HeapInfo JemallocBackend::inspect() {
+    // Statistics are cached by jemalloc until the epoch is advanced.
+    uint64_t epoch = 1;
+    size_t epochLength = sizeof(epoch);
+    mallctl("epoch", &epoch, &epochLength, &epoch, epochLength);
+
+    size_t allocated = 0;
+    size_t active = 0;
+    size_t dirtyPages = 0;
+    char name[128];
+    readStat("stats.allocated", allocated);
+    readStat("stats.active", active);
+    std::snprintf(name, sizeof(name), "stats.arenas.%u.pdirty", MALLCTL_ARENAS_ALL);
+    readStat(name, dirtyPages);
+
+    HeapInfo info;
+    info.totalFree = (active - std::min(active, allocated)) + dirtyPages * pageSize_;
+    if (dirtyPages > 0) {
+        info.biggestFreeBlock = pageSize_;
+        info.freeBlocks.add(dirtyPages * pageSize_, dirtyPages);
+    }
+
+    for (unsigned bin = 0; bin < binCount_; ++bin) {
+        size_t regionSize = 0;
+        uint32_t regionsPerSlab = 0;
+        size_t slabs = 0;
+        size_t regions = 0;
+        std::snprintf(name, sizeof(name), "arenas.bin.%u.size", bin);
+        readStat(name, regionSize);
+        std::snprintf(name, sizeof(name), "arenas.bin.%u.nregs", bin);
+        readStat(name, regionsPerSlab);
+        std::snprintf(name, sizeof(name), "stats.arenas.%u.bins.%u.curslabs", MALLCTL_ARENAS_ALL, bin);
+        readStat(name, slabs);
+        std::snprintf(name, sizeof(name), "stats.arenas.%u.bins.%u.curregs", MALLCTL_ARENAS_ALL, bin);
+        readStat(name, regions);
+        if (slabs * regionsPerSlab > regions) {
+            info.biggestFreeBlock = std::max(info.biggestFreeBlock, regionSize);
+            size_t freeRegions = slabs * regionsPerSlab - regions;
+            info.freeBlocks.add(freeRegions * regionSize, freeRegions);
+        }
+    }
+    return info;
+}
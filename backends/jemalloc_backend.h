@@ -0,0 +1,32 @@
+#pragma once
+
+#include <jemalloc/jemalloc.h>
+
+#include "heap_backend.h"
+
+/**
+ * @brief jemalloc through its non-standard mallocx/dallocx/sallocx API.
+ *
+ * Free space is what jemalloc holds without handing it out: unused regions in
+ * active slabs (stats.active - stats.allocated) plus dirty pages it has not
+ * returned to the OS yet. The largest free block is the biggest slab size
+ * class with at least one unused region.
+ */
+class JemallocBackend {
+public:
+    static constexpr std::string_view name = "jemalloc";
+
+    JemallocBackend();
+
+    void* allocate(size_t size) { return mallocx(size, 0); }
+    void release(void* block) { dallocx(block, 0); }
+    size_t usableSize(void* block) const { return sallocx(block, 0); }
+    void* reallocate(void* block, size_t size) { return rallocx(block, size, 0); }
+    void* allocateAligned(size_t size, size_t alignment) { return mallocx(size, MALLOCX_ALIGN(alignment)); }
+
+    HeapInfo inspect();
+
+private:
+    unsigned binCount_ = 0;
+    size_t pageSize_ = 0;
+};
@@ -0,0 +1,27 @@
+#include "mimalloc_backend.h"
+
+#include <algorithm>
+
+namespace {
+
+bool visitArea(const mi_heap_t*, const mi_heap_area_t* area, void* block, size_t, void* arg) {
+    if (block != nullptr) {
+        return true; // Only called per area, since we do not ask for blocks.
+    }
+    HeapInfo& info = *static_cast<HeapInfo*>(arg);
+    size_t used = area->used * area->block_size;
+    if (area->committed > used) {
+        info.totalFree += area->committed - used;
+        info.biggestFreeBlock = std::max(info.biggestFreeBlock, area->block_size);
+        info.freeBlocks.add(area->committed - used, (area->committed - used) / area->block_size);
+    }
+    return true;
+}
+
+} // namespace
+
+HeapInfo MimallocBackend::inspect() {
+    HeapInfo info;
+    mi_heap_visit_blocks(mi_heap_get_default(), false, &visitArea, &info);
+    return info;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <mimalloc.h>
+
+#include "heap_backend.h"
+
+/**
+ * @brief mimalloc through its mi_* API.
+ *
+ * Free space is found by visiting every heap area of the default heap and
+ * counting committed bytes not covered by used blocks. Areas hold blocks of a
+ * single size, so the largest free block is the biggest block size of an area
+ * that still has room.
+ */
+class MimallocBackend {
+public:
+    static constexpr std::string_view name = "mimalloc";
+
+    void* allocate(size_t size) { return mi_malloc(size); }
+    void release(void* block) { mi_free(block); }
+    size_t usableSize(void* block) const { return mi_usable_size(block); }
+    void* reallocate(void* block, size_t size) { return mi_realloc(block, size); }
+    void* allocateAligned(size_t size, size_t alignment) { return mi_malloc_aligned(size, alignment); }
+
+    HeapInfo inspect();
+};
@@ -0,0 +1,391 @@
+#include "pool_backend.h"
+
+#include <algorithm>
+#include <bitset>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+
+#include "huge_pages.h"
+#include "memory_usage.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+// Large blocks carry this header in front of the pointer we hand out.
+struct LargeHeader {
+    size_t mappedBytes;
+    size_t reserved;
+};
+
+char* reserveAddressSpace(size_t bytes) {
+#if defined(_WIN32)
+    return static_cast<char*>(VirtualAlloc(nullptr, bytes, MEM_RESERVE, PAGE_READWRITE));
+#else
+    // Pages are only backed once touched, so the reservation itself is free.
+    void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    return p == MAP_FAILED ? nullptr : static_cast<char*>(p);
+#endif
+}
+
+bool commitPages(char* address, size_t bytes) {
+#if defined(_WIN32)
+    return VirtualAlloc(address, bytes, MEM_COMMIT, PAGE_READWRITE) != nullptr;
+#else
+    (void)address;
+    (void)bytes;
+    return true;
+#endif
+}
+
+// Drops the physical pages behind a range but keeps it reserved.
+void decommitPages(char* address, size_t bytes) {
+#if defined(_WIN32)
+    VirtualFree(address, bytes, MEM_DECOMMIT);
+#else
+    // Private anonymous pages read back as zeros after this, no recommit needed.
+    madvise(address, bytes, MADV_DONTNEED);
+#endif
+}
+
+#if defined(_WIN32)
+// Large pages are locked in memory; the process needs SeLockMemoryPrivilege enabled to map them.
+bool enableLockMemoryPrivilege() {
+    HANDLE token;
+    if (!OpenProcessToken(GetCurrentProcess(), TOKEN_ADJUST_PRIVILEGES | TOKEN_QUERY, &token)) {
+        return false;
+    }
+    TOKEN_PRIVILEGES privileges{};
+    privileges.PrivilegeCount = 1;
+    privileges.Privileges[0].Attributes = SE_PRIVILEGE_ENABLED;
+    bool enabled = LookupPrivilegeValueA(nullptr, "SeLockMemoryPrivilege", &privileges.Privileges[0].Luid) &&
+                   AdjustTokenPrivileges(token, FALSE, &privileges, 0, nullptr, nullptr) &&
+                   GetLastError() == ERROR_SUCCESS;
+    CloseHandle(token);
+    return enabled;
+}
+
+// Size of the slab reservation with MEM_LARGE_PAGES, all of it committed at once.
+constexpr size_t kLargePageReserveBytes = size_t{1} << 30;
+#endif
+
+void releaseAddressSpace(char* address, size_t bytes) {
+#if defined(_WIN32)
+    (void)bytes;
+    VirtualFree(address, 0, MEM_RELEASE);
+#else
+    munmap(address, bytes);
+#endif
+}
+
+// A reservation that starts on a multiple of @p alignment, so slabs line up
+// with the compactor's address windows. VirtualAlloc already starts every
+// reservation on a 64 KiB allocation-granularity boundary; mmap only
+// promises a page boundary, so map the extra and cut off both ends.
+char* reserveAlignedAddressSpace(size_t bytes, size_t alignment) {
+#if defined(_WIN32)
+    (void)alignment;
+    return reserveAddressSpace(bytes);
+#else
+    char* mapping = reserveAddressSpace(bytes + alignment);
+    if (!mapping) {
+        return nullptr;
+    }
+    size_t head = (alignment - reinterpret_cast<uintptr_t>(mapping) % alignment) % alignment;
+    if (head > 0) {
+        munmap(mapping, head);
+    }
+    munmap(mapping + head + bytes, alignment - head);
+    return mapping + head;
+#endif
+}
+
+} // namespace
+
+PoolBackend::PoolBackend(size_t reserveBytes) {
+    // 16-byte steps up to 128 bytes, then four classes per power of two.
+    for (size_t size = 16; size <= 128; size += 16) {
+        classSizes_.push_back(size);
+    }
+    for (size_t group = 128; group < kMaxSmallSize; group *= 2) {
+        for (size_t step = 1; step <= 4; ++step) {
+            classSizes_.push_back(group + step * (group / 4));
+        }
+    }
+
+    classForSize_.resize(kMaxSmallSize / 16 + 1);
+    unsigned sizeClass = 0;
+    for (size_t units = 0; units < classForSize_.size(); ++units) {
+        while (classSizes_[sizeClass] < std::max<size_t>(units * 16, 1)) {
+            ++sizeClass;
+        }
+        classForSize_[units] = static_cast<uint8_t>(sizeClass);
+    }
+    partial_.assign(classSizes_.size(), kNoSlab);
+
+    reservedBytes_ = reserveBytes - reserveBytes % kSlabSize;
+    base_ = reserveAlignedAddressSpace(reservedBytes_, kSlabSize);
+    if (!base_) {
+        throw std::runtime_error("pool backend could not reserve its address space");
+    }
+}
+
+PoolBackend::~PoolBackend() {
+    releaseAddressSpace(base_, reservedBytes_);
+}
+
+void PoolBackend::useHugePages() {
+    if (!slabs_.empty()) {
+        throw std::runtime_error("pool backend: huge pages must be set up before the first allocation");
+    }
+#if defined(_WIN32)
+    size_t largePage = GetLargePageMinimum();
+    if (largePage == 0) {
+        throw std::runtime_error("this system does not support large pages");
+    }
+    if (!enableLockMemoryPrivilege()) {
+        throw std::runtime_error("MEM_LARGE_PAGES needs the 'Lock pages in memory' privilege");
+    }
+    size_t bytes = (kLargePageReserveBytes + largePage - 1) / largePage * largePage;
+    char* arena = static_cast<char*>(
+        VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE));
+    if (!arena) {
+        throw std::runtime_error("VirtualAlloc(MEM_LARGE_PAGES) failed: error " + std::to_string(GetLastError()));
+    }
+    releaseAddressSpace(base_, reservedBytes_);
+    base_ = arena;
+    reservedBytes_ = bytes - bytes % kSlabSize;
+    largePages_ = true;
+#else
+    if (transparentHugePageMode() == "never") {
+        throw std::runtime_error("transparent huge pages are disabled (/sys/kernel/mm/transparent_hugepage/enabled)");
+    }
+    if (madvise(base_, reservedBytes_, MADV_HUGEPAGE) != 0) {
+        throw std::runtime_error(std::string("madvise(MADV_HUGEPAGE) failed: ") + std::strerror(errno));
+    }
+#endif
+}
+
+uint32_t PoolBackend::newSlab(unsigned sizeClass) {
+    uint32_t slabIndex;
+    if (!emptySlabs_.empty()) {
+        slabIndex = emptySlabs_.back();
+        if (slabs_[slabIndex].decommitted && !commitPages(slabBase(slabIndex), kSlabSize)) {
+            return kNoSlab;
+        }
+        emptySlabs_.pop_back();
+    } else {
+        slabIndex = static_cast<uint32_t>(slabs_.size());
+        if ((size_t{slabIndex} + 1) * kSlabSize > reservedBytes_ ||
+            (!largePages_ && !commitPages(slabBase(slabIndex), kSlabSize))) {
+            return kNoSlab;
+        }
+        slabs_.emplace_back();
+    }
+
+    Slab& slab = slabs_[slabIndex];
+    slab = Slab{};
+    slab.sizeClass = sizeClass;
+    slab.capacity = static_cast<uint32_t>(kSlabSize / classSizes_[sizeClass]);
+    linkPartial(slabIndex);
+    return slabIndex;
+}
+
+void PoolBackend::retireSlab(uint32_t slabIndex) {
+    unlinkPartial(slabIndex);
+    slabs_[slabIndex].empty = true;
+    emptySlabs_.push_back(slabIndex);
+}
+
+void PoolBackend::linkPartial(uint32_t slabIndex) {
+    Slab& slab = slabs_[slabIndex];
+    uint32_t& head = partial_[slab.sizeClass];
+    slab.prev = kNoSlab;
+    slab.next = head;
+    if (head != kNoSlab) {
+        slabs_[head].prev = slabIndex;
+    }
+    head = slabIndex;
+}
+
+void PoolBackend::unlinkPartial(uint32_t slabIndex) {
+    Slab& slab = slabs_[slabIndex];
+    if (slab.prev != kNoSlab) {
+        slabs_[slab.prev].next = slab.next;
+    } else {
+        partial_[slab.sizeClass] = slab.next;
+    }
+    if (slab.next != kNoSlab) {
+        slabs_[slab.next].prev = slab.prev;
+    }
+    slab.prev = kNoSlab;
+    slab.next = kNoSlab;
+}
+
+void* PoolBackend::allocateLarge(size_t size) {
+    // The mapping is whole pages, so the block can use all of them: rounding
+    // waste shows up as internal fragmentation, as it does for the size classes.
+    static const size_t page = systemPageSize();
+    size_t mappedBytes = (sizeof(LargeHeader) + size + page - 1) / page * page;
+    char* mapping = reserveAddressSpace(mappedBytes);
+    if (!mapping) {
+        return nullptr;
+    }
+    if (!commitPages(mapping, mappedBytes)) {
+        releaseAddressSpace(mapping, mappedBytes);
+        return nullptr;
+    }
+    new (mapping) LargeHeader{mappedBytes, 0};
+    ++largeBlocks_;
+    largeBytes_ += mappedBytes;
+    return mapping + sizeof(LargeHeader);
+}
+
+void PoolBackend::releaseLarge(void* block) {
+    char* mapping = static_cast<char*>(block) - sizeof(LargeHeader);
+    size_t mappedBytes = reinterpret_cast<LargeHeader*>(mapping)->mappedBytes;
+    --largeBlocks_;
+    largeBytes_ -= mappedBytes;
+    releaseAddressSpace(mapping, mappedBytes);
+}
+
+void* PoolBackend::allocateDense(size_t size) {
+    if (size > kMaxSmallSize) {
+        return allocateLarge(size);
+    }
+    uint32_t densest = partial_[classForSize_[(size + 15) / 16]];
+    if (densest == kNoSlab) {
+        return allocate(size);
+    }
+    for (uint32_t slabIndex = slabs_[densest].next; slabIndex != kNoSlab; slabIndex = slabs_[slabIndex].next) {
+        if (slabs_[slabIndex].used > slabs_[densest].used) {
+            densest = slabIndex;
+        }
+    }
+    return takeSlot(densest);
+}
+
+size_t PoolBackend::usableSize(void* block) const {
+    if (!inReservation(block)) {
+        const char* mapping = static_cast<const char*>(block) - sizeof(LargeHeader);
+        return reinterpret_cast<const LargeHeader*>(mapping)->mappedBytes - sizeof(LargeHeader);
+    }
+    return classSizes_[slabs_[slabOf(block)].sizeClass];
+}
+
+HeapInfo PoolBackend::inspect() {
+    HeapInfo info;
+    for (const Slab& slab : slabs_) {
+        if (slab.empty) {
+            info.totalFree += kSlabSize;
+            info.biggestFreeBlock = kSlabSize;
+            info.freeBlocks.add(kSlabSize);
+            continue;
+        }
+        size_t slotSize = classSizes_[slab.sizeClass];
+        size_t freeSlots = slab.capacity - slab.used;
+        if (freeSlots > 0) {
+            info.totalFree += freeSlots * slotSize;
+            info.biggestFreeBlock = std::max(info.biggestFreeBlock, slotSize);
+            info.freeBlocks.add(freeSlots * slotSize, freeSlots);
+        }
+    }
+    return info;
+}
+
+size_t PoolBackend::residentFreeBytes() const {
+    const size_t pageSize = systemPageSize();
+    ResidencyCounter counter;
+    for (uint32_t slabIndex = 0; slabIndex < slabs_.size(); ++slabIndex) {
+        const Slab& slab = slabs_[slabIndex];
+        char* base = slabBase(slabIndex);
+        if (slab.empty) {
+            if (!slab.decommitted) {
+                counter.add(base, base + kSlabSize);
+            }
+            continue;
+        }
+        size_t slotSize = classSizes_[slab.sizeClass];
+        counter.add(base + size_t{slab.bump} * slotSize, base + kSlabSize);
+        if (slotSize > pageSize) {
+            for (void* slot = slab.freeList; slot; slot = *static_cast<void**>(slot)) {
+                char* data = static_cast<char*>(slot);
+                counter.add(data + sizeof(void*), data + slotSize);
+            }
+        }
+    }
+    return counter.residentBytes();
+}
+
+void PoolBackend::heapLayout(std::vector<HeapSpan>& spans) const {
+    spans.clear();
+    std::bitset<kSlabSize / 16> freeSlot;
+    for (uint32_t slabIndex = 0; slabIndex < slabs_.size(); ++slabIndex) {
+        const Slab& slab = slabs_[slabIndex];
+        uintptr_t base = reinterpret_cast<uintptr_t>(slabBase(slabIndex));
+        if (slab.empty) {
+            spans.push_back({base, kSlabSize, false});
+            continue;
+        }
+        size_t slotSize = classSizes_[slab.sizeClass];
+        freeSlot.reset();
+        for (void* slot = slab.freeList; slot; slot = *static_cast<void**>(slot)) {
+            freeSlot.set((reinterpret_cast<uintptr_t>(slot) - base) / slotSize);
+        }
+        for (uint32_t i = slab.bump; i < slab.capacity; ++i) {
+            freeSlot.set(i);
+        }
+        // One span per run of slots in the same state; the slab's unused tail
+        // (64 KiB is rarely a multiple of the slot size) goes with the last run.
+        uint32_t runStart = 0;
+        for (uint32_t i = 1; i <= slab.capacity; ++i) {
+            if (i == slab.capacity || freeSlot[i] != freeSlot[runStart]) {
+                uint64_t end = i == slab.capacity ? kSlabSize : uint64_t{i} * slotSize;
+                spans.push_back({base + runStart * slotSize, end - runStart * slotSize, !freeSlot[runStart]});
+                runStart = i;
+            }
+        }
+    }
+}
+
+void PoolBackend::trim() {
+    if (largePages_) {
+        return; // Large pages stay committed until the reservation is released.
+    }
+    for (uint32_t slabIndex : emptySlabs_) {
+        Slab& slab = slabs_[slabIndex];
+        if (!slab.decommitted) {
+            decommitPages(slabBase(slabIndex), kSlabSize);
+            slab.decommitted = true;
+        }
+    }
+}
+
+void PoolBackend::describe(std::ostream& out) const {
+    std::vector<size_t> slabCount(classSizes_.size());
+    std::vector<size_t> usedSlots(classSizes_.size());
+    std::vector<size_t> capacity(classSizes_.size());
+    for (const Slab& slab : slabs_) {
+        if (!slab.empty) {
+            ++slabCount[slab.sizeClass];
+            usedSlots[slab.sizeClass] += slab.used;
+            capacity[slab.sizeClass] += slab.capacity;
+        }
+    }
+    for (size_t c = 0; c < classSizes_.size(); ++c) {
+        if (slabCount[c] > 0) {
+            out << "Class " << classSizes_[c]
+                << ": slabs=" << slabCount[c]
+                << " used=" << usedSlots[c] << "/" << capacity[c] << "\n";
+        }
+    }
+    out << "Empty slabs: " << emptySlabs_.size()
+        << ", large blocks: " << largeBlocks_ << " (" << largeBytes_ << " bytes)\n";
+}
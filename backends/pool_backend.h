@@ -0,0 +1,153 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+#include "heap_backend.h"
+
+/**
+ * @brief A slab / size-class pool allocator, as an alternative to the system heap.
+ *
+ * Small requests are rounded up to one of a few dozen size classes. Each class
+ * carves fixed 64 KiB slabs out of one large virtual reservation (mmap on
+ * Linux, VirtualAlloc on Windows) and keeps freed slots on a per-slab free
+ * list. Requests above the largest class are mapped individually.
+ *
+ * In HeapStats terms the usable size of a block is its slot size, so internal
+ * fragmentation is slot size minus requested size. External fragmentation is
+ * the free space stranded in partially-used slabs: the free slots, plus any
+ * completely empty slabs kept for reuse. The largest free block is a whole
+ * empty slab if there is one, otherwise the largest slot that is free.
+ *
+ * The pool is not thread safe; it is meant to be benchmarked single-threaded.
+ */
+class PoolBackend {
+public:
+    static constexpr std::string_view name = "pool";
+    static constexpr bool threadSafe = false;
+
+    static constexpr size_t kSlabSize = 64 * 1024;
+    static constexpr size_t kMaxSmallSize = 16 * 1024;
+
+    explicit PoolBackend(size_t reserveBytes = size_t{64} << 30);
+    ~PoolBackend();
+    PoolBackend(const PoolBackend&) = delete;
+    PoolBackend& operator=(const PoolBackend&) = delete;
+
+    void* allocate(size_t size) {
+        if (size > kMaxSmallSize) {
+            return allocateLarge(size);
+        }
+        unsigned sizeClass = classForSize_[(size + 15) / 16];
+        uint32_t slabIndex = partial_[sizeClass];
+        if (slabIndex == kNoSlab) {
+            slabIndex = newSlab(sizeClass);
+            if (slabIndex == kNoSlab) {
+                return nullptr;
+            }
+        }
+        return takeSlot(slabIndex);
+    }
+
+    void release(void* block) {
+        if (!block) {
+            return;
+        }
+        if (!inReservation(block)) {
+            releaseLarge(block);
+            return;
+        }
+        uint32_t slabIndex = slabOf(block);
+        Slab& slab = slabs_[slabIndex];
+        *static_cast<void**>(block) = slab.freeList;
+        slab.freeList = block;
+        if (slab.used-- == slab.capacity) {
+            linkPartial(slabIndex);
+        }
+        if (slab.used == 0) {
+            retireSlab(slabIndex);
+        }
+    }
+
+    size_t usableSize(void* block) const;
+
+    // Like allocate(), but from the class's fullest partial slab rather than
+    // the one freed into last, so blocks the compactor moves fill up slabs
+    // that are already well used.
+    void* allocateDense(size_t size);
+
+    HeapInfo inspect();
+
+    // Resident bytes in empty slabs, in the never-used tail of each slab and
+    // in free slots (past their free-list link) of size classes above a page.
+    size_t residentFreeBytes() const;
+    // Runs of busy and free slots, slab by slab; large blocks are not listed.
+    void heapLayout(std::vector<HeapSpan>& spans) const;
+    // Gives the pages of every empty slab back to the OS.
+    void trim();
+    // Linux: madvise(MADV_HUGEPAGE) on the reservation. Windows: swaps it for
+    // a smaller one committed up front on MEM_LARGE_PAGES, which needs the
+    // "Lock pages in memory" privilege and can then never be decommitted.
+    void useHugePages();
+
+    // Slabs and occupancy per size class.
+    void describe(std::ostream& out) const;
+
+private:
+    static constexpr uint32_t kNoSlab = UINT32_MAX;
+
+    struct Slab {
+        void* freeList = nullptr; // Slots that were handed out and came back.
+        uint32_t sizeClass = 0;
+        uint32_t capacity = 0;    // Slots per slab for this class.
+        uint32_t used = 0;        // Slots currently handed out.
+        uint32_t bump = 0;        // Slots handed out at least once; the rest are untouched.
+        uint32_t prev = kNoSlab;  // Links in the class's list of partially used slabs.
+        uint32_t next = kNoSlab;
+        bool empty = false;       // Retired and waiting on the empty list for reuse.
+        bool decommitted = false; // Empty and its pages given back by trim().
+    };
+
+    char* slabBase(uint32_t slabIndex) const { return base_ + size_t{slabIndex} * kSlabSize; }
+    uint32_t slabOf(const void* block) const {
+        return static_cast<uint32_t>((static_cast<const char*>(block) - base_) / kSlabSize);
+    }
+    bool inReservation(const void* block) const {
+        const char* p = static_cast<const char*>(block);
+        return p >= base_ && p < base_ + reservedBytes_;
+    }
+
+    void* takeSlot(uint32_t slabIndex) {
+        Slab& slab = slabs_[slabIndex];
+        void* slot = slab.freeList;
+        if (slot) {
+            slab.freeList = *static_cast<void**>(slot);
+        } else {
+            slot = slabBase(slabIndex) + size_t{slab.bump++} * classSizes_[slab.sizeClass];
+        }
+        if (++slab.used == slab.capacity) {
+            unlinkPartial(slabIndex);
+        }
+        return slot;
+    }
+
+    uint32_t newSlab(unsigned sizeClass);
+    void retireSlab(uint32_t slabIndex);
+    void linkPartial(uint32_t slabIndex);
+    void unlinkPartial(uint32_t slabIndex);
+    void* allocateLarge(size_t size);
+    void releaseLarge(void* block);
+
+    char* base_ = nullptr;
+    size_t reservedBytes_ = 0;
+    std::vector<Slab> slabs_;            // Every slab carved so far, by position in the reservation.
+    std::vector<uint32_t> emptySlabs_;   // Retired slabs, reused before carving new ones.
+    std::vector<size_t> classSizes_;     // Slot size of each class.
+    std::vector<uint32_t> partial_;      // Head of each class's partial-slab list.
+    std::vector<uint8_t> classForSize_;  // (size + 15) / 16 -> size class.
+    size_t largeBlocks_ = 0;
+    size_t largeBytes_ = 0;
+    bool largePages_ = false; // The reservation is one committed MEM_LARGE_PAGES block.
+};
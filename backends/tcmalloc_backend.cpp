@@ -0,0 +1,23 @@
+#include "tcmalloc_backend.h"
+
+#include <gperftools/malloc_extension_c.h>
+
+namespace {
+
+size_t readProperty(const char* property) {
+    size_t value = 0;
+    MallocExtension_GetNumericProperty(property, &value);
+    return value;
+}
+
+} // namespace
+
+HeapInfo TcmallocBackend::inspect() {
+    HeapInfo info;
+    info.totalFree = readProperty("tcmalloc.pageheap_free_bytes") +
+                     readProperty("tcmalloc.central_cache_free_bytes") +
+                     readProperty("tcmalloc.transfer_cache_free_bytes") +
+                     readProperty("tcmalloc.thread_cache_free_bytes");
+    info.biggestFreeBlockKnown = false;
+    return info;
+}
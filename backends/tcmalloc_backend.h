@@ -0,0 +1,25 @@
+#pragma once
+
+#include <gperftools/tcmalloc.h>
+
+#include "heap_backend.h"
+
+/**
+ * @brief gperftools tcmalloc through its tc_* API.
+ *
+ * Free space is the sum of the bytes tcmalloc caches at each level (page heap,
+ * central, transfer and thread caches). tcmalloc does not expose the size of
+ * its largest free span, so the external fragmentation ratio is unknown.
+ */
+class TcmallocBackend {
+public:
+    static constexpr std::string_view name = "tcmalloc";
+
+    void* allocate(size_t size) { return tc_malloc(size); }
+    void release(void* block) { tc_free(block); }
+    size_t usableSize(void* block) const { return tc_malloc_size(block); }
+    void* reallocate(void* block, size_t size) { return tc_realloc(block, size); }
+    void* allocateAligned(size_t size, size_t alignment) { return tc_memalign(alignment, size); }
+
+    HeapInfo inspect();
+};
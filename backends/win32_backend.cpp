@@ -0,0 +1,224 @@
+#include "win32_backend.h"
+
+#include <algorithm>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#include <winnt.h>
+
+#include "memory_usage.h"
+
+namespace {
+
+// Whether this executable's manifest opts into the segment heap, which then
+// backs every heap the process creates.
+bool manifestAsksForSegmentHeap() {
+    HRSRC resource = FindResourceA(nullptr, MAKEINTRESOURCEA(1), RT_MANIFEST);
+    HGLOBAL loaded = resource ? LoadResource(nullptr, resource) : nullptr;
+    const char* text = loaded ? static_cast<const char*>(LockResource(loaded)) : nullptr;
+    if (!text) {
+        return false;
+    }
+    std::string_view manifest(text, SizeofResource(nullptr, resource));
+    return manifest.find(">SegmentHeap<") != std::string_view::npos;
+}
+
+const long kSegmentHeap = manifestAsksForSegmentHeap();
+
+} // namespace
+
+Win32Backend::Win32Backend() : heap_(HeapCreate(0, 0, 0)), heapWalker_(heap_) {
+    if (!heap_) {
+        throw std::runtime_error("HeapCreate failed: " + std::to_string(GetLastError()));
+    }
+
+    // HeapCompatibilityInformation = 2 turns the Low-Fragmentation Heap ON; it
+    // cannot be used to turn it off. Asking for it up front keeps runs
+    // comparable, as Windows would otherwise switch it on by itself once some
+    // size class gets busy. --tune lfh=0 is the way to measure without it.
+    // The segment heap has no LFH of this kind, and refuses the request.
+    if (kSegmentHeap) {
+        lfh_ = 0;
+    } else {
+        setTunable("lfh", 1);
+    }
+}
+
+Win32Backend::~Win32Backend() {
+    if (walkerThread_.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(snapshotMutex_);
+            stopWalker_ = true;
+        }
+        walkRequested_.notify_one();
+        walkerThread_.join();
+    }
+    HeapDestroy(heap_);
+}
+
+void Win32Backend::replaceHeap(DWORD options) {
+    HANDLE fresh = HeapCreate(options, 0, 0);
+    if (!fresh) {
+        throw std::runtime_error("HeapCreate failed: " + std::to_string(GetLastError()));
+    }
+    HeapDestroy(heap_);
+    heap_ = fresh;
+    serialize_ = (options & HEAP_NO_SERIALIZE) != 0;
+    heapWalker_ = Win32HeapWalker(heap_, !serialize_);
+}
+
+bool Win32Backend::setTunable(std::string_view name, long value) {
+    if (name == "segment_heap") {
+        if (value != kSegmentHeap) {
+            throw std::runtime_error(std::string("the segment heap is chosen by the executable's manifest; run ") +
+                                     (value ? "heap_analyzer_segment" : "heap_analyzer") + " instead");
+        }
+        return true;
+    }
+    if (name != "lfh") {
+        return false;
+    }
+    if (value == 0) {
+        // The LFH cannot be enabled on a HEAP_NO_SERIALIZE heap.
+        replaceHeap(HEAP_NO_SERIALIZE);
+    } else {
+        if (serialize_) {
+            replaceHeap(0);
+        }
+        ULONG heapInfo = 2;
+        if (!HeapSetInformation(heap_, HeapCompatibilityInformation, &heapInfo, sizeof(heapInfo))) {
+            throw std::runtime_error("enabling the LFH failed: " + std::to_string(GetLastError()));
+        }
+    }
+    lfh_ = value != 0;
+    return true;
+}
+
+std::vector<std::pair<std::string, long>> Win32Backend::settings() const {
+    // What the heap reports: 0 standard, 1 look-aside lists, 2 LFH.
+    ULONG compatibility = 0;
+    HeapQueryInformation(heap_, HeapCompatibilityInformation, &compatibility, sizeof(compatibility), nullptr);
+    return {{"lfh", lfh_}, {"segment_heap", kSegmentHeap}, {"heap_compatibility", static_cast<long>(compatibility)}};
+}
+
+HeapInfo Win32Backend::walkHeap(bool reuseRegions) {
+    HeapInfo info;
+    std::unique_lock<std::mutex> serialized(heapMutex_, std::defer_lock);
+    if (serialize_) {
+        serialized.lock();
+    }
+    if (!heapWalker_.walk(reuseRegions, info)) {
+        failedWalks_.fetch_add(1, std::memory_order_relaxed);
+        lastWalkError_.store(heapWalker_.lastError(), std::memory_order_relaxed);
+    }
+    return info;
+}
+
+void Win32Backend::describe(std::ostream& out) const {
+    uint64_t failed = failedWalks_.load(std::memory_order_relaxed);
+    if (failed > 0) {
+        out << "Warning: " << failed << " heap walks failed (last error "
+            << lastWalkError_.load(std::memory_order_relaxed)
+            << "); their samples have no free-space figures.\n";
+    }
+}
+
+// Calls @p visit on every HeapWalk() entry, with the heap locked.
+template <typename Visit>
+void Win32Backend::forEachEntry(Visit&& visit) {
+    std::unique_lock<std::mutex> serialized(heapMutex_, std::defer_lock);
+    if (serialize_) {
+        serialized.lock();
+    } else if (!HeapLock(heap_)) {
+        return;
+    }
+    PROCESS_HEAP_ENTRY entry{};
+    while (HeapWalk(heap_, &entry)) {
+        visit(entry);
+    }
+    if (!serialize_) {
+        HeapUnlock(heap_);
+    }
+}
+
+size_t Win32Backend::residentFreeBytes() {
+    // A free block starts with the heap's list links; only the rest can be decommitted.
+    constexpr size_t kFreeBlockLinksBytes = 2 * sizeof(void*);
+    ResidencyCounter counter;
+    forEachEntry([&](const PROCESS_HEAP_ENTRY& entry) {
+        if ((entry.wFlags & (PROCESS_HEAP_ENTRY_BUSY | PROCESS_HEAP_REGION | PROCESS_HEAP_UNCOMMITTED_RANGE)) == 0 &&
+            entry.cbData > kFreeBlockLinksBytes) {
+            const char* data = static_cast<const char*>(entry.lpData);
+            counter.add(data + kFreeBlockLinksBytes, data + entry.cbData);
+        }
+    });
+    return counter.residentBytes();
+}
+
+void Win32Backend::heapLayout(std::vector<HeapSpan>& spans) {
+    // spans lives on the CRT heap, not on heap_, so growing it does not
+    // disturb the walk.
+    spans.clear();
+    forEachEntry([&](const PROCESS_HEAP_ENTRY& entry) {
+        if (entry.wFlags & (PROCESS_HEAP_REGION | PROCESS_HEAP_UNCOMMITTED_RANGE)) {
+            return;
+        }
+        // Block headers fall in the gaps between spans.
+        bool busy = (entry.wFlags & PROCESS_HEAP_ENTRY_BUSY) != 0;
+        spans.push_back({reinterpret_cast<uintptr_t>(entry.lpData), entry.cbData, busy});
+    });
+    std::sort(spans.begin(), spans.end(),
+              [](const HeapSpan& a, const HeapSpan& b) { return a.address < b.address; });
+}
+
+void Win32Backend::trim() {
+    if (serialize_) {
+        std::lock_guard<std::mutex> lock(heapMutex_);
+        HeapCompact(heap_, 0);
+        return;
+    }
+    HeapCompact(heap_, 0);
+}
+
+void Win32Backend::setInspectionMode(InspectionMode mode) {
+    mode_ = mode;
+    if (mode == InspectionMode::Background && !walkerThread_.joinable()) {
+        walkerThread_ = std::thread(&Win32Backend::backgroundLoop, this);
+    }
+}
+
+HeapInfo Win32Backend::inspect() {
+    if (mode_ != InspectionMode::Background) {
+        return walkHeap(mode_ == InspectionMode::Cached);
+    }
+
+    std::unique_lock<std::mutex> lock(snapshotMutex_);
+    if (!haveSnapshot_) {
+        // Nothing to report yet: the first sample waits for a walk.
+        lock.unlock();
+        HeapInfo first = walkHeap(false);
+        lock.lock();
+        snapshot_ = first;
+        haveSnapshot_ = true;
+    }
+    pendingWalk_ = true;
+    walkRequested_.notify_one();
+    return snapshot_;
+}
+
+void Win32Backend::backgroundLoop() {
+    std::unique_lock<std::mutex> lock(snapshotMutex_);
+    while (true) {
+        walkRequested_.wait(lock, [this] { return pendingWalk_ || stopWalker_; });
+        if (stopWalker_) {
+            return;
+        }
+        pendingWalk_ = false;
+        lock.unlock();
+        HeapInfo latest = walkHeap(false);
+        lock.lock();
+        snapshot_ = std::move(latest);
+    }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <windows.h>
+#include <heapapi.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "heap_backend.h"
+#include "win32_heap_walker.h"
+
+/**
+ * @brief The Win32 heap: HeapAlloc/HeapFree on a private HeapCreate() heap.
+ *
+ * The heap belongs to this backend alone, so walking it never stalls the CRT
+ * or any other code in the process. HeapWalk() is the key function used to
+ * iterate through every block in the heap (both busy and free) to measure
+ * external fragmentation, and HeapSize() gives the actual size of an
+ * allocated block.
+ *
+ * InspectionMode::Cached uses Win32HeapWalker's per-region cache.
+ * InspectionMode::Background walks on a helper thread and returns the
+ * previous walk's result, so the sampling thread never waits on the lock.
+ *
+ * Tunables (set before the first allocation):
+ *   lfh=1           Ask for the Low-Fragmentation Heap up front (the default).
+ *   lfh=0           Use a HEAP_NO_SERIALIZE heap, the one documented way to
+ *                   keep the LFH off. The backend then serializes calls with
+ *                   its own mutex, which the latency figures include.
+ *   segment_heap=N  Only checks the executable: the segment heap is chosen by
+ *                   its manifest (heap_analyzer_segment.exe has it).
+ */
+class Win32Backend {
+public:
+    static constexpr std::string_view name = "win32";
+
+    Win32Backend();
+    ~Win32Backend();
+    Win32Backend(const Win32Backend&) = delete;
+    Win32Backend& operator=(const Win32Backend&) = delete;
+
+    void* allocate(size_t size) {
+        if (serialize_) {
+            std::lock_guard<std::mutex> lock(heapMutex_);
+            return HeapAlloc(heap_, 0, size);
+        }
+        return HeapAlloc(heap_, 0, size);
+    }
+    void release(void* block) {
+        if (serialize_) {
+            std::lock_guard<std::mutex> lock(heapMutex_);
+            HeapFree(heap_, 0, block);
+            return;
+        }
+        HeapFree(heap_, 0, block);
+    }
+    size_t usableSize(void* block) const {
+        if (serialize_) {
+            std::lock_guard<std::mutex> lock(heapMutex_);
+            return HeapSize(heap_, 0, block);
+        }
+        return HeapSize(heap_, 0, block);
+    }
+    // HeapReAlloc() moves the block when it cannot grow it in place. There is
+    // no aligned HeapAlloc(), so aligned blocks use the simulation's fallback.
+    void* reallocate(void* block, size_t size) {
+        if (serialize_) {
+            std::lock_guard<std::mutex> lock(heapMutex_);
+            return HeapReAlloc(heap_, 0, block, size);
+        }
+        return HeapReAlloc(heap_, 0, block, size);
+    }
+
+    HeapInfo inspect();
+    void setInspectionMode(InspectionMode mode);
+
+    // Resident bytes inside the heap's free blocks, found with HeapWalk().
+    size_t residentFreeBytes();
+    // Every busy and free HeapWalk() entry, in address order.
+    void heapLayout(std::vector<HeapSpan>& spans);
+    // HeapCompact(): coalesces free blocks and decommits what it can.
+    void trim();
+
+    bool setTunable(std::string_view name, long value);
+    std::vector<std::pair<std::string, long>> settings() const;
+
+    // Reports heap walks that failed, if any did; a failed walk reads as an empty heap.
+    void describe(std::ostream& out) const;
+
+private:
+    void backgroundLoop();
+    HeapInfo walkHeap(bool reuseRegions);
+    template <typename Visit>
+    void forEachEntry(Visit&& visit);
+    void replaceHeap(DWORD options);
+
+    HANDLE heap_;
+    Win32HeapWalker heapWalker_;
+    std::atomic<uint64_t> failedWalks_{0}; // Walks may fail on the background thread.
+    std::atomic<DWORD> lastWalkError_{0};
+    InspectionMode mode_ = InspectionMode::Full;
+
+    // LFH off: the heap does no locking of its own, so every call takes heapMutex_.
+    bool serialize_ = false;
+    mutable std::mutex heapMutex_;
+    long lfh_ = 1;
+
+    // Background mode.
+    std::thread walkerThread_;
+    std::mutex snapshotMutex_;
+    std::condition_variable walkRequested_;
+    HeapInfo snapshot_;
+    bool haveSnapshot_ = false;
+    bool pendingWalk_ = false;
+    bool stopWalker_ = false;
+};
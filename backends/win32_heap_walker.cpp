@@ -0,0 +1,169 @@
+#include "win32_heap_walker.h"
+
+#include <cstdint>
+
+#include <winnt.h>
+
+namespace {
+
+// Bytes currently committed in [begin, end), by asking the memory manager
+// rather than the heap, so it needs no heap lock.
+size_t committedBytes(const void* begin, const void* end) {
+    size_t committed = 0;
+    auto* cursor = static_cast<const char*>(begin);
+    MEMORY_BASIC_INFORMATION info;
+    while (cursor < end && VirtualQuery(cursor, &info, sizeof(info)) == sizeof(info)) {
+        if (info.State == MEM_COMMIT) {
+            committed += info.RegionSize;
+        }
+        cursor = static_cast<const char*>(info.BaseAddress) + info.RegionSize;
+    }
+    return committed;
+}
+
+size_t regionCommittedBytes(const PROCESS_HEAP_ENTRY& region) {
+    return committedBytes(region.lpData, region.Region.lpLastBlock);
+}
+
+} // namespace
+
+/**
+ * @brief Walks the heap to calculate total free memory and the largest
+ * contiguous free block. This is the core of measuring EXTERNAL fragmentation.
+ *
+ * With @p reuseRegions, regions whose committed size is unchanged keep the
+ * figures from the previous walk and are not walked at all.
+ */
+bool Win32HeapWalker::walk(bool reuseRegions, HeapInfo& info) {
+    info = HeapInfo{};
+    WalkStatus status;
+    for (;;) {
+        // New regions are recorded while the heap is locked, and a vector
+        // growing then would allocate on the heap being walked (fragmon walks
+        // GetProcessHeap()). So the room is made here, and a walk that runs
+        // out of it is redone from scratch with twice as much.
+        if (regions_.capacity() < regions_.size() + kSpareRegions) {
+            regions_.reserve(regions_.size() + kSpareRegions);
+        }
+        if (lockHeap_ && !HeapLock(heap_)) {
+            lastError_ = GetLastError();
+            return false;
+        }
+        status = reuseRegions && !regions_.empty() ? walkChanged() : walkAll();
+        if (lockHeap_) {
+            HeapUnlock(heap_);
+        }
+        if (status != WalkStatus::NeedsRoom) {
+            break;
+        }
+        regions_.reserve(regions_.capacity() * 2);
+        reuseRegions = false;
+    }
+
+    if (status != WalkStatus::Ok) {
+        regions_.clear(); // Start from scratch next time.
+        return false;
+    }
+    info.totalFree = outsideFree_;
+    info.biggestFreeBlock = outsideBiggest_;
+    info.freeBlocks = outsideBlocks_;
+    for (const RegionCache& region : regions_) {
+        info.totalFree += region.freeBytes;
+        info.freeBlocks.merge(region.freeBlocks);
+        if (region.biggestFreeBlock > info.biggestFreeBlock) {
+            info.biggestFreeBlock = region.biggestFreeBlock;
+        }
+    }
+    return true;
+}
+
+// Walks the whole heap, forgetting what earlier walks found.
+Win32HeapWalker::WalkStatus Win32HeapWalker::walkAll() {
+    regions_.clear();
+    outsideFree_ = 0;
+    outsideBiggest_ = 0;
+    outsideBlocks_ = FreeBlockHistogram{};
+    PROCESS_HEAP_ENTRY entry;
+    entry.lpData = nullptr;
+    return walkFrom(entry, SIZE_MAX, false);
+}
+
+// Walks only the regions whose committed size changed, and the last one.
+Win32HeapWalker::WalkStatus Win32HeapWalker::walkChanged() {
+    size_t last = regions_.size() - 1;
+    for (size_t i = 0; i < last; ++i) {
+        size_t committed = regionCommittedBytes(regions_[i].entry);
+        if (committed != regions_[i].committed) {
+            PROCESS_HEAP_ENTRY entry = regions_[i].entry;
+            if (WalkStatus status = walkFrom(entry, i, true); status != WalkStatus::Ok) {
+                return status;
+            }
+            regions_[i].committed = committed;
+        }
+    }
+    // The heap grows at its end, and new regions appear after the last
+    // one, so that part is always walked.
+    PROCESS_HEAP_ENTRY entry = regions_[last].entry;
+    regions_[last].committed = regionCommittedBytes(entry);
+    regions_.resize(last + 1);
+    outsideFree_ = 0;
+    outsideBiggest_ = 0;
+    outsideBlocks_ = FreeBlockHistogram{};
+    return walkFrom(entry, last, false);
+}
+
+size_t Win32HeapWalker::committedBytes() const {
+    size_t committed = 0;
+    for (const RegionCache& region : regions_) {
+        committed += region.committed;
+    }
+    return committed;
+}
+
+/**
+ * @brief Continues a HeapWalk from @p entry, crediting free blocks to region
+ * @p region (SIZE_MAX: none yet) and to every region entered afterwards.
+ * With @p stopAtNextRegion it stops at the start of the following region.
+ * Runs with the heap locked, so it must not allocate: a region that does
+ * not fit into the capacity of regions_ ends the walk with NeedsRoom.
+ */
+Win32HeapWalker::WalkStatus Win32HeapWalker::walkFrom(PROCESS_HEAP_ENTRY& entry, size_t region, bool stopAtNextRegion) {
+    if (region != SIZE_MAX) {
+        regions_[region].freeBytes = 0;
+        regions_[region].biggestFreeBlock = 0;
+        regions_[region].freeBlocks = FreeBlockHistogram{};
+    }
+    while (HeapWalk(heap_, &entry)) {
+        if (entry.wFlags & PROCESS_HEAP_REGION) {
+            if (stopAtNextRegion) {
+                regions_[region + 1].entry = entry;
+                return WalkStatus::Ok;
+            }
+            if (regions_.size() == regions_.capacity()) {
+                return WalkStatus::NeedsRoom;
+            }
+            region = regions_.size();
+            regions_.push_back({entry, regionCommittedBytes(entry), 0, 0, {}});
+            continue;
+        }
+        if (entry.wFlags & (PROCESS_HEAP_ENTRY_BUSY | PROCESS_HEAP_UNCOMMITTED_RANGE)) {
+            continue;
+        }
+        // A free block.
+        size_t& freeBytes = region == SIZE_MAX ? outsideFree_ : regions_[region].freeBytes;
+        size_t& biggest = region == SIZE_MAX ? outsideBiggest_ : regions_[region].biggestFreeBlock;
+        FreeBlockHistogram& freeBlocks = region == SIZE_MAX ? outsideBlocks_ : regions_[region].freeBlocks;
+        freeBytes += entry.cbData;
+        freeBlocks.add(entry.cbData);
+        if (entry.cbData > biggest) {
+            biggest = entry.cbData;
+        }
+    }
+
+    DWORD lastError = GetLastError();
+    if (lastError != ERROR_NO_MORE_ITEMS) {
+        lastError_ = lastError;
+        return WalkStatus::Failed;
+    }
+    return WalkStatus::Ok;
+}
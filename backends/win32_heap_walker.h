@@ -0,0 +1,68 @@
+#pragma once
+
+#include <windows.h>
+#include <heapapi.h>
+
+#include <cstddef>
+#include <vector>
+
+#include "heap_backend.h"
+
+/**
+ * @brief HeapWalk()-based free-space inspection of one Win32 heap.
+ *
+ * A full walk holds HeapLock for O(heap entries). With reuseRegions, the
+ * result is kept per heap region and only regions whose committed size
+ * changed since the previous walk are visited again (plus the last region,
+ * where the heap grows). Free entries are also kept as a size histogram per
+ * region, so a cached walk reports the same histogram a full one would. Used by Win32Backend on its private heap and by
+ * libfragmon on the process heap.
+ *
+ * A heap created with HEAP_NO_SERIALIZE must not be HeapLock()ed; pass
+ * lockHeap = false for one and serialize access to it yourself.
+ */
+class Win32HeapWalker {
+public:
+    explicit Win32HeapWalker(HANDLE heap, bool lockHeap = true) : heap_(heap), lockHeap_(lockHeap) {}
+
+    /**
+     * @brief Fills @p info with the heap's free-space figures.
+     * @return false, leaving @p info empty, if the heap could not be locked or
+     * HeapWalk() failed; lastError() then says why.
+     */
+    bool walk(bool reuseRegions, HeapInfo& info);
+
+    // GetLastError() of the last walk that failed, 0 if none has.
+    DWORD lastError() const { return lastError_; }
+
+    // Committed bytes over all regions as of the last walk.
+    size_t committedBytes() const;
+    size_t regionCount() const { return regions_.size(); }
+
+private:
+    // What the last walk found in one heap region.
+    struct RegionCache {
+        PROCESS_HEAP_ENTRY entry; // The region's own entry; a walk of the region resumes from it.
+        size_t committed;         // Committed bytes when the region was last walked.
+        size_t freeBytes;
+        size_t biggestFreeBlock;
+        FreeBlockHistogram freeBlocks; // The region's free entries by size.
+    };
+
+    enum class WalkStatus { Ok, Failed, NeedsRoom };
+
+    // Regions a walk can add before it has to start over with more room.
+    static constexpr size_t kSpareRegions = 64;
+
+    WalkStatus walkAll();
+    WalkStatus walkChanged();
+    WalkStatus walkFrom(PROCESS_HEAP_ENTRY& entry, size_t region, bool stopAtNextRegion);
+
+    HANDLE heap_;
+    bool lockHeap_;
+    std::vector<RegionCache> regions_;
+    size_t outsideFree_ = 0; // Free entries not inside any region.
+    size_t outsideBiggest_ = 0;
+    FreeBlockHistogram outsideBlocks_;
+    DWORD lastError_ = 0;
+};
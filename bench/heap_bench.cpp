@@ -0,0 +1,252 @@
+// Microbenchmarks for the allocator hot paths and for the cost of inspecting
+// a heap, i.e. how much the measurement itself weighs on what is measured.
+//
+// Every benchmark is registered once per backend compiled into the build.
+// Run with --benchmark_out=FILE --benchmark_out_format=json (or the
+// run_benchmarks target) to keep results for comparison across versions.
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "backend_registry.h"
+#include "fast_random.h"
+#include "heap_backend.h"
+
+#if !defined(_WIN32)
+#include <gnu/libc-version.h>
+#include <malloc.h>
+
+#include "malloc_info_scanner.h"
+#endif
+
+namespace {
+
+// Blocks allocated and freed together per iteration of AllocFree. Larger than
+// the per-size caches of glibc and tcmalloc, so it is not just a cache hit.
+constexpr int kBatch = 256;
+
+/**
+ * @brief A heap with @p blocks live blocks of mixed sizes and a free hole
+ * between most of them, so inspection has real free lists to walk.
+ */
+template <HeapBackend Backend>
+class FragmentedHeap {
+public:
+    FragmentedHeap(Backend& backend, size_t blocks) : backend_(backend) {
+        FastRandom rng(1);
+        std::vector<void*> all;
+        all.reserve(2 * blocks);
+        for (size_t i = 0; i < 2 * blocks; ++i) {
+            all.push_back(backend_.allocate(16 + rng.below(4080)));
+        }
+        live_.reserve(blocks);
+        for (size_t i = 0; i < all.size(); ++i) {
+            if (i % 2 == 0) {
+                live_.push_back(all[i]);
+            } else {
+                backend_.release(all[i]);
+            }
+        }
+    }
+
+    ~FragmentedHeap() {
+        for (void* block : live_) {
+            backend_.release(block);
+        }
+    }
+
+    FragmentedHeap(const FragmentedHeap&) = delete;
+    FragmentedHeap& operator=(const FragmentedHeap&) = delete;
+
+    const std::vector<void*>& live() const { return live_; }
+
+private:
+    Backend& backend_;
+    std::vector<void*> live_;
+};
+
+template <HeapBackend Backend>
+void allocFree(benchmark::State& state) {
+    Backend backend;
+    size_t size = static_cast<size_t>(state.range(0));
+    void* blocks[kBatch];
+    for (auto _ : state) {
+        for (void*& block : blocks) {
+            block = backend.allocate(size);
+        }
+        benchmark::DoNotOptimize(blocks);
+        for (void* block : blocks) {
+            backend.release(block);
+        }
+    }
+    state.SetItemsProcessed(state.iterations() * kBatch);
+}
+
+template <HeapBackend Backend>
+void usableSize(benchmark::State& state) {
+    Backend backend;
+    FragmentedHeap<Backend> heap(backend, 1024);
+    for (auto _ : state) {
+        size_t total = 0;
+        for (void* block : heap.live()) {
+            total += backend.usableSize(block);
+        }
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(heap.live().size()));
+}
+
+// One inspect() call, i.e. one sample of the simulation, against a heap of state.range(0) live blocks.
+template <HeapBackend Backend>
+void inspect(benchmark::State& state, InspectionMode mode) {
+    Backend backend;
+    if constexpr (ConfigurableHeapBackend<Backend>) {
+        backend.setInspectionMode(mode);
+    }
+    FragmentedHeap<Backend> heap(backend, static_cast<size_t>(state.range(0)));
+    for (auto _ : state) {
+        HeapInfo info = backend.inspect();
+        benchmark::DoNotOptimize(info.totalFree);
+    }
+    state.counters["live_blocks"] = static_cast<double>(state.range(0));
+}
+
+template <HeapBackend Backend>
+void registerBackend() {
+    std::string name(Backend::name);
+    benchmark::RegisterBenchmark(("AllocFree/" + name).c_str(), allocFree<Backend>)
+        ->RangeMultiplier(4)
+        ->Range(16, 64 << 10);
+    benchmark::RegisterBenchmark(("UsableSize/" + name).c_str(), usableSize<Backend>);
+    benchmark::RegisterBenchmark(("Inspect/" + name).c_str(), inspect<Backend>, InspectionMode::Full)
+        ->RangeMultiplier(8)
+        ->Range(1 << 10, 1 << 17)
+        ->Unit(benchmark::kMicrosecond);
+    if constexpr (ConfigurableHeapBackend<Backend>) {
+        benchmark::RegisterBenchmark(("Inspect/" + name + "/cached").c_str(), inspect<Backend>,
+                                     InspectionMode::Cached)
+            ->RangeMultiplier(8)
+            ->Range(1 << 10, 1 << 17)
+            ->Unit(benchmark::kMicrosecond);
+    }
+}
+
+#if !defined(_WIN32)
+// Captures malloc_info() into @p buffer, growing it until the document fits.
+size_t captureMallocInfo(std::vector<char>& buffer) {
+    while (true) {
+        std::FILE* stream = fmemopen(buffer.data(), buffer.size(), "w");
+        malloc_info(0, stream);
+        long length = std::ftell(stream);
+        std::fclose(stream);
+        if (length >= 0 && static_cast<size_t>(length) + 1 < buffer.size()) {
+            return static_cast<size_t>(length);
+        }
+        buffer.resize(buffer.size() * 2);
+    }
+}
+
+// The two halves of GlibcBackend::inspect(): glibc producing the XML, and our scanner reading it.
+void mallocInfoCapture(benchmark::State& state) {
+    GlibcBackend backend;
+    FragmentedHeap<GlibcBackend> heap(backend, static_cast<size_t>(state.range(0)));
+    std::vector<char> buffer(64 * 1024);
+    size_t length = 0;
+    for (auto _ : state) {
+        length = captureMallocInfo(buffer);
+    }
+    state.counters["live_blocks"] = static_cast<double>(state.range(0));
+    state.counters["xml_bytes"] = static_cast<double>(length);
+}
+
+void mallocInfoParse(benchmark::State& state) {
+    GlibcBackend backend;
+    FragmentedHeap<GlibcBackend> heap(backend, static_cast<size_t>(state.range(0)));
+    std::vector<char> buffer(64 * 1024);
+    size_t length = captureMallocInfo(buffer);
+    MallocInfoSnapshot snapshot;
+    for (auto _ : state) {
+        MallocInfoScanner::parse(buffer.data(), buffer.data() + length, snapshot);
+        benchmark::DoNotOptimize(snapshot.totalFree);
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(length));
+    state.counters["live_blocks"] = static_cast<double>(state.range(0));
+}
+#else
+// HeapWalk() over a private heap, against the number of entries it has to visit.
+void heapWalk(benchmark::State& state, bool reuseRegions) {
+    HANDLE heap = HeapCreate(0, 0, 0);
+    FastRandom rng(1);
+    std::vector<void*> blocks;
+    for (int64_t i = 0; i < 2 * state.range(0); ++i) {
+        blocks.push_back(HeapAlloc(heap, 0, 16 + rng.below(4080)));
+    }
+    for (size_t i = 1; i < blocks.size(); i += 2) {
+        HeapFree(heap, 0, blocks[i]);
+    }
+
+    size_t entries = 0;
+    PROCESS_HEAP_ENTRY entry{};
+    HeapLock(heap);
+    while (HeapWalk(heap, &entry)) {
+        ++entries;
+    }
+    HeapUnlock(heap);
+
+    Win32HeapWalker walker(heap);
+    HeapInfo info;
+    for (auto _ : state) {
+        if (!walker.walk(reuseRegions, info)) {
+            state.SkipWithError("HeapWalk failed");
+            break;
+        }
+        benchmark::DoNotOptimize(info.totalFree);
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(entries));
+    state.counters["entries"] = static_cast<double>(entries);
+    HeapDestroy(heap);
+}
+#endif
+
+} // namespace
+
+int main(int argc, char** argv) {
+    std::string backends;
+    AvailableBackends::forEach([&]<HeapBackend Backend>() {
+        registerBackend<Backend>();
+        backends += (backends.empty() ? "" : ",") + std::string(Backend::name);
+    });
+    benchmark::AddCustomContext("backends", backends);
+
+#if !defined(_WIN32)
+    benchmark::AddCustomContext("glibc_version", gnu_get_libc_version());
+    benchmark::RegisterBenchmark("MallocInfo/capture", mallocInfoCapture)
+        ->RangeMultiplier(8)
+        ->Range(1 << 10, 1 << 17)
+        ->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("MallocInfo/parse", mallocInfoParse)
+        ->RangeMultiplier(8)
+        ->Range(1 << 10, 1 << 17)
+        ->Unit(benchmark::kMicrosecond);
+#else
+    benchmark::RegisterBenchmark("HeapWalk/full", heapWalk, false)
+        ->RangeMultiplier(8)
+        ->Range(1 << 10, 1 << 17)
+        ->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("HeapWalk/cached", heapWalk, true)
+        ->RangeMultiplier(8)
+        ->Range(1 << 10, 1 << 17)
+        ->Unit(benchmark::kMicrosecond);
+#endif
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
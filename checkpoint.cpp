@@ -0,0 +1,81 @@
+#include "checkpoint.h"
+
+#include <array>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <system_error>
+
+namespace {
+
+constexpr char kCheckpointMagic[8] = {'H', 'E', 'A', 'P', 'C', 'K', 'P', 'T'};
+constexpr uint32_t kCheckpointVersion = 1;
+
+} // namespace
+
+Checkpoint readCheckpoint(const std::string& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        throw std::runtime_error("could not open " + path);
+    }
+    std::vector<char> bytes((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    CheckpointReader reader(bytes);
+    if (bytes.size() < sizeof(kCheckpointMagic) ||
+        std::memcmp(reader.get<std::array<char, sizeof(kCheckpointMagic)>>().data(), kCheckpointMagic,
+                    sizeof(kCheckpointMagic)) != 0) {
+        throw std::runtime_error(path + " is not a checkpoint");
+    }
+    if (uint32_t version = reader.get<uint32_t>(); version != kCheckpointVersion) {
+        throw std::runtime_error(path + " is a version " + std::to_string(version) +
+                                 " checkpoint; this build reads version " + std::to_string(kCheckpointVersion));
+    }
+
+    Checkpoint checkpoint;
+    for (uint32_t count = reader.get<uint32_t>(); count > 0; --count) {
+        checkpoint.arguments.push_back(reader.getString());
+    }
+    checkpoint.nextStep = reader.get<int32_t>();
+    checkpoint.elapsedSeconds = reader.get<double>();
+    checkpoint.stats = reader.get<StatsFilePosition>();
+    checkpoint.state = reader.getVector<char>();
+    reader.expectEnd();
+    return checkpoint;
+}
+
+void Checkpointer::save(int nextStep, double elapsedSeconds, const CheckpointWriter& state) {
+    if (!writer_.flush()) {
+        throw std::runtime_error("could not write the statistics for checkpoint " + path_);
+    }
+    CheckpointWriter out;
+    std::array<char, sizeof(kCheckpointMagic)> magic;
+    std::memcpy(magic.data(), kCheckpointMagic, sizeof(kCheckpointMagic));
+    out.put(magic);
+    out.put(kCheckpointVersion);
+    out.put(static_cast<uint32_t>(arguments_.size()));
+    for (const std::string& argument : arguments_) {
+        out.putString(argument);
+    }
+    out.put(static_cast<int32_t>(nextStep));
+    out.put(elapsedSeconds);
+    out.put(writer_.position());
+    out.putVector(state.bytes());
+
+    // Written next to the checkpoint, so the rename stays on one file system.
+    std::string temporary = path_ + ".tmp";
+    std::FILE* file = std::fopen(temporary.c_str(), "wb");
+    bool ok = file && std::fwrite(out.bytes().data(), 1, out.bytes().size(), file) == out.bytes().size();
+    ok = file && std::fclose(file) == 0 && ok;
+    std::error_code error;
+    if (ok) {
+        std::filesystem::rename(temporary, path_, error);
+    }
+    if (!ok || error) {
+        std::filesystem::remove(temporary, error);
+        throw std::runtime_error("could not write checkpoint " + path_);
+    }
+    ++saved_;
+    lastStep_ = nextStep;
+}
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "checkpoint_stream.h"
+#include "stats_writer.h"
+
+class Checkpointer;
+struct Checkpoint;
+
+// Long runs: --duration, --checkpoint-every and --resume.
+struct SoakOptions {
+    double durationSeconds = 0; // Stop after this much run time, counted across resumes; 0 for no limit.
+    int checkpointEvery = 0;    // Steps between two checkpoints, 0 for none.
+    Checkpointer* checkpointer = nullptr; // Where they go; set up by the driver.
+    const Checkpoint* resume = nullptr;   // The run to continue, if any; set up by the driver.
+};
+
+/**
+ * @brief A saved run, as read back by readCheckpoint().
+ *
+ * The file is
+ *
+ *     char     magic[8] = "HEAPCKPT"
+ *     uint32   version
+ *     uint32   argumentCount; { uint64 length; char text[length]; }[argumentCount]
+ *     int32    nextStep
+ *     float64  elapsedSeconds
+ *     uint64   rows, mainBytes, arenaBytes, freeBlockBytes   (StatsFilePosition)
+ *     uint64   stateBytes; char state[stateBytes]
+ *
+ * in host byte order, as it is only meant to be read on the machine that
+ * wrote it. The state is opaque outside runSimulation(): the RNG, the
+ * lifetime scheduler, the sampling policy and the live-block table.
+ */
+struct Checkpoint {
+    std::vector<std::string> arguments; // The run's command line, without the program name, seed included.
+    int nextStep = 0;                   // First step still to run.
+    double elapsedSeconds = 0;          // Run time up to the checkpoint, across earlier resumes.
+    StatsFilePosition stats;            // Where the stats files ended.
+    std::vector<char> state;
+};
+
+// Run time for --duration and the checkpoints, going on from a resumed checkpoint's.
+class RunClock {
+public:
+    explicit RunClock(const SoakOptions& options)
+        : durationSeconds_(options.durationSeconds),
+          before_(options.resume ? options.resume->elapsedSeconds : 0),
+          started_(std::chrono::steady_clock::now()) {}
+
+    double seconds() const {
+        return before_ + std::chrono::duration<double>(std::chrono::steady_clock::now() - started_).count();
+    }
+    bool timeUp() const { return durationSeconds_ > 0 && seconds() >= durationSeconds_; }
+
+private:
+    double durationSeconds_;
+    double before_;
+    std::chrono::steady_clock::time_point started_;
+};
+
+// Throws std::runtime_error if @p path cannot be read or is no checkpoint.
+Checkpoint readCheckpoint(const std::string& path);
+
+/**
+ * @brief Saves checkpoints of a run.
+ *
+ * Each save first has @p writer write out every row handed to it so far, so
+ * the stats files and the checkpoint agree, then writes the checkpoint to a
+ * temporary file and renames it over the previous one. A run killed at any
+ * moment therefore leaves either the old checkpoint or the new one, and a
+ * resume cuts the stats files back to where that checkpoint says they ended.
+ */
+class Checkpointer {
+public:
+    Checkpointer(std::string path, std::vector<std::string> arguments, StatsWriter& writer)
+        : path_(std::move(path)), arguments_(std::move(arguments)), writer_(writer) {}
+
+    // Throws std::runtime_error if the stats or the checkpoint cannot be written.
+    void save(int nextStep, double elapsedSeconds, const CheckpointWriter& state);
+
+    const std::string& path() const { return path_; }
+    uint64_t saved() const { return saved_; }
+    int lastStep() const { return lastStep_; } // Step the last checkpoint resumes at.
+
+private:
+    std::string path_;
+    std::vector<std::string> arguments_;
+    StatsWriter& writer_;
+    uint64_t saved_ = 0;
+    int lastStep_ = 0;
+};
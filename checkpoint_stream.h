@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Appends the state of a run to a byte buffer, in host byte order.
+class CheckpointWriter {
+public:
+    template <typename T>
+    void put(const T& value) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        size_t at = bytes_.size();
+        bytes_.resize(at + sizeof(T));
+        std::memcpy(bytes_.data() + at, &value, sizeof(T));
+    }
+
+    template <typename T>
+    void putVector(const std::vector<T>& values) {
+        static_assert(std::is_trivially_copyable_v<T>);
+        put<uint64_t>(values.size());
+        size_t at = bytes_.size();
+        bytes_.resize(at + values.size() * sizeof(T));
+        if (!values.empty()) {
+            std::memcpy(bytes_.data() + at, values.data(), values.size() * sizeof(T));
+        }
+    }
+
+    void putString(const std::string& text) { putVector(std::vector<char>(text.begin(), text.end())); }
+
+    const std::vector<char>& bytes() const { return bytes_; }
+
+private:
+    std::vector<char> bytes_;
+};
+
+// Reads back what a CheckpointWriter wrote. Throws std::runtime_error on reading past the end.
+// It only refers to the bytes, which must outlive it.
+class CheckpointReader {
+public:
+    explicit CheckpointReader(const std::vector<char>& bytes) : bytes_(bytes) {}
+    CheckpointReader(std::vector<char>&&) = delete;
+
+    template <typename T>
+    T get() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        T value;
+        std::memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    std::vector<T> getVector() {
+        static_assert(std::is_trivially_copyable_v<T>);
+        uint64_t count = get<uint64_t>();
+        if (count > (bytes_.size() - offset_) / sizeof(T)) {
+            throw std::runtime_error("the checkpoint is truncated");
+        }
+        std::vector<T> values(count);
+        std::memcpy(values.data(), take(count * sizeof(T)), count * sizeof(T));
+        return values;
+    }
+
+    std::string getString() {
+        std::vector<char> text = getVector<char>();
+        return std::string(text.begin(), text.end());
+    }
+
+    // Throws if anything was left unread: the checkpoint is not of this build.
+    void expectEnd() const {
+        if (offset_ != bytes_.size()) {
+            throw std::runtime_error("the checkpoint does not match this build of the analyzer");
+        }
+    }
+
+private:
+    const char* take(size_t size) {
+        if (size > bytes_.size() - offset_) {
+            throw std::runtime_error("the checkpoint is truncated");
+        }
+        const char* at = bytes_.data() + offset_;
+        offset_ += size;
+        return at;
+    }
+
+    const std::vector<char>& bytes_;
+    size_t offset_ = 0;
+};
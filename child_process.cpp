@@ -0,0 +1,139 @@
+#include "child_process.h"
+
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <cerrno>
+#include <cstring>
+
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char** environ;
+#endif
+
+#ifdef _WIN32
+
+namespace {
+
+// Quotes one argument so that the child's CommandLineToArgvW / CRT parser gets it back verbatim.
+void appendQuoted(std::string& commandLine, const std::string& arg) {
+    if (!arg.empty() && arg.find_first_of(" \t\"") == std::string::npos) {
+        commandLine += arg;
+        return;
+    }
+    commandLine += '"';
+    size_t backslashes = 0;
+    for (char c : arg) {
+        if (c == '\\') {
+            ++backslashes;
+            continue;
+        }
+        // Backslashes are only special in front of a quote.
+        commandLine.append(c == '"' ? 2 * backslashes + 1 : backslashes, '\\');
+        backslashes = 0;
+        commandLine += c;
+    }
+    commandLine.append(2 * backslashes, '\\');
+    commandLine += '"';
+}
+
+} // namespace
+
+ChildProcess startChildProcess(const std::vector<std::string>& argv, const std::string& logPath) {
+    std::string commandLine;
+    for (const std::string& arg : argv) {
+        if (!commandLine.empty()) {
+            commandLine += ' ';
+        }
+        appendQuoted(commandLine, arg);
+    }
+
+    SECURITY_ATTRIBUTES inheritable{sizeof(inheritable), nullptr, TRUE};
+    HANDLE log = CreateFileA(logPath.c_str(), GENERIC_WRITE, FILE_SHARE_READ, &inheritable, CREATE_ALWAYS,
+                             FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (log == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("could not create " + logPath);
+    }
+    STARTUPINFOA startup{};
+    startup.cb = sizeof(startup);
+    startup.dwFlags = STARTF_USESTDHANDLES;
+    startup.hStdInput = GetStdHandle(STD_INPUT_HANDLE);
+    startup.hStdOutput = log;
+    startup.hStdError = log;
+    PROCESS_INFORMATION process{};
+    BOOL started = CreateProcessA(argv[0].c_str(), commandLine.data(), nullptr, nullptr, TRUE, 0, nullptr,
+                                  nullptr, &startup, &process);
+    DWORD error = GetLastError();
+    CloseHandle(log);
+    if (!started) {
+        throw std::runtime_error("could not start " + argv[0] + ": error " + std::to_string(error));
+    }
+    CloseHandle(process.hThread);
+    return {process.hProcess};
+}
+
+size_t waitForAnyChild(const std::vector<ChildProcess>& running, int& exitCode) {
+    HANDLE handles[MAXIMUM_WAIT_OBJECTS];
+    for (size_t i = 0; i < running.size(); ++i) {
+        handles[i] = running[i].handle;
+    }
+    DWORD result = WaitForMultipleObjects(static_cast<DWORD>(running.size()), handles, FALSE, INFINITE);
+    if (result == WAIT_FAILED || result - WAIT_OBJECT_0 >= running.size()) {
+        throw std::runtime_error("WaitForMultipleObjects failed: " + std::to_string(GetLastError()));
+    }
+    size_t index = result - WAIT_OBJECT_0;
+    DWORD code = 0;
+    GetExitCodeProcess(handles[index], &code);
+    CloseHandle(handles[index]);
+    exitCode = static_cast<int>(code);
+    return index;
+}
+
+size_t maxChildProcesses() { return MAXIMUM_WAIT_OBJECTS; }
+
+#else
+
+ChildProcess startChildProcess(const std::vector<std::string>& argv, const std::string& logPath) {
+    std::vector<char*> args;
+    for (const std::string& arg : argv) {
+        args.push_back(const_cast<char*>(arg.c_str()));
+    }
+    args.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, logPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+    ChildProcess child;
+    int error = posix_spawn(&child.pid, args[0], &actions, nullptr, args.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (error != 0) {
+        throw std::runtime_error("could not start " + argv[0] + ": " + std::strerror(error));
+    }
+    return child;
+}
+
+size_t waitForAnyChild(const std::vector<ChildProcess>& running, int& exitCode) {
+    while (true) {
+        int status = 0;
+        pid_t pid = waitpid(-1, &status, 0);
+        if (pid < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw std::runtime_error(std::string("waitpid failed: ") + std::strerror(errno));
+        }
+        for (size_t i = 0; i < running.size(); ++i) {
+            if (running[i].pid == pid) {
+                exitCode = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+                return i;
+            }
+        }
+    }
+}
+
+size_t maxChildProcesses() { return 1024; }
+
+#endif
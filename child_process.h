@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#endif
+
+// A process started by startChildProcess(), until waitForAnyChild() reaps it.
+struct ChildProcess {
+#ifdef _WIN32
+    HANDLE handle = nullptr;
+#else
+    pid_t pid = -1;
+#endif
+};
+
+/**
+ * @brief Starts @p argv[0] with arguments @p argv, stdout and stderr going to @p logPath.
+ * Throws std::runtime_error if the process cannot be started.
+ */
+ChildProcess startChildProcess(const std::vector<std::string>& argv, const std::string& logPath);
+
+/**
+ * @brief Blocks until one of @p running exits.
+ * @return The index of that process in @p running, with its exit code in
+ * @p exitCode (128 + signal number if it was killed by a signal).
+ */
+size_t waitForAnyChild(const std::vector<ChildProcess>& running, int& exitCode);
+
+// The most processes waitForAnyChild() can wait on at once.
+size_t maxChildProcesses();
@@ -0,0 +1,281 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <vector>
+
+#include "cycle_clock.h"
+#include "heap_backend.h"
+#include "heap_stats.h"
+#include "live_block_table.h"
+
+// When and how the simulation compacts the heap (--compact-threshold).
+struct CompactionOptions {
+    double threshold = 0;         // Compact when ExternalFrag_Ratio goes above this; 0 for never.
+    size_t windowBytes = 64 << 10; // Address ranges whose occupancy is compared.
+    double sparseOccupancy = 0.5; // Windows with less than this share in live blocks are evacuated.
+    uint32_t maxBackoff = 64;     // Most samples skipped after passes that did not lower the ratio.
+};
+
+/**
+ * @brief Moves live blocks out of sparsely used parts of the heap, so the
+ * holes around them can merge into larger free blocks.
+ *
+ * This is possible because the workload never keeps a raw pointer: blocks are
+ * reached through their LiveBlockTable entry, a handle whose BlockRef
+ * (slot + generation) stays valid while the block moves. A compaction pass
+ * files every live block under the fixed-size address window it starts in,
+ * and empties the windows whose live bytes fill less than
+ * CompactionOptions::sparseOccupancy of them, emptiest first: allocate a new
+ * block, copy, update the handle. The old blocks are only released once every
+ * replacement is placed, so replacements cannot land in the space being
+ * vacated. Where they land is up to the allocator, or the fullest slab for a
+ * DenseHeapBackend. A replacement is only kept if it lands in a window that
+ * is being kept: a dense one, or a sparse one that held at least as many
+ * live bytes as the block's own and is then no longer emptied. One that
+ * lands in its own window, in a window already emptied or sparser, or in
+ * space no live block was in (the top of the heap, a fresh mapping) is
+ * released again and the block stays put, since moving it there would
+ * spread the free space rather than gather it. Where the allocator picks
+ * the place itself, so is one carved out of the biggest free span found
+ * before the pass (for a LayoutHeapBackend): shrinking that block is what
+ * raises the ratio most, and it means blocks that size have no hole left.
+ *
+ * A pass that does not lower the ratio is not repeated on the next sample:
+ * the compactor sits out the next sample over the threshold, then twice as
+ * many after each further useless pass, up to CompactionOptions::maxBackoff,
+ * and starts over once a pass helps.
+ *
+ * The scratch lists are kept between passes and grown by reserve() before
+ * the sample, so a pass allocates nothing for itself on the heap it is
+ * measuring.
+ */
+class HeapCompactor {
+public:
+    explicit HeapCompactor(const CompactionOptions& options) : options_(options) {}
+
+    /**
+     * @brief Compacts if @p stats, the row just sampled, is over the threshold,
+     * and fills in the row's compaction figures. The pause is the time spent
+     * moving blocks; the ratio after comes from one more inspect(), or is the
+     * ratio before if no block moved. Samples skipped while backing off keep
+     * the figures of a row without a pass.
+     */
+    template <HeapBackend Backend>
+    void compactIfFragmented(Backend& backend, std::span<LiveBlockTable* const> tables, HeapStats& stats) {
+        if (options_.threshold <= 0 || !(stats.externalFragmentationRatio > options_.threshold)) {
+            return;
+        }
+        if (skip_ > 0) {
+            --skip_;
+            return;
+        }
+        uint64_t start = CycleClock::now();
+        compact(backend, tables, stats);
+        stats.compactionNs = CycleClock::toNanoseconds(CycleClock::now() - start);
+        stats.compactionRatioAfter = stats.compactionMovedBlocks > 0 ? externalFragmentationRatio(backend.inspect())
+                                                                     : stats.externalFragmentationRatio;
+        if (stats.compactionRatioAfter < stats.externalFragmentationRatio) {
+            backoff_ = 0;
+        } else {
+            backoff_ = std::min(backoff_ > 0 ? backoff_ * 2 : 1, options_.maxBackoff);
+            skip_ = backoff_;
+        }
+    }
+
+    /**
+     * @brief Grows the scratch lists, with room to spare, to cover the live
+     * blocks in @p tables. They live on the heap being compacted, so call this
+     * before the sample is taken: whatever growing them takes from the heap is
+     * then in the ratio the pass is judged against, not put down to the pass.
+     */
+    template <HeapBackend Backend>
+    void reserve(Backend&, std::span<LiveBlockTable* const> tables) {
+        if (options_.threshold <= 0 || skip_ > 0) {
+            return;
+        }
+        size_t liveBlocks = 0;
+        for (const LiveBlockTable* table : tables) {
+            liveBlocks += table->size();
+        }
+        auto grow = [](auto& list, size_t count) {
+            if (list.capacity() < count) {
+                list.reserve(count * 2);
+            }
+        };
+        grow(entries_, liveBlocks);
+        grow(windows_, liveBlocks);
+        grow(sparse_, liveBlocks);
+        grow(vacated_, liveBlocks);
+        if constexpr (LayoutHeapBackend<Backend> && !DenseHeapBackend<Backend>) {
+            // Free spans and blocks the allocator caches lie between the live ones.
+            grow(spans_, liveBlocks * 3 + 64);
+        }
+    }
+
+private:
+    // A live block, by the window it starts in.
+    struct Entry {
+        uintptr_t window;
+        uint32_t table;
+        uint32_t index;
+        size_t usable;
+    };
+
+    // What a pass does with a window that holds live blocks.
+    enum class WindowState : uint8_t {
+        Dense,     // Full enough to keep; takes blocks.
+        Sparse,    // Not yet emptied; may still be kept if a sparser window fills it up.
+        Receiving, // Sparse, but took blocks, so it is kept.
+        Emptied,   // Its blocks were moved out (those that could be); takes none.
+    };
+
+    struct Window {
+        uintptr_t window;
+        size_t liveBytes;
+        size_t first; // Its blocks are entries_[first, last).
+        size_t last;
+        WindowState state;
+    };
+
+    template <HeapBackend Backend>
+    void compact(Backend& backend, std::span<LiveBlockTable* const> tables, HeapStats& stats) {
+        entries_.clear();
+        for (uint32_t t = 0; t < tables.size(); ++t) {
+            const LiveBlockTable& table = *tables[t];
+            for (uint32_t i = 0; i < table.size(); ++i) {
+                uintptr_t address = reinterpret_cast<uintptr_t>(table[i].ptr);
+                entries_.push_back({address / options_.windowBytes, t, i, table[i].usable});
+            }
+        }
+        std::sort(entries_.begin(), entries_.end(),
+                  [](const Entry& a, const Entry& b) { return a.window < b.window; });
+
+        keepFree_ = HeapSpan{};
+        noRoomFrom_ = SIZE_MAX;
+        if constexpr (LayoutHeapBackend<Backend> && !DenseHeapBackend<Backend>) {
+            backend.heapLayout(spans_);
+            for (const HeapSpan& span : spans_) {
+                if (!span.busy && span.size > keepFree_.size) {
+                    keepFree_ = span;
+                }
+            }
+        }
+
+        windows_.clear();
+        sparse_.clear();
+        const double sparseBytes = options_.sparseOccupancy * static_cast<double>(options_.windowBytes);
+        for (size_t first = 0; first < entries_.size();) {
+            size_t last = first;
+            size_t liveBytes = 0;
+            for (; last < entries_.size() && entries_[last].window == entries_[first].window; ++last) {
+                liveBytes += entries_[last].usable;
+            }
+            bool sparse = static_cast<double>(liveBytes) < sparseBytes;
+            if (sparse) {
+                sparse_.push_back(static_cast<uint32_t>(windows_.size()));
+            }
+            windows_.push_back({entries_[first].window, liveBytes, first, last,
+                                sparse ? WindowState::Sparse : WindowState::Dense});
+            first = last;
+        }
+
+        // Emptiest first, so the fuller sparse windows are there to take its blocks.
+        std::sort(sparse_.begin(), sparse_.end(),
+                  [&](uint32_t a, uint32_t b) { return windows_[a].liveBytes < windows_[b].liveBytes; });
+        vacated_.clear();
+        for (uint32_t w : sparse_) {
+            if (windows_[w].state != WindowState::Sparse) {
+                continue; // It took blocks from a sparser window.
+            }
+            windows_[w].state = WindowState::Emptied;
+            for (size_t e = windows_[w].first; e < windows_[w].last; ++e) {
+                relocate(backend, *tables[entries_[e].table], entries_[e].index, windows_[w].liveBytes, stats);
+            }
+        }
+        for (void* block : vacated_) {
+            backend.release(block);
+        }
+    }
+
+    // The window @p address starts in, if it is one a block from a window
+    // with @p sourceBytes live bytes may move to; nullptr otherwise. Free
+    // space outside every window (the end of the heap, a new mapping) does
+    // not qualify: moving there would spread the free space further.
+    Window* destination(uintptr_t address, size_t sourceBytes) {
+        uintptr_t window = address / options_.windowBytes;
+        auto found = std::lower_bound(windows_.begin(), windows_.end(), window,
+                                      [](const Window& w, uintptr_t value) { return w.window < value; });
+        if (found == windows_.end() || found->window != window) {
+            return nullptr;
+        }
+        switch (found->state) {
+        case WindowState::Dense:
+        case WindowState::Receiving:
+            return &*found;
+        case WindowState::Sparse:
+            return found->liveBytes >= sourceBytes ? &*found : nullptr;
+        case WindowState::Emptied:
+            return nullptr;
+        }
+        return nullptr;
+    }
+
+    template <HeapBackend Backend>
+    void relocate(Backend& backend, LiveBlockTable& table, size_t index, size_t sourceBytes, HeapStats& stats) {
+        const LiveBlock block = table[index];
+        if (block.requested >= noRoomFrom_) {
+            return;
+        }
+        void* moved = allocateReplacement(backend, block.requested, block.alignment);
+        if (!moved) {
+            return; // Out of memory: the block just stays where it is.
+        }
+        if (reinterpret_cast<uintptr_t>(moved) - keepFree_.address < keepFree_.size) {
+            // No hole left for a block this size. Releasing it does not
+            // always make good the split (glibc's tcache keeps it apart), so
+            // do not try larger ones either.
+            backend.release(moved);
+            noRoomFrom_ = block.requested;
+            return;
+        }
+        Window* target = destination(reinterpret_cast<uintptr_t>(moved), sourceBytes);
+        if (!target) {
+            backend.release(moved); // It would land in the same or a sparser place; leave it.
+            return;
+        }
+        if (target->state == WindowState::Sparse) {
+            target->state = WindowState::Receiving;
+        }
+        target->liveBytes += block.usable;
+        std::memcpy(moved, block.ptr, block.requested);
+        table.resizeAt(index, moved, block.requested, backend.usableSize(moved));
+        vacated_.push_back(block.ptr);
+        ++stats.compactionMovedBlocks;
+        stats.compactionMovedBytes += block.requested;
+    }
+
+    template <HeapBackend Backend>
+    static void* allocateReplacement(Backend& backend, size_t size, size_t alignment) {
+        if constexpr (DenseHeapBackend<Backend>) {
+            if (alignment == 0) {
+                return backend.allocateDense(size);
+            }
+        }
+        return allocateBlock(backend, size, alignment);
+    }
+
+    CompactionOptions options_;
+    std::vector<Entry> entries_;
+    std::vector<Window> windows_;  // By address, as entries_ is.
+    std::vector<uint32_t> sparse_; // Indices into windows_, emptiest first.
+    std::vector<void*> vacated_;
+    std::vector<HeapSpan> spans_; // The layout, for a LayoutHeapBackend without allocateDense().
+    HeapSpan keepFree_{};         // Its biggest free span; size 0 if unknown.
+    size_t noRoomFrom_ = SIZE_MAX; // Blocks this big found no place but keepFree_ this pass.
+    uint32_t backoff_ = 0; // Samples skipped after the last useless pass.
+    uint32_t skip_ = 0;    // Samples still to skip.
+};
@@ -0,0 +1,582 @@
+// heap_compare: runs heap_analyzer with a baseline and a candidate set of
+// options over the same seeds, interleaved, reduces every run to a few
+// figures and tests whether the candidate's are worse. Meant as the gate of
+// an allocator or configuration upgrade: the exit code is 1 on a regression.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "child_process.h"
+#include "mann_whitney.h"
+#include "stats_writer.h"
+#include "tool_options.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+enum class Reduction { Final, Mean, Median, Max };
+
+// One figure per run, e.g. max:TotalFree_Bytes. Larger is worse.
+struct Metric {
+    std::string name; // As given: REDUCTION:COLUMN.
+    Reduction reduction;
+    std::string column;
+};
+
+struct CompareOptions {
+    std::string analyzer;
+    std::string outputPath = "compare.csv";
+    unsigned jobs = 1;
+    bool keepRuns = false;
+    bool showHelp = false;
+    std::vector<unsigned> seeds;
+    std::vector<std::string> baselineArgs;
+    std::vector<std::string> candidateArgs;
+    std::vector<std::string> analyzerArgs; // Everything after "--", for both sides.
+    std::vector<Metric> metrics;
+    double alpha = 0.05;
+    double minChangePercent = 1;
+};
+
+// One heap_analyzer process of the comparison.
+struct CompareRun {
+    int side; // 0 baseline, 1 candidate.
+    unsigned seed;
+    int exitCode = -1;
+    double seconds = 0;
+    std::vector<double> values; // One per metric; empty if the run failed.
+};
+
+struct MetricResult {
+    double baselineMedian;
+    double candidateMedian;
+    double changePercent; // Of the candidate's median over the baseline's.
+    double pWorse;        // One-sided: the candidate's values tend to be larger.
+    double pBetter;
+    bool exact;           // Exact U distribution rather than the normal approximation.
+    const char* verdict;
+};
+
+constexpr const char* kSideNames[] = {"baseline", "candidate"};
+
+constexpr const char* kDefaultMetrics =
+    "final:RSS_Bytes,max:TotalFree_Bytes,mean:ExternalFrag_Ratio,mean:AllocLatency_p99_ns";
+
+// Whitespace-separated heap_analyzer options; values with spaces are not supported.
+std::vector<std::string> splitArguments(std::string_view text) {
+    std::vector<std::string> arguments;
+    size_t begin = 0;
+    while ((begin = text.find_first_not_of(" \t", begin)) != std::string_view::npos) {
+        size_t end = std::min(text.find_first_of(" \t", begin), text.size());
+        arguments.emplace_back(text.substr(begin, end - begin));
+        begin = end;
+    }
+    return arguments;
+}
+
+// Every column the analyzer writes, the Allocatable_<S> ones by their prefix.
+bool isStatsColumn(const std::string& column) {
+    std::vector<std::string> fitNames;
+    for (const StatsColumn& known : mainStatsColumns({}, fitNames)) {
+        if (column == known.name) {
+            return column != "Time";
+        }
+    }
+    return column.starts_with("Allocatable_") && column.size() > 12;
+}
+
+bool parseMetrics(std::string_view text, std::vector<Metric>& metrics, std::string& error) {
+    metrics.clear();
+    while (!text.empty()) {
+        size_t comma = text.find(',');
+        std::string_view item = text.substr(0, comma);
+        text = comma == std::string_view::npos ? std::string_view() : text.substr(comma + 1);
+
+        size_t colon = item.find(':');
+        std::string_view reduction = item.substr(0, colon);
+        Metric metric{std::string(item), Reduction::Final,
+                      std::string(colon == std::string_view::npos ? "" : item.substr(colon + 1))};
+        if (reduction == "final") {
+            metric.reduction = Reduction::Final;
+        } else if (reduction == "mean") {
+            metric.reduction = Reduction::Mean;
+        } else if (reduction == "median") {
+            metric.reduction = Reduction::Median;
+        } else if (reduction == "max") {
+            metric.reduction = Reduction::Max;
+        } else {
+            error = "metric " + std::string(item) + " is not final:, mean:, median: or max: and a column";
+            return false;
+        }
+        if (!isStatsColumn(metric.column)) {
+            error = "metric " + std::string(item) + ": no column named " + metric.column;
+            return false;
+        }
+        metrics.push_back(std::move(metric));
+    }
+    if (metrics.empty()) {
+        error = "--metrics needs at least one metric";
+        return false;
+    }
+    return true;
+}
+
+// The comparison picks the output, format and seed of every run itself.
+bool checkAnalyzerArgs(const std::vector<std::string>& args, std::string& error) {
+    for (const std::string& arg : args) {
+        if (arg == "--output" || arg == "--format" || arg == "--seed" || arg == "--resume") {
+            error = arg + " is set by heap_compare for every run";
+            return false;
+        }
+    }
+    return true;
+}
+
+bool parseCompareOptions(int argc, char** argv, CompareOptions& options, std::string& error) {
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--") {
+            options.analyzerArgs.assign(argv + i + 1, argv + argc);
+            break;
+        }
+        if (arg == "--help" || arg == "-h") {
+            options.showHelp = true;
+            continue;
+        }
+        if (arg == "--keep-runs") {
+            options.keepRuns = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            error = "unknown option or missing value: " + std::string(arg);
+            return false;
+        }
+        std::string_view value = argv[++i];
+
+        bool ok = true;
+        if (arg == "--analyzer") {
+            options.analyzer = value;
+        } else if (arg == "--output") {
+            options.outputPath = value;
+        } else if (arg == "--jobs") {
+            ok = parseNumber(value, options.jobs) && options.jobs > 0;
+        } else if (arg == "--seeds") {
+            ok = parseList(value, options.seeds);
+        } else if (arg == "--baseline") {
+            options.baselineArgs = splitArguments(value);
+        } else if (arg == "--candidate") {
+            options.candidateArgs = splitArguments(value);
+        } else if (arg == "--metrics") {
+            if (!parseMetrics(value, options.metrics, error)) {
+                return false;
+            }
+        } else if (arg == "--alpha") {
+            ok = parseNumber(value, options.alpha) && options.alpha > 0 && options.alpha < 1;
+        } else if (arg == "--min-change") {
+            ok = parseNumber(value, options.minChangePercent) && options.minChangePercent >= 0;
+        } else {
+            error = "unknown option: " + std::string(arg);
+            return false;
+        }
+        if (!ok) {
+            error = "invalid value for " + std::string(arg) + ": " + std::string(value);
+            return false;
+        }
+    }
+    if (options.seeds.empty()) {
+        parseList("1-10", options.seeds);
+    }
+    if (options.metrics.empty()) {
+        parseMetrics(kDefaultMetrics, options.metrics, error);
+    }
+    return checkAnalyzerArgs(options.baselineArgs, error) && checkAnalyzerArgs(options.candidateArgs, error) &&
+           checkAnalyzerArgs(options.analyzerArgs, error);
+}
+
+void printUsage(std::ostream& out, const char* program) {
+    out << "Usage: " << program << " --candidate OPTIONS [options] [-- heap_analyzer options]\n"
+        << "Runs heap_analyzer with the baseline's and the candidate's options for every seed and\n"
+        << "exits with 1 if the candidate's metrics are significantly worse.\n"
+        << "  --baseline OPTIONS   heap_analyzer options of the baseline, e.g. \"--backend glibc\"\n"
+        << "                       (default: none)\n"
+        << "  --candidate OPTIONS  The same for the candidate, e.g. \"--tune arena_max=1\"\n"
+        << "  --seeds LIST         Workload seeds, run for both sides (default 1-10); e.g. 1-20 or 3,7,9\n"
+        << "  --metrics LIST       What to compare, as REDUCTION:COLUMN with REDUCTION final, mean,\n"
+        << "                       median or max over the run's rows; larger is worse (default\n"
+        << "                       " << kDefaultMetrics << ")\n"
+        << "  --alpha A            False alarm rate of the whole gate, split over the metrics (default 0.05)\n"
+        << "  --min-change PCT     Smallest change of the median that counts as a regression (default 1)\n"
+        << "  --jobs N             Runs at a time (default 1; more make the latencies noisier)\n"
+        << "  --output FILE        Per-metric results (default compare.csv); every run's figures go\n"
+        << "                       to FILE_runs.csv next to it\n"
+        << "  --analyzer PATH      heap_analyzer to run (default: the one next to this program)\n"
+        << "  --keep-runs          Keep each run's own output and log\n"
+        << "  --help               Show this message\n"
+        << "Options after -- (e.g. --steps, --sizes, --workload) are passed to both sides.\n";
+}
+
+/**
+ * @brief The runs in the order they are started: for each seed a baseline
+ * and a candidate run, alternating which goes first (ABBA), so slow drift of
+ * the machine (heat, background load) hits both sides alike.
+ */
+std::vector<CompareRun> interleavedRuns(const std::vector<unsigned>& seeds) {
+    std::vector<CompareRun> runs;
+    for (size_t i = 0; i < seeds.size(); ++i) {
+        int first = static_cast<int>(i % 2);
+        runs.push_back({first, seeds[i], -1, 0, {}});
+        runs.push_back({1 - first, seeds[i], -1, 0, {}});
+    }
+    return runs;
+}
+
+fs::path runOutputPath(const fs::path& runsDir, const CompareRun& run) {
+    return runsDir / (std::string(kSideNames[run.side]) + "_" + std::to_string(run.seed) + ".bin");
+}
+
+std::vector<std::string> analyzerCommand(const CompareOptions& options, const CompareRun& run,
+                                         const std::string& outputPath) {
+    std::vector<std::string> argv = {options.analyzer, "--format", "binary", "--output", outputPath,
+                                     "--seed", std::to_string(run.seed)};
+    argv.insert(argv.end(), options.analyzerArgs.begin(), options.analyzerArgs.end());
+    const std::vector<std::string>& side = run.side == 0 ? options.baselineArgs : options.candidateArgs;
+    argv.insert(argv.end(), side.begin(), side.end());
+    return argv;
+}
+
+/**
+ * @brief Reduces the binary stats file of one run to one value per metric.
+ * NaN cells are skipped; a metric with no value left is NaN.
+ * @return false if the file is missing or not a stats file, with the reason in @p error.
+ */
+bool reduceRun(const fs::path& path, const std::vector<Metric>& metrics, std::vector<double>& values,
+               std::string& error) {
+    std::FILE* in = std::fopen(path.string().c_str(), "rb");
+    if (!in) {
+        error = "no stats file";
+        return false;
+    }
+    BinaryStatsPrologue prologue;
+    bool ok = std::fread(&prologue, sizeof(prologue), 1, in) == 1 &&
+              std::memcmp(prologue.magic, kBinaryStatsMagic, sizeof(prologue.magic)) == 0 &&
+              prologue.version >= 1 && prologue.version <= kBinaryStatsVersion &&
+              prologue.recordBytes == prologue.columnCount * sizeof(uint64_t);
+    std::vector<char> entries(size_t{ok ? prologue.columnCount : 0} * kBinaryColumnBytes);
+    ok = ok && std::fread(entries.data(), 1, entries.size(), in) == entries.size() &&
+         std::fseek(in, static_cast<long>(prologue.headerBytes), SEEK_SET) == 0;
+    if (!ok) {
+        std::fclose(in);
+        error = "not a binary stats file";
+        return false;
+    }
+
+    // The column and type of every metric.
+    std::vector<size_t> index(metrics.size());
+    std::vector<char> types(metrics.size());
+    for (size_t m = 0; m < metrics.size(); ++m) {
+        index[m] = prologue.columnCount;
+        for (size_t c = 0; c < prologue.columnCount; ++c) {
+            const char* entry = entries.data() + c * kBinaryColumnBytes;
+            if (metrics[m].column == std::string_view(entry, strnlen(entry, kBinaryColumnBytes - 8))) {
+                index[m] = c;
+                types[m] = entry[kBinaryColumnBytes - 8];
+            }
+        }
+        if (index[m] == prologue.columnCount) {
+            std::fclose(in);
+            error = "no column " + metrics[m].column;
+            return false;
+        }
+    }
+
+    std::vector<std::vector<double>> series(metrics.size());
+    std::vector<uint64_t> record(prologue.columnCount);
+    while (std::fread(record.data(), prologue.recordBytes, 1, in) == 1) {
+        for (size_t m = 0; m < metrics.size(); ++m) {
+            uint64_t cell = record[index[m]];
+            double value;
+            if (types[m] == 'i') {
+                int64_t signedCell;
+                std::memcpy(&signedCell, &cell, sizeof(signedCell));
+                value = static_cast<double>(signedCell);
+            } else if (types[m] == 'u') {
+                value = static_cast<double>(cell);
+            } else {
+                std::memcpy(&value, &cell, sizeof(value));
+            }
+            if (!std::isnan(value)) {
+                series[m].push_back(value);
+            }
+        }
+    }
+    std::fclose(in);
+
+    values.clear();
+    for (size_t m = 0; m < metrics.size(); ++m) {
+        std::vector<double>& s = series[m];
+        double value = std::numeric_limits<double>::quiet_NaN();
+        if (!s.empty()) {
+            switch (metrics[m].reduction) {
+            case Reduction::Final:
+                value = s.back();
+                break;
+            case Reduction::Mean: {
+                double sum = 0;
+                for (double x : s) {
+                    sum += x;
+                }
+                value = sum / static_cast<double>(s.size());
+                break;
+            }
+            case Reduction::Median:
+                std::sort(s.begin(), s.end());
+                value = s.size() % 2 ? s[s.size() / 2] : (s[s.size() / 2 - 1] + s[s.size() / 2]) / 2;
+                break;
+            case Reduction::Max:
+                value = *std::max_element(s.begin(), s.end());
+                break;
+            }
+        }
+        values.push_back(value);
+    }
+    return true;
+}
+
+double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    size_t n = values.size();
+    return n % 2 ? values[n / 2] : (values[n / 2 - 1] + values[n / 2]) / 2;
+}
+
+MetricResult compareMetric(const std::vector<double>& baseline, const std::vector<double>& candidate,
+                           const CompareOptions& options) {
+    constexpr double kNaN = std::numeric_limits<double>::quiet_NaN();
+    MetricResult result{};
+    result.baselineMedian = baseline.empty() ? kNaN : median(baseline);
+    result.candidateMedian = candidate.empty() ? kNaN : median(candidate);
+    if (baseline.empty() || candidate.empty()) {
+        result.changePercent = kNaN;
+        result.pWorse = result.pBetter = 1;
+        result.verdict = "no data";
+        return result;
+    }
+    double change = result.candidateMedian - result.baselineMedian;
+    result.changePercent = result.baselineMedian != 0 ? 100 * change / std::fabs(result.baselineMedian)
+                           : change == 0                ? 0
+                           : change > 0                 ? std::numeric_limits<double>::infinity()
+                                                        : -std::numeric_limits<double>::infinity();
+    bool exactBetter = false;
+    result.pWorse = mannWhitneyGreater(candidate, baseline, result.exact);
+    result.pBetter = mannWhitneyGreater(baseline, candidate, exactBetter);
+
+    // Bonferroni: every metric is tested at alpha / metrics, so the gate as a whole raises false alarms <= alpha.
+    double alpha = options.alpha / static_cast<double>(options.metrics.size());
+    if (result.pWorse < alpha && result.changePercent > options.minChangePercent) {
+        result.verdict = "WORSE";
+    } else if (result.pBetter < alpha && result.changePercent < -options.minChangePercent) {
+        result.verdict = "better";
+    } else {
+        result.verdict = "same";
+    }
+    return result;
+}
+
+// compare.csv -> compare_runs.csv (or the compare_runs directory, with an empty @p extension)
+fs::path siblingPath(const fs::path& output, const std::string& suffix, const std::string& extension) {
+    fs::path path = output;
+    return path.replace_filename(output.stem().string() + suffix + extension);
+}
+
+void writeMetadata(std::ostream& out, const CompareOptions& options) {
+    out << "# compare.baseline=" << joinNames(options.baselineArgs, ' ') << "\n"
+        << "# compare.candidate=" << joinNames(options.candidateArgs, ' ') << "\n"
+        << "# compare.analyzer_args=" << joinNames(options.analyzerArgs, ' ') << "\n"
+        << "# compare.alpha=" << options.alpha << "\n"
+        << "# compare.min_change=" << options.minChangePercent << "\n";
+}
+
+int runComparison(const CompareOptions& options) {
+    std::vector<CompareRun> runs = interleavedRuns(options.seeds);
+    fs::path output = options.outputPath;
+    fs::path runsDir = siblingPath(output, "_runs", "");
+    fs::create_directories(runsDir);
+
+    unsigned jobs = static_cast<unsigned>(std::min<size_t>({options.jobs, runs.size(), maxChildProcesses()}));
+    std::cout << "Comparing " << options.seeds.size() << " seeds of the baseline and the candidate, "
+              << runs.size() << " runs, " << jobs << " at a time..." << std::endl;
+
+    using Clock = std::chrono::steady_clock;
+    std::vector<ChildProcess> running;
+    std::vector<size_t> runningIndex;
+    std::vector<Clock::time_point> started;
+    size_t next = 0;
+    size_t finished = 0;
+    size_t failed = 0;
+    while (finished < runs.size()) {
+        while (next < runs.size() && running.size() < jobs) {
+            fs::path runOutput = runOutputPath(runsDir, runs[next]);
+            fs::path log = fs::path(runOutput).replace_extension(".log");
+            running.push_back(startChildProcess(analyzerCommand(options, runs[next], runOutput.string()),
+                                                log.string()));
+            runningIndex.push_back(next);
+            started.push_back(Clock::now());
+            ++next;
+        }
+
+        int exitCode = 0;
+        size_t slot = waitForAnyChild(running, exitCode);
+        CompareRun& run = runs[runningIndex[slot]];
+        run.exitCode = exitCode;
+        run.seconds = std::chrono::duration<double>(Clock::now() - started[slot]).count();
+        running.erase(running.begin() + static_cast<std::ptrdiff_t>(slot));
+        runningIndex.erase(runningIndex.begin() + static_cast<std::ptrdiff_t>(slot));
+        started.erase(started.begin() + static_cast<std::ptrdiff_t>(slot));
+        ++finished;
+
+        fs::path runOutput = runOutputPath(runsDir, run);
+        std::string error;
+        if (exitCode != 0) {
+            error = "exited with code " + std::to_string(exitCode);
+        } else if (!reduceRun(runOutput, options.metrics, run.values, error)) {
+            run.values.clear();
+        }
+        if (!error.empty()) {
+            ++failed;
+            std::cerr << "Warning: the " << kSideNames[run.side] << " run of seed " << run.seed << " " << error
+                      << "; see " << fs::path(runOutput).replace_extension(".log").string() << std::endl;
+        }
+        std::cout << "[" << finished << "/" << runs.size() << "] " << kSideNames[run.side] << " seed " << run.seed
+                  << " finished in " << run.seconds << " s" << std::endl;
+    }
+
+    // Everything the two sides came up with, per metric.
+    std::vector<MetricResult> results;
+    for (size_t m = 0; m < options.metrics.size(); ++m) {
+        std::vector<double> samples[2];
+        for (const CompareRun& run : runs) {
+            if (!run.values.empty() && !std::isnan(run.values[m])) {
+                samples[run.side].push_back(run.values[m]);
+            }
+        }
+        results.push_back(compareMetric(samples[0], samples[1], options));
+    }
+
+    fs::path runsPath = siblingPath(output, "_runs", ".csv");
+    std::ofstream runsFile(runsPath.string());
+    writeMetadata(runsFile, options);
+    runsFile << "Side,Seed,ExitCode,Seconds";
+    for (const Metric& metric : options.metrics) {
+        runsFile << ',' << metric.name;
+    }
+    runsFile << '\n';
+    for (const CompareRun& run : runs) {
+        runsFile << kSideNames[run.side] << ',' << run.seed << ',' << run.exitCode << ',' << run.seconds;
+        for (size_t m = 0; m < options.metrics.size(); ++m) {
+            runsFile << ',';
+            if (!run.values.empty()) {
+                runsFile << run.values[m];
+            }
+        }
+        runsFile << '\n';
+    }
+    runsFile.close();
+
+    std::ofstream summary(output.string());
+    writeMetadata(summary, options);
+    summary << "Metric,Baseline_Median,Candidate_Median,Change_Percent,P_Worse,P_Better,Exact,Verdict\n";
+    for (size_t m = 0; m < options.metrics.size(); ++m) {
+        const MetricResult& r = results[m];
+        summary << options.metrics[m].name << ',' << r.baselineMedian << ',' << r.candidateMedian << ','
+                << r.changePercent << ',' << r.pWorse << ',' << r.pBetter << ',' << (r.exact ? 1 : 0) << ','
+                << r.verdict << '\n';
+    }
+    summary.close();
+    if (!runsFile || !summary) {
+        std::cerr << "Error: Could not write " << output.string() << " / " << runsPath.string() << "." << std::endl;
+        return 1;
+    }
+
+    // The report: one line per metric, then the verdict.
+    char line[200];
+    std::snprintf(line, sizeof(line), "\n%-32s %14s %14s %9s %10s  %s\n", "Metric", "Baseline", "Candidate",
+                  "Change", "p(worse)", "Result");
+    std::cout << line;
+    std::vector<std::string> regressions;
+    for (size_t m = 0; m < options.metrics.size(); ++m) {
+        const MetricResult& r = results[m];
+        std::snprintf(line, sizeof(line), "%-32s %14.6g %14.6g %+8.2f%% %10.3g  %s\n", options.metrics[m].name.c_str(),
+                      r.baselineMedian, r.candidateMedian, r.changePercent, r.pWorse, r.verdict);
+        std::cout << line;
+        if (std::string_view(r.verdict) == "WORSE") {
+            regressions.push_back(options.metrics[m].name);
+        }
+    }
+    std::cout << "Medians across seeds; each metric tested at alpha " << options.alpha / options.metrics.size()
+              << " (" << options.alpha << " over " << options.metrics.size() << " metrics), changes under "
+              << options.minChangePercent << "% ignored." << std::endl;
+    std::cout << "Results written to " << output.string() << " and " << runsPath.string() << "." << std::endl;
+
+    if (failed == 0 && !options.keepRuns) {
+        fs::remove_all(runsDir);
+    } else {
+        std::cout << "Per-run output and logs are in " << runsDir.string() << "." << std::endl;
+    }
+    if (!regressions.empty()) {
+        std::string list;
+        for (const std::string& name : regressions) {
+            list += (list.empty() ? "" : ", ") + name;
+        }
+        std::cout << "REGRESSION: the candidate is worse in " << list << "." << std::endl;
+        return 1;
+    }
+    if (failed > 0) {
+        std::cout << "FAILED: " << failed << " runs did not finish; see the warnings above." << std::endl;
+        return 1;
+    }
+    std::cout << "No regression." << std::endl;
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    CompareOptions options;
+    std::string error;
+    if (!parseCompareOptions(argc, argv, options, error)) {
+        std::cerr << "Error: " << error << "\n";
+        printUsage(std::cerr, argv[0]);
+        return 2;
+    }
+    if (options.showHelp) {
+        printUsage(std::cout, argv[0]);
+        return 0;
+    }
+    if (options.analyzer.empty()) {
+#ifdef _WIN32
+        options.analyzer = (fs::path(argv[0]).parent_path() / "heap_analyzer.exe").string();
+#else
+        options.analyzer = (fs::path(argv[0]).parent_path() / "heap_analyzer").string();
+#endif
+    }
+
+    try {
+        return runComparison(options);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#include <intrin.h>
+#define FRAGMENTATION_CYCLE_CLOCK_TSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define FRAGMENTATION_CYCLE_CLOCK_TSC 1
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+/**
+ * @brief Cheapest available timestamp for timing single allocator calls.
+ *
+ * On x86 this is the time-stamp counter (rdtsc, ~20 cycles, invariant on any
+ * CPU from the last decade), fenced so the timed call cannot be reordered
+ * around it. Elsewhere it is QueryPerformanceCounter on Windows and
+ * steady_clock otherwise. Ticks are converted to nanoseconds only when a
+ * histogram is summarized, never on the timing path.
+ */
+class CycleClock {
+public:
+    static uint64_t now() {
+#if defined(FRAGMENTATION_CYCLE_CLOCK_TSC)
+        _mm_lfence();
+        uint64_t ticks = __rdtsc();
+        _mm_lfence();
+        return ticks;
+#elif defined(_WIN32)
+        LARGE_INTEGER counter;
+        QueryPerformanceCounter(&counter);
+        return static_cast<uint64_t>(counter.QuadPart);
+#else
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                         std::chrono::steady_clock::now().time_since_epoch())
+                                         .count());
+#endif
+    }
+
+    // Measured once, on first use, against steady_clock (TSC) or queried (QPC).
+    static double nanosecondsPerTick() {
+        static const double ratio = calibrate();
+        return ratio;
+    }
+
+    static uint64_t toNanoseconds(uint64_t ticks) {
+        return static_cast<uint64_t>(static_cast<double>(ticks) * nanosecondsPerTick() + 0.5);
+    }
+
+private:
+    static double calibrate() {
+#if defined(FRAGMENTATION_CYCLE_CLOCK_TSC)
+        using std::chrono::steady_clock;
+        auto wallStart = steady_clock::now();
+        uint64_t tickStart = now();
+        while (steady_clock::now() - wallStart < std::chrono::milliseconds(10)) {
+        }
+        auto wallEnd = steady_clock::now();
+        uint64_t tickEnd = now();
+        double nanoseconds = static_cast<double>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(wallEnd - wallStart).count());
+        return nanoseconds / static_cast<double>(tickEnd - tickStart);
+#elif defined(_WIN32)
+        LARGE_INTEGER frequency;
+        QueryPerformanceFrequency(&frequency);
+        return 1e9 / static_cast<double>(frequency.QuadPart);
+#else
+        return 1.0;
+#endif
+    }
+};
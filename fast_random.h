@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+#include "checkpoint_stream.h"
+
+/**
+ * @brief xoshiro256** pseudo-random generator, seeded through splitmix64.
+ *
+ * A handful of shifts, rotates and one multiply per 64-bit draw, with a 2^256
+ * period and no low-entropy bits, so the workload generator stays far cheaper
+ * than the allocator calls it drives. Satisfies UniformRandomBitGenerator, so
+ * it also works with the <random> distributions.
+ */
+class FastRandom {
+public:
+    using result_type = uint64_t;
+
+    explicit FastRandom(uint64_t seed) {
+        for (uint64_t& word : state_) {
+            seed += 0x9e3779b97f4a7c15;
+            uint64_t z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+            word = z ^ (z >> 31);
+        }
+    }
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    result_type operator()() {
+        uint64_t result = rotl(state_[1] * 5, 7) * 9;
+        uint64_t t = state_[1] << 17;
+        state_[2] ^= state_[0];
+        state_[3] ^= state_[1];
+        state_[1] ^= state_[2];
+        state_[0] ^= state_[3];
+        state_[2] ^= t;
+        state_[3] = rotl(state_[3], 45);
+        return result;
+    }
+
+    // Uniform integer in [0, bound), by multiply-shift instead of a division.
+    uint32_t below(uint32_t bound) { return static_cast<uint32_t>(((*this)() >> 32) * bound >> 32); }
+
+    // Uniform double in [0, 1).
+    double uniform() { return static_cast<double>((*this)() >> 11) * 0x1.0p-53; }
+
+    // For --checkpoint-every: the generator continues exactly where it was saved.
+    void save(CheckpointWriter& out) const {
+        for (uint64_t word : state_) {
+            out.put(word);
+        }
+    }
+    void load(CheckpointReader& in) {
+        for (uint64_t& word : state_) {
+            word = in.get<uint64_t>();
+        }
+    }
+
+private:
+    static uint64_t rotl(uint64_t x, int k) { return (x << k) | (x >> (64 - k)); }
+
+    uint64_t state_[4];
+};
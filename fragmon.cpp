@@ -0,0 +1,111 @@
+#include "fragmon.h"
+
+#include "cycle_clock.h"
+
+#ifdef _WIN32
+#include <windows.h>
+
+#include "backends/win32_heap_walker.h"
+#else
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "malloc_info_scanner.h"
+#endif
+
+namespace fragmon {
+
+#ifdef _WIN32
+
+struct Monitor::Probe {
+    // Region-cached: the process heap is shared with the whole service, so
+    // re-walking unchanged regions would hold its lock for nothing.
+    Win32HeapWalker walker{GetProcessHeap()};
+
+    bool sample(Snapshot& out) {
+        HeapInfo info;
+        if (!walker.walk(true, info)) {
+            return false;
+        }
+        out.totalFreeOnHeap = info.totalFree;
+        out.biggestFreeBlock = info.biggestFreeBlock;
+        out.heapCommitted = walker.committedBytes();
+        out.arenaCount = static_cast<uint32_t>(walker.regionCount());
+        return true;
+    }
+
+    static void lowerPriority() { SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_LOWEST); }
+};
+
+#else
+
+struct Monitor::Probe {
+    MallocInfoScanner scanner;
+    MallocInfoSnapshot snapshot;
+
+    // Leaves @p out untouched and returns false when malloc_info could not be read.
+    bool sample(Snapshot& out) {
+        if (!scanner.sample(snapshot)) {
+            return false;
+        }
+        out.totalFreeOnHeap = snapshot.totalFree;
+        out.biggestFreeBlock = snapshot.biggestFreeBlock;
+        out.heapCommitted = snapshot.systemCurrent + snapshot.mmapBytes;
+        out.arenaCount = static_cast<uint32_t>(snapshot.arenas.size());
+        return true;
+    }
+
+    // Nice 19 for this thread only (Linux applies nice values per thread).
+    // Not SCHED_IDLE: on a saturated host that would starve the sampler and
+    // stop the telemetry exactly when it is most interesting.
+    static void lowerPriority() {
+#ifdef __linux__
+        setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), 19);
+#endif
+    }
+};
+
+#endif
+
+Monitor::Monitor(const MonitorOptions& options) : options_(options), probe_(std::make_unique<Probe>()) {
+    sampler_ = std::thread(&Monitor::run, this);
+}
+
+Monitor::~Monitor() {
+    {
+        std::lock_guard<std::mutex> lock(stopMutex_);
+        stop_ = true;
+    }
+    stopRequested_.notify_one();
+    sampler_.join();
+}
+
+void Monitor::run() {
+    if (options_.lowPriority) {
+        Probe::lowerPriority();
+    }
+    Snapshot snapshot;
+    std::unique_lock<std::mutex> lock(stopMutex_);
+    while (!stop_) {
+        lock.unlock();
+        uint64_t start = CycleClock::now();
+        // A failed probe publishes nothing, so readers keep the last real sample.
+        if (probe_->sample(snapshot)) {
+            snapshot.sampleDurationNs = CycleClock::toNanoseconds(CycleClock::now() - start);
+            snapshot.timestampNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                                             std::chrono::system_clock::now().time_since_epoch())
+                                                             .count());
+            snapshot.externalFragmentationRatio =
+                snapshot.totalFreeOnHeap > 0
+                    ? 1.0 - static_cast<double>(snapshot.biggestFreeBlock) / snapshot.totalFreeOnHeap
+                    : 0.0;
+            ++snapshot.sampleCount;
+            published_.store(snapshot);
+        }
+        lock.lock();
+        stopRequested_.wait_for(lock, options_.interval, [this] { return stop_; });
+    }
+}
+
+} // namespace fragmon
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "seqlock.h"
+
+// libfragmon: fragmentation telemetry for the process it is linked into.
+//
+//     fragmon::Monitor monitor({std::chrono::seconds(5)});
+//     ...
+//     fragmon::Snapshot s = monitor.latest(); // From any thread, never blocks.
+//
+// A low-priority background thread inspects the process heap (malloc_info()
+// for glibc, a region-cached HeapWalk of the process heap on Windows) at a
+// fixed interval and publishes the result through a seqlock. Request threads
+// only ever read it.
+namespace fragmon {
+
+/**
+ * @brief The latest heap figures, the in-process counterpart of HeapStats.
+ *
+ * Only what can be known from outside the allocator is here: there are no
+ * requested sizes, so there is no internal fragmentation figure.
+ */
+struct Snapshot {
+    uint64_t sampleCount = 0;         // Successful samples so far; 0 means none yet.
+    uint64_t timestampNs = 0;         // Wall-clock time of the sample, ns since the Unix epoch.
+    uint64_t sampleDurationNs = 0;    // How long the inspection took (the monitor's own cost).
+    size_t totalFreeOnHeap = 0;       // Free memory the allocator is holding on to.
+    size_t biggestFreeBlock = 0;      // The largest single contiguous free block.
+    size_t heapCommitted = 0;         // Memory the heap has obtained from the OS.
+    double externalFragmentationRatio = 0; // 1 - biggest/total, as in the CSV.
+    uint32_t arenaCount = 0;          // glibc arenas, or Win32 heap regions.
+};
+
+struct MonitorOptions {
+    std::chrono::milliseconds interval{1000};
+    bool lowPriority = true; // Run the sampler at nice 19 (Linux) / lowest priority (Windows).
+};
+
+/**
+ * @brief Samples the process heap on a background thread until destroyed.
+ * Construct one per process; more would only take redundant samples.
+ */
+class Monitor {
+public:
+    explicit Monitor(const MonitorOptions& options = {});
+    ~Monitor();
+    Monitor(const Monitor&) = delete;
+    Monitor& operator=(const Monitor&) = delete;
+
+    // Wait-free for the sampler; readers retry only while a sample is being published.
+    Snapshot latest() const { return published_.load(); }
+
+private:
+    struct Probe; // Platform inspection state, kept out of this header.
+
+    void run();
+
+    MonitorOptions options_;
+    std::unique_ptr<Probe> probe_;
+    Seqlock<Snapshot> published_;
+    std::mutex stopMutex_;
+    std::condition_variable stopRequested_;
+    bool stop_ = false;
+    std::thread sampler_;
+};
+
+} // namespace fragmon
@@ -0,0 +1,197 @@
+#pragma once
+
+#include <cmath>
+#include <concepts>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "heap_stats.h"
+
+// What a backend can tell us about the free space it is holding on to.
+struct HeapInfo {
+    size_t totalFree = 0;        // Bytes the allocator owns but has not handed out.
+    size_t biggestFreeBlock = 0; // Largest single free block it could serve from.
+    // Some allocators cannot report their largest free block. Their
+    // ExternalFrag_Ratio is written as NaN rather than a made-up number.
+    bool biggestFreeBlockKnown = true;
+    std::vector<ArenaStats> arenas; // Filled in by backends with several arenas.
+    FreeBlockHistogram freeBlocks;  // Sizes of the free blocks behind totalFree, if known.
+};
+
+// 1 - biggest free block / total free: 0 when all free space is in one piece.
+inline double externalFragmentationRatio(const HeapInfo& info) {
+    if (!info.biggestFreeBlockKnown) {
+        return NAN;
+    }
+    return (info.totalFree > 0) ? (1.0 - (double)info.biggestFreeBlock / info.totalFree) : 0.0;
+}
+
+/**
+ * @brief The operations the simulation needs from an allocator.
+ *
+ * Backends are plain classes used as template policies: the simulation loop is
+ * instantiated once per backend, so alloc/free calls are direct (and usually
+ * inlined) calls with no virtual dispatch between the workload and the
+ * allocator being measured.
+ *
+ * Backends acquire their allocator in the constructor and throw
+ * std::runtime_error if that fails.
+ */
+template <typename Backend>
+concept HeapBackend = requires(Backend& backend, void* block, size_t size) {
+    { Backend::name } -> std::convertible_to<std::string_view>;
+    { backend.allocate(size) } -> std::same_as<void*>;
+    { backend.release(block) };
+    { backend.usableSize(block) } -> std::convertible_to<size_t>;
+    { backend.inspect() } -> std::same_as<HeapInfo>;
+};
+
+// Backends are assumed to be thread safe unless they declare
+// `static constexpr bool threadSafe = false;`.
+template <HeapBackend Backend>
+constexpr bool isThreadSafe() {
+    if constexpr (requires { Backend::threadSafe; }) {
+        return Backend::threadSafe;
+    } else {
+        return true;
+    }
+}
+
+// Optional extra: a backend may print allocator-specific detail after a run.
+template <typename Backend>
+concept DescribableHeapBackend = HeapBackend<Backend> && requires(const Backend& backend, std::ostream& out) {
+    { backend.describe(out) };
+};
+
+// How a backend's inspect() may trade accuracy for overhead (--inspect).
+enum class InspectionMode {
+    Full,       // Walk everything on every sample (the default).
+    Cached,     // Re-walk only the parts of the heap that changed, cheaply detected.
+    Background, // Walk on a helper thread; inspect() returns the previous walk.
+};
+
+// Optional extra: a backend may support inspection modes other than Full.
+template <typename Backend>
+concept ConfigurableHeapBackend = HeapBackend<Backend> && requires(Backend& backend, InspectionMode mode) {
+    { backend.setInspectionMode(mode) };
+};
+
+// Optional extra: a backend may expose allocator knobs (--tune NAME=VALUE).
+// setTunable() returns false for a name it does not know and throws
+// std::runtime_error if the allocator rejects the value. settings() lists
+// every knob the backend sets, defaults included, for the output header.
+template <typename Backend>
+concept TunableHeapBackend = HeapBackend<Backend> && requires(Backend& backend, const Backend& constBackend,
+                                                              std::string_view name, long value) {
+    { backend.setTunable(name, value) } -> std::same_as<bool>;
+    { constBackend.settings() } -> std::same_as<std::vector<std::pair<std::string, long>>>;
+};
+
+// Optional extra: a backend may report how many bytes of its free memory are
+// still resident (--residency), i.e. what a trim could give back to the OS.
+template <typename Backend>
+concept ResidencyHeapBackend = HeapBackend<Backend> && requires(Backend& backend) {
+    { backend.residentFreeBytes() } -> std::convertible_to<size_t>;
+};
+
+// Optional extra: a backend may return free memory to the OS on request
+// (--trim-every), like malloc_trim() or HeapCompact().
+template <typename Backend>
+concept TrimmableHeapBackend = HeapBackend<Backend> && requires(Backend& backend) {
+    { backend.trim() };
+};
+
+// Optional extra: a backend may put its heap on huge pages (--huge-pages),
+// like glibc.malloc.hugetlb or madvise(MADV_HUGEPAGE). Called before the
+// first allocation; throws std::runtime_error if the system will not allow it.
+template <typename Backend>
+concept HugePageHeapBackend = HeapBackend<Backend> && requires(Backend& backend) {
+    { backend.useHugePages() };
+};
+
+// Optional extra: a backend with several arenas may say which one served a
+// block, so latency can be split by arena. arenaOf() runs after every timed
+// call and must be cheap; it returns an opaque key, 0 for a block no arena
+// owns. arenaNumber() turns a key into the ArenaStats::arena number inspect()
+// reports, or -1 if it cannot.
+template <typename Backend>
+concept ArenaHeapBackend = HeapBackend<Backend> && requires(Backend& backend, void* block, uintptr_t key) {
+    { backend.arenaOf(block) } -> std::same_as<uintptr_t>;
+    { backend.arenaNumber(key) } -> std::same_as<int>;
+};
+
+// One stretch of a heap's address space, as listed by heapLayout().
+struct HeapSpan {
+    uintptr_t address;
+    uint64_t size;
+    bool busy; // Handed out (or held by the allocator itself), as opposed to free.
+};
+
+// Optional extra: a backend may list its heap block by block, in address
+// order (--layout-every). heapLayout() replaces the contents of @p spans and
+// should reuse its capacity rather than allocate on every call.
+template <typename Backend>
+concept LayoutHeapBackend = HeapBackend<Backend> && requires(Backend& backend, std::vector<HeapSpan>& spans) {
+    { backend.heapLayout(spans) };
+};
+
+// Optional extra: a backend may resize a block itself (realloc, HeapReAlloc),
+// growing it in place when the memory after it is free. Without it, the
+// simulation grows blocks by allocate + copy + release.
+template <typename Backend>
+concept ReallocHeapBackend = HeapBackend<Backend> && requires(Backend& backend, void* block, size_t size) {
+    { backend.reallocate(block, size) } -> std::same_as<void*>;
+};
+
+// Optional extra: a backend may hand out blocks aligned to a power of two
+// (posix_memalign, mallocx with MALLOCX_ALIGN, ...). Such blocks are freed with
+// release() and measured with usableSize() like any other. Without it, the
+// simulation only over-allocates by what _aligned_malloc would add, so the
+// padding cost is counted; the block it gets back is not actually aligned.
+template <typename Backend>
+concept AlignedHeapBackend = HeapBackend<Backend> && requires(Backend& backend, size_t size, size_t alignment) {
+    { backend.allocateAligned(size, alignment) } -> std::same_as<void*>;
+};
+
+// Optional extra: a backend may place a block in the most used part of its
+// heap that has room for it (the fullest partial slab, say) instead of where
+// allocate() would. The compactor (--compact-threshold) packs the blocks it
+// moves with it; without it, they go wherever allocate() puts them.
+template <typename Backend>
+concept DenseHeapBackend = HeapBackend<Backend> && requires(Backend& backend, size_t size) {
+    { backend.allocateDense(size) } -> std::same_as<void*>;
+};
+
+// Extra bytes an aligned block costs without AlignedHeapBackend: room to move
+// the start up to the alignment plus a pointer slot, as in _aligned_malloc.
+template <HeapBackend Backend>
+constexpr size_t alignmentOverhead(size_t alignment) {
+    if constexpr (AlignedHeapBackend<Backend>) {
+        return 0;
+    } else {
+        return alignment != 0 ? alignment - 1 + sizeof(void*) : 0;
+    }
+}
+
+/**
+ * @brief Allocates a block of @p size bytes, aligned to @p alignment unless it is 0.
+ *
+ * The result is what the backend returned, so release() and usableSize()
+ * take it whichever way it was made. The usable size of an over-allocated
+ * block includes the alignment overhead, so the padding is counted as
+ * internal fragmentation either way.
+ */
+template <HeapBackend Backend>
+void* allocateBlock(Backend& backend, size_t size, size_t alignment) {
+    if constexpr (AlignedHeapBackend<Backend>) {
+        if (alignment != 0) {
+            return backend.allocateAligned(size, alignment);
+        }
+    }
+    return backend.allocate(size + alignmentOverhead<Backend>(alignment));
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// Tail of one operation's latency during a timestep, in nanoseconds.
+struct LatencySummary {
+    uint64_t p50Ns = 0;
+    uint64_t p99Ns = 0;
+    uint64_t p999Ns = 0;
+    uint64_t maxNs = 0;
+};
+
+// Free-space figures for one arena of allocators that have several (glibc's
+// per-thread arenas, for instance).
+struct ArenaStats {
+    int arena;
+    size_t freeBytes;
+    size_t biggestFreeBlock;
+    // Calls whose block this arena served, for backends that can tell
+    // (ArenaHeapBackend); all zero otherwise.
+    LatencySummary allocLatency{};
+    LatencySummary freeLatency{};
+};
+
+// Cost of one pass over the live blocks (--locality), per block. NaN when not
+// measured; the miss counts also when the CPU's counters are not available.
+struct TraversalStats {
+    double ns = NAN;
+    double l1Misses = NAN;  // L1 data cache read misses.
+    double llcMisses = NAN; // Last-level cache read misses.
+    double dtlbMisses = NAN;
+};
+
+/**
+ * @brief Free blocks by size, in log2 buckets: bucket b holds blocks of
+ * [2^b, 2^(b+1)) bytes.
+ *
+ * A fixed array rather than a map, so taking a sample allocates nothing on the
+ * heap being measured. Backends that can only see groups of blocks (glibc's
+ * bins) file each group under its average block size.
+ */
+struct FreeBlockHistogram {
+    static constexpr int kBuckets = 48;
+
+    std::array<uint64_t, kBuckets> blocks{};
+    std::array<uint64_t, kBuckets> bytes{};
+
+    static int bucketOf(size_t size) {
+        int bucket = size > 0 ? static_cast<int>(std::bit_width(size)) - 1 : 0;
+        return bucket < kBuckets ? bucket : kBuckets - 1;
+    }
+
+    // Adds @p count blocks of @p totalBytes bytes together.
+    void add(size_t totalBytes, size_t count = 1) {
+        if (count == 0) {
+            return;
+        }
+        int bucket = bucketOf(totalBytes / count);
+        blocks[bucket] += count;
+        bytes[bucket] += totalBytes;
+    }
+
+    void merge(const FreeBlockHistogram& other) {
+        for (int b = 0; b < kBuckets; ++b) {
+            blocks[b] += other.blocks[b];
+            bytes[b] += other.bytes[b];
+        }
+    }
+
+    bool empty() const {
+        for (uint64_t count : blocks) {
+            if (count != 0) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief Share of the free bytes held in blocks of at least @p request bytes,
+     * i.e. free space that could serve a request of that size without growing
+     * the heap. Inside the bucket @p request falls in, bytes are assumed to be
+     * spread evenly over the bucket's range. NaN if there are no free blocks;
+     * for a @p request of 0, every free block fits.
+     */
+    double allocatableFraction(size_t request) const {
+        uint64_t total = 0;
+        double fit = 0;
+        int first = bucketOf(request);
+        for (int b = 0; b < kBuckets; ++b) {
+            total += bytes[b];
+            if (b > first) {
+                fit += static_cast<double>(bytes[b]);
+            }
+        }
+        if (total == 0) {
+            return NAN;
+        }
+        if (request == 0) {
+            return 1.0;
+        }
+        double low = std::ldexp(1.0, first);
+        double share = 1.0 - std::min(1.0, (static_cast<double>(request) - low) / low);
+        fit += static_cast<double>(bytes[first]) * share;
+        return fit / static_cast<double>(total);
+    }
+};
+
+// Data structure to hold all the metrics we collect at a single point in time.
+// Every backend fills in the same fields, so runs are directly comparable.
+struct HeapStats {
+    int timeStep;
+    size_t totalUserRequested;         // Sum of sizes the simulation asked for.
+    size_t totalHeapCommitted;         // Sum of actual sizes allocated by the heap manager.
+    size_t internalFragmentation;      // The difference between committed and requested.
+    size_t totalFreeOnHeap;            // Total free memory, in many small blocks.
+    size_t biggestFreeBlock;           // The largest single contiguous free block.
+    double externalFragmentationRatio; // A calculated metric (1 - biggest/total).
+    LatencySummary allocLatency;       // Latency of the allocate calls made since the previous sample.
+    LatencySummary freeLatency;        // Latency of the release calls made since the previous sample.
+    size_t residentSetBytes = 0;       // RSS / working set of the whole process after the step.
+    size_t residentFreeBytes = 0;      // Resident pages inside free blocks (--residency), else 0.
+    uint64_t trimNs = 0;               // Time spent in the trim this step (--trim-every), else 0.
+    int64_t trimReclaimedBytes = 0;    // RSS before the trim minus RSS after it.
+    uint64_t reallocations = 0;        // Blocks grown with realloc since the previous sample.
+    uint64_t reallocMoves = 0;         // Those that ended at a new address, i.e. were copied.
+    uint64_t reallocCopiedBytes = 0;   // Bytes those moves copied.
+    uint64_t reallocNs = 0;            // Time spent growing blocks, copies included.
+    size_t alignedFragmentation = 0;   // Part of internalFragmentation owned by aligned blocks.
+    uint64_t compactionNs = 0;         // Pause of the compaction after this sample (--compact-threshold), else 0.
+    uint64_t compactionMovedBlocks = 0; // Blocks it relocated.
+    uint64_t compactionMovedBytes = 0; // Bytes it copied doing so.
+    double compactionRatioAfter = NAN; // externalFragmentationRatio once compacted, NaN if it did not run.
+    TraversalStats allocationOrder;    // Visiting the live blocks oldest first (--locality).
+    TraversalStats randomOrder;        // Visiting them in a random order.
+    double liveGapBytes = NAN;         // Mean distance from one live block's end to the next one's start.
+    size_t anonHugePageBytes = 0;      // Process memory on transparent huge pages (--huge-page-stats).
+    uint64_t hugeRegionsFree = 0;      // 2 MiB regions of the heap with no busy bytes,
+    uint64_t hugeRegionsPartial = 0;   // with busy and free bytes,
+    uint64_t hugeRegionsFull = 0;      // and with no free bytes.
+    uint32_t sampleTrigger = 0;        // Why this step was sampled: SampleTrigger bits.
+    uint64_t sampleNs = 0;             // Time spent taking this sample: inspect() and the probes.
+    std::vector<ArenaStats> arenas;    // Per-arena breakdown, empty if the backend has none.
+    FreeBlockHistogram freeBlocks;     // Free block sizes, empty if the backend cannot tell.
+};
+
+// Anything the simulation loops can hand finished rows to: StatsWriter, or a
+// plain collector.
+template <typename Sink>
+concept StatsSink = requires(Sink& sink, HeapStats&& stats) {
+    { sink.write(std::move(stats)) };
+};
@@ -0,0 +1,93 @@
+#include "huge_pages.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+std::string transparentHugePageMode() {
+#ifdef _WIN32
+    return {};
+#else
+    std::FILE* file = std::fopen("/sys/kernel/mm/transparent_hugepage/enabled", "r");
+    if (!file) {
+        return {};
+    }
+    // The active choice is bracketed: "always [madvise] never".
+    char text[128] = {};
+    size_t length = std::fread(text, 1, sizeof(text) - 1, file);
+    std::fclose(file);
+    text[length] = '\0';
+    const char* open = std::strchr(text, '[');
+    const char* close = open ? std::strchr(open, ']') : nullptr;
+    return close ? std::string(open + 1, close) : std::string();
+#endif
+}
+
+size_t anonHugePageBytes() {
+#ifdef _WIN32
+    return 0;
+#else
+    // Kept open like /proc/self/statm: reading from offset 0 regenerates the numbers.
+    static int rollup = open("/proc/self/smaps_rollup", O_RDONLY | O_CLOEXEC);
+    char text[4096];
+    ssize_t length = rollup >= 0 ? pread(rollup, text, sizeof(text) - 1, 0) : -1;
+    if (length <= 0) {
+        return 0;
+    }
+    text[length] = '\0';
+    const char* line = std::strstr(text, "\nAnonHugePages:");
+    unsigned long long kilobytes = 0;
+    if (!line || std::sscanf(line + 1, "AnonHugePages: %llu kB", &kilobytes) != 1) {
+        return 0;
+    }
+    return static_cast<size_t>(kilobytes) * 1024;
+#endif
+}
+
+void HugePageProbe::classify(HeapStats& stats) const {
+    uint64_t freeRegions = 0;
+    uint64_t partialRegions = 0;
+    uint64_t fullRegions = 0;
+    uintptr_t region = 0;
+    uint64_t busyBytes = 0;
+    uint64_t freeBytes = 0;
+    auto finishRegion = [&] {
+        if (busyBytes == 0 && freeBytes == 0) {
+            return;
+        }
+        if (busyBytes == 0) {
+            ++freeRegions;
+        } else if (freeBytes == 0) {
+            ++fullRegions;
+        } else {
+            ++partialRegions;
+        }
+        busyBytes = 0;
+        freeBytes = 0;
+    };
+
+    for (const HeapSpan& span : spans_) {
+        uintptr_t address = span.address;
+        uintptr_t end = span.address + span.size;
+        while (address < end) {
+            uintptr_t spanRegion = address / kHugePageBytes;
+            if (spanRegion != region) {
+                finishRegion();
+                region = spanRegion;
+            }
+            uintptr_t pieceEnd = std::min<uintptr_t>(end, (spanRegion + 1) * kHugePageBytes);
+            (span.busy ? busyBytes : freeBytes) += pieceEnd - address;
+            address = pieceEnd;
+        }
+    }
+    finishRegion();
+
+    stats.hugeRegionsFree = freeRegions;
+    stats.hugeRegionsPartial = partialRegions;
+    stats.hugeRegionsFull = fullRegions;
+}
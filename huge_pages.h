@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "heap_backend.h"
+#include "heap_stats.h"
+
+// Size of a transparent huge page on x86-64 and most arm64 kernels.
+constexpr size_t kHugePageBytes = size_t{2} << 20;
+
+// The kernel's THP policy: "always", "madvise" or "never" from
+// /sys/kernel/mm/transparent_hugepage/enabled, empty where there is none.
+std::string transparentHugePageMode();
+
+// Bytes of the process's memory currently backed by transparent huge pages
+// (AnonHugePages in /proc/self/smaps_rollup). 0 if unavailable or not Linux.
+size_t anonHugePageBytes();
+
+/**
+ * @brief Fills in the huge-page figures of a sample (--huge-page-stats).
+ *
+ * The heap's spans from heapLayout() are cut at 2 MiB boundaries and every
+ * huge-page-sized region they touch is counted as fully free, partly used
+ * or fully used. A fully free region is one a trim could hand back whole; a
+ * partly used one is where fragmentation keeps a huge page from being given
+ * back, or keeps khugepaged from bothering to collapse it. Regions the heap
+ * only partly covers are judged on the part it covers.
+ *
+ * The span list is kept between calls, so a sample allocates nothing once it
+ * has grown to the heap's size.
+ */
+class HugePageProbe {
+public:
+    template <LayoutHeapBackend Backend>
+    void measure(Backend& backend, HeapStats& stats) {
+        backend.heapLayout(spans_);
+        classify(stats);
+        stats.anonHugePageBytes = anonHugePageBytes();
+    }
+
+private:
+    void classify(HeapStats& stats) const;
+
+    std::vector<HeapSpan> spans_;
+};
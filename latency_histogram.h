@@ -0,0 +1,117 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @brief Log-linear (HDR-style) histogram of latencies in clock ticks.
+ *
+ * Values below 64 get exact buckets; above that every power of two is split
+ * into 32 linear sub-buckets, so any recorded value is known to within ~3%.
+ * Recording is a couple of integer operations and one increment, and the
+ * whole range of uint64_t fits in a fixed array, so it never allocates. That
+ * includes values near 2^64, which a tick delta taken across two cores with
+ * unsynchronized TSCs can wrap around to.
+ *
+ * Each histogram has a single writer, the thread being timed. Counters are
+ * atomics updated with relaxed load + store rather than a locked
+ * read-modify-write, which costs the writer nothing over a plain increment
+ * but lets any other thread merge or read a histogram while it is being
+ * filled without tearing a counter. Readers see a consistent count per bucket,
+ * not a consistent snapshot across buckets.
+ */
+class LatencyHistogram {
+public:
+    static constexpr unsigned kSubBucketBits = 5;
+    static constexpr uint64_t kSubBuckets = uint64_t{1} << kSubBucketBits;
+    // 2 * kSubBuckets exact buckets, then kSubBuckets for each bit width from
+    // kSubBucketBits + 2 up to 64.
+    static constexpr size_t kBucketCount = (64 - kSubBucketBits + 1) * kSubBuckets;
+
+    void record(uint64_t ticks) {
+        bump(counts_[bucketOf(ticks)], 1);
+        bump(total_, 1);
+        if (ticks > max_.load(std::memory_order_relaxed)) {
+            max_.store(ticks, std::memory_order_relaxed);
+        }
+    }
+
+    // Adds @p other into this histogram; only this histogram's writer may call it.
+    void merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            bump(counts_[i], other.counts_[i].load(std::memory_order_relaxed));
+        }
+        bump(total_, other.total_.load(std::memory_order_relaxed));
+        uint64_t otherMax = other.max_.load(std::memory_order_relaxed);
+        if (otherMax > max_.load(std::memory_order_relaxed)) {
+            max_.store(otherMax, std::memory_order_relaxed);
+        }
+    }
+
+    void reset() {
+        for (auto& count : counts_) {
+            count.store(0, std::memory_order_relaxed);
+        }
+        total_.store(0, std::memory_order_relaxed);
+        max_.store(0, std::memory_order_relaxed);
+    }
+
+    uint64_t count() const { return total_.load(std::memory_order_relaxed); }
+
+    // Largest value recorded, exactly (not rounded to a bucket).
+    uint64_t max() const { return max_.load(std::memory_order_relaxed); }
+
+    /**
+     * @brief Returns the value at quantile @p q (0..1), as the midpoint of its bucket.
+     * Returns 0 when nothing was recorded.
+     */
+    uint64_t percentile(double q) const {
+        uint64_t total = count();
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(q * static_cast<double>(total));
+        if (rank >= total) {
+            rank = total - 1;
+        }
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBucketCount; ++i) {
+            seen += counts_[i].load(std::memory_order_relaxed);
+            if (seen > rank) {
+                // A bucket midpoint can overshoot the largest value actually seen.
+                uint64_t midpoint = bucketMidpoint(i);
+                return midpoint < max() ? midpoint : max();
+            }
+        }
+        return max();
+    }
+
+    static size_t bucketOf(uint64_t value) {
+        if (value < 2 * kSubBuckets) {
+            return static_cast<size_t>(value);
+        }
+        unsigned shift = static_cast<unsigned>(std::bit_width(value)) - 1 - kSubBucketBits;
+        return static_cast<size_t>((shift + 1) * kSubBuckets + ((value >> shift) - kSubBuckets));
+    }
+
+    static uint64_t bucketMidpoint(size_t bucket) {
+        if (bucket < 2 * kSubBuckets) {
+            return bucket;
+        }
+        unsigned shift = static_cast<unsigned>(bucket / kSubBuckets) - 1;
+        uint64_t lower = (kSubBuckets + bucket % kSubBuckets) << shift;
+        return lower + ((uint64_t{1} << shift) >> 1);
+    }
+
+private:
+    static void bump(std::atomic<uint64_t>& counter, uint64_t amount) {
+        counter.store(counter.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic<uint64_t>, kBucketCount> counts_{};
+    std::atomic<uint64_t> total_{0};
+    std::atomic<uint64_t> max_{0};
+};
@@ -0,0 +1,112 @@
+#include "layout_recorder.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace {
+
+void appendVarint(std::vector<uint8_t>& out, uint64_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+bool sameSpan(const HeapSpan& a, const HeapSpan& b) {
+    return a.address == b.address && a.size == b.size && a.busy == b.busy;
+}
+
+// Merges neighbouring spans in the same state, in place.
+void coalesce(std::vector<HeapSpan>& spans) {
+    size_t kept = 0;
+    for (const HeapSpan& span : spans) {
+        if (kept > 0) {
+            HeapSpan& last = spans[kept - 1];
+            if (last.busy == span.busy && last.address + last.size == span.address) {
+                last.size += span.size;
+                continue;
+            }
+        }
+        spans[kept++] = span;
+    }
+    spans.resize(kept);
+}
+
+} // namespace
+
+LayoutRecorder::LayoutRecorder(const std::string& path, const RunMetadata& metadata)
+    : path_(path), file_(std::fopen(path.c_str(), "wb")) {
+    if (!file_) {
+        throw std::runtime_error("could not open " + path + " for writing");
+    }
+    std::string metadataBlock = binaryMetadataBlock(metadata, sizeof(LayoutFilePrologue));
+    LayoutFilePrologue prologue;
+    std::memcpy(prologue.magic, kLayoutMagic, sizeof(prologue.magic));
+    prologue.version = kLayoutVersion;
+    prologue.headerBytes = static_cast<uint32_t>(sizeof(prologue) + metadataBlock.size());
+    failed_ |= std::fwrite(&prologue, sizeof(prologue), 1, file_) != 1;
+    failed_ |= std::fwrite(metadataBlock.data(), 1, metadataBlock.size(), file_) != metadataBlock.size();
+    bytes_ = prologue.headerBytes;
+}
+
+LayoutRecorder::~LayoutRecorder() { close(); }
+
+void LayoutRecorder::record(int timeStep) {
+    if (!file_) {
+        return;
+    }
+    coalesce(current_);
+    bool keyframe = snapshots_ % kKeyframeEvery == 0;
+
+    // Both snapshots are in address order, so one merge pass finds the changes.
+    removed_.clear();
+    added_.clear();
+    if (keyframe) {
+        added_ = current_;
+    } else {
+        size_t i = 0;
+        size_t j = 0;
+        while (i < previous_.size() || j < current_.size()) {
+            if (j == current_.size() || (i < previous_.size() && previous_[i].address < current_[j].address)) {
+                removed_.push_back(previous_[i++]);
+            } else if (i == previous_.size() || current_[j].address < previous_[i].address) {
+                added_.push_back(current_[j++]);
+            } else {
+                if (!sameSpan(previous_[i], current_[j])) {
+                    removed_.push_back(previous_[i]);
+                    added_.push_back(current_[j]);
+                }
+                ++i;
+                ++j;
+            }
+        }
+    }
+    payload_.clear();
+    for (const std::vector<HeapSpan>* list : {&removed_, &added_}) {
+        uintptr_t previousAddress = 0;
+        for (const HeapSpan& span : *list) {
+            appendVarint(payload_, span.address - previousAddress);
+            appendVarint(payload_, span.size << 1 | (span.busy ? 1 : 0));
+            previousAddress = span.address;
+        }
+    }
+
+    LayoutRecordHeader header{keyframe ? uint32_t{'K'} : uint32_t{'D'}, timeStep, removed_.size(), added_.size(),
+                              payload_.size()};
+    failed_ |= std::fwrite(&header, sizeof(header), 1, file_) != 1;
+    failed_ |= std::fwrite(payload_.data(), 1, payload_.size(), file_) != payload_.size();
+    failed_ |= std::fflush(file_) != 0;
+    bytes_ += sizeof(header) + payload_.size();
+    ++snapshots_;
+    std::swap(previous_, current_);
+}
+
+bool LayoutRecorder::close() {
+    if (file_) {
+        failed_ |= std::fclose(file_) != 0;
+        file_ = nullptr;
+    }
+    return !failed_;
+}
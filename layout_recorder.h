@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "heap_backend.h"
+#include "stats_writer.h"
+
+/**
+ * @brief Writes address-ordered heap layout snapshots (--layout-every) to a file.
+ *
+ * A backend fills spans() with heapLayout(), then record() merges adjacent
+ * spans in the same state and writes only what changed since the previous
+ * snapshot: the spans that went away and the spans that appeared. Every
+ * kKeyframeEvery-th snapshot is written in full, so a reader can start there.
+ *
+ *     char     magic[8] = "HEAPLAYT"
+ *     uint32   version, headerBytes
+ *     uint32   metadataBytes; char metadata[metadataBytes]  (as in stats files)
+ *     record[] at offset headerBytes:
+ *         uint32 kind ('K' keyframe, 'D' delta); int32 timeStep
+ *         uint64 removedSpans, addedSpans, payloadBytes
+ *         payload: removed spans, then added spans, each two LEB128 varints:
+ *                  address minus the previous span's address in the same list
+ *                  (the first is absolute), then size << 1 | busy
+ *
+ * Applying a delta removes the listed spans by address and inserts the added
+ * ones. Spans are in address order in both lists.
+ */
+class LayoutRecorder {
+public:
+    static constexpr int kKeyframeEvery = 64;
+
+    // Throws std::runtime_error if @p path cannot be created.
+    LayoutRecorder(const std::string& path, const RunMetadata& metadata);
+    ~LayoutRecorder();
+    LayoutRecorder(const LayoutRecorder&) = delete;
+    LayoutRecorder& operator=(const LayoutRecorder&) = delete;
+
+    // The buffer heapLayout() fills for the next record().
+    std::vector<HeapSpan>& spans() { return current_; }
+    void record(int timeStep);
+
+    // @return false if any write failed.
+    bool close();
+
+    const std::string& path() const { return path_; }
+    uint64_t snapshots() const { return snapshots_; }
+    uint64_t bytesWritten() const { return bytes_; }
+
+private:
+    std::string path_;
+    std::FILE* file_ = nullptr;
+    std::vector<HeapSpan> previous_;
+    std::vector<HeapSpan> current_;
+    std::vector<HeapSpan> removed_;
+    std::vector<HeapSpan> added_;
+    std::vector<uint8_t> payload_;
+    uint64_t snapshots_ = 0;
+    uint64_t bytes_ = 0;
+    bool failed_ = false;
+};
+
+// The fixed start of a layout file; the metadata block follows it.
+struct LayoutFilePrologue {
+    char magic[8];
+    uint32_t version;
+    uint32_t headerBytes;
+};
+static_assert(sizeof(LayoutFilePrologue) == 16);
+
+struct LayoutRecordHeader {
+    uint32_t kind;
+    int32_t timeStep;
+    uint64_t removedSpans;
+    uint64_t addedSpans;
+    uint64_t payloadBytes;
+};
+static_assert(sizeof(LayoutRecordHeader) == 32);
+
+inline constexpr char kLayoutMagic[8] = {'H', 'E', 'A', 'P', 'L', 'A', 'Y', 'T'};
+inline constexpr uint32_t kLayoutVersion = 1;
@@ -0,0 +1,185 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "checkpoint_stream.h"
+
+// One block the simulation currently owns.
+struct LiveBlock {
+    void* ptr;
+    size_t requested; // Size we asked the allocator for.
+    size_t usable;    // Size the allocator actually gave us (HeapSize / malloc_usable_size).
+    uint32_t alignment = 0; // Alignment asked for, 0 for a plain allocation.
+    uint32_t serial = 0;    // Allocation count of the table when the block was added.
+};
+
+// Stable reference to a table entry. It stays valid until that entry is
+// removed, however often other entries move; after that contains() is false.
+struct BlockRef {
+    uint32_t slot;
+    uint32_t generation;
+};
+
+/**
+ * @brief Table of live blocks with O(1) insertion and O(1) removal.
+ *
+ * Removal moves the last entry into the freed slot ("swap and pop"), so the
+ * order of entries is not stable, which is fine for random victim selection.
+ * Lifetime models that need to find a particular block later (oldest first,
+ * newest first, by deadline) hold on to the BlockRef returned by add() instead
+ * of an index. The table also keeps the running requested/usable totals, and
+ * the part of usable - requested owned by aligned blocks, so they stay in sync
+ * with its contents by construction.
+ */
+class LiveBlockTable {
+public:
+    BlockRef add(void* ptr, size_t requested, size_t usable, size_t alignment = 0) {
+        uint32_t slot;
+        if (freeSlots_.empty()) {
+            slot = static_cast<uint32_t>(slots_.size());
+            slots_.push_back({0, 0});
+        } else {
+            slot = freeSlots_.back();
+            freeSlots_.pop_back();
+        }
+        slots_[slot].index = static_cast<uint32_t>(blocks_.size());
+        blocks_.push_back({ptr, requested, usable, static_cast<uint32_t>(alignment), nextSerial_++});
+        owners_.push_back(slot);
+        count(blocks_.back(), true);
+        return {slot, slots_[slot].generation};
+    }
+
+    // Points the entry at @p index at a resized block; its BlockRef stays valid.
+    void resizeAt(size_t index, void* ptr, size_t requested, size_t usable) {
+        LiveBlock& block = blocks_[index];
+        count(block, false);
+        block.ptr = ptr;
+        block.requested = requested;
+        block.usable = usable;
+        count(block, true);
+    }
+
+    /**
+     * @brief Removes the entry at @p index and returns it.
+     * The caller is responsible for handing the pointer back to the allocator.
+     */
+    LiveBlock removeAt(size_t index) {
+        LiveBlock removed = blocks_[index];
+        uint32_t slot = owners_[index];
+        blocks_[index] = blocks_.back();
+        owners_[index] = owners_.back();
+        slots_[owners_[index]].index = static_cast<uint32_t>(index);
+        blocks_.pop_back();
+        owners_.pop_back();
+        ++slots_[slot].generation;
+        freeSlots_.push_back(slot);
+        count(removed, false);
+        return removed;
+    }
+
+    bool contains(BlockRef ref) const { return slots_[ref.slot].generation == ref.generation; }
+
+    // Removes a block by reference; @p ref must still be contained.
+    LiveBlock remove(BlockRef ref) { return removeAt(slots_[ref.slot].index); }
+
+    /**
+     * @brief Saves the entries, in order, with every slot and generation, so
+     * BlockRefs and indices into the table mean the same after load().
+     * Block addresses are not saved: they belong to the process.
+     */
+    void save(CheckpointWriter& out) const {
+        out.putVector(blocks_);
+        out.putVector(owners_);
+        out.putVector(slots_);
+        out.putVector(freeSlots_);
+        out.put(nextSerial_);
+    }
+
+    // Replaces the contents with saved ones, without blocks: attach() one to every entry.
+    void load(CheckpointReader& in) {
+        blocks_ = in.getVector<LiveBlock>();
+        owners_ = in.getVector<uint32_t>();
+        slots_ = in.getVector<Slot>();
+        freeSlots_ = in.getVector<uint32_t>();
+        nextSerial_ = in.get<uint32_t>();
+        for (LiveBlock& block : blocks_) {
+            block.ptr = nullptr;
+            block.usable = 0;
+        }
+        totalRequested_ = 0;
+        totalUsable_ = 0;
+        totalAlignedFragmentation_ = 0;
+    }
+
+    // Gives a loaded entry its new block, @p usable bytes for its requested size.
+    void attach(size_t index, void* ptr, size_t usable) {
+        LiveBlock& block = blocks_[index];
+        block.ptr = ptr;
+        block.usable = usable;
+        count(block, true);
+    }
+
+    void reserve(size_t count) {
+        blocks_.reserve(count);
+        owners_.reserve(count);
+    }
+    void clear() {
+        blocks_.clear();
+        owners_.clear();
+        // Invalidate every outstanding reference.
+        freeSlots_.clear();
+        for (uint32_t slot = 0; slot < slots_.size(); ++slot) {
+            ++slots_[slot].generation;
+            freeSlots_.push_back(slot);
+        }
+        totalRequested_ = 0;
+        totalUsable_ = 0;
+        totalAlignedFragmentation_ = 0;
+    }
+
+    size_t size() const { return blocks_.size(); }
+    bool empty() const { return blocks_.empty(); }
+    const LiveBlock& operator[](size_t index) const { return blocks_[index]; }
+    auto begin() const { return blocks_.begin(); }
+    auto end() const { return blocks_.end(); }
+
+    size_t totalRequested() const { return totalRequested_; }
+    size_t totalUsable() const { return totalUsable_; }
+    // Serial the next block will get. It wraps, so compare blocks by their age,
+    // nextSerial() - serial, which is exact below 2^32 allocations.
+    uint32_t nextSerial() const { return nextSerial_; }
+    // Internal fragmentation held by aligned blocks: usable - requested summed
+    // over them. It includes the size-class rounding a plain block of the same
+    // size would get, so it is not the cost of alignment alone.
+    size_t totalAlignedFragmentation() const { return totalAlignedFragmentation_; }
+
+private:
+    struct Slot {
+        uint32_t index;      // Position in blocks_ while the slot is in use.
+        uint32_t generation; // Bumped on removal, so stale BlockRefs no longer match.
+    };
+
+    std::vector<LiveBlock> blocks_;
+    std::vector<uint32_t> owners_;    // Slot of each entry in blocks_.
+    std::vector<Slot> slots_;
+    std::vector<uint32_t> freeSlots_;
+    size_t totalRequested_ = 0;
+    size_t totalUsable_ = 0;
+    size_t totalAlignedFragmentation_ = 0;
+    uint32_t nextSerial_ = 0;
+
+    void count(const LiveBlock& block, bool adding) {
+        size_t slack = block.alignment != 0 ? block.usable - block.requested : 0;
+        if (adding) {
+            totalRequested_ += block.requested;
+            totalUsable_ += block.usable;
+            totalAlignedFragmentation_ += slack;
+        } else {
+            totalRequested_ -= block.requested;
+            totalUsable_ -= block.usable;
+            totalAlignedFragmentation_ -= slack;
+        }
+    }
+};
@@ -0,0 +1,145 @@
+#include "locality_probe.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "cycle_clock.h"
+
+#ifdef __linux__
+#include <cstring>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef __linux__
+int openCacheCounter(uint64_t cache) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.config = cache | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    // This thread, on any CPU.
+    return static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, PERF_FLAG_FD_CLOEXEC));
+}
+#endif
+
+} // namespace
+
+CacheMissCounters::CacheMissCounters() {
+    fds_.fill(-1);
+#ifdef __linux__
+    fds_[0] = openCacheCounter(PERF_COUNT_HW_CACHE_L1D);
+    fds_[1] = openCacheCounter(PERF_COUNT_HW_CACHE_LL);
+    fds_[2] = openCacheCounter(PERF_COUNT_HW_CACHE_DTLB);
+#endif
+}
+
+CacheMissCounters::~CacheMissCounters() {
+#ifdef __linux__
+    for (int fd : fds_) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+bool CacheMissCounters::anyAvailable() const {
+    return std::any_of(fds_.begin(), fds_.end(), [](int fd) { return fd >= 0; });
+}
+
+void CacheMissCounters::start() {
+#ifdef __linux__
+    for (int fd : fds_) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+std::array<double, CacheMissCounters::kCount> CacheMissCounters::stop() {
+    std::array<double, kCount> misses;
+    misses.fill(NAN);
+#ifdef __linux__
+    for (size_t i = 0; i < kCount; ++i) {
+        if (fds_[i] < 0) {
+            continue;
+        }
+        ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t count = 0;
+        if (read(fds_[i], &count, sizeof(count)) == static_cast<ssize_t>(sizeof(count))) {
+            misses[i] = static_cast<double>(count);
+        }
+    }
+#endif
+    return misses;
+}
+
+void LocalityProbe::measure(std::span<LiveBlockTable* const> tables, HeapStats& stats) {
+    entries_.clear();
+    for (size_t t = 0; t < tables.size(); ++t) {
+        const LiveBlockTable& table = *tables[t];
+        for (const LiveBlock& block : table) {
+            uint32_t age = table.nextSerial() - block.serial;
+            entries_.push_back({(uint64_t{t} << 32) | (UINT32_MAX - age), reinterpret_cast<uintptr_t>(block.ptr),
+                                block.usable});
+        }
+    }
+    if (entries_.empty()) {
+        return;
+    }
+    if (!counters_ || countersThread_ != std::this_thread::get_id()) {
+        counters_ = std::make_unique<CacheMissCounters>();
+        countersThread_ = std::this_thread::get_id();
+    }
+
+    std::sort(entries_.begin(), entries_.end(), [](const Entry& a, const Entry& b) { return a.order < b.order; });
+    visits_.clear();
+    for (const Entry& entry : entries_) {
+        visits_.push_back(reinterpret_cast<void*>(entry.address));
+    }
+    stats.allocationOrder = traverse();
+
+    std::shuffle(visits_.begin(), visits_.end(), random_);
+    stats.randomOrder = traverse();
+
+    if (entries_.size() > 1) {
+        std::sort(entries_.begin(), entries_.end(),
+                  [](const Entry& a, const Entry& b) { return a.address < b.address; });
+        double gaps = 0;
+        for (size_t i = 1; i < entries_.size(); ++i) {
+            uintptr_t end = entries_[i - 1].address + entries_[i - 1].usable;
+            gaps += entries_[i].address > end ? static_cast<double>(entries_[i].address - end) : 0.0;
+        }
+        stats.liveGapBytes = gaps / static_cast<double>(entries_.size() - 1);
+    }
+}
+
+TraversalStats LocalityProbe::traverse() {
+    counters_->start();
+    uint64_t start = CycleClock::now();
+    for (void* block : visits_) {
+        (void)*static_cast<volatile unsigned char*>(block);
+    }
+    uint64_t ticks = CycleClock::now() - start;
+    std::array<double, CacheMissCounters::kCount> misses = counters_->stop();
+
+    double blocks = static_cast<double>(visits_.size());
+    TraversalStats result;
+    result.ns = static_cast<double>(ticks) * CycleClock::nanosecondsPerTick() / blocks;
+    result.l1Misses = misses[0] / blocks;
+    result.llcMisses = misses[1] / blocks;
+    result.dtlbMisses = misses[2] / blocks;
+    return result;
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <thread>
+#include <vector>
+
+#include "fast_random.h"
+#include "heap_stats.h"
+#include "live_block_table.h"
+
+/**
+ * @brief Hardware cache-miss counters of the calling thread: L1 data cache,
+ * last-level cache and data TLB read misses, opened with perf_event_open().
+ *
+ * Each counter is opened on its own, so a CPU or kernel that lacks one still
+ * gives the others. Counters the kernel refuses (perf_event_paranoid, most
+ * containers) and every counter on Windows, where the PMU is only reachable
+ * through a kernel driver, read as NaN.
+ */
+class CacheMissCounters {
+public:
+    static constexpr size_t kCount = 3; // L1, LLC, dTLB.
+
+    CacheMissCounters();
+    ~CacheMissCounters();
+    CacheMissCounters(const CacheMissCounters&) = delete;
+    CacheMissCounters& operator=(const CacheMissCounters&) = delete;
+
+    bool anyAvailable() const;
+    void start();
+    // Misses since start(), NaN for counters that are not available.
+    std::array<double, kCount> stop();
+
+private:
+    std::array<int, kCount> fds_;
+};
+
+/**
+ * @brief Measures what the heap layout costs a program that walks its objects (--locality).
+ *
+ * Each call visits every live block twice, reading the first byte (so one
+ * cache line) of each: first oldest first, which is the order a program
+ * would build and walk a list in, then in a random order. The loads do not
+ * depend on each other, as in a loop over an array of pointers, so the CPU
+ * may overlap misses. Blocks scattered over many pages and lines cost more
+ * per block, and the miss counters show which level pays. The random pass
+ * runs second, on whatever the first pass left in the cache; with a live set
+ * smaller than the cache both passes mostly hit.
+ *
+ * The address-locality score is the mean gap between consecutive live
+ * blocks in address order, from the end of one to the start of the next.
+ *
+ * The scratch lists are kept between calls, so apart from reopening the
+ * counters when the sampling thread changes, a call allocates nothing on
+ * the heap being measured once the live set has stopped growing.
+ */
+class LocalityProbe {
+public:
+    // Fills in the traversal and gap figures of @p stats from the blocks of @p tables.
+    void measure(std::span<LiveBlockTable* const> tables, HeapStats& stats);
+
+private:
+    struct Entry {
+        uint64_t order; // Table, then age: sorts oldest first within each table.
+        uintptr_t address;
+        size_t usable;
+    };
+
+    TraversalStats traverse();
+
+    std::vector<Entry> entries_;
+    std::vector<void*> visits_;
+    FastRandom random_{0x6c6f63616c697479}; // Fixed, so every sample shuffles alike.
+    std::unique_ptr<CacheMissCounters> counters_;
+    std::thread::id countersThread_;
+};
@@ -0,0 +1,494 @@
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <exception>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include "backend_registry.h"
+#include "checkpoint.h"
+#include "layout_recorder.h"
+#include "metrics_exporter.h"
+#include "options.h"
+#include "simulation.h"
+#include "stats_writer.h"
+#include "system_info.h"
+#include "threaded_simulation.h"
+#include "trace_replay.h"
+
+namespace {
+
+const char* inspectionName(InspectionMode mode) {
+    switch (mode) {
+    case InspectionMode::Cached:
+        return "cached";
+    case InspectionMode::Background:
+        return "background";
+    default:
+        return "full";
+    }
+}
+
+std::string formatNumber(double value) {
+    char text[32];
+    auto [end, ec] = std::to_chars(text, text + sizeof(text), value);
+    return std::string(text, end);
+}
+
+// The parameters of every phase, prefixed with phase<N>. when there are several,
+// so runs of different workloads never share a header.
+void addWorkloadMetadata(const WorkloadSpec& workload, RunMetadata& metadata) {
+    for (size_t i = 0; i < workload.phases.size(); ++i) {
+        const WorkloadPhase& phase = workload.phases[i];
+        std::string prefix = workload.phases.size() > 1 ? "phase" + std::to_string(i + 1) + "." : "";
+        metadata.emplace_back(prefix + "steps", std::to_string(phase.steps));
+        metadata.emplace_back(prefix + "allocs_per_step", std::to_string(phase.allocationsPerStep));
+        metadata.emplace_back(prefix + "frees_per_step", std::to_string(phase.freesPerStep));
+        metadata.emplace_back(prefix + "min_live_blocks", std::to_string(phase.minLiveBlocks));
+        metadata.emplace_back(prefix + "sizes", phase.sizes.spec());
+        metadata.emplace_back(prefix + "lifetime", phase.lifetime.spec);
+        if (phase.reallocationsPerStep > 0) {
+            metadata.emplace_back(prefix + "reallocs_per_step", std::to_string(phase.reallocationsPerStep));
+            metadata.emplace_back(prefix + "realloc_growth", formatNumber(phase.reallocGrowth));
+        }
+        if (phase.alignedPercent > 0) {
+            metadata.emplace_back(prefix + "aligned_percent", std::to_string(phase.alignedPercent));
+            metadata.emplace_back(prefix + "alignment", std::to_string(phase.alignment));
+        }
+    }
+}
+
+// What went into this run, for the header of the stats file.
+template <HeapBackend Backend>
+RunMetadata runMetadata(const Backend& backend, const Options& options) {
+    RunMetadata metadata = {
+        {"backend", std::string(Backend::name)},
+        {"seed", std::to_string(options.simulation.seed)},
+        {"threads", std::to_string(options.simulation.threads)},
+        {"inspect", inspectionName(options.inspection)},
+    };
+    if constexpr (TunableHeapBackend<Backend>) {
+        for (const auto& [setting, value] : backend.settings()) {
+            metadata.emplace_back("tune." + setting, std::to_string(value));
+        }
+    }
+    if (options.simulation.probes.residency) {
+        metadata.emplace_back("residency", "1");
+    }
+    if (options.simulation.probes.locality) {
+        metadata.emplace_back("locality", "1");
+    }
+    if (options.hugePages) {
+        metadata.emplace_back("huge_pages", "1");
+    }
+    if (options.simulation.probes.hugePageStats) {
+        metadata.emplace_back("huge_page_stats", "1");
+        metadata.emplace_back("thp", transparentHugePageMode());
+    }
+    if (options.simulation.probes.trimEvery > 0) {
+        metadata.emplace_back("trim_every", std::to_string(options.simulation.probes.trimEvery));
+    }
+    if (options.simulation.probes.layoutEvery > 0) {
+        metadata.emplace_back("layout_every", std::to_string(options.simulation.probes.layoutEvery));
+    }
+    const SamplingOptions& sampling = options.simulation.probes.sampling;
+    if (sampling.every != 1 || sampling.adaptive) {
+        metadata.emplace_back("sample_every", std::to_string(sampling.every));
+    }
+    if (sampling.adaptive) {
+        metadata.emplace_back("adaptive_sampling", "1");
+        metadata.emplace_back("sample_max_every", std::to_string(sampling.longestGap()));
+        metadata.emplace_back("sample_large_free", std::to_string(sampling.largeFreeBytes));
+        metadata.emplace_back("sample_internal_change", std::to_string(sampling.internalChangePercent));
+    }
+    if (options.simulation.compaction.threshold > 0) {
+        metadata.emplace_back("compact_threshold", std::to_string(options.simulation.compaction.threshold));
+    }
+    if (options.simulation.soak.durationSeconds > 0) {
+        metadata.emplace_back("duration", std::to_string(options.simulation.soak.durationSeconds));
+    }
+    if (options.simulation.soak.checkpointEvery > 0) {
+        metadata.emplace_back("checkpoint_every", std::to_string(options.simulation.soak.checkpointEvery));
+    }
+    if (const char* tunables = std::getenv("GLIBC_TUNABLES")) {
+        metadata.emplace_back("glibc_tunables", tunables);
+    }
+    if (!options.replay.path.empty()) {
+        metadata.emplace_back("replay", options.replay.path);
+        metadata.emplace_back("events_per_step", std::to_string(options.replay.eventsPerStep));
+        if (options.replay.startSeconds > 0) {
+            metadata.emplace_back("replay_start", formatNumber(options.replay.startSeconds));
+        }
+        if (options.replay.endSeconds >= 0) {
+            metadata.emplace_back("replay_end", formatNumber(options.replay.endSeconds));
+        }
+    } else {
+        if (!options.workloadPath.empty()) {
+            metadata.emplace_back("workload", options.workloadPath);
+        }
+        addWorkloadMetadata(options.simulation.workload, metadata);
+        if (options.simulation.threads > 1) {
+            metadata.emplace_back("cross_thread_free_percent",
+                                  std::to_string(options.simulation.crossThreadFreePercent));
+        }
+    }
+    for (auto& entry : systemMetadata()) {
+        metadata.push_back(std::move(entry));
+    }
+    metadata.emplace_back("command", options.commandLine);
+    return metadata;
+}
+
+// heap_fragmentation_stats.csv -> heap_fragmentation_stats_layout.bin (with ".bin" as @p extension)
+std::string companionPathWithExtension(const std::string& outputPath, const std::string& suffix,
+                                       const std::string& extension) {
+    std::string path = companionPath(outputPath, suffix);
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+        path.erase(dot);
+    }
+    return path + extension;
+}
+
+// The run's stats writer, continuing the files of the checkpoint if it resumes one.
+StatsWriter openStatsWriter(const Options& options, RunMetadata metadata) {
+    if (const Checkpoint* resume = options.simulation.soak.resume) {
+        return StatsWriter(options.outputPath, options.format, std::move(metadata), options.fitSizes, resume->stats);
+    }
+    return StatsWriter(options.outputPath, options.format, std::move(metadata), options.fitSizes);
+}
+
+/**
+ * @brief Replaces @p options with those of the run @p checkpoint was taken of,
+ * keeping a --duration given with --resume.
+ * @return false if they no longer parse, with the reason in @p error.
+ */
+bool resumeOptions(const Checkpoint& checkpoint, const char* program, Options& options, std::string& error) {
+    std::vector<std::string> arguments = checkpoint.arguments;
+    arguments.insert(arguments.begin(), program);
+    std::vector<char*> argv;
+    for (std::string& argument : arguments) {
+        argv.push_back(argument.data());
+    }
+    Options resumed;
+    if (!parseOptions(static_cast<int>(argv.size()), argv.data(), resumed, error)) {
+        error = "the checkpoint's options do not parse: " + error;
+        return false;
+    }
+    if (options.durationGiven) {
+        resumed.simulation.soak.durationSeconds = options.simulation.soak.durationSeconds;
+    }
+    resumed.resumePath = options.resumePath;
+    options = std::move(resumed);
+    return true;
+}
+
+#ifndef _WIN32
+/**
+ * @brief Makes sure GLIBC_TUNABLES holds every --glibc-tunable entry.
+ * The dynamic loader reads it only at startup, so when something is missing
+ * it is added and the program re-executes itself; after that the entries are
+ * present and this returns true. Returns false if the re-exec failed.
+ */
+bool applyGlibcTunables(const std::vector<std::string>& tunables, char** argv, std::string& error) {
+    const char* current = std::getenv("GLIBC_TUNABLES");
+    std::string value = current ? current : "";
+    bool changed = false;
+    for (const std::string& tunable : tunables) {
+        bool present = false;
+        for (size_t begin = 0; begin <= value.size() && !present;) {
+            size_t end = std::min(value.find(':', begin), value.size());
+            present = std::string_view(value).substr(begin, end - begin) == tunable;
+            begin = end + 1;
+        }
+        if (!present) {
+            value += (value.empty() ? "" : ":") + tunable;
+            changed = true;
+        }
+    }
+    if (!changed) {
+        return true;
+    }
+    setenv("GLIBC_TUNABLES", value.c_str(), 1);
+    execv("/proc/self/exe", argv);
+    error = "could not restart with GLIBC_TUNABLES=" + value + ": " + std::strerror(errno);
+    return false;
+}
+#endif
+
+/**
+ * @brief Runs the whole experiment for one backend type.
+ * Instantiated per backend, so the simulation loop calls it directly.
+ */
+template <HeapBackend Backend>
+int runWithBackend(const Options& options) {
+    if (options.simulation.threads > 1 && !isThreadSafe<Backend>()) {
+        std::cerr << "Error: the " << Backend::name << " backend is single-threaded; drop --threads." << std::endl;
+        return 2;
+    }
+    Backend backend;
+    // Tunables may replace the heap, so they go before anything else touches it.
+    for (const auto& [setting, value] : options.tunables) {
+        if constexpr (TunableHeapBackend<Backend>) {
+            if (!backend.setTunable(setting, value)) {
+                std::cerr << "Error: the " << Backend::name << " backend has no setting '" << setting << "'."
+                          << std::endl;
+                return 2;
+            }
+        } else {
+            std::cerr << "Error: the " << Backend::name << " backend does not support --tune." << std::endl;
+            return 2;
+        }
+    }
+    if (options.inspection != InspectionMode::Full) {
+        if constexpr (ConfigurableHeapBackend<Backend>) {
+            backend.setInspectionMode(options.inspection);
+        } else {
+            std::cerr << "Error: the " << Backend::name << " backend only supports --inspect full." << std::endl;
+            return 2;
+        }
+    }
+    if (options.simulation.probes.residency && !ResidencyHeapBackend<Backend>) {
+        std::cerr << "Error: the " << Backend::name << " backend does not support --residency." << std::endl;
+        return 2;
+    }
+    if (options.simulation.probes.trimEvery > 0 && !TrimmableHeapBackend<Backend>) {
+        std::cerr << "Error: the " << Backend::name << " backend does not support --trim-every." << std::endl;
+        return 2;
+    }
+    if (options.simulation.probes.layoutEvery > 0 && !LayoutHeapBackend<Backend>) {
+        std::cerr << "Error: the " << Backend::name << " backend does not support --layout-every." << std::endl;
+        return 2;
+    }
+    // The 2 MiB regions are found from the heap's layout.
+    if (options.simulation.probes.hugePageStats && !LayoutHeapBackend<Backend>) {
+        std::cerr << "Error: the " << Backend::name << " backend does not support --huge-page-stats." << std::endl;
+        return 2;
+    }
+    if (options.hugePages) {
+        if constexpr (HugePageHeapBackend<Backend>) {
+            backend.useHugePages();
+        } else {
+            std::cerr << "Error: the " << Backend::name << " backend does not support --huge-pages." << std::endl;
+            return 2;
+        }
+    }
+
+    if (options.checkOnly) {
+        std::cout << "The " << Backend::name << " backend supports these options." << std::endl;
+        return 0;
+    }
+
+    // Rows are streamed to disk by a writer thread as the run goes.
+    RunMetadata metadata = runMetadata(backend, options);
+    StatsWriter writer = openStatsWriter(options, metadata);
+    std::cout << (options.simulation.soak.resume ? "Appending statistics to " : "Writing statistics to ")
+              << options.outputPath << " as the run goes." << std::endl;
+    std::unique_ptr<MetricsExporter> exporter;
+    if (options.metrics.enabled()) {
+        exporter = std::make_unique<MetricsExporter>(options.metrics, metadata, options.fitSizes);
+        if (!options.metrics.sharedMemoryName.empty()) {
+            std::cout << "Publishing the latest row in shared memory " << options.metrics.sharedMemoryName << "."
+                      << std::endl;
+        }
+        if (!options.metrics.listenAddress.empty()) {
+            std::cout << "Serving metrics on port " << exporter->port() << " at /metrics." << std::endl;
+        }
+    }
+    ExportingSink<StatsWriter> sink(writer, exporter.get());
+    SimulationOptions simulation = options.simulation;
+    ReplayOptions replay = options.replay;
+    std::unique_ptr<LayoutRecorder> layout;
+    if (simulation.probes.layoutEvery > 0) {
+        layout = std::make_unique<LayoutRecorder>(companionPathWithExtension(options.outputPath, "_layout", ".bin"), metadata);
+        simulation.probes.layout = layout.get();
+        replay.probes.layout = layout.get();
+    }
+    std::unique_ptr<SiteAttribution> sites;
+    if (options.sites.enabled()) {
+        sites = std::make_unique<SiteAttribution>(options.sites);
+        replay.sites = sites.get();
+    }
+    std::unique_ptr<Checkpointer> checkpointer;
+    if (simulation.soak.checkpointEvery > 0) {
+        checkpointer = std::make_unique<Checkpointer>(
+            companionPathWithExtension(options.outputPath, "_checkpoint", ".bin"), options.arguments, writer);
+        simulation.soak.checkpointer = checkpointer.get();
+        std::cout << "Checkpointing every " << simulation.soak.checkpointEvery << " steps to " << checkpointer->path()
+                  << "." << std::endl;
+    }
+    HugePageProbe hugePages;
+    if (simulation.probes.hugePageStats) {
+        simulation.probes.hugePages = &hugePages;
+        replay.probes.hugePages = &hugePages;
+    }
+    if (!options.replay.path.empty()) {
+        std::cout << "Replaying " << options.replay.path << " on the " << Backend::name << " backend..." << std::endl;
+        ReplaySummary summary;
+        replayTrace(backend, replay, sink, summary);
+        std::cout << "Replayed " << summary.events << " events: "
+                  << summary.allocations << " allocations, "
+                  << summary.frees << " frees, "
+                  << summary.reallocations << " reallocations ("
+                  << summary.unmatchedFrees << " frees of unknown blocks, "
+                  << summary.corruptChunks << " corrupt chunks)." << std::endl;
+        if (summary.indexRebuilt) {
+            std::cout << "Note: the trace had no chunk index (recording cut short?); it was rebuilt." << std::endl;
+        }
+        if (sites) {
+            std::string sitesPath = companionPathWithExtension(options.outputPath, "_sites", ".csv");
+            sites->write(sitesPath, metadata);
+            sites->printTop(std::cout);
+            std::cout << "Every call site written to " << sitesPath << "." << std::endl;
+        }
+    } else {
+        std::cout << "Running memory simulation for " << options.simulation.workload.totalSteps()
+                  << " timesteps on the " << Backend::name << " backend";
+        if (options.simulation.workload.phases.size() > 1) {
+            std::cout << " in " << options.simulation.workload.phases.size() << " phases";
+        }
+        if (options.simulation.threads > 1) {
+            std::cout << " with " << options.simulation.threads << " threads";
+        }
+        if (options.simulation.soak.durationSeconds > 0) {
+            std::cout << ", for at most " << options.simulation.soak.durationSeconds << " s";
+        }
+        std::cout << "..." << std::endl;
+        if (const Checkpoint* resume = options.simulation.soak.resume) {
+            std::cout << "Resuming from step " << resume->nextStep << ", after " << resume->elapsedSeconds
+                      << " s, with " << resume->stats.rows << " rows written so far." << std::endl;
+        }
+        if (options.simulation.probes.locality && !CacheMissCounters().anyAvailable()) {
+            std::cout << "Note: no cache-miss counters available here; the Traverse*Miss columns will be NaN."
+                      << std::endl;
+        }
+        if (options.simulation.threads > 1) {
+            runThreadedSimulation(backend, simulation, sink);
+        } else {
+            runSimulation(backend, simulation, sink);
+        }
+    }
+
+    if constexpr (DescribableHeapBackend<Backend>) {
+        backend.describe(std::cout);
+    }
+
+    if (!writer.close()) {
+        std::cerr << "Error: Could not write " << options.outputPath << "." << std::endl;
+        return 1;
+    }
+    std::cout << "Simulation Complete. Wrote " << writer.rowsWritten() << " rows to " << options.outputPath << "."
+              << std::endl;
+    if (writer.wroteArenas()) {
+        std::cout << "Per-arena breakdown written to " << writer.arenaPath() << "." << std::endl;
+    }
+    if (writer.wroteFreeBlocks()) {
+        std::cout << "Free block histogram written to " << writer.freeBlockPath() << "." << std::endl;
+    }
+    if (checkpointer && checkpointer->saved() > 0) {
+        std::cout << "Saved " << checkpointer->saved() << " checkpoints to " << checkpointer->path()
+                  << ", the last one at step " << checkpointer->lastStep() << "." << std::endl;
+    }
+    if (layout) {
+        if (!layout->close()) {
+            std::cerr << "Error: Could not write " << layout->path() << "." << std::endl;
+            return 1;
+        }
+        std::cout << "Wrote " << layout->snapshots() << " layout snapshots (" << layout->bytesWritten()
+                  << " bytes) to " << layout->path() << "." << std::endl;
+    }
+    return 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    Options options;
+    std::string error;
+    if (!parseOptions(argc, argv, options, error)) {
+        std::cerr << "Error: " << error << "\n";
+        printUsage(std::cerr, argv[0]);
+        return 2;
+    }
+    if (options.showHelp) {
+        printUsage(std::cout, argv[0]);
+        return 0;
+    }
+    if (options.listBackends) {
+        AvailableBackends::forEach([]<HeapBackend Backend>() { std::cout << Backend::name << "\n"; });
+        return 0;
+    }
+
+    // Kept for the whole run: the simulation loads its state from it.
+    Checkpoint checkpoint;
+    if (!options.resumePath.empty()) {
+        try {
+            checkpoint = readCheckpoint(options.resumePath);
+        } catch (const std::exception& e) {
+            std::cerr << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+        if (!resumeOptions(checkpoint, argv[0], options, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 2;
+        }
+        options.simulation.soak.resume = &checkpoint;
+    }
+
+    std::string backendName = options.backend.empty() ? std::string(SystemBackend::name) : options.backend;
+#ifndef _WIN32
+    // glibc only reads its huge-page setting at startup, so it goes in with the other tunables.
+    if (options.hugePages && backendName == GlibcBackend::name) {
+        options.glibcTunables.push_back("glibc.malloc.hugetlb=1");
+    }
+#endif
+
+    if (!options.glibcTunables.empty()) {
+#ifdef _WIN32
+        std::cerr << "Error: --glibc-tunable needs glibc." << std::endl;
+        return 2;
+#else
+        if (!applyGlibcTunables(options.glibcTunables, argv, error)) {
+            std::cerr << "Error: " << error << std::endl;
+            return 1;
+        }
+#endif
+    }
+
+    // Seed the workload generator. A checkpoint's command line names the seed, so a resume gets the same one.
+    options.simulation.seed = options.seedGiven ? options.seed : static_cast<unsigned int>(std::time(nullptr));
+    if (!options.seedGiven) {
+        options.arguments.push_back("--seed");
+        options.arguments.push_back(std::to_string(options.simulation.seed));
+    }
+
+    int exitCode = 0;
+    try {
+        bool found = AvailableBackends::dispatch(backendName, [&]<HeapBackend Backend>() {
+            exitCode = runWithBackend<Backend>(options);
+        });
+        if (!found) {
+            std::cerr << "Error: backend '" << backendName << "' is not available in this build.\n";
+            return 2;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+
+    if (exitCode == 0) {
+        std::cout << "Done.\n";
+    }
+    return exitCode;
+}
@@ -0,0 +1,247 @@
+#include "malloc_info_scanner.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdio>
+#include <cstring>
+
+#include <malloc.h>
+
+namespace {
+
+template <size_t N>
+bool equals(const char* text, size_t length, const char (&literal)[N]) {
+    return length == N - 1 && std::memcmp(text, literal, N - 1) == 0;
+}
+
+// The handful of attributes malloc_info() emits. A tag only ever uses a few of
+// them; the rest stay zero.
+struct Attributes {
+    size_t from = 0;
+    size_t to = 0;
+    size_t total = 0;
+    size_t count = 0;
+    size_t size = 0;
+    int nr = 0;
+    const char* type = nullptr;
+    size_t typeLength = 0;
+};
+
+template <typename T>
+void toNumber(const char* begin, const char* end, T& value) {
+    std::from_chars(begin, end, value);
+}
+
+/**
+ * @brief Reads `key="value"` pairs up to the end of the current tag.
+ * @return A pointer just past the closing '>' (or @p end if the tag is cut off).
+ */
+const char* parseAttributes(const char* p, const char* end, Attributes& attrs) {
+    while (p < end && *p != '>') {
+        if (*p == ' ' || *p == '\t' || *p == '\n' || *p == '/') {
+            ++p;
+            continue;
+        }
+
+        const char* key = p;
+        while (p < end && *p != '=' && *p != '>' && *p != ' ') {
+            ++p;
+        }
+        size_t keyLength = p - key;
+        if (p >= end || *p != '=') {
+            continue;
+        }
+        if (p + 1 >= end) {
+            return end;
+        }
+        if (p[1] != '"') {
+            // Unquoted value: skip it, so the next pass does not stop on this '=' again.
+            ++p;
+            while (p < end && *p != ' ' && *p != '\t' && *p != '\n' && *p != '>') {
+                ++p;
+            }
+            continue;
+        }
+        p += 2;
+
+        const char* value = p;
+        while (p < end && *p != '"') {
+            ++p;
+        }
+        const char* valueEnd = p;
+        if (p < end) {
+            ++p;
+        }
+
+        if (equals(key, keyLength, "from")) {
+            toNumber(value, valueEnd, attrs.from);
+        } else if (equals(key, keyLength, "to")) {
+            toNumber(value, valueEnd, attrs.to);
+        } else if (equals(key, keyLength, "total")) {
+            toNumber(value, valueEnd, attrs.total);
+        } else if (equals(key, keyLength, "count")) {
+            toNumber(value, valueEnd, attrs.count);
+        } else if (equals(key, keyLength, "size")) {
+            toNumber(value, valueEnd, attrs.size);
+        } else if (equals(key, keyLength, "nr")) {
+            toNumber(value, valueEnd, attrs.nr);
+        } else if (equals(key, keyLength, "type")) {
+            attrs.type = value;
+            attrs.typeLength = valueEnd - value;
+        }
+    }
+    return p < end ? p + 1 : end;
+}
+
+// Running sums for the arena currently being parsed.
+struct ArenaTotals {
+    size_t binBytes = 0;  // Sum of every <size>/<unsorted> total, fastbins included.
+    size_t fastCount = 0;
+    size_t restBytes = 0; // <total type="rest">: regular bins plus the top chunk.
+    size_t restCount = 0;
+};
+
+void finishArena(ArenaFreeInfo& arena, const ArenaTotals& totals, FreeBlockHistogram& freeBlocks) {
+    // glibc never lists the top chunk in <sizes>, but it does count it in
+    // <total type="rest">. Whatever "rest" has beyond the regular bins is top.
+    size_t regularBins = totals.binBytes - std::min(totals.binBytes, arena.fastBytes);
+    arena.topBytes = totals.restBytes > regularBins ? totals.restBytes - regularBins : 0;
+    arena.freeBytes = arena.fastBytes + totals.restBytes;
+    arena.freeChunks = totals.fastCount + totals.restCount;
+    arena.biggestFreeBlock = std::max(arena.biggestFreeBlock, arena.topBytes);
+    freeBlocks.add(arena.topBytes);
+}
+
+} // namespace
+
+MallocInfoScanner::MallocInfoScanner(size_t initialCapacity)
+    : buffer_(std::max<size_t>(initialCapacity, 256)) {}
+
+bool MallocInfoScanner::sample(MallocInfoSnapshot& out) {
+    for (;;) {
+        FILE* stream = fmemopen(buffer_.data(), buffer_.size(), "w");
+        if (!stream) {
+            perror("fmemopen failed");
+            return false;
+        }
+        // Unbuffered, so malloc_info() writes straight into buffer_ and stdio
+        // does not allocate a staging buffer on the heap we are measuring.
+        setvbuf(stream, nullptr, _IONBF, 0);
+
+        malloc_info(0, stream);
+        long written = ftell(stream);
+        bool truncated = ferror(stream) || written < 0 ||
+                         static_cast<size_t>(written) >= buffer_.size();
+        fclose(stream);
+
+        if (!truncated) {
+            parse(buffer_.data(), buffer_.data() + written, out);
+            return true;
+        }
+        // The document did not fit: grow and take the sample again.
+        buffer_.resize(buffer_.size() * 2);
+    }
+}
+
+void MallocInfoScanner::parse(const char* begin, const char* end, MallocInfoSnapshot& out) {
+    out.arenas.clear();
+    out.totalFree = 0;
+    out.biggestFreeBlock = 0;
+    out.freeBlocks = FreeBlockHistogram{};
+    out.mmapBytes = 0;
+    out.systemCurrent = 0;
+    out.systemMax = 0;
+
+    bool inArena = false;
+    ArenaTotals totals;
+    size_t globalFast = 0;
+    size_t globalRest = 0;
+
+    const char* p = begin;
+    while (p < end) {
+        p = static_cast<const char*>(std::memchr(p, '<', end - p));
+        if (!p) {
+            break;
+        }
+        ++p;
+
+        bool closing = p < end && *p == '/';
+        if (closing) {
+            ++p;
+        }
+        const char* name = p;
+        while (p < end && ((*p >= 'a' && *p <= 'z') || (*p >= 'A' && *p <= 'Z'))) {
+            ++p;
+        }
+        size_t nameLength = p - name;
+
+        if (closing) {
+            if (inArena && equals(name, nameLength, "heap")) {
+                finishArena(out.arenas.back(), totals, out.freeBlocks);
+                inArena = false;
+            }
+            continue;
+        }
+
+        Attributes attrs;
+        p = parseAttributes(p, end, attrs);
+
+        if (equals(name, nameLength, "heap")) {
+            out.arenas.emplace_back();
+            out.arenas.back().arena = attrs.nr;
+            totals = ArenaTotals{};
+            inArena = true;
+        } else if (equals(name, nameLength, "size") || equals(name, nameLength, "unsorted")) {
+            if (inArena && attrs.count > 0) {
+                ArenaFreeInfo& arena = out.arenas.back();
+                totals.binBytes += attrs.total;
+                // "to" is the largest chunk seen in the bin; it can never
+                // exceed the bin's total.
+                size_t largest = std::min(attrs.to, attrs.total);
+                arena.biggestFreeBlock = std::max(arena.biggestFreeBlock, largest);
+                // A bin only gives its count and total, so its chunks are
+                // filed under their average size.
+                out.freeBlocks.add(attrs.total, attrs.count);
+            }
+        } else if (equals(name, nameLength, "total")) {
+            const char* type = attrs.type;
+            size_t typeLength = attrs.typeLength;
+            if (equals(type, typeLength, "fast")) {
+                if (inArena) {
+                    out.arenas.back().fastBytes = attrs.size;
+                    totals.fastCount = attrs.count;
+                } else {
+                    globalFast = attrs.size;
+                }
+            } else if (equals(type, typeLength, "rest")) {
+                if (inArena) {
+                    totals.restBytes = attrs.size;
+                    totals.restCount = attrs.count;
+                } else {
+                    globalRest = attrs.size;
+                }
+            } else if (equals(type, typeLength, "mmap")) {
+                out.mmapBytes = attrs.size;
+            }
+        } else if (equals(name, nameLength, "system")) {
+            bool current = equals(attrs.type, attrs.typeLength, "current");
+            bool max = equals(attrs.type, attrs.typeLength, "max");
+            if (inArena) {
+                if (current) {
+                    out.arenas.back().systemCurrent = attrs.size;
+                } else if (max) {
+                    out.arenas.back().systemMax = attrs.size;
+                }
+            } else if (current) {
+                out.systemCurrent = attrs.size;
+            } else if (max) {
+                out.systemMax = attrs.size;
+            }
+        }
+    }
+
+    out.totalFree = globalFast + globalRest;
+    for (const ArenaFreeInfo& arena : out.arenas) {
+        out.biggestFreeBlock = std::max(out.biggestFreeBlock, arena.biggestFreeBlock);
+    }
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+#include "heap_stats.h"
+
+// Free-space figures for one glibc arena, i.e. one <heap nr="..."> section of
+// the malloc_info() XML.
+struct ArenaFreeInfo {
+    int arena = 0;                // The "nr" attribute of the <heap> tag.
+    size_t freeBytes = 0;         // Fastbins + regular bins + top chunk.
+    size_t freeChunks = 0;        // Number of free chunks (top included).
+    size_t fastBytes = 0;         // Bytes parked in fastbins.
+    size_t topBytes = 0;          // Size of the top chunk (derived, not reported directly).
+    size_t biggestFreeBlock = 0;  // Largest chunk that is free, top included.
+    size_t systemCurrent = 0;     // <system type="current">: bytes obtained from the OS.
+    size_t systemMax = 0;         // <system type="max">: high-water mark of the above.
+};
+
+// Everything we pull out of a single malloc_info() call.
+struct MallocInfoSnapshot {
+    std::vector<ArenaFreeInfo> arenas; // One entry per arena, in output order.
+    size_t totalFree = 0;              // Sum of free bytes over all arenas.
+    size_t biggestFreeBlock = 0;       // Largest free chunk over all arenas.
+    FreeBlockHistogram freeBlocks;     // Every bin of every arena, plus the top chunks.
+    size_t mmapBytes = 0;              // <total type="mmap">: directly mmapped chunks.
+    size_t systemCurrent = 0;          // Process-wide <system type="current">.
+    size_t systemMax = 0;              // Process-wide <system type="max">.
+};
+
+/**
+ * @brief Single-pass scanner for the XML written by glibc's malloc_info().
+ *
+ * The scanner owns a reusable output buffer which malloc_info() writes into via
+ * fmemopen(). If the output does not fit, the buffer is doubled and the call is
+ * repeated, so there is no upper bound on the heap complexity we can describe.
+ * Once the buffer has reached its working size, sampling performs no heap
+ * allocations of its own besides the FILE object libc creates for fmemopen().
+ *
+ * Parsing works directly on the raw characters: no regex, no std::string, and
+ * numbers are converted in place with std::from_chars.
+ */
+class MallocInfoScanner {
+public:
+    explicit MallocInfoScanner(size_t initialCapacity = 16 * 1024);
+
+    /**
+     * @brief Runs malloc_info() and fills @p out with per-arena and total figures.
+     * @p out is reused between calls so its arena vector keeps its capacity.
+     * @return false if malloc_info() could not be captured.
+     */
+    bool sample(MallocInfoSnapshot& out);
+
+    /**
+     * @brief Parses an already captured malloc_info() document.
+     * Exposed separately so the parsing cost can be measured on its own.
+     */
+    static void parse(const char* begin, const char* end, MallocInfoSnapshot& out);
+
+private:
+    std::vector<char> buffer_;
+};
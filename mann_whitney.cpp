@@ -0,0 +1,78 @@
+#include "mann_whitney.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+std::vector<double> exactUCounts(size_t m, size_t n) {
+    std::vector<double> counts(m * n + m + n + 1, 0.0);
+    counts[0] = 1;
+    size_t degree = 0;
+    for (size_t i = 1; i <= m; ++i) {
+        size_t factor = n + i;
+        degree += factor;
+        for (size_t j = degree; j >= factor; --j) {
+            counts[j] -= counts[j - factor];
+        }
+        for (size_t j = i; j <= degree; ++j) {
+            counts[j] += counts[j - i];
+        }
+        degree -= i;
+    }
+    counts.resize(m * n + 1);
+    return counts;
+}
+
+double mannWhitneyGreater(const std::vector<double>& larger, const std::vector<double>& smaller, bool& exact) {
+    exact = false;
+    const size_t m = larger.size();
+    const size_t n = smaller.size();
+    if (m == 0 || n == 0) {
+        return 1;
+    }
+    // Ranks over both samples, ties getting the mean of their ranks.
+    std::vector<std::pair<double, int>> pooled;
+    for (double x : larger) {
+        pooled.emplace_back(x, 0);
+    }
+    for (double x : smaller) {
+        pooled.emplace_back(x, 1);
+    }
+    std::sort(pooled.begin(), pooled.end());
+    const double total = static_cast<double>(m + n);
+    double rankSum = 0;
+    double tieTerm = 0;
+    for (size_t begin = 0; begin < pooled.size();) {
+        size_t end = begin;
+        while (end < pooled.size() && pooled[end].first == pooled[begin].first) {
+            ++end;
+        }
+        double rank = (static_cast<double>(begin + end) + 1) / 2;
+        for (size_t i = begin; i < end; ++i) {
+            rankSum += pooled[i].second == 0 ? rank : 0;
+        }
+        double tied = static_cast<double>(end - begin);
+        tieTerm += tied * tied * tied - tied;
+        begin = end;
+    }
+    const double u = rankSum - static_cast<double>(m) * static_cast<double>(m + 1) / 2;
+
+    if (tieTerm == 0 && m <= 50 && n <= 50) {
+        exact = true;
+        std::vector<double> counts = exactUCounts(m, n);
+        double all = 0;
+        double atLeast = 0;
+        for (size_t k = 0; k < counts.size(); ++k) {
+            all += counts[k];
+            atLeast += static_cast<double>(k) >= u ? counts[k] : 0;
+        }
+        return std::clamp(atLeast / all, 0.0, 1.0);
+    }
+    const double mn = static_cast<double>(m) * static_cast<double>(n);
+    const double variance = mn / 12 * (total + 1 - tieTerm / (total * (total - 1)));
+    if (variance <= 0) {
+        return 1;
+    }
+    double z = (u - mn / 2 - 0.5) / std::sqrt(variance);
+    return std::clamp(0.5 * std::erfc(z / std::sqrt(2.0)), 0.0, 1.0);
+}
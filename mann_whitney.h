@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+/**
+ * @brief Number of ways each value of U can come about, for samples of @p m
+ * and @p n values without ties: the coefficients of the Gaussian binomial
+ * [m+n choose m] in q, built as the product of (1 - q^(n+i)) / (1 - q^i).
+ * Element k is the count for U = k, for k from 0 to m * n.
+ */
+std::vector<double> exactUCounts(size_t m, size_t n);
+
+/**
+ * @brief One-sided Mann-Whitney U test that values of @p larger tend to be
+ * larger than those of @p smaller. Exact when there are no ties and at most
+ * 50 values per side, else the normal approximation with tie and continuity
+ * corrections; @p exact tells which.
+ * @return The p-value; 1 if either side is empty or every value is tied.
+ */
+double mannWhitneyGreater(const std::vector<double>& larger, const std::vector<double>& smaller, bool& exact);
@@ -0,0 +1,113 @@
+#include "memory_usage.h"
+
+#include <cstdint>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <cstdio>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Pages looked up per mincore() / QueryWorkingSetEx() call.
+constexpr size_t kPagesPerQuery = 256;
+
+#ifndef _WIN32
+// Field @p index (0-based, in pages) of /proc/self/statm, converted to bytes.
+size_t statmBytes(int index) {
+    // Kept open: re-reading from offset 0 gives fresh numbers each time.
+    static int statm = open("/proc/self/statm", O_RDONLY | O_CLOEXEC);
+    static size_t pageSize = systemPageSize();
+    char text[128];
+    ssize_t length = statm >= 0 ? pread(statm, text, sizeof(text) - 1, 0) : -1;
+    if (length <= 0) {
+        return 0;
+    }
+    text[length] = '\0';
+    // size resident shared text lib data dt
+    unsigned long long fields[7] = {};
+    if (std::sscanf(text, "%llu %llu %llu %llu %llu %llu %llu", &fields[0], &fields[1], &fields[2], &fields[3],
+                    &fields[4], &fields[5], &fields[6]) <= index) {
+        return 0;
+    }
+    return static_cast<size_t>(fields[index]) * pageSize;
+}
+#endif
+
+} // namespace
+
+size_t systemPageSize() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+#else
+    return static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+}
+
+size_t residentSetBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.WorkingSetSize;
+#else
+    return statmBytes(1);
+#endif
+}
+
+size_t committedBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS_EX counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), reinterpret_cast<PROCESS_MEMORY_COUNTERS*>(&counters),
+                              sizeof(counters))) {
+        return 0;
+    }
+    return counters.PrivateUsage;
+#else
+    return statmBytes(5);
+#endif
+}
+
+ResidencyCounter::ResidencyCounter() : pageSize_(systemPageSize()) {}
+
+void ResidencyCounter::add(const void* begin, const void* end) {
+    uintptr_t first = (reinterpret_cast<uintptr_t>(begin) + pageSize_ - 1) & ~(uintptr_t{pageSize_} - 1);
+    uintptr_t last = reinterpret_cast<uintptr_t>(end) & ~(uintptr_t{pageSize_} - 1);
+    while (first < last) {
+        size_t pages = static_cast<size_t>((last - first) / pageSize_);
+        if (pages > kPagesPerQuery) {
+            pages = kPagesPerQuery;
+        }
+        size_t residentPages = 0;
+#ifdef _WIN32
+        PSAPI_WORKING_SET_EX_INFORMATION info[kPagesPerQuery];
+        for (size_t i = 0; i < pages; ++i) {
+            info[i].VirtualAddress = reinterpret_cast<void*>(first + i * pageSize_);
+        }
+        if (QueryWorkingSetEx(GetCurrentProcess(), info, static_cast<DWORD>(pages * sizeof(info[0])))) {
+            for (size_t i = 0; i < pages; ++i) {
+                residentPages += info[i].VirtualAttributes.Valid;
+            }
+        }
+#else
+        unsigned char status[kPagesPerQuery];
+        if (mincore(reinterpret_cast<void*>(first), pages * pageSize_, status) == 0) {
+            for (size_t i = 0; i < pages; ++i) {
+                residentPages += status[i] & 1;
+            }
+        }
+#endif
+        resident_ += residentPages * pageSize_;
+        scanned_ += pages * pageSize_;
+        first += pages * pageSize_;
+    }
+}
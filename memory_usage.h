@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+
+// Physical memory the whole process holds right now: the RSS from
+// /proc/self/statm on Linux, the working set on Windows. 0 if unavailable.
+size_t residentSetBytes();
+
+// Memory the process has committed: private writable mappings, brk heap
+// included (VmData from /proc/self/statm) on Linux, the commit charge on
+// Windows. Grows when an allocator takes more memory from the OS, whether or
+// not it has been touched yet. 0 if unavailable.
+size_t committedBytes();
+
+// Size of a virtual memory page.
+size_t systemPageSize();
+
+/**
+ * @brief Counts how much of a set of free address ranges is still backed by physical pages.
+ *
+ * Backends feed it the free memory whose contents they do not need (heap
+ * bookkeeping inside a free block excluded); each range is shrunk to whole
+ * pages and looked up with mincore() / QueryWorkingSetEx(). Those pages are
+ * what a trim could hand back to the OS.
+ *
+ * It never allocates, so a backend may call add() while walking its own heap.
+ */
+class ResidencyCounter {
+public:
+    ResidencyCounter();
+
+    void add(const void* begin, const void* end);
+
+    size_t residentBytes() const { return resident_; }
+    size_t scannedBytes() const { return scanned_; }
+
+private:
+    size_t pageSize_;
+    size_t resident_ = 0;
+    size_t scanned_ = 0;
+};
@@ -0,0 +1,457 @@
+#include "metrics_exporter.h"
+
+#include <cctype>
+#include <cerrno>
+#include <charconv>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#include <windows.h>
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char kLiveMagic[8] = {'H', 'E', 'A', 'P', 'L', 'I', 'V', 'E'};
+constexpr int kPollMilliseconds = 200; // How soon the server thread notices the run is over.
+constexpr size_t kRequestBytes = 4096; // Longest request head read; the rest is ignored.
+
+constexpr const char* kPrometheusType = "text/plain; version=0.0.4; charset=utf-8";
+constexpr const char* kOpenMetricsType = "application/openmetrics-text; version=1.0.0; charset=utf-8";
+
+// ExternalFrag_Ratio -> external_frag_ratio, TraverseAlloc_LLCMiss -> traverse_alloc_llc_miss.
+std::string snakeCase(std::string_view name) {
+    std::string out;
+    for (size_t i = 0; i < name.size(); ++i) {
+        unsigned char c = static_cast<unsigned char>(name[i]);
+        if (std::isupper(c) && i > 0 && out.back() != '_') {
+            unsigned char before = static_cast<unsigned char>(name[i - 1]);
+            bool wordEnds = i + 1 < name.size() && std::islower(static_cast<unsigned char>(name[i + 1]));
+            if (std::islower(before) || std::isdigit(before) || (std::isupper(before) && wordEnds)) {
+                out += '_';
+            }
+        }
+        out += std::isalnum(c) ? static_cast<char>(std::tolower(c)) : '_';
+    }
+    return out;
+}
+
+// Metadata keys such as tune.mmap_max become label names such as tune_mmap_max.
+std::string labelName(std::string_view key) {
+    std::string out = std::isdigit(static_cast<unsigned char>(key.empty() ? '0' : key[0])) ? "_" : "";
+    for (char c : key) {
+        out += std::isalnum(static_cast<unsigned char>(c)) ? c : '_';
+    }
+    return out;
+}
+
+std::string labelValue(std::string_view value) {
+    std::string out;
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            out += '\\';
+        }
+        if (c == '\n') {
+            out.append("\\n");
+        } else {
+            out.push_back(c);
+        }
+    }
+    return out;
+}
+
+void appendText(std::string& out, std::string_view text) { out.append(text); }
+
+template <typename T>
+void appendNumber(std::string& out, T value) {
+    char digits[32];
+    auto [end, ec] = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, end);
+}
+
+// One cell of a binary record, written as a Prometheus sample value.
+void appendCell(std::string& out, uint64_t cell, char type) {
+    if (type == 'i') {
+        appendNumber(out, static_cast<int64_t>(cell));
+    } else if (type == 'u') {
+        appendNumber(out, cell);
+    } else {
+        double value;
+        std::memcpy(&value, &cell, sizeof(value));
+        if (std::isnan(value)) {
+            appendText(out, "NaN");
+        } else if (std::isinf(value)) {
+            appendText(out, value > 0 ? "+Inf" : "-Inf");
+        } else {
+            appendNumber(out, value);
+        }
+    }
+}
+
+void closeSocket(intptr_t socket) {
+#ifdef _WIN32
+    closesocket(static_cast<SOCKET>(socket));
+#else
+    close(static_cast<int>(socket));
+#endif
+}
+
+// The name shm_open() wants: a single leading slash.
+std::string segmentName(const std::string& name) { return name.starts_with('/') ? name : "/" + name; }
+
+} // namespace
+
+MetricsExporter::MetricsExporter(const MetricsOptions& options, const RunMetadata& metadata,
+                                 const std::vector<size_t>& fitSizes)
+    : options_(options), fitSizes_(fitSizes) {
+    std::vector<std::string> fitNames;
+    std::vector<StatsColumn> columns = mainStatsColumns(fitSizes_, fitNames);
+    std::string header = binaryStatsHeader(columns, metadata);
+    std::memcpy(header.data(), kLiveMagic, sizeof(kLiveMagic));
+    headerBytes_ = header.size();
+    blockBytes_ = headerBytes_ + (1 + columns.size()) * sizeof(uint64_t);
+    if (!options_.sharedMemoryName.empty()) {
+        mapSegment(blockBytes_);
+    } else {
+        privateBlock_.assign(blockBytes_ / sizeof(uint64_t), 0);
+        block_ = reinterpret_cast<char*>(privateBlock_.data());
+    }
+    std::memset(block_, 0, blockBytes_);
+    std::memcpy(block_, header.data(), header.size());
+    record_.reserve(columns.size() * sizeof(uint64_t));
+    latest_.resize(columns.size());
+
+    std::string backend;
+    for (const auto& [key, value] : metadata) {
+        if (key == "backend") {
+            backend = value;
+        }
+        if (!infoLabels_.empty()) {
+            infoLabels_.push_back(',');
+        }
+        infoLabels_.append(labelName(key)).append("=\"").append(labelValue(value)).append("\"");
+    }
+    std::string backendLabel = "backend=\"" + labelValue(backend) + "\"";
+    size_t fixedColumns = columns.size() - fitSizes_.size();
+    for (size_t i = 0; i < columns.size(); ++i) {
+        if (i >= fixedColumns) {
+            std::string size = std::to_string(fitSizes_[i - fixedColumns]);
+            series_.push_back({"heap_allocatable_fraction", columns[i].name, backendLabel + ",size=\"" + size + "\"",
+                               columns[i].type});
+        } else {
+            std::string family = std::string_view(columns[i].name) == "Time" ? "time_step" : snakeCase(columns[i].name);
+            series_.push_back({"heap_" + family, columns[i].name, backendLabel, columns[i].type});
+        }
+    }
+
+    if (!options_.listenAddress.empty()) {
+        try {
+            openListener(options_.listenAddress);
+        } catch (...) {
+            unmapSegment();
+            throw;
+        }
+        response_.reserve(64 << 10);
+        server_ = std::thread(&MetricsExporter::serve, this);
+    }
+}
+
+MetricsExporter::~MetricsExporter() {
+    if (server_.joinable()) {
+        stop_.store(true, std::memory_order_relaxed);
+        server_.join();
+    }
+    if (listener_ != -1) {
+        closeSocket(listener_);
+#ifdef _WIN32
+        WSACleanup();
+#endif
+    }
+    unmapSegment();
+}
+
+void MetricsExporter::mapSegment(size_t bytes) {
+#ifdef _WIN32
+    HANDLE mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE,
+                                        static_cast<DWORD>(static_cast<uint64_t>(bytes) >> 32),
+                                        static_cast<DWORD>(bytes), options_.sharedMemoryName.c_str());
+    if (!mapping) {
+        throw std::runtime_error("could not create shared memory " + options_.sharedMemoryName + " (error " +
+                                 std::to_string(GetLastError()) + ")");
+    }
+    void* view = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+    if (!view) {
+        DWORD error = GetLastError();
+        CloseHandle(mapping);
+        throw std::runtime_error("could not map shared memory " + options_.sharedMemoryName + " (error " +
+                                 std::to_string(error) + ")");
+    }
+    mapping_ = mapping;
+    block_ = static_cast<char*>(view);
+#else
+    std::string name = segmentName(options_.sharedMemoryName);
+    int fd = shm_open(name.c_str(), O_CREAT | O_RDWR | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        throw std::runtime_error("could not create shared memory " + name + ": " + std::strerror(errno));
+    }
+    void* mapped = ftruncate(fd, static_cast<off_t>(bytes)) == 0
+                       ? mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                       : MAP_FAILED;
+    int error = errno;
+    close(fd);
+    if (mapped == MAP_FAILED) {
+        shm_unlink(name.c_str());
+        throw std::runtime_error("could not map shared memory " + name + ": " + std::strerror(error));
+    }
+    block_ = static_cast<char*>(mapped);
+#endif
+}
+
+// Removes the segment, so scrapers see the run has ended rather than a frozen row.
+void MetricsExporter::unmapSegment() {
+    if (options_.sharedMemoryName.empty() || !block_) {
+        return;
+    }
+#ifdef _WIN32
+    UnmapViewOfFile(block_);
+    CloseHandle(mapping_);
+#else
+    munmap(block_, blockBytes_);
+    shm_unlink(segmentName(options_.sharedMemoryName).c_str());
+#endif
+    block_ = nullptr;
+}
+
+void MetricsExporter::openListener(const std::string& address) {
+    size_t colon = address.rfind(':');
+    std::string host = address.substr(0, colon);
+    std::string_view portText = std::string_view(address).substr(colon + 1);
+    uint16_t port = 0;
+    auto [end, ec] = std::from_chars(portText.data(), portText.data() + portText.size(), port);
+    sockaddr_in socketAddress{};
+    socketAddress.sin_family = AF_INET;
+    socketAddress.sin_port = htons(port);
+    if (colon == std::string::npos || ec != std::errc() || end != portText.data() + portText.size() ||
+        inet_pton(AF_INET, host.c_str(), &socketAddress.sin_addr) != 1) {
+        throw std::runtime_error("--metrics-listen needs an IPv4 ADDRESS:PORT, not " + address);
+    }
+
+#ifdef _WIN32
+    WSADATA data;
+    if (WSAStartup(MAKEWORD(2, 2), &data) != 0) {
+        throw std::runtime_error("could not start Winsock");
+    }
+    SOCKET listener = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    bool opened = listener != INVALID_SOCKET;
+#else
+    int listener = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    bool opened = listener >= 0;
+    int reuse = 1;
+    if (opened) {
+        setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    }
+#endif
+    socklen_t length = sizeof(socketAddress);
+    if (!opened || bind(listener, reinterpret_cast<sockaddr*>(&socketAddress), sizeof(socketAddress)) != 0 ||
+        ::listen(listener, 16) != 0 ||
+        getsockname(listener, reinterpret_cast<sockaddr*>(&socketAddress), &length) != 0) {
+        if (opened) {
+            closeSocket(static_cast<intptr_t>(listener));
+        }
+#ifdef _WIN32
+        WSACleanup();
+#endif
+        throw std::runtime_error("could not listen on " + address);
+    }
+    listener_ = static_cast<intptr_t>(listener);
+    port_ = ntohs(socketAddress.sin_port);
+}
+
+void MetricsExporter::publish(const HeapStats& stats) {
+    record_.clear();
+    appendBinaryRow(record_, stats, fitSizes_);
+    uint64_t* words = reinterpret_cast<uint64_t*>(block_ + headerBytes_);
+    std::atomic_ref<uint64_t> sequence(words[0]);
+    uint64_t current = sequence.load(std::memory_order_relaxed);
+    sequence.store(current + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < latest_.size(); ++i) {
+        uint64_t cell;
+        std::memcpy(&cell, record_.data() + i * sizeof(cell), sizeof(cell));
+        std::atomic_ref<uint64_t>(words[1 + i]).store(cell, std::memory_order_relaxed);
+    }
+    sequence.store(current + 2, std::memory_order_release);
+}
+
+// Copies the latest row into latest_. Returns false if nothing was published yet.
+bool MetricsExporter::readLatest(uint64_t& published) {
+    uint64_t* words = reinterpret_cast<uint64_t*>(block_ + headerBytes_);
+    std::atomic_ref<uint64_t> sequence(words[0]);
+    while (true) {
+        uint64_t before = sequence.load(std::memory_order_acquire);
+        if (before & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        for (size_t i = 0; i < latest_.size(); ++i) {
+            latest_[i] = std::atomic_ref<uint64_t>(words[1 + i]).load(std::memory_order_relaxed);
+        }
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (sequence.load(std::memory_order_relaxed) == before) {
+            published = before / 2;
+            return published > 0;
+        }
+    }
+}
+
+void MetricsExporter::formatMetrics(bool openMetrics) {
+    response_.clear();
+    uint64_t published = 0;
+    bool any = readLatest(published);
+
+    // OpenMetrics families drop the _info / _total suffix of their samples; HELP and TYPE name the family.
+    const char* infoFamily = openMetrics ? "heap_analyzer" : "heap_analyzer_info";
+    const char* samplesFamily = openMetrics ? "heap_analyzer_samples" : "heap_analyzer_samples_total";
+    appendText(response_, "# HELP ");
+    appendText(response_, infoFamily);
+    appendText(response_, " Settings the run was made with.\n# TYPE ");
+    appendText(response_, infoFamily);
+    appendText(response_, openMetrics ? " info\n" : " gauge\n");
+    appendText(response_, "heap_analyzer_info{");
+    appendText(response_, infoLabels_);
+    appendText(response_, "} 1\n");
+    appendText(response_, "# HELP ");
+    appendText(response_, samplesFamily);
+    appendText(response_, " Rows published so far.\n# TYPE ");
+    appendText(response_, samplesFamily);
+    appendText(response_, " counter\n");
+    appendText(response_, "heap_analyzer_samples_total ");
+    appendNumber(response_, published);
+    appendText(response_, "\n");
+
+    for (size_t i = 0; any && i < series_.size(); ++i) {
+        const Series& series = series_[i];
+        if (i == 0 || series.family != series_[i - 1].family) {
+            appendText(response_, "# HELP ");
+            appendText(response_, series.family);
+            appendText(response_, " ");
+            appendText(response_, i >= series_.size() - fitSizes_.size() ? "Allocatable_<size>" : series.column);
+            appendText(response_, " column of the stats file.\n# TYPE ");
+            appendText(response_, series.family);
+            appendText(response_, " gauge\n");
+        }
+        appendText(response_, series.family);
+        appendText(response_, "{");
+        appendText(response_, series.labels);
+        appendText(response_, "} ");
+        appendCell(response_, latest_[i], series.type);
+        appendText(response_, "\n");
+    }
+    if (openMetrics) {
+        appendText(response_, "# EOF\n");
+    }
+}
+
+void MetricsExporter::serve() {
+    while (!stop_.load(std::memory_order_relaxed)) {
+#ifdef _WIN32
+        WSAPOLLFD ready{static_cast<SOCKET>(listener_), POLLRDNORM, 0};
+        if (WSAPoll(&ready, 1, kPollMilliseconds) <= 0) {
+            continue;
+        }
+        SOCKET client = accept(static_cast<SOCKET>(listener_), nullptr, nullptr);
+        if (client == INVALID_SOCKET) {
+            continue;
+        }
+#else
+        pollfd ready{static_cast<int>(listener_), POLLIN, 0};
+        if (poll(&ready, 1, kPollMilliseconds) <= 0) {
+            continue;
+        }
+        int client = accept4(static_cast<int>(listener_), nullptr, nullptr, SOCK_CLOEXEC);
+        if (client < 0) {
+            continue;
+        }
+#endif
+        answer(static_cast<intptr_t>(client));
+        closeSocket(static_cast<intptr_t>(client));
+    }
+}
+
+// Reads one request from @p client and answers it; every connection carries one request.
+void MetricsExporter::answer(intptr_t client) {
+#ifdef _WIN32
+    SOCKET socket = static_cast<SOCKET>(client);
+    DWORD timeout = 1000;
+    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, reinterpret_cast<const char*>(&timeout), sizeof(timeout));
+    constexpr int kSendFlags = 0;
+#else
+    int socket = static_cast<int>(client);
+    timeval timeout{1, 0};
+    setsockopt(socket, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    constexpr int kSendFlags = MSG_NOSIGNAL;
+#endif
+    char request[kRequestBytes];
+    size_t length = 0;
+    while (length + 1 < sizeof(request)) {
+        auto received = recv(socket, request + length, static_cast<int>(sizeof(request) - 1 - length), 0);
+        if (received <= 0) {
+            break;
+        }
+        length += static_cast<size_t>(received);
+        request[length] = '\0';
+        if (std::strstr(request, "\r\n\r\n")) {
+            break;
+        }
+    }
+    std::string_view text(request, length);
+
+    const char* status = "200 OK";
+    const char* contentType = kPrometheusType;
+    if (!text.starts_with("GET ")) {
+        status = "405 Method Not Allowed";
+    } else {
+        std::string_view target = text.substr(4, text.find_first_of(" ?\r\n", 4) - 4);
+        if (target != "/metrics") {
+            status = "404 Not Found";
+        }
+    }
+    if (std::strcmp(status, "200 OK") == 0) {
+        bool openMetrics = text.find("application/openmetrics-text") != std::string_view::npos;
+        contentType = openMetrics ? kOpenMetricsType : kPrometheusType;
+        formatMetrics(openMetrics);
+    } else {
+        response_.clear();
+        appendText(response_, "Only GET /metrics is served here.\n");
+    }
+
+    char head[256];
+    int headLength = std::snprintf(head, sizeof(head),
+                                   "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %zu\r\nConnection: close\r\n\r\n",
+                                   status, contentType, response_.size());
+    for (auto [data, size] : {std::pair<const char*, size_t>(head, static_cast<size_t>(headLength)),
+                              std::pair<const char*, size_t>(response_.data(), response_.size())}) {
+        while (size > 0) {
+            auto sent = send(socket, data, static_cast<int>(size), kSendFlags);
+            if (sent <= 0) {
+                return;
+            }
+            data += sent;
+            size -= static_cast<size_t>(sent);
+        }
+    }
+}
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "heap_stats.h"
+#include "stats_writer.h"
+
+// Where the latest row is published while a run goes on.
+struct MetricsOptions {
+    std::string sharedMemoryName; // --metrics-shm: shm_open() / CreateFileMapping() name, empty for none.
+    std::string listenAddress;    // --metrics-listen: IPv4 ADDRESS:PORT serving /metrics, empty for none.
+
+    bool enabled() const { return !sharedMemoryName.empty() || !listenAddress.empty(); }
+};
+
+/**
+ * @brief Publishes the latest HeapStats row for scrapers, without ever
+ * blocking the simulation.
+ *
+ * The row is encoded as one binary stats record and stored under a sequence
+ * lock, the same protocol as Seqlock, in a block of memory that is either a
+ * named shared memory segment (--metrics-shm) or, for the HTTP endpoint
+ * alone, private. publish() is a handful of plain stores: no lock, no
+ * syscall. The segment starts with the header of a binary stats file (see
+ * StatsWriter) under the magic "HEAPLIVE"; at headerBytes follow a uint64
+ * sequence number, odd while a row is being stored and twice the rows
+ * published so far otherwise, and then the record. A reader copies the
+ * record and retries while the sequence was odd or changed under it.
+ *
+ * With --metrics-listen, a thread serves GET /metrics in the Prometheus text
+ * format (or OpenMetrics, if the scraper asks for it), one gauge per column
+ * with a backend label, plus heap_analyzer_info carrying the run's metadata.
+ * It reads the row through the same sequence lock and formats into buffers
+ * kept from one scrape to the next, so after the first scrape it does not
+ * allocate on the heap being measured.
+ */
+class MetricsExporter {
+public:
+    // Throws std::runtime_error if the segment or the listening socket cannot be set up.
+    MetricsExporter(const MetricsOptions& options, const RunMetadata& metadata, const std::vector<size_t>& fitSizes);
+    ~MetricsExporter();
+    MetricsExporter(const MetricsExporter&) = delete;
+    MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+    // Only the thread that runs the simulation may call publish().
+    void publish(const HeapStats& stats);
+
+    // The port /metrics is served on (useful with port 0), 0 without --metrics-listen.
+    uint16_t port() const { return port_; }
+
+private:
+    // One column as a Prometheus sample: family name and labels.
+    struct Series {
+        std::string family;
+        std::string column; // Name in the stats file.
+        std::string labels;
+        char type; // 'i', 'u' or 'f', as in the stats file.
+    };
+
+    void mapSegment(size_t bytes);
+    void unmapSegment();
+    void openListener(const std::string& address);
+    bool readLatest(uint64_t& sequence);
+    void formatMetrics(bool openMetrics);
+    void serve();
+    void answer(intptr_t client);
+
+    MetricsOptions options_;
+    std::vector<size_t> fitSizes_;
+    std::vector<Series> series_;
+    std::string infoLabels_;
+
+    // The published block: header, sequence word, record. Either the mapped
+    // segment or privateBlock_.
+    char* block_ = nullptr;
+    size_t blockBytes_ = 0;
+    size_t headerBytes_ = 0;
+    std::vector<uint64_t> privateBlock_;
+#ifdef _WIN32
+    void* mapping_ = nullptr;
+#endif
+
+    std::vector<char> record_;     // Encoding buffer of publish().
+    std::vector<uint64_t> latest_; // Copy taken by the server thread.
+    std::string response_;         // Response the server thread builds.
+    intptr_t listener_ = -1;
+    uint16_t port_ = 0;
+    std::atomic<bool> stop_{false};
+    std::thread server_;
+};
+
+/**
+ * @brief A StatsSink that publishes every row to a MetricsExporter, if there
+ * is one, before passing it on to @p Sink.
+ */
+template <StatsSink Sink>
+class ExportingSink {
+public:
+    ExportingSink(Sink& sink, MetricsExporter* exporter) : sink_(sink), exporter_(exporter) {}
+
+    void write(HeapStats&& stats) {
+        if (exporter_) {
+            exporter_->publish(stats);
+        }
+        sink_.write(std::move(stats));
+    }
+
+private:
+    Sink& sink_;
+    MetricsExporter* exporter_;
+};
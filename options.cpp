@@ -0,0 +1,348 @@
+#include "options.h"
+
+#include <algorithm>
+#include <charconv>
+#include <string_view>
+
+namespace {
+
+template <typename T>
+bool parseNumber(std::string_view text, T& value) {
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return ec == std::errc() && end == text.data() + text.size();
+}
+
+// "90", "90s", "15m", "12h" or "7d", in seconds.
+bool parseDuration(std::string_view text, double& seconds) {
+    double unit = 1;
+    if (!text.empty()) {
+        switch (text.back()) {
+        case 'd':
+            unit *= 24;
+            [[fallthrough]];
+        case 'h':
+            unit *= 60;
+            [[fallthrough]];
+        case 'm':
+            unit *= 60;
+            [[fallthrough]];
+        case 's':
+            text.remove_suffix(1);
+            break;
+        default:
+            break;
+        }
+    }
+    if (!parseNumber(text, seconds) || !(seconds > 0)) {
+        return false;
+    }
+    seconds *= unit;
+    return true;
+}
+
+} // namespace
+
+bool parseOptions(int argc, char** argv, Options& options, std::string& error) {
+    for (int i = 0; i < argc; ++i) {
+        options.commandLine += (i > 0 ? " " : "") + std::string(argv[i]);
+    }
+    options.arguments.assign(argv + std::min(argc, 1), argv + argc);
+    bool onlyResumeOptions = true; // --resume takes the rest from the checkpoint.
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        onlyResumeOptions = onlyResumeOptions && (arg == "--resume" || arg == "--duration");
+
+        // Every option except the flags below takes exactly one value.
+        if (arg == "--help" || arg == "-h") {
+            options.showHelp = true;
+            continue;
+        }
+        if (arg == "--list-backends") {
+            options.listBackends = true;
+            continue;
+        }
+        if (arg == "--check") {
+            options.checkOnly = true;
+            continue;
+        }
+        if (arg == "--residency") {
+            options.simulation.probes.residency = true;
+            continue;
+        }
+        if (arg == "--locality") {
+            options.simulation.probes.locality = true;
+            continue;
+        }
+        if (arg == "--adaptive-sampling") {
+            options.simulation.probes.sampling.adaptive = true;
+            continue;
+        }
+        if (arg == "--huge-page-stats") {
+            options.simulation.probes.hugePageStats = true;
+            continue;
+        }
+        if (arg == "--huge-pages") {
+            options.hugePages = true;
+            options.simulation.probes.hugePageStats = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            error = "unknown option or missing value: " + std::string(arg);
+            return false;
+        }
+        std::string_view value = argv[++i];
+
+        bool ok = true;
+        if (arg == "--backend") {
+            options.backend = value;
+        } else if (arg == "--output") {
+            options.outputPath = value;
+            options.outputGiven = true;
+        } else if (arg == "--format") {
+            if (value == "csv") {
+                options.format = StatsFormat::Csv;
+            } else if (value == "binary") {
+                options.format = StatsFormat::Binary;
+            } else {
+                ok = false;
+            }
+        } else if (arg.starts_with("--") && isPhaseParameter(arg.substr(2))) {
+            if (!setPhaseParameter(options.workloadDefaults, arg.substr(2), value, error)) {
+                return false;
+            }
+        } else if (arg == "--inspect") {
+            if (value == "full") {
+                options.inspection = InspectionMode::Full;
+            } else if (value == "cached") {
+                options.inspection = InspectionMode::Cached;
+            } else if (value == "background") {
+                options.inspection = InspectionMode::Background;
+            } else {
+                ok = false;
+            }
+        } else if (arg == "--tune") {
+            size_t equals = value.find('=');
+            long setting = 0;
+            ok = equals != std::string_view::npos && equals > 0 && parseNumber(value.substr(equals + 1), setting);
+            if (ok) {
+                options.tunables.emplace_back(std::string(value.substr(0, equals)), setting);
+            }
+        } else if (arg == "--glibc-tunable") {
+            // Short names are malloc tunables: tcache_count=0 is glibc.malloc.tcache_count=0.
+            size_t equals = value.find('=');
+            ok = equals != std::string_view::npos && equals > 0 && value.find(':') == std::string_view::npos;
+            if (ok) {
+                bool qualified = value.substr(0, equals).find('.') != std::string_view::npos;
+                options.glibcTunables.push_back((qualified ? "" : "glibc.malloc.") + std::string(value));
+            }
+        } else if (arg == "--fit-sizes") {
+            options.fitSizes.clear();
+            for (size_t begin = 0; ok && begin <= value.size();) {
+                size_t end = std::min(value.find(',', begin), value.size());
+                size_t size = 0;
+                ok = parseNumber(value.substr(begin, end - begin), size) && size > 0;
+                options.fitSizes.push_back(size);
+                begin = end + 1;
+            }
+        } else if (arg == "--workload") {
+            options.workloadPath = value;
+        } else if (arg == "--threads") {
+            ok = parseNumber(value, options.simulation.threads) && options.simulation.threads > 0;
+        } else if (arg == "--cross-free-percent") {
+            ok = parseNumber(value, options.simulation.crossThreadFreePercent) &&
+                 options.simulation.crossThreadFreePercent >= 0 && options.simulation.crossThreadFreePercent <= 100;
+        } else if (arg == "--replay") {
+            options.replay.path = value;
+        } else if (arg == "--replay-step-events") {
+            ok = parseNumber(value, options.replay.eventsPerStep) && options.replay.eventsPerStep > 0;
+        } else if (arg == "--replay-start") {
+            ok = parseNumber(value, options.replay.startSeconds) && options.replay.startSeconds >= 0;
+        } else if (arg == "--replay-end") {
+            ok = parseNumber(value, options.replay.endSeconds) && options.replay.endSeconds >= 0;
+        } else if (arg == "--sites") {
+            ok = parseNumber(value, options.sites.top) && options.sites.top > 0;
+        } else if (arg == "--sites-min-age") {
+            ok = parseNumber(value, options.sites.minAge) && options.sites.minAge >= 0;
+        } else if (arg == "--trim-every") {
+            ok = parseNumber(value, options.simulation.probes.trimEvery) && options.simulation.probes.trimEvery > 0;
+        } else if (arg == "--layout-every") {
+            ok = parseNumber(value, options.simulation.probes.layoutEvery) && options.simulation.probes.layoutEvery > 0;
+        } else if (arg == "--sample-every") {
+            ok = parseNumber(value, options.simulation.probes.sampling.every) &&
+                 options.simulation.probes.sampling.every > 0;
+        } else if (arg == "--sample-max-every") {
+            ok = parseNumber(value, options.simulation.probes.sampling.maxEvery) &&
+                 options.simulation.probes.sampling.maxEvery > 0;
+        } else if (arg == "--sample-large-free") {
+            ok = parseNumber(value, options.simulation.probes.sampling.largeFreeBytes) &&
+                 options.simulation.probes.sampling.largeFreeBytes > 0;
+        } else if (arg == "--sample-internal-change") {
+            double& percent = options.simulation.probes.sampling.internalChangePercent;
+            ok = parseNumber(value, percent) && percent > 0;
+        } else if (arg == "--duration") {
+            ok = parseDuration(value, options.simulation.soak.durationSeconds);
+            options.durationGiven = true;
+        } else if (arg == "--checkpoint-every") {
+            ok = parseNumber(value, options.simulation.soak.checkpointEvery) && options.simulation.soak.checkpointEvery > 0;
+        } else if (arg == "--resume") {
+            options.resumePath = value;
+            ok = !value.empty();
+        } else if (arg == "--compact-threshold") {
+            double& threshold = options.simulation.compaction.threshold;
+            ok = parseNumber(value, threshold) && threshold > 0 && threshold < 1;
+        } else if (arg == "--metrics-shm") {
+            options.metrics.sharedMemoryName = value;
+            ok = !value.empty();
+        } else if (arg == "--metrics-listen") {
+            // The address itself is checked when the socket is opened.
+            size_t colon = value.rfind(':');
+            uint16_t port = 0;
+            options.metrics.listenAddress = value;
+            ok = colon != std::string_view::npos && colon > 0 && parseNumber(value.substr(colon + 1), port);
+        } else if (arg == "--seed") {
+            ok = parseNumber(value, options.seed);
+            options.seedGiven = true;
+        } else {
+            error = "unknown option: " + std::string(arg);
+            return false;
+        }
+
+        if (!ok) {
+            error = "invalid value for " + std::string(arg) + ": " + std::string(value);
+            return false;
+        }
+    }
+
+    if (!options.resumePath.empty() && !onlyResumeOptions) {
+        error = "--resume only takes --duration; the run's other options come from the checkpoint";
+        return false;
+    }
+    options.replay.probes = options.simulation.probes;
+    // Compaction and the locality probe work on the simulation's own blocks; a replay's belong to the trace.
+    if (options.simulation.compaction.threshold > 0 && !options.replay.path.empty()) {
+        error = "--compact-threshold cannot be combined with --replay";
+        return false;
+    }
+    if (options.simulation.probes.locality && !options.replay.path.empty()) {
+        error = "--locality cannot be combined with --replay";
+        return false;
+    }
+    // A replay has its own loop and state; the synthetic workload is the one a soak test runs.
+    const SoakOptions& soak = options.simulation.soak;
+    if ((soak.durationSeconds > 0 || soak.checkpointEvery > 0) && !options.replay.path.empty()) {
+        error = std::string(soak.checkpointEvery > 0 ? "--checkpoint-every" : "--duration") +
+                " cannot be combined with --replay";
+        return false;
+    }
+    if (soak.checkpointEvery > 0 && options.simulation.threads > 1) {
+        error = "--checkpoint-every needs a single thread";
+        return false;
+    }
+    // Layout snapshots are delta-encoded against the previous one, which a resumed run does not have.
+    if (soak.checkpointEvery > 0 && options.simulation.probes.layoutEvery > 0) {
+        error = "--checkpoint-every cannot be combined with --layout-every";
+        return false;
+    }
+    // Call stacks only exist in recorded traces.
+    if (options.sites.enabled() && options.replay.path.empty()) {
+        error = "--sites needs --replay";
+        return false;
+    }
+    if (!options.outputGiven && options.format == StatsFormat::Binary) {
+        options.outputPath = "heap_fragmentation_stats.bin";
+    }
+    if (options.workloadPath.empty()) {
+        options.simulation.workload.phases = {options.workloadDefaults};
+    } else if (!loadWorkloadFile(options.workloadPath, options.workloadDefaults, options.simulation.workload, error)) {
+        return false;
+    }
+    // A replay's sizes are only known once it has been read, so it needs --fit-sizes.
+    if (options.fitSizes.empty() && options.replay.path.empty()) {
+        options.fitSizes = typicalRequestSizes(options.simulation.workload);
+    }
+    return true;
+}
+
+void printUsage(std::ostream& out, const char* program) {
+    out << "Usage: " << program << " [options]\n"
+        << "  --backend NAME     Allocator to measure (see --list-backends)\n"
+        << "  --output FILE      Statistics file to write (default heap_fragmentation_stats.csv or .bin)\n"
+        << "  --format FORMAT    csv (default) or binary (fixed-width records, see README)\n"
+        << "  --steps N          Number of timesteps to simulate (default 100)\n"
+        << "  --allocs-per-step N, --frees-per-step N\n"
+        << "                     Blocks allocated and freed per timestep (default 10 and 1)\n"
+        << "  --min-live-blocks N\n"
+        << "                     Only free once more blocks than this are live (default 20)\n"
+        << "  --reallocs-per-step N, --realloc-growth F\n"
+        << "                     Grow N random live blocks per step by a factor F with realloc\n"
+        << "                     (default 0 and 2.0)\n"
+        << "  --aligned-percent P, --alignment A\n"
+        << "                     Make P% of allocations aligned to A bytes (default 0 and 64)\n"
+        << "  --sizes SPEC       Block size distribution (default uniform,512,1535), one of\n"
+        << "                     uniform,MIN,MAX  lognormal,MEDIAN,SIGMA  powerlaw,MIN,MAX,ALPHA\n"
+        << "                     empirical,SIZE:WEIGHT,...\n"
+        << "  --lifetime SPEC    Which blocks are freed (default random), one of random, lifo, fifo,\n"
+        << "                     exponential,MEAN_STEPS  generational,YOUNG_SHARE,YOUNG_MEAN,OLD_MEAN\n"
+        << "  --workload FILE    Multi-phase workload file (see README); flags above are its defaults\n"
+        << "  --inspect MODE     How the heap is inspected each step: full (default), cached\n"
+        << "                     (re-walk only changed regions) or background (walk on a helper thread)\n"
+        << "  --tune NAME=VALUE  Allocator setting, repeatable. glibc (mallopt): mmap_max (default 0),\n"
+        << "                     mmap_threshold, trim_threshold, top_pad, arena_max, arena_test, mxfast,\n"
+        << "                     perturb. win32: lfh (0 or 1, default 1), segment_heap (see README)\n"
+        << "  --glibc-tunable NAME=VALUE\n"
+        << "                     glibc tunable set through GLIBC_TUNABLES before startup, e.g.\n"
+        << "                     tcache_count=0 or glibc.malloc.tcache_max=0; repeatable\n"
+        << "  --residency        Also count the resident pages inside free blocks (ResidentFree_Bytes)\n"
+        << "  --locality         Time a walk over all live blocks, oldest first and in random order, with\n"
+        << "                     cache and dTLB misses where perf_event_open allows (Traverse*), and the\n"
+        << "                     mean gap between neighbouring live blocks (LiveGap_Bytes)\n"
+        << "  --huge-pages       Back the heap with transparent huge pages (glibc: glibc.malloc.hugetlb=1,\n"
+        << "                     pool: MADV_HUGEPAGE, or MEM_LARGE_PAGES on Windows); implies --huge-page-stats\n"
+        << "  --huge-page-stats  Record AnonHugePages and the heap's 2 MiB regions that are free, partly\n"
+        << "                     used or full (AnonHuge_Bytes, HugeRegions_*)\n"
+        << "  --trim-every N     Trim the heap (malloc_trim, HeapCompact, ...) every N steps and record\n"
+        << "                     its time and the RSS it gave back (Trim_ns, TrimReclaimed_Bytes)\n"
+        << "  --layout-every N   Snapshot the heap's busy and free spans every N steps into\n"
+        << "                     <output>_layout.bin, delta-encoded (see README)\n"
+        << "  --sample-every N   Take a sample every N steps instead of every step (default 1)\n"
+        << "  --adaptive-sampling\n"
+        << "                     Also sample as soon as the process commits more memory than ever, a large\n"
+        << "                     block is freed or internal fragmentation moves, and double the gap after\n"
+        << "                     every sample that only the interval asked for (see README)\n"
+        << "  --sample-max-every N, --sample-large-free BYTES, --sample-internal-change PCT\n"
+        << "                     Longest gap backoff reaches (default 64 x --sample-every), smallest free\n"
+        << "                     that triggers a sample (default 1048576) and internal fragmentation\n"
+        << "                     change, in percent of the last sample's, that does (default 5)\n"
+        << "  --compact-threshold R\n"
+        << "                     Relocate the blocks of sparsely used 64 KiB windows whenever\n"
+        << "                     ExternalFrag_Ratio is above R (0 < R < 1); see README\n"
+        << "  --metrics-shm NAME Publish the latest row in shared memory NAME (shm_open / CreateFileMapping)\n"
+        << "  --metrics-listen ADDRESS:PORT\n"
+        << "                     Serve the latest row as Prometheus metrics on http://ADDRESS:PORT/metrics,\n"
+        << "                     e.g. 127.0.0.1:9464 or 0.0.0.0:9464\n"
+        << "  --duration TIME    Stop after TIME (90, 90s, 15m, 12h or 7d) even if steps remain; pair it with a\n"
+        << "                     large --steps for a soak test\n"
+        << "  --checkpoint-every N\n"
+        << "                     Save the run's state every N steps (and when --duration ends it) to\n"
+        << "                     FILE_checkpoint.bin, so a killed run can be resumed\n"
+        << "  --resume CHECKPOINT\n"
+        << "                     Continue a checkpointed run with its own options, appending to its stats\n"
+        << "                     files; only --duration, counted from the run's start, may be given as well\n"
+        << "  --fit-sizes S,...  Request sizes to write an Allocatable_<S> column for: the share of free\n"
+        << "                     bytes in blocks of at least S (default: the workload's p50, p90 and p99)\n"
+        << "  --threads N        Run the workload on N threads (default 1)\n"
+        << "  --cross-free-percent P\n"
+        << "                     With --threads, share of frees done by another thread (default 25)\n"
+        << "  --seed N           Seed for the workload (default: current time)\n"
+        << "  --replay FILE      Replay a heaptrace recording instead of the synthetic workload\n"
+        << "  --replay-step-events N\n"
+        << "                     Trace events per step when replaying (default 10000)\n"
+        << "  --replay-start SEC, --replay-end SEC\n"
+        << "                     Only replay events in this window, in seconds from the start of the trace\n"
+        << "  --sites N          List the N call sites whose blocks cause the most fragmentation, from\n"
+        << "                     the stacks sampled by the recorder; all go to FILE_sites.csv\n"
+        << "  --sites-min-age N  Steps a block must have been live for to count as pinning (default 1)\n"
+        << "  --list-backends    Print the backends compiled into this build\n"
+        << "  --check            Only check that the backend supports the options (exit code 2 if not)\n"
+        << "  --help             Show this message\n";
+}
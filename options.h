@@ -0,0 +1,49 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "heap_backend.h"
+#include "metrics_exporter.h"
+#include "simulation.h"
+#include "site_attribution.h"
+#include "stats_writer.h"
+#include "trace_replay.h"
+
+// Everything selectable from the command line.
+struct Options {
+    std::string backend;                                   // Empty: the system allocator.
+    std::string outputPath = "heap_fragmentation_stats.csv";
+    bool outputGiven = false;                              // Otherwise the extension follows --format.
+    StatsFormat format = StatsFormat::Csv;
+    unsigned int seed = 0;
+    bool seedGiven = false;                                // Otherwise seeded from the clock.
+    InspectionMode inspection = InspectionMode::Full;
+    std::vector<std::pair<std::string, long>> tunables;   // --tune NAME=VALUE, applied in order.
+    std::vector<std::string> glibcTunables;                // --glibc-tunable NAME=VALUE, full names.
+    std::vector<size_t> fitSizes;                          // --fit-sizes, else typicalRequestSizes().
+    bool hugePages = false;                                // --huge-pages: back the heap with huge pages.
+    MetricsOptions metrics;                                // --metrics-shm, --metrics-listen.
+    SiteOptions sites;                                     // --sites, --sites-min-age (replay only).
+    std::string commandLine;                               // argv joined by spaces, for the stats file's header.
+    std::vector<std::string> arguments;                    // argv after the program name, saved in checkpoints.
+    std::string resumePath;                                // --resume: the run's options come from there.
+    bool durationGiven = false;                            // --duration, which --resume may override.
+    bool listBackends = false;
+    bool checkOnly = false;                                // --check: validate against the backend, run nothing.
+    bool showHelp = false;
+    std::string workloadPath;                              // Workload file; phases start from the flags below.
+    WorkloadPhase workloadDefaults;                        // --steps, --sizes, --lifetime, ...
+    SimulationOptions simulation;                          // Workload filled in by parseOptions().
+    ReplayOptions replay;                                  // Replaces the synthetic workload if a path is set.
+};
+
+/**
+ * @brief Parses argv into @p options.
+ * @return false on a malformed command line, with the reason in @p error.
+ */
+bool parseOptions(int argc, char** argv, Options& options, std::string& error);
+
+void printUsage(std::ostream& out, const char* program);
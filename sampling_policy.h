@@ -0,0 +1,122 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "checkpoint_stream.h"
+#include "memory_usage.h"
+
+// When the simulation takes a HeapStats sample (--sample-every, --adaptive-sampling).
+struct SamplingOptions {
+    int every = 1;                    // Steps between two samples; with backoff, the shortest gap.
+    bool adaptive = false;            // Sample early on the events below and back off while nothing happens.
+    int maxEvery = 0;                 // Longest gap backoff may reach; 0 for 64 x every.
+    size_t largeFreeBytes = 1 << 20;  // A free of a block at least this big triggers a sample.
+    double internalChangePercent = 5; // So does internal fragmentation moving this much since the last sample.
+
+    // The gap backoff stops at.
+    int longestGap() const { return maxEvery > 0 ? std::max(maxEvery, every) : 64 * every; }
+};
+
+// Why a row was sampled, as a bit mask in the SampleTrigger column.
+enum SampleTrigger : uint32_t {
+    kSampleInterval = 1,       // The gap since the previous sample was up.
+    kSampleHeapGrowth = 2,     // The process committed more memory than ever before.
+    kSampleLargeFree = 4,      // A block of at least SamplingOptions::largeFreeBytes was freed.
+    kSampleInternalChange = 8, // Internal fragmentation moved by more than the set share.
+    kSampleForced = 16,        // First or last step, or a step due for a trim or a layout snapshot.
+};
+
+/**
+ * @brief Decides, at the end of each step, whether the step gets a HeapStats row.
+ *
+ * An inspect() walks the heap, which costs far more than a step's worth of
+ * allocations once the heap is large. Without --adaptive-sampling a row is
+ * taken every SamplingOptions::every steps. With it, a step is also sampled
+ * straight away when one of three cheap signals fires: the process's commit
+ * charge reaches a new high (the heap grew with sbrk, mmap or a commit), a
+ * large block was freed, or the live blocks' internal fragmentation, which
+ * the live-block tables keep as running totals, has moved by more than the
+ * set share since the last row. Every row that only the interval asked for
+ * doubles the interval, up to SamplingOptions::maxEvery, so a steady state
+ * costs ever fewer rows; any trigger resets it to SamplingOptions::every.
+ *
+ * The commit charge is read once per step, from /proc/self/statm or
+ * GetProcessMemoryInfo(). It counts the whole process, the stats writer's
+ * buffers included, but those stop growing early in a run.
+ */
+class SamplingPolicy {
+public:
+    explicit SamplingPolicy(const SamplingOptions& options)
+        : options_(options),
+          maxEvery_(options.longestGap()),
+          interval_(options.every),
+          peakCommitted_(options.adaptive ? committedBytes() : 0) {}
+
+    /**
+     * @brief Called once at the end of every step.
+     * @param forced Sample this step whatever the signals say.
+     * @param largestFree Usable size of the biggest block freed since the previous call.
+     * @return The reasons to sample this step, 0 to skip it.
+     */
+    uint32_t due(bool forced, size_t largestFree, size_t totalRequested, size_t totalUsable) {
+        ++stepsSince_;
+        uint32_t triggers = forced ? uint32_t{kSampleForced} : 0u;
+        if (stepsSince_ >= interval_) {
+            triggers |= kSampleInterval;
+        }
+        const size_t internal = totalUsable - totalRequested;
+        if (options_.adaptive) {
+            if (size_t committed = committedBytes(); committed > peakCommitted_) {
+                peakCommitted_ = committed;
+                triggers |= kSampleHeapGrowth;
+            }
+            if (largestFree >= options_.largeFreeBytes) {
+                triggers |= kSampleLargeFree;
+            }
+            double change = static_cast<double>(internal > lastInternal_ ? internal - lastInternal_
+                                                                        : lastInternal_ - internal);
+            if (change * 100 > options_.internalChangePercent * static_cast<double>(lastInternal_)) {
+                triggers |= kSampleInternalChange;
+            }
+        }
+        if (triggers == 0) {
+            return 0;
+        }
+
+        // A forced sample alone leaves the interval where it was, so plain
+        // --sample-every rows stay on the same steps.
+        if (triggers != kSampleForced) {
+            if (options_.adaptive) {
+                bool event = (triggers & (kSampleHeapGrowth | kSampleLargeFree | kSampleInternalChange)) != 0;
+                interval_ = event ? options_.every : std::min(interval_ * 2, maxEvery_);
+            }
+            stepsSince_ = 0;
+        }
+        lastInternal_ = internal;
+        return triggers;
+    }
+
+    // The gap and the signals' baselines, so a resumed run samples the steps this one would have.
+    void save(CheckpointWriter& out) const {
+        out.put(interval_);
+        out.put(stepsSince_);
+        out.put(peakCommitted_);
+        out.put(lastInternal_);
+    }
+    void load(CheckpointReader& in) {
+        interval_ = in.get<int>();
+        stepsSince_ = in.get<int>();
+        peakCommitted_ = in.get<size_t>();
+        lastInternal_ = in.get<size_t>();
+    }
+
+private:
+    SamplingOptions options_;
+    int maxEvery_;
+    int interval_;
+    int stepsSince_ = 0;
+    size_t peakCommitted_;
+    size_t lastInternal_ = 0;
+};
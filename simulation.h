@@ -0,0 +1,490 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "checkpoint.h"
+#include "compaction.h"
+#include "cycle_clock.h"
+#include "heap_backend.h"
+#include "heap_stats.h"
+#include "huge_pages.h"
+#include "latency_histogram.h"
+#include "layout_recorder.h"
+#include "live_block_table.h"
+#include "locality_probe.h"
+#include "memory_usage.h"
+#include "sampling_policy.h"
+#include "workload.h"
+
+// OS-level probes taken with each sample, on top of the backend's inspect().
+struct ProbeOptions {
+    bool residency = false; // Count the resident pages inside free blocks (--residency).
+    int trimEvery = 0;      // Trim the heap before every Nth sample (--trim-every), 0 for never.
+    int layoutEvery = 0;    // Snapshot the heap layout every Nth sample (--layout-every), 0 for never.
+    bool locality = false;  // Time a walk over the live blocks (--locality); needs the simulation's tables.
+    LayoutRecorder* layout = nullptr; // Where the snapshots go; set up by the driver.
+    bool hugePageStats = false; // Count huge pages and 2 MiB regions by use (--huge-page-stats).
+    HugePageProbe* hugePages = nullptr; // Set up by the driver along with it.
+    SamplingOptions sampling;           // Which steps get a row at all.
+};
+
+// Steps that are sampled whatever SamplingPolicy says: the first and the last,
+// and those due for a trim or a layout snapshot, which happen while sampling.
+inline bool mustSample(const ProbeOptions& probes, int timeStep, bool lastStep) {
+    return timeStep == 0 || lastStep || (probes.trimEvery > 0 && (timeStep + 1) % probes.trimEvery == 0) ||
+           (probes.layoutEvery > 0 && timeStep % probes.layoutEvery == 0);
+}
+
+// Shape of the synthetic workload.
+struct SimulationOptions {
+    WorkloadSpec workload;
+    unsigned int seed = 0;
+    int threads = 1;               // More than one selects runThreadedSimulation().
+    int crossThreadFreePercent = 25; // Share of frees handed to another thread.
+    ProbeOptions probes;
+    CompactionOptions compaction;
+    SoakOptions soak;
+};
+
+/**
+ * @brief Times a single allocator call with the CycleClock.
+ * @return The call's result, with the elapsed ticks recorded in @p histogram
+ * and, if given, stored in @p elapsed.
+ */
+template <typename Call>
+auto timedCall(LatencyHistogram& histogram, Call&& call, uint64_t* elapsed = nullptr) {
+    uint64_t start = CycleClock::now();
+    if constexpr (std::is_void_v<decltype(call())>) {
+        call();
+        uint64_t ticks = CycleClock::now() - start;
+        histogram.record(ticks);
+        if (elapsed) {
+            *elapsed = ticks;
+        }
+    } else {
+        auto result = call();
+        uint64_t ticks = CycleClock::now() - start;
+        histogram.record(ticks);
+        if (elapsed) {
+            *elapsed = ticks;
+        }
+        return result;
+    }
+}
+
+// Converts a histogram of CycleClock ticks into the percentiles written to the CSV.
+inline LatencySummary summarizeLatency(const LatencyHistogram& histogram) {
+    LatencySummary summary;
+    summary.p50Ns = CycleClock::toNanoseconds(histogram.percentile(0.50));
+    summary.p99Ns = CycleClock::toNanoseconds(histogram.percentile(0.99));
+    summary.p999Ns = CycleClock::toNanoseconds(histogram.percentile(0.999));
+    summary.maxNs = CycleClock::toNanoseconds(histogram.max());
+    return summary;
+}
+
+/**
+ * @brief Alloc and free latency split by the arena that served each block.
+ *
+ * Records nothing unless @p Backend is an ArenaHeapBackend. Every thread that
+ * allocates keeps its own; whoever samples merges them and files the
+ * summaries under the matching ArenaStats of the row. An arena's histograms
+ * are added the first time one of its blocks is seen, so after warm-up
+ * recording allocates nothing.
+ */
+template <HeapBackend Backend>
+class ArenaLatency {
+public:
+    // The arena of @p block, to be taken before the block is released.
+    uintptr_t arenaOf(Backend& backend, void* block) const {
+        if constexpr (ArenaHeapBackend<Backend>) {
+            return backend.arenaOf(block);
+        } else {
+            return 0;
+        }
+    }
+
+    void recordAlloc(Backend& backend, void* block, uint64_t ticks) {
+        if (uintptr_t arena = arenaOf(backend, block)) {
+            histograms(arena).alloc.record(ticks);
+        }
+    }
+
+    void recordFree(uintptr_t arena, uint64_t ticks) {
+        if (arena != 0) {
+            histograms(arena).free.record(ticks);
+        }
+    }
+
+    // Adds @p other into this one and clears @p other.
+    void take(ArenaLatency& other) {
+        for (auto& arena : other.arenas_) {
+            Histograms& mine = histograms(arena->arena);
+            mine.alloc.merge(arena->alloc);
+            mine.free.merge(arena->free);
+        }
+        other.reset();
+    }
+
+    void reset() {
+        for (auto& arena : arenas_) {
+            arena->alloc.reset();
+            arena->free.reset();
+        }
+    }
+
+    // Fills in the latency of every row of @p arenas this one has figures for.
+    void summarize(Backend& backend, std::vector<ArenaStats>& arenas) const {
+        if constexpr (ArenaHeapBackend<Backend>) {
+            for (const auto& arena : arenas_) {
+                int number = backend.arenaNumber(arena->arena);
+                for (ArenaStats& row : arenas) {
+                    if (row.arena == number) {
+                        row.allocLatency = summarizeLatency(arena->alloc);
+                        row.freeLatency = summarizeLatency(arena->free);
+                    }
+                }
+            }
+        }
+    }
+
+private:
+    struct Histograms {
+        uintptr_t arena = 0;
+        LatencyHistogram alloc;
+        LatencyHistogram free;
+    };
+
+    Histograms& histograms(uintptr_t arena) {
+        for (auto& entry : arenas_) {
+            if (entry->arena == arena) {
+                return *entry;
+            }
+        }
+        arenas_.push_back(std::make_unique<Histograms>());
+        arenas_.back()->arena = arena;
+        return *arenas_.back();
+    }
+
+    std::vector<std::unique_ptr<Histograms>> arenas_; // A handful; histograms are atomics, so not movable.
+};
+
+/**
+ * @brief Step B: turns the running totals and a heap inspection into one HeapStats row.
+ */
+inline HeapStats collectHeapStats(int timeStep, size_t totalRequested, size_t totalUsable,
+                                  HeapInfo&& info, const LatencyHistogram& allocLatency,
+                                  const LatencyHistogram& freeLatency) {
+    HeapStats currentStats;
+    currentStats.timeStep = timeStep;
+    currentStats.totalUserRequested = totalRequested;
+    currentStats.totalHeapCommitted = totalUsable;
+    currentStats.internalFragmentation = currentStats.totalHeapCommitted - currentStats.totalUserRequested;
+
+    currentStats.totalFreeOnHeap = info.totalFree;
+    currentStats.biggestFreeBlock = info.biggestFreeBlock;
+    currentStats.externalFragmentationRatio = externalFragmentationRatio(info);
+
+    currentStats.allocLatency = summarizeLatency(allocLatency);
+    currentStats.freeLatency = summarizeLatency(freeLatency);
+    currentStats.arenas = std::move(info.arenas);
+    currentStats.freeBlocks = info.freeBlocks;
+    return currentStats;
+}
+
+// What the realloc operations since the previous sample did.
+struct ReallocCounters {
+    uint64_t calls = 0;
+    uint64_t moves = 0;       // Calls that left the block at a new address.
+    uint64_t copiedBytes = 0; // Old requested size of every moved block.
+    uint64_t ticks = 0;       // CycleClock ticks spent in the calls, copies included.
+
+    void merge(const ReallocCounters& other) {
+        calls += other.calls;
+        moves += other.moves;
+        copiedBytes += other.copiedBytes;
+        ticks += other.ticks;
+    }
+};
+
+// Alignment of the next allocation of @p phase: the phase's alignment for
+// WorkloadPhase::alignedPercent of them, else 0.
+inline size_t drawAlignment(const WorkloadPhase& phase, FastRandom& random) {
+    // No draw at all for phases without aligned blocks, so existing seeds give the same runs.
+    if (phase.alignedPercent == 0) {
+        return 0;
+    }
+    return static_cast<int>(random.below(100)) < phase.alignedPercent ? phase.alignment : 0;
+}
+
+// The size a block of @p requested bytes grows to under @p phase, or 0 if it
+// is already kMaxSize or more and cannot grow.
+inline size_t grownSize(const WorkloadPhase& phase, size_t requested) {
+    if (requested >= SizeDistribution::kMaxSize) {
+        return 0;
+    }
+    double grown = std::min(std::ceil(static_cast<double>(requested) * phase.reallocGrowth),
+                            static_cast<double>(SizeDistribution::kMaxSize));
+    return std::clamp(static_cast<size_t>(grown), requested + 1, SizeDistribution::kMaxSize);
+}
+
+/**
+ * @brief Grows the block at @p index of @p blocks to @p size bytes, as a growing buffer does.
+ *
+ * Plain blocks go through the backend's own realloc if it has one. Otherwise,
+ * and always for aligned blocks (C has no aligned realloc), a block with room
+ * to spare keeps its address and any other is moved: allocate, copy the old
+ * contents, release. Every call that ends at a new address counts as a move
+ * that copied the old requested size, even where the allocator could remap
+ * pages instead (glibc's mremap for mmap'd chunks). A failed call leaves the
+ * block as it was.
+ */
+template <HeapBackend Backend>
+void growBlock(Backend& backend, LiveBlockTable& blocks, size_t index, size_t size, ReallocCounters& counters) {
+    const LiveBlock block = blocks[index];
+    uint64_t start = CycleClock::now();
+    void* resized = nullptr;
+    bool resizedByBackend = false;
+    if constexpr (ReallocHeapBackend<Backend>) {
+        if (block.alignment == 0) {
+            resized = backend.reallocate(block.ptr, size);
+            resizedByBackend = true;
+        }
+    }
+    if (!resizedByBackend) {
+        if (size + alignmentOverhead<Backend>(block.alignment) <= block.usable) {
+            resized = block.ptr;
+        } else if ((resized = allocateBlock(backend, size, block.alignment)) != nullptr) {
+            std::memcpy(resized, block.ptr, block.requested);
+            backend.release(block.ptr);
+        }
+    }
+    counters.ticks += CycleClock::now() - start;
+    ++counters.calls;
+    if (!resized) {
+        return;
+    }
+    if (resized != block.ptr) {
+        ++counters.moves;
+        counters.copiedBytes += block.requested;
+    }
+    blocks.resizeAt(index, resized, size, backend.usableSize(resized));
+}
+
+// Fills in the realloc, alignment and sampling figures of a row, which come
+// from the workload rather than from inspecting the heap.
+inline void addWorkloadCounters(HeapStats& stats, const ReallocCounters& reallocs, size_t alignedFragmentation,
+                                uint32_t sampleTrigger) {
+    stats.reallocations = reallocs.calls;
+    stats.reallocMoves = reallocs.moves;
+    stats.reallocCopiedBytes = reallocs.copiedBytes;
+    stats.reallocNs = CycleClock::toNanoseconds(reallocs.ticks);
+    stats.alignedFragmentation = alignedFragmentation;
+    stats.sampleTrigger = sampleTrigger;
+}
+
+/**
+ * @brief Step B with the OS-level probes: trims if this step is due for it,
+ * inspects the heap, then records RSS and, if asked for, free-page residency,
+ * a layout snapshot and the huge-page figures.
+ *
+ * The trim's cost is its wall time and its gain the drop in RSS across it;
+ * the heap figures of the row are those after the trim. Everything after the
+ * trim is timed as the sample's own cost (Sample_ns).
+ */
+template <HeapBackend Backend>
+HeapStats sampleHeap(Backend& backend, const ProbeOptions& probes, int timeStep, size_t totalRequested,
+                     size_t totalUsable, const LatencyHistogram& allocLatency, const LatencyHistogram& freeLatency) {
+    uint64_t trimNs = 0;
+    int64_t trimReclaimed = 0;
+    if constexpr (TrimmableHeapBackend<Backend>) {
+        if (probes.trimEvery > 0 && (timeStep + 1) % probes.trimEvery == 0) {
+            size_t before = residentSetBytes();
+            uint64_t start = CycleClock::now();
+            backend.trim();
+            trimNs = CycleClock::toNanoseconds(CycleClock::now() - start);
+            trimReclaimed = static_cast<int64_t>(before) - static_cast<int64_t>(residentSetBytes());
+        }
+    }
+    uint64_t sampleStart = CycleClock::now();
+    HeapStats stats = collectHeapStats(timeStep, totalRequested, totalUsable, backend.inspect(), allocLatency,
+                                       freeLatency);
+    stats.residentSetBytes = residentSetBytes();
+    if constexpr (ResidencyHeapBackend<Backend>) {
+        if (probes.residency) {
+            stats.residentFreeBytes = backend.residentFreeBytes();
+        }
+    }
+    stats.trimNs = trimNs;
+    stats.trimReclaimedBytes = trimReclaimed;
+    if constexpr (LayoutHeapBackend<Backend>) {
+        if (probes.layout && probes.layoutEvery > 0 && timeStep % probes.layoutEvery == 0) {
+            backend.heapLayout(probes.layout->spans());
+            probes.layout->record(timeStep);
+        }
+        if (probes.hugePages) {
+            probes.hugePages->measure(backend, stats);
+        }
+    }
+    stats.sampleNs = CycleClock::toNanoseconds(CycleClock::now() - sampleStart);
+    return stats;
+}
+
+/**
+ * @brief Gives every entry of a table loaded from a checkpoint a new block of
+ * its requested size and alignment, oldest block first, so the heap is laid
+ * out roughly in the order the original run built it.
+ * Throws std::runtime_error if the backend runs out of memory.
+ */
+template <HeapBackend Backend>
+void reallocateLiveBlocks(Backend& backend, LiveBlockTable& blocks) {
+    std::vector<size_t> order(blocks.size());
+    std::iota(order.begin(), order.end(), size_t{0});
+    const uint32_t next = blocks.nextSerial();
+    std::sort(order.begin(), order.end(),
+              [&](size_t a, size_t b) { return next - blocks[a].serial > next - blocks[b].serial; });
+    for (size_t index : order) {
+        const LiveBlock& block = blocks[index];
+        void* ptr = allocateBlock(backend, block.requested, block.alignment);
+        if (!ptr) {
+            throw std::runtime_error("out of memory reallocating the checkpoint's live blocks");
+        }
+        blocks.attach(index, ptr, backend.usableSize(ptr));
+    }
+}
+
+/**
+ * @brief Runs the timestep loop against @p backend, writing one HeapStats per step to @p sink.
+ *
+ * Each step allocates a batch of new blocks with sizes drawn from the current
+ * phase's distribution (some of them aligned), grows a few random live blocks
+ * with realloc, then frees whatever its lifetime model says is due, which
+ * mimics the churn of a real application and gradually fragments the heap.
+ * A SamplingPolicy picks the steps that get a row; the latency and realloc
+ * figures of a row cover every step since the previous one.
+ * With CompactionOptions::threshold set, a sample over the threshold is
+ * followed by a HeapCompactor pass, reported in the same row.
+ *
+ * SoakOptions::durationSeconds ends the run early, at the first step past it.
+ * Every SoakOptions::checkpointEvery steps, and at such an early end, the
+ * step is sampled and the RNG, the lifetime scheduler, the sampling policy
+ * and the live-block table are saved through the Checkpointer. A run given
+ * SoakOptions::resume loads them back, allocates every live block anew and
+ * carries on at the saved step with the same workload; the heap it carries
+ * on with is a fresh one, which only approximates the saved run's layout.
+ * All blocks still alive at the end are released before returning.
+ */
+template <HeapBackend Backend, StatsSink Sink>
+void runSimulation(Backend& backend, const SimulationOptions& options, Sink& sink) {
+    // Every block we currently own, with its requested and usable size.
+    // The table also keeps the running totals used for Step B.
+    LiveBlockTable allocatedBlocks;
+    LatencyHistogram allocLatency;
+    LatencyHistogram freeLatency;
+    ArenaLatency<Backend> arenaLatency;
+    ReallocCounters reallocs;
+    HeapCompactor compactor(options.compaction);
+    LocalityProbe locality;
+    LiveBlockTable* const tables[] = {&allocatedBlocks};
+    SamplingPolicy sampling(options.probes.sampling);
+    size_t largestFree = 0;
+    const int lastStep = options.workload.totalSteps() - 1;
+    LifetimeScheduler scheduler(options.seed);
+    FastRandom& random = scheduler.random();
+    const SoakOptions& soak = options.soak;
+    RunClock clock(soak);
+    int firstStep = 0;
+    if (soak.resume) {
+        CheckpointReader state(soak.resume->state);
+        scheduler.load(state);
+        sampling.load(state);
+        allocatedBlocks.load(state);
+        state.expectEnd();
+        reallocateLiveBlocks(backend, allocatedBlocks);
+        firstStep = soak.resume->nextStep;
+    }
+
+    int t = 0;
+    bool stopped = false;
+    for (const WorkloadPhase& phase : options.workload.phases) {
+        // A resumed run skips the steps done before the checkpoint.
+        int skipped = std::clamp(firstStep - t, 0, phase.steps);
+        t += skipped;
+        for (int phaseStep = skipped; phaseStep < phase.steps && !stopped; ++phaseStep, ++t) {
+            // Step A: Perform Memory Operations to simulate a workload.
+            for (int i = 0; i < phase.allocationsPerStep; ++i) {
+                size_t size = phase.sizes(random);
+                size_t alignment = drawAlignment(phase, random);
+                uint64_t ticks = 0;
+                void* block =
+                    timedCall(allocLatency, [&] { return allocateBlock(backend, size, alignment); }, &ticks);
+                if (block) {
+                    arenaLatency.recordAlloc(backend, block, ticks);
+                    scheduler.onAllocated(
+                        phase, allocatedBlocks.add(block, size, backend.usableSize(block), alignment), t);
+                }
+            }
+            for (int i = 0; i < phase.reallocationsPerStep && !allocatedBlocks.empty(); ++i) {
+                size_t index = random.below(static_cast<uint32_t>(allocatedBlocks.size()));
+                if (size_t size = grownSize(phase, allocatedBlocks[index].requested)) {
+                    growBlock(backend, allocatedBlocks, index, size, reallocs);
+                }
+            }
+            scheduler.freeDue(phase, t, allocatedBlocks, [&](const LiveBlock& victim) {
+                largestFree = std::max(largestFree, victim.usable);
+                uintptr_t arena = arenaLatency.arenaOf(backend, victim.ptr);
+                uint64_t ticks = 0;
+                timedCall(freeLatency, [&] { backend.release(victim.ptr); }, &ticks);
+                arenaLatency.recordFree(arena, ticks);
+            });
+
+            // Step B: Collect Data for this Timestep, if the sampling policy picks it.
+            stopped = clock.timeUp();
+            bool checkpoint = soak.checkpointEvery > 0 && t != lastStep &&
+                              ((t + 1) % soak.checkpointEvery == 0 || stopped);
+            bool forced = mustSample(options.probes, t, t == lastStep || stopped) || checkpoint;
+            uint32_t trigger = sampling.due(forced, largestFree, allocatedBlocks.totalRequested(),
+                                            allocatedBlocks.totalUsable());
+            largestFree = 0;
+            if (trigger == 0) {
+                continue;
+            }
+            compactor.reserve(backend, tables);
+            HeapStats stats = sampleHeap(backend, options.probes, t, allocatedBlocks.totalRequested(),
+                                         allocatedBlocks.totalUsable(), allocLatency, freeLatency);
+            arenaLatency.summarize(backend, stats.arenas);
+            addWorkloadCounters(stats, reallocs, allocatedBlocks.totalAlignedFragmentation(), trigger);
+            if (options.probes.locality) {
+                locality.measure(tables, stats);
+            }
+            compactor.compactIfFragmented(backend, tables, stats);
+            sink.write(std::move(stats));
+            allocLatency.reset();
+            freeLatency.reset();
+            arenaLatency.reset();
+            reallocs = {};
+            // Right after a sample nothing is pending in the histograms and counters.
+            if (checkpoint) {
+                CheckpointWriter state;
+                scheduler.save(state);
+                sampling.save(state);
+                allocatedBlocks.save(state);
+                soak.checkpointer->save(t + 1, clock.seconds(), state);
+            }
+        }
+    }
+
+    // --- Final Cleanup ---
+    for (const LiveBlock& block : allocatedBlocks) {
+        backend.release(block.ptr);
+    }
+    allocatedBlocks.clear();
+}
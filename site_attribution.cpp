@@ -0,0 +1,161 @@
+#include "site_attribution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+
+void SiteAttribution::start(const trace::TraceFile& file) {
+    if (!file.hasStacks()) {
+        throw std::runtime_error("the trace has no call stacks; record it with HEAPTRACE_STACK_EVERY=N or "
+                                 "HEAPTRACE_STACK_BYTES=N to use --sites");
+    }
+    sampling_ = file.stackSampling();
+    period_ = static_cast<double>(std::max<uint64_t>(file.stackSamplingPeriod(), 1));
+}
+
+void SiteAttribution::allocated(uint64_t address, uint32_t stack, size_t requested, int step) {
+    if (stack == 0) {
+        tracked_.erase(address); // The address was taken over by an unsampled block.
+        return;
+    }
+    double weight = period_;
+    if (sampling_ == trace::StackSampling::Bytes) {
+        weight = requested > 0 ? 1.0 / -std::expm1(-static_cast<double>(requested) / period_) : 1.0;
+    }
+    tracked_[address] = {stack, step, weight};
+    Site& site = sites_[stack];
+    site.stack = stack;
+    site.allocations += weight;
+}
+
+void SiteAttribution::released(uint64_t address) {
+    tracked_.erase(address);
+}
+
+void SiteAttribution::sample(const std::unordered_map<uint64_t, LiveBlock>& liveBlocks, int step) {
+    ++samples_;
+    if (tracked_.empty()) {
+        return;
+    }
+    liveAddresses_.clear();
+    if (!spans_.empty()) {
+        for (const auto& [address, block] : liveBlocks) {
+            liveAddresses_.push_back(reinterpret_cast<uintptr_t>(block.ptr));
+        }
+        std::sort(liveAddresses_.begin(), liveAddresses_.end());
+    }
+
+    for (const auto& [address, tracked] : tracked_) {
+        auto live = liveBlocks.find(address);
+        if (live == liveBlocks.end()) {
+            continue;
+        }
+        const LiveBlock& block = live->second;
+        Site& site = sites_[tracked.stack];
+        site.blocks += tracked.weight;
+        site.internalBytes += tracked.weight * static_cast<double>(block.usable - block.requested);
+        if (step - tracked.born < options_.minAge || spans_.empty()) {
+            continue;
+        }
+        // The busy span holding the block, which must hold no other live block.
+        uintptr_t start = reinterpret_cast<uintptr_t>(block.ptr);
+        auto span = std::upper_bound(spans_.begin(), spans_.end(), start,
+                                     [](uintptr_t value, const HeapSpan& s) { return value < s.address; });
+        if (span == spans_.begin()) {
+            continue;
+        }
+        --span;
+        uintptr_t spanEnd = span->address + span->size;
+        if (!span->busy || start >= spanEnd) {
+            continue;
+        }
+        auto at = std::lower_bound(liveAddresses_.begin(), liveAddresses_.end(), start);
+        if ((at != liveAddresses_.begin() && *(at - 1) >= span->address) ||
+            (at + 1 != liveAddresses_.end() && *(at + 1) < spanEnd)) {
+            continue;
+        }
+        size_t below = span != spans_.begin() && !(span - 1)->busy ? (span - 1)->size : 0;
+        size_t above = span + 1 != spans_.end() && !(span + 1)->busy ? (span + 1)->size : 0;
+        if (below > 0 && above > 0) {
+            site.pinningBlocks += tracked.weight;
+            site.pinnedBytes += tracked.weight * static_cast<double>(below + above);
+        }
+    }
+}
+
+void SiteAttribution::finish(const trace::TraceFile& file) {
+    for (auto& [stack, site] : sites_) {
+        site.frames.clear();
+        if (const std::vector<uint64_t>* frames = file.stack(stack)) {
+            for (uint64_t frame : *frames) {
+                site.frames.push_back(file.describeFrame(frame));
+            }
+        }
+    }
+    tracked_.clear();
+}
+
+std::vector<const SiteAttribution::Site*> SiteAttribution::ranked() const {
+    std::vector<const Site*> sites;
+    for (const auto& [stack, site] : sites_) {
+        sites.push_back(&site);
+    }
+    std::sort(sites.begin(), sites.end(), [](const Site* a, const Site* b) {
+        return a->fragmentationBytes() != b->fragmentationBytes() ? a->fragmentationBytes() > b->fragmentationBytes()
+                                                                  : a->stack < b->stack;
+    });
+    return sites;
+}
+
+void SiteAttribution::write(const std::string& path, const RunMetadata& metadata) const {
+    std::FILE* file = std::fopen(path.c_str(), "w");
+    if (!file) {
+        throw std::runtime_error("could not open " + path + " for writing");
+    }
+    for (const auto& [key, value] : metadata) {
+        std::fprintf(file, "# %s=%s\n", key.c_str(), value.c_str());
+    }
+    std::fprintf(file, "# sites.sampling=%s\n# sites.period=%.0f\n# sites.samples=%llu\n# sites.min_age=%d\n",
+                 sampling_ == trace::StackSampling::Bytes ? "bytes" : "every", period_,
+                 static_cast<unsigned long long>(samples_), options_.minAge);
+    std::fputs("Rank,Stack,Allocations,Blocks,InternalFrag_Bytes,PinningBlocks,Pinned_Bytes,Fragmentation_Bytes,"
+               "Frames\n",
+               file);
+    double samples = static_cast<double>(std::max<uint64_t>(samples_, 1));
+    int rank = 0;
+    for (const Site* site : ranked()) {
+        std::fprintf(file, "%d,%u,%.0f,%.2f,%.1f,%.2f,%.1f,%.1f,", ++rank, site->stack, site->allocations,
+                     site->blocks / samples, site->internalBytes / samples, site->pinningBlocks / samples,
+                     site->pinnedBytes / samples, site->fragmentationBytes() / samples);
+        for (size_t i = 0; i < site->frames.size(); ++i) {
+            std::fprintf(file, "%s%s", i ? ";" : "", site->frames[i].c_str());
+        }
+        std::fputc('\n', file);
+    }
+    if (std::fclose(file) != 0) {
+        throw std::runtime_error("could not write " + path);
+    }
+}
+
+void SiteAttribution::printTop(std::ostream& out) const {
+    constexpr size_t kFramesShown = 4;
+    std::vector<const Site*> sites = ranked();
+    double samples = static_cast<double>(std::max<uint64_t>(samples_, 1));
+    size_t shown = std::min(sites.size(), static_cast<size_t>(options_.top));
+    out << "Top " << shown << " of " << sites.size() << " call sites by fragmentation, mean over " << samples_
+        << " sampled steps:" << std::endl;
+    char line[160];
+    for (size_t i = 0; i < shown; ++i) {
+        const Site& site = *sites[i];
+        std::snprintf(line, sizeof(line), "%3zu. %12.0f bytes: %.0f internal, %.0f pinned by %.1f blocks\n     ",
+                      i + 1, site.fragmentationBytes() / samples, site.internalBytes / samples,
+                      site.pinnedBytes / samples, site.pinningBlocks / samples);
+        out << line;
+        for (size_t f = 0; f < site.frames.size() && f < kFramesShown; ++f) {
+            out << (f ? " <- " : "") << site.frames[f];
+        }
+        out << (site.frames.size() > kFramesShown ? " <- ..." : "") << '\n';
+    }
+    out.flush();
+}
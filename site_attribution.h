@@ -0,0 +1,100 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "heap_backend.h"
+#include "live_block_table.h"
+#include "stats_writer.h"
+#include "trace_file.h"
+
+// --sites: which call sites the fragmentation of a replayed trace comes from.
+struct SiteOptions {
+    int top = 0;    // Sites listed at the end of the run; 0 turns attribution off.
+    int minAge = 1; // Steps a block must have been live for to count as pinning (--sites-min-age).
+
+    bool enabled() const { return top > 0; }
+};
+
+/**
+ * @brief Charges the fragmentation of a replayed heap to the call stacks the
+ * recorder sampled (HEAPTRACE_STACK_EVERY / HEAPTRACE_STACK_BYTES).
+ *
+ * At every sampled step, each live block with a call stack is charged to it:
+ *
+ *   - its internal fragmentation, usable minus requested bytes;
+ *   - if it has been live for at least SiteOptions::minAge steps and free
+ *     chunks lie right below and above it, their bytes. Such a block is
+ *     "pinning": it keeps two free chunks from merging, and they would merge
+ *     if it went away. A free chunk between two pinning blocks is charged to
+ *     both.
+ *
+ * Free chunks come from the backend's heapLayout(), which the replay fills
+ * into spans() before each sample(), so memory the allocator holds for
+ * itself (this class's own maps among it) is never taken for free space. A
+ * block only pins if it is alone in its busy span, since a run of live
+ * blocks between two free chunks keeps them apart whichever one goes. With a
+ * backend that has no heap layout, only internal fragmentation is charged.
+ *
+ * A sampled block stands for several: period allocations with
+ * StackSampling::Every, 1 / (1 - exp(-size / period)) with StackSampling::Bytes.
+ * The report gives each site's weighted figures averaged over the sampled steps.
+ */
+class SiteAttribution {
+public:
+    explicit SiteAttribution(const SiteOptions& options) : options_(options) {}
+
+    // Throws std::runtime_error if @p file has no call stacks.
+    void start(const trace::TraceFile& file);
+
+    // @p address is the recorded one, the key of the replay's live blocks.
+    void allocated(uint64_t address, uint32_t stack, size_t requested, int step);
+    void released(uint64_t address);
+    // Charges the blocks live at @p step, reading free chunks from spans().
+    void sample(const std::unordered_map<uint64_t, LiveBlock>& liveBlocks, int step);
+
+    // The buffer heapLayout() fills for the next sample(); left empty, nothing pins.
+    std::vector<HeapSpan>& spans() { return spans_; }
+
+    // Names the frames of every site that was charged anything; call before @p file goes away.
+    void finish(const trace::TraceFile& file);
+
+    // Every site, most fragmentation first, as CSV. Throws std::runtime_error if @p path cannot be written.
+    void write(const std::string& path, const RunMetadata& metadata) const;
+    void printTop(std::ostream& out) const;
+
+private:
+    struct Tracked {
+        uint32_t stack;
+        int born;
+        double weight;
+    };
+
+    // Sums over the sampled steps.
+    struct Site {
+        uint32_t stack = 0;
+        double allocations = 0;
+        double blocks = 0;
+        double internalBytes = 0;
+        double pinningBlocks = 0;
+        double pinnedBytes = 0;
+        std::vector<std::string> frames;
+
+        double fragmentationBytes() const { return internalBytes + pinnedBytes; }
+    };
+
+    std::vector<const Site*> ranked() const;
+
+    SiteOptions options_;
+    trace::StackSampling sampling_ = trace::StackSampling::Every;
+    double period_ = 1;
+    std::unordered_map<uint64_t, Tracked> tracked_;
+    std::unordered_map<uint32_t, Site> sites_;
+    uint64_t samples_ = 0;
+    std::vector<HeapSpan> spans_;
+    std::vector<uintptr_t> liveAddresses_; // Scratch of sample(), kept to avoid reallocating.
+};
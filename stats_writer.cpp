@@ -0,0 +1,598 @@
+#include "stats_writer.h"
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <system_error>
+#include <iterator>
+#include <span>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+static_assert(std::endian::native == std::endian::little, "binary stats are written in host byte order");
+
+namespace {
+
+// Same names and order as the CSV header, so both formats read the same way.
+constexpr StatsColumn kStatsColumns[] = {
+    {"Time", 'i'},
+    {"InternalFrag_Bytes", 'u'},
+    {"ExternalFrag_Ratio", 'f'},
+    {"TotalFree_Bytes", 'u'},
+    {"BiggestBlock_Bytes", 'u'},
+    {"TotalUserRequested", 'u'},
+    {"AllocLatency_p50_ns", 'u'},
+    {"AllocLatency_p99_ns", 'u'},
+    {"AllocLatency_p999_ns", 'u'},
+    {"AllocLatency_max_ns", 'u'},
+    {"FreeLatency_p50_ns", 'u'},
+    {"FreeLatency_p99_ns", 'u'},
+    {"FreeLatency_p999_ns", 'u'},
+    {"FreeLatency_max_ns", 'u'},
+    {"RSS_Bytes", 'u'},
+    {"ResidentFree_Bytes", 'u'},
+    {"Trim_ns", 'u'},
+    {"TrimReclaimed_Bytes", 'i'},
+    {"Reallocs", 'u'},
+    {"ReallocMoves", 'u'},
+    {"ReallocCopied_Bytes", 'u'},
+    {"Realloc_ns", 'u'},
+    {"AlignedFrag_Bytes", 'u'},
+    {"Compact_ns", 'u'},
+    {"CompactMoved_Blocks", 'u'},
+    {"CompactMoved_Bytes", 'u'},
+    {"CompactRatio_After", 'f'},
+    {"TraverseAlloc_ns", 'f'},
+    {"TraverseAlloc_L1Miss", 'f'},
+    {"TraverseAlloc_LLCMiss", 'f'},
+    {"TraverseAlloc_dTLBMiss", 'f'},
+    {"TraverseRandom_ns", 'f'},
+    {"TraverseRandom_L1Miss", 'f'},
+    {"TraverseRandom_LLCMiss", 'f'},
+    {"TraverseRandom_dTLBMiss", 'f'},
+    {"LiveGap_Bytes", 'f'},
+    {"AnonHuge_Bytes", 'u'},
+    {"HugeRegions_Free", 'u'},
+    {"HugeRegions_Partial", 'u'},
+    {"HugeRegions_Full", 'u'},
+    {"SampleTrigger", 'u'},
+    {"Sample_ns", 'u'},
+};
+
+constexpr StatsColumn kArenaColumns[] = {
+    {"Time", 'i'},
+    {"Arena", 'i'},
+    {"Free_Bytes", 'u'},
+    {"BiggestBlock_Bytes", 'u'},
+    {"AllocLatency_p50_ns", 'u'},
+    {"AllocLatency_p99_ns", 'u'},
+    {"AllocLatency_p999_ns", 'u'},
+    {"AllocLatency_max_ns", 'u'},
+    {"FreeLatency_p50_ns", 'u'},
+    {"FreeLatency_p99_ns", 'u'},
+    {"FreeLatency_p999_ns", 'u'},
+    {"FreeLatency_max_ns", 'u'},
+};
+
+// One row per non-empty log2 bucket; Bucket_Bytes is the bucket's lower bound.
+constexpr StatsColumn kFreeBlockColumns[] = {
+    {"Time", 'i'},
+    {"Bucket_Bytes", 'u'},
+    {"Blocks", 'u'},
+    {"Free_Bytes", 'u'},
+};
+
+constexpr size_t kColumnNameBytes = 24;
+
+// One 8-byte cell of a binary record.
+union Cell {
+    int64_t i;
+    uint64_t u;
+    double f;
+};
+
+// Room one formatted cell can take: CsvLine's 32 characters and a separator.
+constexpr size_t kMaxCellBytes = 33;
+
+// Capacity of the writer thread's formatting buffer, reserved before it starts.
+constexpr size_t kTextBytes = 256 * 1024;
+
+// Written in one go: the files are unbuffered (see unbuffered()).
+bool writeHeader(std::FILE* file, std::span<const StatsColumn> columns, StatsFormat format,
+                 const RunMetadata& metadata) {
+    std::string header;
+    if (format == StatsFormat::Csv) {
+        for (const auto& [key, value] : metadata) {
+            header.append("# ").append(key).append("=").append(value).append("\n");
+        }
+        for (size_t i = 0; i < columns.size(); ++i) {
+            header.append(columns[i].name).push_back(i + 1 < columns.size() ? ',' : '\n');
+        }
+    } else {
+        header = binaryStatsHeader(columns, metadata);
+    }
+    return std::fwrite(header.data(), 1, header.size(), file) == header.size();
+}
+
+// stdio would malloc a buffer on the first write, which comes from the writer
+// thread; the rows are batched already, so the files go without one.
+std::FILE* unbuffered(std::FILE* file) {
+    if (file) {
+        std::setvbuf(file, nullptr, _IONBF, 0);
+    }
+    return file;
+}
+
+std::FILE* openOrThrow(const std::string& path, StatsFormat format) {
+    std::FILE* file = unbuffered(std::fopen(path.c_str(), format == StatsFormat::Csv ? "w" : "wb"));
+    if (!file) {
+        throw std::runtime_error("could not open " + path + " for writing");
+    }
+    return file;
+}
+
+// Cuts @p path back to @p bytes and opens it for appending.
+std::FILE* reopenAt(const std::string& path, uint64_t bytes, StatsFormat format) {
+    std::error_code error;
+    uint64_t size = std::filesystem::file_size(path, error);
+    if (error) {
+        throw std::runtime_error("cannot resume " + path + ": it is missing");
+    }
+    if (size < bytes) {
+        throw std::runtime_error("cannot resume " + path + ": it is shorter than at the checkpoint");
+    }
+    std::filesystem::resize_file(path, bytes, error);
+    std::FILE* file = error ? nullptr : unbuffered(std::fopen(path.c_str(), format == StatsFormat::Csv ? "a" : "ab"));
+    if (!file) {
+        throw std::runtime_error("could not reopen " + path + " to resume it");
+    }
+    return file;
+}
+
+// Size of @p path, or 0 if it does not exist.
+uint64_t fileBytes(const std::string& path) {
+    std::error_code error;
+    uint64_t size = std::filesystem::file_size(path, error);
+    return error ? 0 : size;
+}
+
+// Appends cells to a text buffer as one CSV line.
+class CsvLine {
+public:
+    explicit CsvLine(std::vector<char>& out) : out_(out) {}
+
+    template <typename T>
+    CsvLine& operator<<(T value) {
+        char digits[32];
+        std::to_chars_result result;
+        if constexpr (std::is_floating_point_v<T>) {
+            if (std::isnan(value)) {
+                std::memcpy(digits, "nan", 3);
+                result.ptr = digits + 3;
+            } else {
+                result = std::to_chars(digits, digits + sizeof(digits), value);
+            }
+        } else {
+            result = std::to_chars(digits, digits + sizeof(digits), value);
+        }
+        if (!first_) {
+            out_.push_back(',');
+        }
+        first_ = false;
+        out_.insert(out_.end(), digits, result.ptr);
+        return *this;
+    }
+
+    void end() { out_.push_back('\n'); }
+
+private:
+    std::vector<char>& out_;
+    bool first_ = true;
+};
+
+void appendCsvRow(std::vector<char>& out, const HeapStats& s, const std::vector<size_t>& fitSizes) {
+    CsvLine line(out);
+    line << s.timeStep << s.internalFragmentation << s.externalFragmentationRatio << s.totalFreeOnHeap
+         << s.biggestFreeBlock << s.totalUserRequested << s.allocLatency.p50Ns << s.allocLatency.p99Ns
+         << s.allocLatency.p999Ns << s.allocLatency.maxNs << s.freeLatency.p50Ns << s.freeLatency.p99Ns
+         << s.freeLatency.p999Ns << s.freeLatency.maxNs << s.residentSetBytes << s.residentFreeBytes << s.trimNs
+         << s.trimReclaimedBytes << s.reallocations << s.reallocMoves << s.reallocCopiedBytes << s.reallocNs
+         << s.alignedFragmentation << s.compactionNs << s.compactionMovedBlocks << s.compactionMovedBytes
+         << s.compactionRatioAfter << s.allocationOrder.ns << s.allocationOrder.l1Misses
+         << s.allocationOrder.llcMisses << s.allocationOrder.dtlbMisses << s.randomOrder.ns << s.randomOrder.l1Misses
+         << s.randomOrder.llcMisses << s.randomOrder.dtlbMisses << s.liveGapBytes << s.anonHugePageBytes
+         << s.hugeRegionsFree << s.hugeRegionsPartial << s.hugeRegionsFull << s.sampleTrigger << s.sampleNs;
+    for (size_t size : fitSizes) {
+        line << s.freeBlocks.allocatableFraction(size);
+    }
+    line.end();
+}
+
+void appendArenaRow(std::vector<char>& out, const HeapStats& s, const ArenaStats& arena, StatsFormat format) {
+    if (format == StatsFormat::Csv) {
+        CsvLine line(out);
+        line << s.timeStep << arena.arena << arena.freeBytes << arena.biggestFreeBlock << arena.allocLatency.p50Ns
+             << arena.allocLatency.p99Ns << arena.allocLatency.p999Ns << arena.allocLatency.maxNs
+             << arena.freeLatency.p50Ns << arena.freeLatency.p99Ns << arena.freeLatency.p999Ns
+             << arena.freeLatency.maxNs;
+        line.end();
+        return;
+    }
+    Cell cells[std::size(kArenaColumns)];
+    cells[0].i = s.timeStep;
+    cells[1].i = arena.arena;
+    cells[2].u = arena.freeBytes;
+    cells[3].u = arena.biggestFreeBlock;
+    cells[4].u = arena.allocLatency.p50Ns;
+    cells[5].u = arena.allocLatency.p99Ns;
+    cells[6].u = arena.allocLatency.p999Ns;
+    cells[7].u = arena.allocLatency.maxNs;
+    cells[8].u = arena.freeLatency.p50Ns;
+    cells[9].u = arena.freeLatency.p99Ns;
+    cells[10].u = arena.freeLatency.p999Ns;
+    cells[11].u = arena.freeLatency.maxNs;
+    const char* bytes = reinterpret_cast<const char*>(cells);
+    out.insert(out.end(), bytes, bytes + sizeof(cells));
+}
+
+void appendFreeBlockRows(std::vector<char>& out, const HeapStats& s, StatsFormat format) {
+    for (int bucket = 0; bucket < FreeBlockHistogram::kBuckets; ++bucket) {
+        uint64_t blocks = s.freeBlocks.blocks[bucket];
+        if (blocks == 0) {
+            continue;
+        }
+        uint64_t lowerBound = uint64_t{1} << bucket;
+        if (format == StatsFormat::Csv) {
+            CsvLine line(out);
+            line << s.timeStep << lowerBound << blocks << s.freeBlocks.bytes[bucket];
+            line.end();
+            continue;
+        }
+        Cell cells[std::size(kFreeBlockColumns)];
+        cells[0].i = s.timeStep;
+        cells[1].u = lowerBound;
+        cells[2].u = blocks;
+        cells[3].u = s.freeBlocks.bytes[bucket];
+        const char* bytes = reinterpret_cast<const char*>(cells);
+        out.insert(out.end(), bytes, bytes + sizeof(cells));
+    }
+}
+
+} // namespace
+
+void appendBinaryRow(std::vector<char>& out, const HeapStats& s, const std::vector<size_t>& fitSizes) {
+    Cell cells[std::size(kStatsColumns)];
+    cells[0].i = s.timeStep;
+    cells[1].u = s.internalFragmentation;
+    cells[2].f = s.externalFragmentationRatio;
+    cells[3].u = s.totalFreeOnHeap;
+    cells[4].u = s.biggestFreeBlock;
+    cells[5].u = s.totalUserRequested;
+    cells[6].u = s.allocLatency.p50Ns;
+    cells[7].u = s.allocLatency.p99Ns;
+    cells[8].u = s.allocLatency.p999Ns;
+    cells[9].u = s.allocLatency.maxNs;
+    cells[10].u = s.freeLatency.p50Ns;
+    cells[11].u = s.freeLatency.p99Ns;
+    cells[12].u = s.freeLatency.p999Ns;
+    cells[13].u = s.freeLatency.maxNs;
+    cells[14].u = s.residentSetBytes;
+    cells[15].u = s.residentFreeBytes;
+    cells[16].u = s.trimNs;
+    cells[17].i = s.trimReclaimedBytes;
+    cells[18].u = s.reallocations;
+    cells[19].u = s.reallocMoves;
+    cells[20].u = s.reallocCopiedBytes;
+    cells[21].u = s.reallocNs;
+    cells[22].u = s.alignedFragmentation;
+    cells[23].u = s.compactionNs;
+    cells[24].u = s.compactionMovedBlocks;
+    cells[25].u = s.compactionMovedBytes;
+    cells[26].f = s.compactionRatioAfter;
+    cells[27].f = s.allocationOrder.ns;
+    cells[28].f = s.allocationOrder.l1Misses;
+    cells[29].f = s.allocationOrder.llcMisses;
+    cells[30].f = s.allocationOrder.dtlbMisses;
+    cells[31].f = s.randomOrder.ns;
+    cells[32].f = s.randomOrder.l1Misses;
+    cells[33].f = s.randomOrder.llcMisses;
+    cells[34].f = s.randomOrder.dtlbMisses;
+    cells[35].f = s.liveGapBytes;
+    cells[36].u = s.anonHugePageBytes;
+    cells[37].u = s.hugeRegionsFree;
+    cells[38].u = s.hugeRegionsPartial;
+    cells[39].u = s.hugeRegionsFull;
+    cells[40].u = s.sampleTrigger;
+    cells[41].u = s.sampleNs;
+    const char* bytes = reinterpret_cast<const char*>(cells);
+    out.insert(out.end(), bytes, bytes + sizeof(cells));
+    for (size_t size : fitSizes) {
+        Cell fit;
+        fit.f = s.freeBlocks.allocatableFraction(size);
+        bytes = reinterpret_cast<const char*>(&fit);
+        out.insert(out.end(), bytes, bytes + sizeof(fit));
+    }
+}
+
+std::array<char, kBinaryColumnBytes> binaryColumnEntry(std::string_view name, char type) {
+    std::array<char, kBinaryColumnBytes> entry{};
+    std::memcpy(entry.data(), name.data(), std::min(name.size(), kColumnNameBytes - 1));
+    entry[kColumnNameBytes] = type;
+    return entry;
+}
+
+std::string binaryMetadataBlock(const RunMetadata& metadata, size_t headerSoFar) {
+    std::string text;
+    for (const auto& [key, value] : metadata) {
+        text += key + "=" + value + "\n";
+    }
+    uint32_t length = static_cast<uint32_t>(text.size());
+    std::string block(reinterpret_cast<const char*>(&length), sizeof(length));
+    block += text;
+    block.append((8 - (headerSoFar + block.size()) % 8) % 8, '\0');
+    return block;
+}
+
+RunMetadata parseMetadataLines(std::string_view text) {
+    RunMetadata metadata;
+    while (!text.empty()) {
+        size_t newline = text.find('\n');
+        std::string_view entry = text.substr(0, newline);
+        text = newline == std::string_view::npos ? std::string_view() : text.substr(newline + 1);
+        size_t equals = entry.find('=');
+        if (equals != std::string_view::npos) {
+            metadata.emplace_back(entry.substr(0, equals), entry.substr(equals + 1));
+        }
+    }
+    return metadata;
+}
+
+std::string binaryStatsHeader(std::span<const StatsColumn> columns, const RunMetadata& metadata) {
+    size_t columnsEnd = sizeof(BinaryStatsPrologue) + columns.size() * kBinaryColumnBytes;
+    std::string metadataBlock = binaryMetadataBlock(metadata, columnsEnd);
+    BinaryStatsPrologue prologue;
+    std::memcpy(prologue.magic, kBinaryStatsMagic, sizeof(prologue.magic));
+    prologue.version = kBinaryStatsVersion;
+    prologue.recordBytes = static_cast<uint32_t>(columns.size() * sizeof(Cell));
+    prologue.headerBytes = static_cast<uint32_t>(columnsEnd + metadataBlock.size());
+    prologue.columnCount = static_cast<uint32_t>(columns.size());
+    std::string header(reinterpret_cast<const char*>(&prologue), sizeof(prologue));
+    for (const StatsColumn& column : columns) {
+        header.append(binaryColumnEntry(column.name, column.type).data(), kBinaryColumnBytes);
+    }
+    return header + metadataBlock;
+}
+
+std::vector<StatsColumn> mainStatsColumns(const std::vector<size_t>& fitSizes, std::vector<std::string>& fitNames) {
+    fitNames.clear();
+    for (size_t size : fitSizes) {
+        fitNames.push_back("Allocatable_" + std::to_string(size));
+    }
+    std::vector<StatsColumn> columns(std::begin(kStatsColumns), std::end(kStatsColumns));
+    for (const std::string& name : fitNames) {
+        columns.push_back({name.c_str(), 'f'});
+    }
+    return columns;
+}
+
+std::string companionPath(const std::string& path, const std::string& suffix) {
+    size_t dot = path.find_last_of('.');
+    size_t slash = path.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+        return path + suffix;
+    }
+    return path.substr(0, dot) + suffix + path.substr(dot);
+}
+
+StatsWriter::StatsWriter(const std::string& path, StatsFormat format, RunMetadata metadata,
+                         std::vector<size_t> fitSizes)
+    : format_(format), metadata_(std::move(metadata)), fitSizes_(std::move(fitSizes)),
+      file_(openOrThrow(path, format)), path_(path) {
+    arenas_.path = companionPath(path, "_arenas");
+    freeBlocks_.path = companionPath(path, "_freeblocks");
+
+    std::vector<std::string> fitNames;
+    failed_ = !writeHeader(file_, mainStatsColumns(fitSizes_, fitNames), format_, metadata_);
+    filling_.reserve(kBatchRows);
+    flushing_.reserve(kBatchRows);
+    text_.reserve(std::max(kTextBytes, mainRowBytes()));
+    writer_ = std::thread(&StatsWriter::writerLoop, this);
+}
+
+StatsWriter::StatsWriter(const std::string& path, StatsFormat format, RunMetadata metadata,
+                         std::vector<size_t> fitSizes, const StatsFilePosition& resumeAt)
+    : format_(format), metadata_(std::move(metadata)), fitSizes_(std::move(fitSizes)),
+      file_(reopenAt(path, resumeAt.mainBytes, format)), path_(path) {
+    arenas_.path = companionPath(path, "_arenas");
+    freeBlocks_.path = companionPath(path, "_freeblocks");
+    try {
+        // A companion the checkpoint did not have yet is created afresh on its first row.
+        if (resumeAt.arenaBytes > 0) {
+            arenas_.file = reopenAt(arenas_.path, resumeAt.arenaBytes, format);
+        }
+        if (resumeAt.freeBlockBytes > 0) {
+            freeBlocks_.file = reopenAt(freeBlocks_.path, resumeAt.freeBlockBytes, format);
+        }
+    } catch (...) {
+        for (std::FILE* file : {file_, arenas_.file}) {
+            if (file) {
+                std::fclose(file);
+            }
+        }
+        throw;
+    }
+    rows_ = resumeAt.rows;
+    filling_.reserve(kBatchRows);
+    flushing_.reserve(kBatchRows);
+    text_.reserve(std::max(kTextBytes, mainRowBytes()));
+    writer_ = std::thread(&StatsWriter::writerLoop, this);
+}
+
+StatsWriter::~StatsWriter() { close(); }
+
+void StatsWriter::write(HeapStats&& stats) {
+    // Companions are opened here rather than by the writer thread, which must not allocate.
+    if (!stats.arenas.empty() && !arenas_.file && !openFailed_) {
+        openCompanion(arenas_, kArenaColumns);
+    }
+    if (!stats.freeBlocks.empty() && !freeBlocks_.file && !openFailed_) {
+        openCompanion(freeBlocks_, kFreeBlockColumns);
+    }
+    filling_.push_back(std::move(stats));
+    if (filling_.size() == kBatchRows) {
+        handOff();
+    }
+}
+
+// Waits for the writer to finish the previous batch, then gives it this one.
+void StatsWriter::handOff() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    batchDone_.wait(lock, [this] { return !flushPending_; });
+    std::swap(filling_, flushing_);
+    filling_.clear();
+    flushPending_ = true;
+    batchReady_.notify_one();
+}
+
+void StatsWriter::waitForWriter() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    batchDone_.wait(lock, [this] { return !flushPending_; });
+}
+
+bool StatsWriter::flush() {
+    if (!filling_.empty()) {
+        handOff();
+    }
+    waitForWriter();
+    return !failed_ && !openFailed_;
+}
+
+// Every batch is flushed as it is written, so the sizes on disk are the files' ends.
+StatsFilePosition StatsWriter::position() const {
+    StatsFilePosition position;
+    position.rows = rows_;
+    position.mainBytes = fileBytes(path_);
+    position.arenaBytes = arenas_.file ? fileBytes(arenas_.path) : 0;
+    position.freeBlockBytes = freeBlocks_.file ? fileBytes(freeBlocks_.path) : 0;
+    return position;
+}
+
+void StatsWriter::writerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        batchReady_.wait(lock, [this] { return flushPending_ || stop_; });
+        if (flushPending_) {
+            // The simulation only touches filling_ until flushPending_ is cleared.
+            lock.unlock();
+            flushBatch(flushing_);
+            lock.lock();
+            flushPending_ = false;
+            batchDone_.notify_one();
+        } else if (stop_) {
+            return;
+        }
+    }
+}
+
+size_t StatsWriter::mainRowBytes() const {
+    return (std::size(kStatsColumns) + fitSizes_.size()) * kMaxCellBytes;
+}
+
+/**
+ * @brief Formats @p batch into text_ and writes it out, main rows first.
+ *
+ * Runs on the writer thread, which must not allocate: glibc would give it an
+ * arena of its own, whose free space would then count as the run's. So text_
+ * never grows past the capacity reserved before the thread started, and is
+ * written out whenever the next row might not fit. A companion is only
+ * touched when the batch has rows for it, which means write() opened it
+ * before the batch was handed over.
+ */
+void StatsWriter::flushBatch(const std::vector<HeapStats>& batch) {
+    constexpr size_t kArenaRowBytes = std::size(kArenaColumns) * kMaxCellBytes;
+    constexpr size_t kFreeBlockRowsBytes = FreeBlockHistogram::kBuckets * std::size(kFreeBlockColumns) * kMaxCellBytes;
+    const size_t rowBytes = mainRowBytes();
+    bool anyArenas = false;
+    bool anyFreeBlocks = false;
+    text_.clear();
+    for (const HeapStats& s : batch) {
+        makeRoom(file_, rowBytes);
+        format_ == StatsFormat::Csv ? appendCsvRow(text_, s, fitSizes_) : appendBinaryRow(text_, s, fitSizes_);
+        anyArenas = anyArenas || !s.arenas.empty();
+        anyFreeBlocks = anyFreeBlocks || !s.freeBlocks.empty();
+    }
+    writeText(file_);
+    rows_ += batch.size();
+
+    if (anyArenas) {
+        for (const HeapStats& s : batch) {
+            for (const ArenaStats& arena : s.arenas) {
+                makeRoom(arenas_.file, kArenaRowBytes);
+                appendArenaRow(text_, s, arena, format_);
+            }
+        }
+        writeText(arenas_.file);
+    }
+    if (anyFreeBlocks) {
+        for (const HeapStats& s : batch) {
+            makeRoom(freeBlocks_.file, kFreeBlockRowsBytes);
+            appendFreeBlockRows(text_, s, format_);
+        }
+        writeText(freeBlocks_.file);
+    }
+}
+
+// Writes text_ out to @p file first if fewer than @p bytes are left in it.
+void StatsWriter::makeRoom(std::FILE* file, size_t bytes) {
+    if (text_.capacity() - text_.size() < bytes) {
+        writeText(file);
+    }
+}
+
+// Writes text_ to @p file, flushes it and empties text_. A companion that
+// could not be created is null, and its rows are dropped.
+void StatsWriter::writeText(std::FILE* file) {
+    if (!file) {
+        text_.clear();
+        return;
+    }
+    failed_ |= std::fwrite(text_.data(), 1, text_.size(), file) != text_.size();
+    failed_ |= std::fflush(file) != 0;
+    text_.clear();
+}
+
+// Creates @p companion with its header; a failure shows in flush() and close().
+void StatsWriter::openCompanion(Companion& companion, std::span<const StatsColumn> columns) {
+    companion.file = unbuffered(std::fopen(companion.path.c_str(), format_ == StatsFormat::Csv ? "w" : "wb"));
+    if (!companion.file || !writeHeader(companion.file, columns, format_, metadata_)) {
+        openFailed_ = true;
+    }
+}
+
+bool StatsWriter::close() {
+    if (closed_) {
+        return !failed_ && !openFailed_;
+    }
+    closed_ = true;
+    if (!filling_.empty()) {
+        handOff();
+    }
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        batchDone_.wait(lock, [this] { return !flushPending_; });
+        stop_ = true;
+        batchReady_.notify_one();
+    }
+    writer_.join();
+    failed_ |= std::fclose(file_) != 0;
+    for (Companion* companion : {&arenas_, &freeBlocks_}) {
+        if (companion->file) {
+            failed_ |= std::fclose(companion->file) != 0;
+        }
+    }
+    return !failed_ && !openFailed_;
+}
@@ -0,0 +1,188 @@
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "heap_stats.h"
+
+enum class StatsFormat {
+    Csv,    // Text, one row per timestep (plus *_arenas.csv).
+    Binary, // Fixed-width little-endian records (plus *_arenas.bin); see below.
+};
+
+// One column of a stats file: its name and binary type code ('i', 'u' or 'f').
+struct StatsColumn {
+    const char* name;
+    char type;
+};
+
+// Settings a run was made with, as key/value pairs, written at the top of every stats file.
+using RunMetadata = std::vector<std::pair<std::string, std::string>>;
+
+// Where a stats file and its companions end, for continuing them after a checkpoint.
+struct StatsFilePosition {
+    uint64_t rows = 0;
+    uint64_t mainBytes = 0;
+    uint64_t arenaBytes = 0;     // 0 while the companion file does not exist.
+    uint64_t freeBlockBytes = 0;
+};
+
+/**
+ * @brief Streams HeapStats rows to disk while the run is still going.
+ *
+ * Rows are collected into one of two fixed-size batches. When a batch is full
+ * it is handed to a writer thread, which formats it (std::to_chars, no
+ * iostreams) and writes and flushes it in one go, while the simulation fills
+ * the other batch. Memory use is therefore bounded by two batches however
+ * long the run is, and a crash loses at most the rows not yet handed over.
+ * The writer thread allocates nothing, so on allocators with per-thread
+ * arenas it never gets one of its own and leaves the heap being measured as
+ * it is: its formatting buffer is reserved up front, companion files are
+ * opened by write() and no file has a stdio buffer.
+ *
+ * Per-arena rows go to a companion file (stats_arenas.csv for stats.csv),
+ * and the free block histogram to another (stats_freeblocks.csv, one row per
+ * non-empty bucket). Each is only created once a row with such data arrives.
+ *
+ * CSV files start with one "# key=value" line per metadata entry, before the
+ * column names. Binary files start with a header describing their columns,
+ * followed by fixed-size records, so they can be mapped straight into numpy:
+ *
+ *     char     magic[8] = "HEAPSTAT"
+ *     uint32   version, recordBytes, headerBytes, columnCount
+ *     column[columnCount] { char name[24]; char type; char pad[7]; }
+ *     uint32   metadataBytes; char metadata[metadataBytes]  (version 2+)
+ *     record[] at offset headerBytes, each recordBytes long
+ *
+ * Every column is 8 bytes wide; type is 'i' (int64), 'u' (uint64) or 'f' (float64).
+ * The metadata is "key=value\n" lines; the header is zero-padded to a multiple of 8.
+ */
+class StatsWriter {
+public:
+    static constexpr size_t kBatchRows = 1024;
+
+    // Throws std::runtime_error if @p path cannot be created. Each of
+    // @p fitSizes adds an Allocatable_<size> column (see FreeBlockHistogram).
+    StatsWriter(const std::string& path, StatsFormat format, RunMetadata metadata = {},
+                std::vector<size_t> fitSizes = {});
+    // Continues the files of an earlier run from @p resumeAt, cutting off
+    // whatever they gained after it. @p metadata only goes into companion
+    // files that do not exist yet. Throws std::runtime_error if a file is
+    // missing or shorter than @p resumeAt says.
+    StatsWriter(const std::string& path, StatsFormat format, RunMetadata metadata, std::vector<size_t> fitSizes,
+                const StatsFilePosition& resumeAt);
+    ~StatsWriter();
+    StatsWriter(const StatsWriter&) = delete;
+    StatsWriter& operator=(const StatsWriter&) = delete;
+
+    // Queues one row. Blocks only if the writer thread is still busy with the previous batch.
+    void write(HeapStats&& stats);
+
+    /**
+     * @brief Writes out every row queued so far and waits until it is on disk.
+     * @return false if any write failed.
+     */
+    bool flush();
+
+    // Where the files end; only meaningful right after flush().
+    StatsFilePosition position() const;
+
+    /**
+     * @brief Writes whatever is still queued and closes the files.
+     * @return false if any write failed.
+     */
+    bool close();
+
+    uint64_t rowsWritten() const { return rows_; }
+    bool wroteArenas() const { return arenas_.file != nullptr; }
+    const std::string& arenaPath() const { return arenas_.path; }
+    bool wroteFreeBlocks() const { return freeBlocks_.file != nullptr; }
+    const std::string& freeBlockPath() const { return freeBlocks_.path; }
+
+private:
+    // A file next to the main one, created when the first row for it arrives.
+    struct Companion {
+        std::string path;
+        std::FILE* file = nullptr;
+    };
+
+    void writerLoop();
+    void flushBatch(const std::vector<HeapStats>& batch);
+    void makeRoom(std::FILE* file, size_t bytes);
+    void writeText(std::FILE* file);
+    void openCompanion(Companion& companion, std::span<const StatsColumn> columns);
+    size_t mainRowBytes() const; // Most a formatted main row can take.
+    void handOff();
+    void waitForWriter();
+
+    StatsFormat format_;
+    RunMetadata metadata_;
+    std::vector<size_t> fitSizes_;
+    std::FILE* file_ = nullptr;
+    std::string path_;
+    Companion arenas_;
+    Companion freeBlocks_;
+    std::vector<char> text_; // Formatting buffer of the writer thread; reserved once, never grown.
+    uint64_t rows_ = 0;
+    bool openFailed_ = false; // A companion could not be created; only write() touches it.
+
+    std::vector<HeapStats> filling_;
+    std::vector<HeapStats> flushing_;
+    std::mutex mutex_;
+    std::condition_variable batchReady_;
+    std::condition_variable batchDone_;
+    bool flushPending_ = false;
+    bool stop_ = false;
+    bool failed_ = false;
+    bool closed_ = false;
+    std::thread writer_;
+};
+
+// The fixed-size start of a binary stats file; the column entries follow it.
+struct BinaryStatsPrologue {
+    char magic[8];
+    uint32_t version;
+    uint32_t recordBytes;
+    uint32_t headerBytes;
+    uint32_t columnCount;
+};
+static_assert(sizeof(BinaryStatsPrologue) == 24);
+
+inline constexpr char kBinaryStatsMagic[8] = {'H', 'E', 'A', 'P', 'S', 'T', 'A', 'T'};
+inline constexpr uint32_t kBinaryStatsVersion = 2; // Version 1 had no metadata block.
+inline constexpr size_t kBinaryColumnBytes = 32;
+
+// Encodes one column entry of a binary stats header.
+std::array<char, kBinaryColumnBytes> binaryColumnEntry(std::string_view name, char type);
+
+/**
+ * @brief Encodes the metadata block that follows the column entries.
+ * @p headerSoFar is the size of everything before it; the block is padded so
+ * the records start 8-byte aligned.
+ */
+std::string binaryMetadataBlock(const RunMetadata& metadata, size_t headerSoFar);
+
+// Decodes the "key=value\n" text of a metadata block; lines without '=' are skipped.
+RunMetadata parseMetadataLines(std::string_view text);
+
+// The whole header of a binary stats file with these columns: prologue, column entries and metadata.
+std::string binaryStatsHeader(std::span<const StatsColumn> columns, const RunMetadata& metadata);
+
+// Columns of the main stats file, the Allocatable_<S> column of each of
+// @p fitSizes last. Their names point into @p fitNames, which this fills.
+std::vector<StatsColumn> mainStatsColumns(const std::vector<size_t>& fitSizes, std::vector<std::string>& fitNames);
+
+// Appends @p stats to @p out as one record of a binary main stats file.
+void appendBinaryRow(std::vector<char>& out, const HeapStats& stats, const std::vector<size_t>& fitSizes);
+
+// heap_fragmentation_stats.csv -> heap_fragmentation_stats_arenas.csv
+std::string companionPath(const std::string& path, const std::string& suffix);
@@ -0,0 +1,484 @@
+// heap_sweep: runs heap_analyzer once per point of a parameter grid, several
+// runs at a time, each in its own process so no run's heap state leaks into
+// another's, and merges the results into one binary stats file.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "child_process.h"
+#include "stats_writer.h"
+#include "tool_options.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// One point of the grid.
+struct SweepConfig {
+    std::string backend; // Empty: the analyzer's default.
+    unsigned seed = 1;
+    int threads = 1;
+    std::optional<long> mmapMax;
+    std::optional<long> trimThreshold;
+    std::optional<long> arenaMax;
+};
+
+// What came back from running one SweepConfig.
+struct SweepResult {
+    int exitCode = -1;
+    double seconds = 0;
+    uint64_t rows = 0;
+    std::string skipped; // Why the analyzer turned the configuration down; empty if it ran.
+    RunMetadata metadata; // The run's own header, which the merged file replaces; goes into the configs CSV.
+};
+
+struct SweepOptions {
+    std::string analyzer;
+    std::string outputPath = "sweep_stats.bin";
+    unsigned jobs = 0; // 0: one per hardware thread.
+    bool keepRuns = false;
+    bool showHelp = false;
+    std::vector<std::string> backends;
+    std::vector<unsigned> seeds;
+    std::vector<int> threads;
+    std::vector<long> mmapMax;
+    std::vector<long> trimThreshold;
+    std::vector<long> arenaMax;
+    std::vector<std::string> analyzerArgs; // Everything after "--".
+};
+
+bool parseSweepOptions(int argc, char** argv, SweepOptions& options, std::string& error) {
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        if (arg == "--") {
+            options.analyzerArgs.assign(argv + i + 1, argv + argc);
+            break;
+        }
+        if (arg == "--help" || arg == "-h") {
+            options.showHelp = true;
+            continue;
+        }
+        if (arg == "--keep-runs") {
+            options.keepRuns = true;
+            continue;
+        }
+        if (i + 1 >= argc) {
+            error = "unknown option or missing value: " + std::string(arg);
+            return false;
+        }
+        std::string_view value = argv[++i];
+
+        bool ok = true;
+        if (arg == "--analyzer") {
+            options.analyzer = value;
+        } else if (arg == "--output") {
+            options.outputPath = value;
+        } else if (arg == "--jobs") {
+            ok = parseNumber(value, options.jobs) && options.jobs > 0;
+        } else if (arg == "--backends") {
+            parseNames(value, options.backends);
+        } else if (arg == "--seeds") {
+            ok = parseList(value, options.seeds);
+        } else if (arg == "--threads") {
+            ok = parseList(value, options.threads) && *std::min_element(options.threads.begin(),
+                                                                         options.threads.end()) > 0;
+        } else if (arg == "--mmap-max") {
+            ok = parseList(value, options.mmapMax);
+        } else if (arg == "--trim-threshold") {
+            ok = parseList(value, options.trimThreshold);
+        } else if (arg == "--arena-max") {
+            ok = parseList(value, options.arenaMax);
+        } else {
+            error = "unknown option: " + std::string(arg);
+            return false;
+        }
+        if (!ok) {
+            error = "invalid value for " + std::string(arg) + ": " + std::string(value);
+            return false;
+        }
+    }
+    return true;
+}
+
+void printUsage(std::ostream& out, const char* program) {
+    out << "Usage: " << program << " [options] [-- heap_analyzer options]\n"
+        << "Runs heap_analyzer for every combination of the lists below. Lists are\n"
+        << "comma-separated and may contain inclusive ranges of up to 4096 values, e.g.\n"
+        << "1-50 or 0,65536.\n"
+        << "  --backends LIST    Backends to run (default: the analyzer's default)\n"
+        << "  --seeds LIST       Workload seeds (default 1)\n"
+        << "  --threads LIST     Worker thread counts (default 1)\n"
+        << "  --mmap-max LIST, --trim-threshold LIST, --arena-max LIST\n"
+        << "                     mallopt settings (default: the backend's own)\n"
+        << "  --jobs N           Runs at a time (default: one per hardware thread)\n"
+        << "  --output FILE      Combined binary stats file (default sweep_stats.bin); the\n"
+        << "                     configurations go to FILE_configs.csv next to it\n"
+        << "  --analyzer PATH    heap_analyzer to run (default: the one next to this program)\n"
+        << "  --keep-runs        Keep each run's own output and log\n"
+        << "  --help             Show this message\n"
+        << "Options after -- (e.g. --steps, --sizes, --workload) are passed to every run.\n"
+        << "Configurations whose backend does not support their options are skipped.\n";
+}
+
+std::vector<SweepConfig> expandGrid(const SweepOptions& options) {
+    // An axis that was not given has a single "leave it alone" value.
+    auto axis = [](const std::vector<long>& values) {
+        std::vector<std::optional<long>> points(values.begin(), values.end());
+        if (points.empty()) {
+            points.emplace_back();
+        }
+        return points;
+    };
+    std::vector<std::string> backends = options.backends.empty() ? std::vector<std::string>{""} : options.backends;
+    std::vector<unsigned> seeds = options.seeds.empty() ? std::vector<unsigned>{1} : options.seeds;
+    std::vector<int> threads = options.threads.empty() ? std::vector<int>{1} : options.threads;
+
+    std::vector<SweepConfig> grid;
+    for (const std::string& backend : backends) {
+        for (int threadCount : threads) {
+            for (std::optional<long> mmapMax : axis(options.mmapMax)) {
+                for (std::optional<long> trimThreshold : axis(options.trimThreshold)) {
+                    for (std::optional<long> arenaMax : axis(options.arenaMax)) {
+                        for (unsigned seed : seeds) {
+                            grid.push_back({backend, seed, threadCount, mmapMax, trimThreshold, arenaMax});
+                        }
+                    }
+                }
+            }
+        }
+    }
+    return grid;
+}
+
+std::vector<std::string> analyzerCommand(const SweepOptions& options, const SweepConfig& config,
+                                         const std::string& outputPath) {
+    std::vector<std::string> argv = {options.analyzer, "--format", "binary", "--output", outputPath,
+                                     "--seed", std::to_string(config.seed), "--threads",
+                                     std::to_string(config.threads)};
+    if (!config.backend.empty()) {
+        argv.insert(argv.end(), {"--backend", config.backend});
+    }
+    auto tune = [&](const char* name, const std::optional<long>& value) {
+        if (value) {
+            argv.insert(argv.end(), {"--tune", std::string(name) + "=" + std::to_string(*value)});
+        }
+    };
+    tune("mmap_max", config.mmapMax);
+    tune("trim_threshold", config.trimThreshold);
+    tune("arena_max", config.arenaMax);
+    argv.insert(argv.end(), options.analyzerArgs.begin(), options.analyzerArgs.end());
+    return argv;
+}
+
+fs::path runOutputPath(const fs::path& runsDir, size_t config) {
+    return runsDir / ("config_" + std::to_string(config) + ".bin");
+}
+
+// Configurations that differ only in their seed get the same answer from --check.
+bool sameSettings(const SweepConfig& a, const SweepConfig& b) {
+    return a.backend == b.backend && a.threads == b.threads && a.mmapMax == b.mmapMax &&
+           a.trimThreshold == b.trimThreshold && a.arenaMax == b.arenaMax;
+}
+
+/**
+ * @brief Asks the analyzer (--check) whether the backend of each distinct
+ * setting of the grid supports its options, e.g. no --tune for the pool.
+ * Those it turns down with exit code 2 get the analyzer's reason in
+ * @p results; anything else is left to the run itself to report.
+ */
+void checkGrid(const SweepOptions& options, const std::vector<SweepConfig>& grid, const fs::path& runsDir,
+               std::vector<SweepResult>& results) {
+    for (size_t i = 0; i < grid.size(); ++i) {
+        size_t first = 0;
+        while (!sameSettings(grid[first], grid[i])) {
+            ++first;
+        }
+        if (first != i) {
+            results[i].skipped = results[first].skipped;
+            continue;
+        }
+        fs::path log = runsDir / ("check_" + std::to_string(i) + ".log");
+        std::vector<std::string> argv = analyzerCommand(options, grid[i], runOutputPath(runsDir, i).string());
+        argv.push_back("--check");
+        std::vector<ChildProcess> check = {startChildProcess(argv, log.string())};
+        int exitCode = 0;
+        waitForAnyChild(check, exitCode);
+        if (exitCode == 2) {
+            std::ifstream in(log.string());
+            std::string line;
+            while (std::getline(in, line) && !line.starts_with("Error: ")) {
+            }
+            results[i].skipped = line.starts_with("Error: ") ? line.substr(7) : "not supported";
+        }
+        fs::remove(log);
+    }
+}
+
+/**
+ * @brief Appends every record of one run's binary stats file to @p out,
+ * each prefixed with its configuration number, and reads the run's own
+ * metadata into @p runMetadata.
+ * The first file merged fixes the columns; later ones must match.
+ * @return false if the file is missing, not a stats file or has other columns.
+ */
+bool appendRun(std::FILE* out, const fs::path& path, int64_t config, const RunMetadata& metadata,
+               std::vector<char>& columns, uint64_t& rows, RunMetadata& runMetadata) {
+    std::FILE* in = std::fopen(path.string().c_str(), "rb");
+    if (!in) {
+        return false;
+    }
+    BinaryStatsPrologue prologue;
+    std::vector<char> runColumns;
+    bool ok = std::fread(&prologue, sizeof(prologue), 1, in) == 1 &&
+              std::memcmp(prologue.magic, kBinaryStatsMagic, sizeof(prologue.magic)) == 0 &&
+              prologue.version >= 1 && prologue.version <= kBinaryStatsVersion && prologue.recordBytes > 0;
+    if (ok) {
+        runColumns.resize(size_t{prologue.columnCount} * kBinaryColumnBytes);
+        ok = std::fread(runColumns.data(), 1, runColumns.size(), in) == runColumns.size();
+    }
+    if (ok && prologue.version >= 2) {
+        uint32_t metadataBytes = 0;
+        ok = std::fread(&metadataBytes, sizeof(metadataBytes), 1, in) == 1 && metadataBytes <= prologue.headerBytes;
+        std::string text(ok ? metadataBytes : 0, '\0');
+        ok = ok && std::fread(text.data(), 1, text.size(), in) == text.size();
+        runMetadata = parseMetadataLines(text);
+    }
+    ok = ok && std::fseek(in, static_cast<long>(prologue.headerBytes), SEEK_SET) == 0;
+    if (ok && columns.empty()) {
+        // First run: write the combined header, a Config column in front of the run's own.
+        // Each run's own metadata is replaced by the sweep's; the configs CSV has the per-run settings.
+        columns = runColumns;
+        size_t columnsEnd = sizeof(BinaryStatsPrologue) + columns.size() + kBinaryColumnBytes;
+        std::string metadataBlock = binaryMetadataBlock(metadata, columnsEnd);
+        BinaryStatsPrologue combined = prologue;
+        combined.version = kBinaryStatsVersion;
+        combined.recordBytes += sizeof(int64_t);
+        combined.headerBytes = static_cast<uint32_t>(columnsEnd + metadataBlock.size());
+        combined.columnCount += 1;
+        std::fwrite(&combined, sizeof(combined), 1, out);
+        std::fwrite(binaryColumnEntry("Config", 'i').data(), kBinaryColumnBytes, 1, out);
+        std::fwrite(columns.data(), 1, columns.size(), out);
+        std::fwrite(metadataBlock.data(), 1, metadataBlock.size(), out);
+    }
+    ok = ok && runColumns == columns;
+
+    std::vector<char> record(sizeof(int64_t) + prologue.recordBytes);
+    std::memcpy(record.data(), &config, sizeof(config));
+    rows = 0;
+    while (ok && std::fread(record.data() + sizeof(int64_t), prologue.recordBytes, 1, in) == 1) {
+        std::fwrite(record.data(), record.size(), 1, out);
+        ++rows;
+    }
+    std::fclose(in);
+    return ok;
+}
+
+/**
+ * @brief One line per configuration: its settings, how the run went, and the
+ * run's own metadata as meta.<key> columns (empty for runs that were not
+ * merged), from which heap_aggregate splits the merged file back into runs.
+ * Skipped configurations have an empty ExitCode, Seconds and Rows.
+ */
+void writeConfigs(std::ostream& out, const std::vector<SweepConfig>& grid, const std::vector<SweepResult>& results) {
+    auto optional = [](const std::optional<long>& value) { return value ? std::to_string(*value) : std::string(); };
+    std::vector<std::string> keys; // In the order they are first seen.
+    for (const SweepResult& result : results) {
+        for (const auto& [key, value] : result.metadata) {
+            if (std::find(keys.begin(), keys.end(), key) == keys.end()) {
+                keys.push_back(key);
+            }
+        }
+    }
+    out << "Config,Backend,Seed,Threads,MmapMax,TrimThreshold,ArenaMax,ExitCode,Seconds,Rows,Skipped";
+    for (const std::string& key : keys) {
+        out << ',' << csvField("meta." + key);
+    }
+    out << '\n';
+    for (size_t i = 0; i < grid.size(); ++i) {
+        const SweepConfig& config = grid[i];
+        const SweepResult& result = results[i];
+        out << i << ',' << config.backend << ',' << config.seed << ',' << config.threads << ','
+            << optional(config.mmapMax) << ',' << optional(config.trimThreshold) << ','
+            << optional(config.arenaMax) << ',';
+        if (result.skipped.empty()) {
+            out << result.exitCode << ',' << result.seconds << ',' << result.rows << ',';
+        } else {
+            out << ",,," << csvField(result.skipped);
+        }
+        for (const std::string& key : keys) {
+            auto entry = std::find_if(result.metadata.begin(), result.metadata.end(),
+                                      [&](const auto& pair) { return pair.first == key; });
+            out << ',' << (entry == result.metadata.end() ? std::string() : csvField(entry->second));
+        }
+        out << '\n';
+    }
+}
+
+// sweep_stats.bin -> sweep_stats_configs.csv
+fs::path configsPath(const fs::path& output) {
+    fs::path path = output;
+    return path.replace_filename(output.stem().string() + "_configs.csv");
+}
+
+int runSweep(const SweepOptions& options) {
+    std::vector<SweepConfig> grid = expandGrid(options);
+    fs::path output = options.outputPath;
+    fs::path runsDir = output;
+    runsDir.replace_filename(output.stem().string() + "_runs");
+    fs::create_directories(runsDir);
+
+    std::vector<SweepResult> results(grid.size());
+    checkGrid(options, grid, runsDir, results);
+    size_t skipped = 0;
+    for (size_t i = 0; i < grid.size(); ++i) {
+        if (results[i].skipped.empty()) {
+            continue;
+        }
+        if (i == 0 || !sameSettings(grid[i], grid[i - 1])) {
+            std::cout << "Skipping configuration " << i << " (all seeds): " << results[i].skipped << std::endl;
+        }
+        ++skipped;
+    }
+    size_t toRun = grid.size() - skipped;
+    if (toRun == 0) {
+        fs::remove_all(runsDir);
+        std::cerr << "Error: the backends support none of the configurations." << std::endl;
+        return 2;
+    }
+
+    unsigned jobs = options.jobs ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+    jobs = static_cast<unsigned>(std::min<size_t>({jobs, toRun, maxChildProcesses()}));
+    std::cout << "Sweeping " << toRun << " configurations, " << jobs << " at a time";
+    if (skipped > 0) {
+        std::cout << " (" << skipped << " skipped)";
+    }
+    std::cout << "..." << std::endl;
+
+    using Clock = std::chrono::steady_clock;
+    std::vector<ChildProcess> running;
+    std::vector<size_t> runningConfig;
+    std::vector<Clock::time_point> started;
+    size_t next = 0;
+    size_t finished = 0;
+    size_t failed = 0;
+    while (finished < toRun) {
+        while (next < grid.size() && running.size() < jobs) {
+            if (!results[next].skipped.empty()) {
+                ++next;
+                continue;
+            }
+            fs::path runOutput = runOutputPath(runsDir, next);
+            fs::path log = fs::path(runOutput).replace_extension(".log");
+            running.push_back(startChildProcess(analyzerCommand(options, grid[next], runOutput.string()),
+                                                log.string()));
+            runningConfig.push_back(next);
+            started.push_back(Clock::now());
+            ++next;
+        }
+
+        int exitCode = 0;
+        size_t slot = waitForAnyChild(running, exitCode);
+        size_t config = runningConfig[slot];
+        results[config].exitCode = exitCode;
+        results[config].seconds = std::chrono::duration<double>(Clock::now() - started[slot]).count();
+        running.erase(running.begin() + static_cast<std::ptrdiff_t>(slot));
+        runningConfig.erase(runningConfig.begin() + static_cast<std::ptrdiff_t>(slot));
+        started.erase(started.begin() + static_cast<std::ptrdiff_t>(slot));
+        ++finished;
+        if (exitCode != 0) {
+            ++failed;
+            std::cerr << "Warning: configuration " << config << " exited with code " << exitCode << "; see "
+                      << fs::path(runOutputPath(runsDir, config)).replace_extension(".log").string() << std::endl;
+        }
+        std::cout << "[" << finished << "/" << toRun << "] configuration " << config << " finished in "
+                  << results[config].seconds << " s" << std::endl;
+    }
+
+    std::FILE* out = std::fopen(output.string().c_str(), "wb");
+    if (!out) {
+        std::cerr << "Error: Could not open " << output.string() << " for writing." << std::endl;
+        return 1;
+    }
+    fs::path configs = configsPath(output);
+    std::string analyzerArgs;
+    for (const std::string& arg : options.analyzerArgs) {
+        analyzerArgs += (analyzerArgs.empty() ? "" : " ") + arg;
+    }
+    RunMetadata metadata = {{"sweep.configs", configs.filename().string()}, {"sweep.analyzer_args", analyzerArgs}};
+    std::vector<char> columns;
+    uint64_t totalRows = 0;
+    for (size_t i = 0; i < grid.size(); ++i) {
+        if (!results[i].skipped.empty() || results[i].exitCode != 0) {
+            continue;
+        }
+        if (!appendRun(out, runOutputPath(runsDir, i), static_cast<int64_t>(i), metadata, columns,
+                       results[i].rows, results[i].metadata)) {
+            std::cerr << "Warning: could not merge the output of configuration " << i << "." << std::endl;
+            results[i].exitCode = -1;
+            results[i].metadata.clear();
+            ++failed;
+        }
+        totalRows += results[i].rows;
+    }
+    bool writeFailed = std::fclose(out) != 0;
+
+    std::ofstream configsFile(configs.string());
+    writeConfigs(configsFile, grid, results);
+    configsFile.close();
+    writeFailed = writeFailed || !configsFile;
+    if (writeFailed) {
+        std::cerr << "Error: Could not write " << output.string() << " / " << configs.string() << "." << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << totalRows << " rows to " << output.string() << " and the configurations to "
+              << configs.string() << "." << std::endl;
+
+    if (failed == 0 && !options.keepRuns) {
+        fs::remove_all(runsDir);
+    } else {
+        std::cout << "Per-run output and logs are in " << runsDir.string() << "." << std::endl;
+    }
+    return failed == 0 ? 0 : 1;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    SweepOptions options;
+    std::string error;
+    if (!parseSweepOptions(argc, argv, options, error)) {
+        std::cerr << "Error: " << error << "\n";
+        printUsage(std::cerr, argv[0]);
+        return 2;
+    }
+    if (options.showHelp) {
+        printUsage(std::cout, argv[0]);
+        return 0;
+    }
+    if (options.analyzer.empty()) {
+#ifdef _WIN32
+        options.analyzer = (fs::path(argv[0]).parent_path() / "heap_analyzer.exe").string();
+#else
+        options.analyzer = (fs::path(argv[0]).parent_path() / "heap_analyzer").string();
+#endif
+    }
+
+    try {
+        return runSweep(options);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,129 @@
+#include "system_info.h"
+
+#include <ctime>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <winver.h>
+#else
+#include <sys/utsname.h>
+#endif
+
+#ifdef __GLIBC__
+#include <gnu/libc-version.h>
+#endif
+
+namespace {
+
+std::string compilerName() {
+#if defined(__clang__)
+    return "Clang " __clang_version__;
+#elif defined(__GNUC__)
+    return "GCC " __VERSION__;
+#elif defined(_MSC_VER)
+    return "MSVC " + std::to_string(_MSC_FULL_VER);
+#else
+    return {};
+#endif
+}
+
+#ifdef _WIN32
+// The file version of ntdll.dll, e.g. 10.0.22621.2506: the heap code ships in it.
+std::string ntdllVersion() {
+    char path[MAX_PATH];
+    UINT length = GetSystemDirectoryA(path, MAX_PATH);
+    if (length == 0 || length >= MAX_PATH - 10) {
+        return {};
+    }
+    std::string file = std::string(path, length) + "\\ntdll.dll";
+    DWORD ignored = 0;
+    DWORD size = GetFileVersionInfoSizeA(file.c_str(), &ignored);
+    std::vector<char> info(size);
+    VS_FIXEDFILEINFO* fixed = nullptr;
+    UINT fixedSize = 0;
+    if (size == 0 || !GetFileVersionInfoA(file.c_str(), 0, size, info.data()) ||
+        !VerQueryValueA(info.data(), "\\", reinterpret_cast<LPVOID*>(&fixed), &fixedSize) || !fixed) {
+        return {};
+    }
+    return std::to_string(HIWORD(fixed->dwFileVersionMS)) + "." + std::to_string(LOWORD(fixed->dwFileVersionMS)) +
+           "." + std::to_string(HIWORD(fixed->dwFileVersionLS)) + "." + std::to_string(LOWORD(fixed->dwFileVersionLS));
+}
+
+// GetVersionEx() lies to programs without a compatibility manifest; RtlGetVersion() does not.
+std::string windowsBuild() {
+    using RtlGetVersionFunction = LONG(WINAPI*)(RTL_OSVERSIONINFOW*);
+    auto rtlGetVersion = reinterpret_cast<RtlGetVersionFunction>(
+        reinterpret_cast<void*>(GetProcAddress(GetModuleHandleA("ntdll.dll"), "RtlGetVersion")));
+    RTL_OSVERSIONINFOW version = {};
+    version.dwOSVersionInfoSize = sizeof(version);
+    if (!rtlGetVersion || rtlGetVersion(&version) != 0) {
+        return {};
+    }
+    return std::to_string(version.dwMajorVersion) + "." + std::to_string(version.dwMinorVersion) + "." +
+           std::to_string(version.dwBuildNumber);
+}
+
+std::string architecture() {
+    SYSTEM_INFO info;
+    GetNativeSystemInfo(&info);
+    switch (info.wProcessorArchitecture) {
+    case PROCESSOR_ARCHITECTURE_AMD64:
+        return "x86_64";
+    case PROCESSOR_ARCHITECTURE_ARM64:
+        return "aarch64";
+    case PROCESSOR_ARCHITECTURE_INTEL:
+        return "x86";
+    default:
+        return {};
+    }
+}
+#endif
+
+} // namespace
+
+RunMetadata systemMetadata() {
+    RunMetadata metadata;
+    auto add = [&](const char* key, std::string value) {
+        if (!value.empty()) {
+            metadata.emplace_back(key, std::move(value));
+        }
+    };
+#ifdef _WIN32
+    char host[MAX_COMPUTERNAME_LENGTH + 1];
+    DWORD hostLength = sizeof(host);
+    add("host", GetComputerNameA(host, &hostLength) ? std::string(host, hostLength) : std::string());
+    add("os", "Windows");
+    add("kernel", windowsBuild());
+    add("arch", architecture());
+    std::string ntdll = ntdllVersion();
+    add("libc", ntdll.empty() ? ntdll : "ntdll " + ntdll);
+    // The fourth part of ntdll's version is the update revision (UBR) of the build.
+    add("os_build", ntdll.substr(ntdll.find_last_of('.') + 1));
+#else
+    utsname name;
+    if (uname(&name) == 0) {
+        add("host", name.nodename);
+        add("os", name.sysname);
+        add("kernel", name.release);
+        add("os_build", name.version);
+        add("arch", name.machine);
+    }
+#endif
+#ifdef __GLIBC__
+    add("libc", std::string("glibc ") + gnu_get_libc_version());
+#endif
+    add("compiler", compilerName());
+
+    std::time_t now = std::time(nullptr);
+    std::tm utc;
+#ifdef _WIN32
+    gmtime_s(&utc, &now);
+#else
+    gmtime_r(&now, &utc);
+#endif
+    char started[32];
+    add("started", std::strftime(started, sizeof(started), "%Y-%m-%dT%H:%M:%SZ", &utc) ? started : "");
+    return metadata;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "stats_writer.h"
+
+/**
+ * @brief Describes the machine a run is made on, for the header of its stats
+ * file, so a result can be told apart from thousands of others without any
+ * bookkeeping on the side:
+ *
+ *     host        host name
+ *     os, kernel  "Linux" and the kernel release, or "Windows" and its build
+ *     os_build    uname()'s version string, or the Windows update revision
+ *     arch        machine architecture
+ *     libc        "glibc 2.36", or "ntdll 10.0.22621.2506" (the file version)
+ *     compiler    what built the analyzer
+ *     started     UTC start of the run, ISO 8601
+ *
+ * Fields that cannot be found are left out.
+ */
+RunMetadata systemMetadata();
@@ -0,0 +1,57 @@
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "child_process.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+int run(const std::vector<std::string>& argv, const fs::path& log) {
+    std::vector<ChildProcess> running{startChildProcess(argv, log.string())};
+    int exitCode = -1;
+    waitForAnyChild(running, exitCode);
+    return exitCode;
+}
+
+// Runs of two workloads that differ only in allocations per step, two seeds
+// each, must come out as two groups of two: the workload is in the header.
+void workloadsGroupApart(const std::string& analyzer, const std::string& aggregate) {
+    fs::path dir = fs::temp_directory_path() / ("aggregate_test_" + std::to_string(std::random_device{}()));
+    fs::create_directories(dir / "runs");
+    for (const char* allocs : {"10", "20"}) {
+        for (const char* seed : {"1", "2"}) {
+            fs::path output = dir / "runs" / (std::string("allocs") + allocs + "_seed" + seed + ".csv");
+            CHECK(run({analyzer, "--backend", "pool", "--steps", "20", "--allocs-per-step", allocs, "--seed", seed,
+                       "--output", output.string()},
+                      dir / "analyzer.log") == 0);
+        }
+    }
+    CHECK(run({aggregate, (dir / "runs").string(), "--output", (dir / "aggregate.csv").string()},
+              dir / "aggregate.log") == 0);
+
+    std::ifstream groups(dir / "aggregate_groups.csv");
+    std::string line;
+    std::getline(groups, line); // Column names.
+    int groupCount = 0;
+    while (std::getline(groups, line)) {
+        CHECK(line.starts_with(std::to_string(groupCount) + ",2,")); // Group number, runs in it.
+        ++groupCount;
+    }
+    CHECK(groupCount == 2);
+    fs::remove_all(dir);
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    if (argc != 3) {
+        return 2;
+    }
+    workloadsGroupApart(argv[1], argv[2]);
+    return checkResult();
+}
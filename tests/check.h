@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cmath>
+#include <iostream>
+
+// Minimal test support: each test is its own executable, registered with
+// add_test(), that prints every failed check and exits 1 if there was one.
+
+inline int& checkFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                     \
+    do {                                                                                     \
+        if (!(condition)) {                                                                  \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #condition ") failed\n"; \
+            ++checkFailures();                                                               \
+        }                                                                                    \
+    } while (0)
+
+#define CHECK_NEAR(actual, expected, tolerance)                                               \
+    do {                                                                                      \
+        double checkActual = (actual);                                                        \
+        double checkExpected = (expected);                                                    \
+        if (!(std::fabs(checkActual - checkExpected) <= (tolerance))) {                       \
+            std::cerr << __FILE__ << ":" << __LINE__ << ": " #actual " is " << checkActual    \
+                      << ", expected " << checkExpected << "\n";                              \
+            ++checkFailures();                                                                \
+        }                                                                                     \
+    } while (0)
+
+inline int checkResult() {
+    return checkFailures() == 0 ? 0 : 1;
+}
@@ -0,0 +1,143 @@
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "checkpoint.h"
+#include "fast_random.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+HeapStats row(int step) {
+    HeapStats stats{};
+    stats.timeStep = step;
+    stats.totalUserRequested = 1000 + step;
+    return stats;
+}
+
+void streamRoundTrip() {
+    CheckpointWriter out;
+    out.put(uint32_t{7});
+    out.put(-2.5);
+    out.putString("--steps 100");
+    out.putVector(std::vector<int64_t>{1, -2, 3});
+
+    CheckpointReader in(out.bytes());
+    CHECK(in.get<uint32_t>() == 7);
+    CHECK(in.get<double>() == -2.5);
+    CHECK(in.getString() == "--steps 100");
+    CHECK((in.getVector<int64_t>() == std::vector<int64_t>{1, -2, 3}));
+    in.expectEnd();
+
+    std::vector<char> cut(out.bytes().begin(), out.bytes().begin() + 6);
+    CheckpointReader truncated(cut);
+    truncated.get<uint32_t>();
+    bool threw = false;
+    try {
+        truncated.get<double>();
+    } catch (const std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+// A saved generator continues with the same numbers.
+void randomContinues() {
+    FastRandom random(42);
+    random();
+    CheckpointWriter out;
+    random.save(out);
+    uint64_t expected[3] = {random(), random(), random()};
+
+    FastRandom restored(1);
+    CheckpointReader in(out.bytes());
+    restored.load(in);
+    in.expectEnd();
+    for (uint64_t value : expected) {
+        CHECK(restored() == value);
+    }
+}
+
+// Save after three rows, write two more, read the checkpoint back and
+// resume: the stats file is cut back to the three rows it had.
+void saveAndResume(const fs::path& dir) {
+    std::string stats = (dir / "run.bin").string();
+    std::string path = (dir / "run_checkpoint.bin").string();
+    std::vector<std::string> arguments = {"--steps", "5", "--seed", "9"};
+    CheckpointWriter state;
+    state.putString("simulation state");
+
+    StatsFilePosition saved;
+    {
+        StatsWriter writer(stats, StatsFormat::Binary, {{"seed", "9"}});
+        Checkpointer checkpointer(path, arguments, writer);
+        for (int step = 0; step < 3; ++step) {
+            writer.write(row(step));
+        }
+        checkpointer.save(3, 1.25, state);
+        CHECK(checkpointer.saved() == 1);
+        CHECK(checkpointer.lastStep() == 3);
+        saved = writer.position();
+        for (int step = 3; step < 5; ++step) {
+            writer.write(row(step));
+        }
+        CHECK(writer.close());
+    }
+    CHECK(!fs::exists(path + ".tmp"));
+    CHECK(fs::file_size(stats) > saved.mainBytes);
+
+    Checkpoint checkpoint = readCheckpoint(path);
+    CHECK(checkpoint.arguments == arguments);
+    CHECK(checkpoint.nextStep == 3);
+    CHECK(checkpoint.elapsedSeconds == 1.25);
+    CHECK(checkpoint.stats.rows == 3);
+    CHECK(checkpoint.stats.mainBytes == saved.mainBytes);
+    CHECK(checkpoint.state == state.bytes());
+
+    {
+        StatsWriter resumed(stats, StatsFormat::Binary, {}, {}, checkpoint.stats);
+        CHECK(fs::file_size(stats) == checkpoint.stats.mainBytes);
+        resumed.write(row(3));
+        CHECK(resumed.close());
+        CHECK(resumed.rowsWritten() == 4);
+    }
+}
+
+void rejectsOtherFiles(const fs::path& dir) {
+    for (const std::string& content : {std::string("junk!"), std::string("HEAPCKPT\x01")}) {
+        std::string path = (dir / "bad.bin").string();
+        std::FILE* file = std::fopen(path.c_str(), "wb");
+        std::fwrite(content.data(), 1, content.size(), file);
+        std::fclose(file);
+        bool threw = false;
+        try {
+            readCheckpoint(path);
+        } catch (const std::runtime_error&) {
+            threw = true;
+        }
+        CHECK(threw);
+    }
+}
+
+} // namespace
+
+int main() {
+    fs::path dir = fs::temp_directory_path() / ("checkpoint_test_" + std::to_string(std::random_device{}()));
+    fs::create_directories(dir);
+    streamRoundTrip();
+    randomContinues();
+    try {
+        saveAndResume(dir);
+        rejectsOtherFiles(dir);
+    } catch (const std::exception& e) {
+        std::cerr << "Unexpected exception: " << e.what() << "\n";
+        ++checkFailures();
+    }
+    fs::remove_all(dir);
+    return checkResult();
+}
@@ -0,0 +1,118 @@
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "backends/pool_backend.h"
+#include "check.h"
+#include "compaction.h"
+
+namespace {
+
+constexpr size_t kBlockBytes = 1024; // 64 slots to a slab.
+constexpr size_t kSlots = PoolBackend::kSlabSize / kBlockBytes;
+
+uintptr_t slabOf(const void* block) {
+    return reinterpret_cast<uintptr_t>(block) / PoolBackend::kSlabSize;
+}
+
+CompactionOptions compactAbove(double threshold) {
+    CompactionOptions options;
+    options.threshold = threshold;
+    return options;
+}
+
+void releaseAll(PoolBackend& pool, LiveBlockTable& table) {
+    while (table.size() > 0) {
+        pool.release(table.removeAt(table.size() - 1).ptr);
+    }
+}
+
+HeapStats sample(PoolBackend& pool) {
+    HeapStats stats{};
+    stats.externalFragmentationRatio = externalFragmentationRatio(pool.inspect());
+    return stats;
+}
+
+// Two slabs of one class, a quarter and three quarters full.
+void fillTwoSlabs(PoolBackend& pool, LiveBlockTable& table) {
+    std::vector<void*> blocks;
+    for (size_t i = 0; i < 2 * kSlots; ++i) {
+        blocks.push_back(pool.allocate(kBlockBytes));
+        std::memset(blocks.back(), static_cast<int>(i), kBlockBytes);
+    }
+    // Sparse slab last, so it heads the partial list and allocate() would pick it.
+    for (size_t i = blocks.size(); i-- > 0;) {
+        bool keep = i < kSlots ? i % 4 == 0 : i % 4 != 0;
+        if (keep) {
+            table.add(blocks[i], kBlockBytes, pool.usableSize(blocks[i]));
+        } else {
+            pool.release(blocks[i]);
+        }
+    }
+}
+
+void emptiesTheSparseSlabIntoTheDenseOne() {
+    PoolBackend pool(size_t{1} << 30);
+    LiveBlockTable table;
+    fillTwoSlabs(pool, table);
+    uintptr_t sparseSlab = slabOf(table[table.size() - 1].ptr);
+    uintptr_t denseSlab = slabOf(table[0].ptr);
+    std::vector<int> fill;
+    for (size_t i = 0; i < table.size(); ++i) {
+        fill.push_back(static_cast<unsigned char*>(table[i].ptr)[0]);
+    }
+
+    HeapCompactor compactor(compactAbove(0.5));
+    LiveBlockTable* const tables[] = {&table};
+    compactor.reserve(pool, tables);
+    HeapStats stats = sample(pool);
+    CHECK(stats.externalFragmentationRatio > 0.9);
+    compactor.compactIfFragmented(pool, tables, stats);
+
+    CHECK(stats.compactionMovedBlocks == kSlots / 4);
+    CHECK_NEAR(stats.compactionRatioAfter, 0.0, 1e-9);
+    for (size_t i = 0; i < table.size(); ++i) {
+        CHECK(slabOf(table[i].ptr) == denseSlab);
+        CHECK(static_cast<unsigned char*>(table[i].ptr)[0] == fill[i]);
+        CHECK(static_cast<unsigned char*>(table[i].ptr)[kBlockBytes - 1] == fill[i]);
+    }
+    CHECK(sparseSlab != denseSlab);
+    releaseAll(pool, table);
+}
+
+void backsOffAfterPassesThatDoNotHelp() {
+    // One sparse slab and nowhere to move its blocks to.
+    PoolBackend pool(size_t{1} << 30);
+    LiveBlockTable table;
+    for (size_t i = 0; i < kSlots; ++i) {
+        void* block = pool.allocate(kBlockBytes);
+        if (i % 4 == 0) {
+            table.add(block, kBlockBytes, pool.usableSize(block));
+        } else {
+            pool.release(block);
+        }
+    }
+
+    HeapCompactor compactor(compactAbove(0.5));
+    LiveBlockTable* const tables[] = {&table};
+    std::vector<bool> ran;
+    for (int i = 0; i < 8; ++i) {
+        compactor.reserve(pool, tables);
+        HeapStats stats = sample(pool);
+        compactor.compactIfFragmented(pool, tables, stats);
+        CHECK(stats.compactionMovedBlocks == 0);
+        ran.push_back(!std::isnan(stats.compactionRatioAfter));
+    }
+    // Runs, then sits out 1, 2 and 4 samples.
+    CHECK((ran == std::vector<bool>{true, false, true, false, false, true, false, false}));
+    releaseAll(pool, table);
+}
+
+} // namespace
+
+int main() {
+    emptiesTheSparseSlabIntoTheDenseOne();
+    backsOffAfterPassesThatDoNotHelp();
+    return checkResult();
+}
@@ -0,0 +1,35 @@
+#include <cstdint>
+
+#include "check.h"
+#include "latency_histogram.h"
+
+namespace {
+
+void bucketsCoverAllOfUint64() {
+    CHECK(LatencyHistogram::bucketOf(0) == 0);
+    CHECK(LatencyHistogram::bucketOf(~uint64_t{0}) == LatencyHistogram::kBucketCount - 1);
+    CHECK(LatencyHistogram::bucketMidpoint(LatencyHistogram::kBucketCount - 1) >= uint64_t{63} << 58);
+}
+
+void recordsWrappedTickDeltas() {
+    // A delta taken across cores with unsynchronized TSCs can wrap to near 2^64.
+    LatencyHistogram histogram;
+    histogram.record(0);
+    histogram.record((uint64_t{1} << 63) - 1);
+    histogram.record(uint64_t{1} << 63);
+    histogram.record(~uint64_t{0});
+    CHECK(histogram.count() == 4);
+    CHECK(histogram.max() == ~uint64_t{0});
+    // The midpoint of the top bucket, which holds [63 * 2^58, 2^64).
+    CHECK(histogram.percentile(1.0) >= uint64_t{63} << 58);
+    CHECK(histogram.percentile(1.0) <= histogram.max());
+    CHECK(histogram.percentile(0.0) == 0);
+}
+
+} // namespace
+
+int main() {
+    bucketsCoverAllOfUint64();
+    recordsWrappedTickDeltas();
+    return checkResult();
+}
@@ -0,0 +1,70 @@
+#include <cstring>
+
+#include "check.h"
+#include "malloc_info_scanner.h"
+
+namespace {
+
+void parse(const char* text, MallocInfoSnapshot& out) {
+    MallocInfoScanner::parse(text, text + std::strlen(text), out);
+}
+
+// The shape glibc's malloc_info() writes, with one arena.
+void parsesOneArena() {
+    const char* text = "<malloc version=\"1\">\n"
+                       "<heap nr=\"0\">\n"
+                       "<sizes>\n"
+                       "  <size from=\"33\" to=\"48\" total=\"96\" count=\"2\"/>\n"
+                       "  <size from=\"1025\" to=\"2000\" total=\"3000\" count=\"2\"/>\n"
+                       "</sizes>\n"
+                       "<total type=\"fast\" count=\"2\" size=\"96\"/>\n"
+                       "<total type=\"rest\" count=\"3\" size=\"7000\"/>\n"
+                       "<system type=\"current\" size=\"135168\"/>\n"
+                       "<system type=\"max\" size=\"135168\"/>\n"
+                       "</heap>\n"
+                       "<total type=\"fast\" count=\"2\" size=\"96\"/>\n"
+                       "<total type=\"rest\" count=\"3\" size=\"7000\"/>\n"
+                       "<total type=\"mmap\" count=\"1\" size=\"4096\"/>\n"
+                       "<system type=\"current\" size=\"135168\"/>\n"
+                       "<system type=\"max\" size=\"139264\"/>\n"
+                       "</malloc>\n";
+    MallocInfoSnapshot out;
+    parse(text, out);
+    CHECK(out.arenas.size() == 1);
+    if (out.arenas.size() == 1) {
+        const ArenaFreeInfo& arena = out.arenas[0];
+        CHECK(arena.fastBytes == 96);
+        CHECK(arena.topBytes == 4000); // rest 7000 less the 3000 in regular bins.
+        CHECK(arena.freeBytes == 7096);
+        CHECK(arena.freeChunks == 5);
+        CHECK(arena.biggestFreeBlock == 4000);
+        CHECK(arena.systemCurrent == 135168);
+    }
+    CHECK(out.totalFree == 7096);
+    CHECK(out.mmapBytes == 4096);
+    CHECK(out.systemMax == 139264);
+}
+
+// Unquoted values, stray '=' and cut-off tags must neither hang nor throw
+// off the attributes that follow.
+void skipsMalformedAttributes() {
+    MallocInfoSnapshot out;
+    parse("<heap nr=\"1\"><total a=b type=\"mmap\" size=\"42\"/></heap>", out);
+    CHECK(out.mmapBytes == 42);
+    parse("<heap nr=\"1\"><total = == type=\"mmap\" size=\"7\"/></heap>", out);
+    CHECK(out.mmapBytes == 7);
+    parse("<size a=b>", out);
+    parse("<total type=\"mmap\" a=", out);
+    parse("<total type=\"mmap\" size=\"", out);
+    parse("<total type=\"mmap\" size", out);
+    parse("<", out);
+    CHECK(out.arenas.empty());
+}
+
+} // namespace
+
+int main() {
+    parsesOneArena();
+    skipsMalformedAttributes();
+    return checkResult();
+}
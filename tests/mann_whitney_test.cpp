@@ -0,0 +1,46 @@
+#include <vector>
+
+#include "check.h"
+#include "mann_whitney.h"
+
+namespace {
+
+void countsAreGaussianBinomials() {
+    // [4 choose 2]_q = 1 + q + 2q^2 + q^3 + q^4.
+    CHECK((exactUCounts(2, 2) == std::vector<double>{1, 1, 2, 1, 1}));
+    double all = 0;
+    for (double count : exactUCounts(5, 7)) {
+        all += count;
+    }
+    CHECK(all == 792); // 12 choose 5.
+}
+
+void exactPValues() {
+    bool exact = false;
+    // Every value of one side above every value of the other: 1 / (6 choose 3).
+    CHECK_NEAR(mannWhitneyGreater({4, 5, 6}, {1, 2, 3}, exact), 0.05, 1e-12);
+    CHECK(exact);
+    CHECK_NEAR(mannWhitneyGreater({1, 2, 3}, {4, 5, 6}, exact), 1.0, 1e-12);
+    // U = 13 of 20; 35 of the 126 splits reach it (enumerated by brute force).
+    CHECK_NEAR(mannWhitneyGreater({4, 5, 6, 8}, {1, 2, 3, 7, 9}, exact), 35.0 / 126, 1e-12);
+    CHECK(exact);
+}
+
+void normalApproximationWithTies() {
+    bool exact = true;
+    // U = 18, tie-corrected variance, continuity correction; as
+    // scipy.stats.mannwhitneyu(method="asymptotic", alternative="greater").
+    CHECK_NEAR(mannWhitneyGreater({2, 2, 3, 3, 5}, {1, 1, 2, 2}, exact), 0.0264037557, 1e-9);
+    CHECK(!exact);
+    CHECK(mannWhitneyGreater({7, 7, 7}, {7, 7}, exact) == 1.0);
+    CHECK(mannWhitneyGreater({}, {1, 2}, exact) == 1.0);
+}
+
+} // namespace
+
+int main() {
+    countsAreGaussianBinomials();
+    exactPValues();
+    normalApproximationWithTies();
+    return checkResult();
+}
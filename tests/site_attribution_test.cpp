@@ -0,0 +1,93 @@
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "check.h"
+#include "site_attribution.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Pinned_Bytes of every site in a sites CSV, by stack.
+std::map<uint32_t, double> pinnedBytes(const fs::path& path) {
+    std::map<uint32_t, double> pinned;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.starts_with('#') || line.starts_with("Rank")) {
+            continue;
+        }
+        std::vector<std::string> cells;
+        std::stringstream row(line);
+        for (std::string cell; std::getline(row, cell, ',');) {
+            cells.push_back(cell);
+        }
+        pinned[static_cast<uint32_t>(std::stoul(cells[1]))] = std::stod(cells[6]);
+    }
+    return pinned;
+}
+
+// Free chunks come from the layout, not from gaps between live blocks: a busy
+// span the replay does not own (the allocator's, or the attribution's own
+// map nodes) is no free space, and a block sharing its span pins nothing.
+void pinsOnlyBetweenFreeSpans(const fs::path& dir) {
+    SiteAttribution sites(SiteOptions{10, 1});
+    std::unordered_map<uint64_t, LiveBlock> live;
+    auto add = [&](uintptr_t address, uint32_t stack) {
+        live[address] = {reinterpret_cast<void*>(address), 48, 48};
+        sites.allocated(address, stack, 48, 0);
+    };
+    add(0x1110, 1); // Free on both sides.
+    add(0x1350, 2); // Free below, a busy span above.
+    add(0x1390, 2); // That busy span, free above.
+    add(0x1610, 3); // Two blocks in one span between free chunks.
+    add(0x1650, 3);
+    add(0x1810, 4); // Free below; above is a busy span no live block is in.
+    sites.spans() = {
+        {0x1000, 0x100, false}, {0x1100, 0x40, true},  {0x1140, 0x200, false}, {0x1340, 0x40, true},
+        {0x1380, 0x40, true},   {0x13c0, 0x100, false}, {0x1500, 0x100, true},  {0x1600, 0x80, true},
+        {0x1680, 0x180, false}, {0x1800, 0x40, true},  {0x1840, 0x40, true},   {0x1880, 0x400, false},
+    };
+    sites.sample(live, 1);
+
+    fs::path path = dir / "sites.csv";
+    sites.write(path.string(), {});
+    std::map<uint32_t, double> pinned = pinnedBytes(path);
+    CHECK(pinned[1] == 0x100 + 0x200);
+    CHECK(pinned[2] == 0);
+    CHECK(pinned[3] == 0);
+    CHECK(pinned[4] == 0);
+}
+
+// Without a heap layout nothing pins, whatever the gaps between blocks.
+void noLayoutNoPinning(const fs::path& dir) {
+    SiteAttribution sites(SiteOptions{10, 1});
+    std::unordered_map<uint64_t, LiveBlock> live;
+    for (uintptr_t address : {0x1000, 0x2000, 0x3000}) {
+        live[address] = {reinterpret_cast<void*>(address), 48, 64};
+        sites.allocated(address, 1, 48, 0);
+    }
+    sites.sample(live, 1);
+
+    fs::path path = dir / "no_layout.csv";
+    sites.write(path.string(), {});
+    CHECK(pinnedBytes(path)[1] == 0);
+}
+
+} // namespace
+
+int main() {
+    fs::path dir = fs::temp_directory_path() / ("site_attribution_test_" + std::to_string(std::random_device{}()));
+    fs::create_directories(dir);
+    pinsOnlyBetweenFreeSpans(dir);
+    noLayoutNoPinning(dir);
+    fs::remove_all(dir);
+    return checkResult();
+}
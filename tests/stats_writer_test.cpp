@@ -0,0 +1,51 @@
+#include <cstdio>
+#include <filesystem>
+#include <string>
+
+#include "backends/glibc_backend.h"
+#include "check.h"
+#include "simulation.h"
+#include "stats_writer.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Passes rows on to a StatsWriter, noting the most arenas any of them saw.
+struct CountingSink {
+    StatsWriter& writer;
+    size_t mostArenas = 0;
+    void write(HeapStats&& stats) {
+        mostArenas = std::max(mostArenas, stats.arenas.size());
+        writer.write(std::move(stats));
+    }
+};
+
+// The writer thread must not allocate, or glibc gives it an arena of its own
+// and every row after the first batch counts it. (Its exit still frees the
+// std::thread state, but by then no more rows are taken.)
+void writerLeavesGlibcArenasAlone() {
+    fs::path path = fs::temp_directory_path() / "stats_writer_test.csv";
+    GlibcBackend backend;
+    SimulationOptions options;
+    options.workload.phases[0].steps = 2500; // Two full batches and a partial one.
+    options.seed = 7;
+    {
+        StatsWriter writer(path.string(), StatsFormat::Csv, {{"backend", "glibc"}});
+        CountingSink sink{writer};
+        runSimulation(backend, options, sink);
+        CHECK(writer.close());
+        CHECK(writer.rowsWritten() == 2500);
+        CHECK(sink.mostArenas == 1);
+        CHECK(writer.wroteArenas());
+    }
+    fs::remove(path);
+    fs::remove(companionPath(path.string(), "_arenas"));
+}
+
+} // namespace
+
+int main() {
+    writerLeavesGlibcArenasAlone();
+    return checkResult();
+}
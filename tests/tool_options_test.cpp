@@ -0,0 +1,49 @@
+#include <string>
+#include <vector>
+
+#include "check.h"
+#include "tool_options.h"
+
+namespace {
+
+void parsesListsAndRanges() {
+    std::vector<unsigned> seeds;
+    CHECK(parseList("0,100-102", seeds));
+    CHECK((seeds == std::vector<unsigned>{0, 100, 101, 102}));
+    CHECK(!parseList("5-3", seeds));
+    CHECK(!parseList("1,x", seeds));
+    CHECK(!parseList("", seeds));
+}
+
+// A range ending at the type's maximum used to loop forever, and a huge one
+// ran out of memory; heap_compare --seeds had both.
+void rejectsRunawayRanges() {
+    std::vector<unsigned> seeds;
+    CHECK(parseList("4294967295-4294967295", seeds));
+    CHECK((seeds == std::vector<unsigned>{4294967295u}));
+    CHECK(parseList("4294967290-4294967295", seeds));
+    CHECK(seeds.size() == 6);
+    CHECK(!parseList("1-100000000", seeds));
+    CHECK(parseList("1-4096", seeds));
+    CHECK(!parseList("1-4097", seeds));
+}
+
+void namesAndCsvFields() {
+    std::vector<std::string> names;
+    parseNames("backend,seed,,threads", names);
+    CHECK((names == std::vector<std::string>{"backend", "seed", "", "threads"}));
+    CHECK(joinNames(names) == "backend,seed,,threads");
+    CHECK(joinNames({"--steps", "100"}, ' ') == "--steps 100");
+    CHECK(csvField("plain") == "plain");
+    CHECK(csvField("a,b") == "\"a,b\"");
+    CHECK(csvField("say \"hi\"") == "\"say \"\"hi\"\"\"");
+}
+
+} // namespace
+
+int main() {
+    parsesListsAndRanges();
+    rejectsRunawayRanges();
+    namesAndCsvFields();
+    return checkResult();
+}
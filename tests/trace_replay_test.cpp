@@ -0,0 +1,153 @@
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "backends/pool_backend.h"
+#include "check.h"
+#include "trace_replay.h"
+
+namespace fs = std::filesystem;
+
+namespace {
+
+struct CollectingSink {
+    std::vector<HeapStats> rows;
+    void write(HeapStats&& stats) { rows.push_back(std::move(stats)); }
+};
+
+trace::Event alloc(uint64_t timestamp, uint64_t address, uint64_t size) {
+    trace::Event event;
+    event.type = trace::EventType::Alloc;
+    event.timestamp = timestamp;
+    event.address = address;
+    event.size = size;
+    return event;
+}
+
+trace::Event release(uint64_t timestamp, uint64_t address) {
+    trace::Event event;
+    event.type = trace::EventType::Free;
+    event.timestamp = timestamp;
+    event.address = address;
+    return event;
+}
+
+struct Chunk {
+    uint32_t thread;
+    std::vector<trace::Event> events;
+};
+
+// Writes @p chunks in the given order, followed by their index.
+void writeTrace(const std::string& path, const std::vector<Chunk>& chunks) {
+    std::vector<uint8_t> bytes(sizeof(trace::FileHeader));
+    std::vector<trace::IndexEntry> index;
+    for (const Chunk& chunk : chunks) {
+        std::vector<uint8_t> buffer(sizeof(trace::ChunkHeader) + chunk.events.size() * trace::kMaxEventBytes);
+        trace::ChunkEncoder encoder;
+        encoder.reset(buffer.data(), buffer.size(), chunk.thread);
+        for (const trace::Event& event : chunk.events) {
+            encoder.append(event);
+        }
+        trace::ChunkHeader header = encoder.header();
+        index.push_back({bytes.size(), header.firstTimestamp, header.lastTimestamp, header.eventCount, chunk.thread});
+        bytes.insert(bytes.end(), buffer.data(), buffer.data() + encoder.finish());
+    }
+    trace::FileHeader header{};
+    std::memcpy(header.magic, trace::kMagic, sizeof(trace::kMagic));
+    header.version = trace::kVersion;
+    header.chunkCount = index.size();
+    header.indexOffset = bytes.size();
+    std::memcpy(bytes.data(), &header, sizeof(header));
+    const uint8_t* entries = reinterpret_cast<const uint8_t*>(index.data());
+    bytes.insert(bytes.end(), entries, entries + index.size() * sizeof(trace::IndexEntry));
+
+    std::FILE* file = std::fopen(path.c_str(), "wb");
+    std::fwrite(bytes.data(), 1, bytes.size(), file);
+    std::fclose(file);
+}
+
+// Thread 2 frees everything thread 1 allocates, and its buffer was flushed
+// first; thread 1's second buffer was flushed before its first. Replayed in
+// file order, every free would come before its allocation.
+void crossThreadFrees(const fs::path& dir) {
+    std::string path = (dir / "cross_thread.bin").string();
+    writeTrace(path, {
+                         {2, {release(20, 0x1000), release(40, 0x2000), release(60, 0x1000)}},
+                         {1, {alloc(50, 0x1000, 64)}},
+                         {1, {alloc(10, 0x1000, 32), alloc(30, 0x2000, 48)}},
+                     });
+
+    PoolBackend backend(size_t{64} << 20);
+    ReplayOptions options;
+    options.path = path;
+    options.eventsPerStep = 1;
+    CollectingSink sink;
+    ReplaySummary summary;
+    replayTrace(backend, options, sink, summary);
+
+    CHECK(summary.events == 6);
+    CHECK(summary.allocations == 3);
+    CHECK(summary.frees == 3);
+    CHECK(summary.unmatchedFrees == 0);
+    CHECK(summary.corruptChunks == 0);
+    CHECK(sink.rows.size() == 6);
+    if (sink.rows.size() == 6) {
+        // In timestamp order: 32 live, none, 48, none, 64, none.
+        const size_t requested[] = {32, 0, 48, 0, 64, 0};
+        for (size_t i = 0; i < 6; ++i) {
+            CHECK(sink.rows[i].totalUserRequested == requested[i]);
+        }
+    }
+}
+
+// A window replays only the events inside it, from every thread, even with
+// each thread's chunks flushed out of order.
+void replaysWindow(const fs::path& dir) {
+    constexpr uint64_t kSecond = 1000000000;
+    std::string path = (dir / "window.bin").string();
+    writeTrace(path, {
+                         {1, {release(5 * kSecond, 0x2000)}},
+                         {2, {alloc(4 * kSecond, 0x3000, 64)}},
+                         {1, {alloc(1 * kSecond, 0x1000, 16)}},
+                         {2, {release(2 * kSecond, 0x1000)}},
+                         {1, {alloc(3 * kSecond, 0x2000, 32)}},
+                         {2, {release(6 * kSecond, 0x3000)}},
+                     });
+
+    PoolBackend backend(size_t{64} << 20);
+    ReplayOptions options;
+    options.path = path;
+    options.startSeconds = 1.5; // From the first event, so 2.5 s to 4.5 s.
+    options.endSeconds = 3.5;
+    CollectingSink sink;
+    ReplaySummary summary;
+    replayTrace(backend, options, sink, summary);
+
+    CHECK(summary.events == 2);
+    CHECK(summary.allocations == 2);
+    CHECK(summary.frees == 0);
+    CHECK(summary.corruptChunks == 0);
+    CHECK(!sink.rows.empty());
+    if (!sink.rows.empty()) {
+        CHECK(sink.rows.back().totalUserRequested == 32 + 64);
+    }
+}
+
+} // namespace
+
+int main() {
+    fs::path dir = fs::temp_directory_path() / ("trace_replay_test_" + std::to_string(std::random_device{}()));
+    fs::create_directories(dir);
+    try {
+        crossThreadFrees(dir);
+        replaysWindow(dir);
+    } catch (const std::exception& e) {
+        std::cerr << "Unexpected exception: " << e.what() << "\n";
+        ++checkFailures();
+    }
+    fs::remove_all(dir);
+    return checkResult();
+}
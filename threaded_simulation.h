@@ -0,0 +1,182 @@
+#pragma once
+
+#include <algorithm>
+#include <barrier>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "handoff_queue.h"
+#include "simulation.h"
+
+/**
+ * @brief Multithreaded variant of runSimulation().
+ *
+ * Every worker runs the same workload on its own live-block table, so
+ * allocators with per-thread arenas or caches see one stream per thread. A
+ * share of each worker's frees is handed to another worker through a lock-free
+ * queue and freed there, which exercises the cross-thread free paths that
+ * fragment per-thread arenas in real services.
+ *
+ * Workers meet at two barriers per timestep: after the handoff phase (so every
+ * handed-off block is freed before sampling) and at the end of the step, where
+ * the last thread to arrive samples the heap, on the steps the
+ * SamplingPolicy picks, while all others are parked.
+ * That thread also runs any compaction, moving every worker's blocks, so
+ * the relocated blocks come from its own thread cache or arena. It is also
+ * the one that notices SoakOptions::durationSeconds is up, and everybody
+ * stops after that step. Checkpoints are single-threaded only.
+ */
+template <HeapBackend Backend, StatsSink Sink>
+void runThreadedSimulation(Backend& backend, const SimulationOptions& options, Sink& sink) {
+    struct Worker {
+        explicit Worker(uint64_t seed) : scheduler(seed) {}
+
+        LiveBlockTable blocks;
+        LatencyHistogram allocLatency;
+        LatencyHistogram freeLatency;
+        ArenaLatency<Backend> arenaLatency;
+        ReallocCounters reallocs;
+        size_t largestFree = 0; // Biggest block this worker freed during the step.
+        HandoffQueue<LiveBlock> inbox{1024};
+        LifetimeScheduler scheduler;
+    };
+
+    const int threadCount = options.threads;
+    std::vector<std::unique_ptr<Worker>> workers;
+    for (int i = 0; i < threadCount; ++i) {
+        workers.push_back(std::make_unique<Worker>(uint64_t{options.seed} + i));
+    }
+
+    HeapCompactor compactor(options.compaction);
+    LocalityProbe locality;
+    std::vector<LiveBlockTable*> tables;
+    for (auto& worker : workers) {
+        tables.push_back(&worker->blocks);
+    }
+
+    SamplingPolicy sampling(options.probes.sampling);
+    ArenaLatency<Backend> arenaLatency; // Every worker's, merged when sampling.
+    const int lastStep = options.workload.totalSteps() - 1;
+    int timeStep = 0;
+    RunClock clock(options.soak);
+    bool stopped = false; // Written by the barrier's completion, read by the workers after it.
+
+    // Step B: runs on exactly one thread once everybody has finished the step.
+    auto sample = [&]() noexcept {
+        int t = timeStep++;
+        size_t totalRequested = 0;
+        size_t totalUsable = 0;
+        size_t largestFree = 0;
+        for (auto& worker : workers) {
+            totalRequested += worker->blocks.totalRequested();
+            totalUsable += worker->blocks.totalUsable();
+            largestFree = std::max(largestFree, worker->largestFree);
+            worker->largestFree = 0;
+        }
+        stopped = clock.timeUp();
+        uint32_t trigger = sampling.due(mustSample(options.probes, t, t == lastStep || stopped), largestFree,
+                                        totalRequested, totalUsable);
+        if (trigger == 0) {
+            return;
+        }
+
+        LatencyHistogram allocLatency;
+        LatencyHistogram freeLatency;
+        ReallocCounters reallocs;
+        size_t alignedFragmentation = 0;
+        for (auto& worker : workers) {
+            alignedFragmentation += worker->blocks.totalAlignedFragmentation();
+            allocLatency.merge(worker->allocLatency);
+            freeLatency.merge(worker->freeLatency);
+            reallocs.merge(worker->reallocs);
+            arenaLatency.take(worker->arenaLatency);
+            worker->allocLatency.reset();
+            worker->freeLatency.reset();
+            worker->reallocs = {};
+        }
+        compactor.reserve(backend, tables);
+        HeapStats stats = sampleHeap(backend, options.probes, t, totalRequested, totalUsable, allocLatency,
+                                     freeLatency);
+        arenaLatency.summarize(backend, stats.arenas);
+        arenaLatency.reset();
+        addWorkloadCounters(stats, reallocs, alignedFragmentation, trigger);
+        if (options.probes.locality) {
+            locality.measure(tables, stats);
+        }
+        // Everybody else is parked at the barrier, so blocks can move under their handles.
+        compactor.compactIfFragmented(backend, tables, stats);
+        sink.write(std::move(stats));
+    };
+    std::barrier handoffDone(threadCount);
+    std::barrier stepDone(threadCount, sample);
+
+    auto work = [&](int id) {
+        Worker& self = *workers[id];
+        FastRandom& random = self.scheduler.random();
+        int t = 0;
+        for (const WorkloadPhase& phase : options.workload.phases) {
+            for (int phaseStep = 0; phaseStep < phase.steps && !stopped; ++phaseStep, ++t) {
+                // Step A: Perform Memory Operations to simulate a workload.
+                for (int i = 0; i < phase.allocationsPerStep; ++i) {
+                    size_t size = phase.sizes(random);
+                    size_t alignment = drawAlignment(phase, random);
+                    uint64_t ticks = 0;
+                    void* block = timedCall(
+                        self.allocLatency, [&] { return allocateBlock(backend, size, alignment); }, &ticks);
+                    if (block) {
+                        self.arenaLatency.recordAlloc(backend, block, ticks);
+                        self.scheduler.onAllocated(
+                            phase, self.blocks.add(block, size, backend.usableSize(block), alignment), t);
+                    }
+                }
+                for (int i = 0; i < phase.reallocationsPerStep && !self.blocks.empty(); ++i) {
+                    size_t index = random.below(static_cast<uint32_t>(self.blocks.size()));
+                    if (size_t size = grownSize(phase, self.blocks[index].requested)) {
+                        growBlock(backend, self.blocks, index, size, self.reallocs);
+                    }
+                }
+
+                self.scheduler.freeDue(phase, t, self.blocks, [&](const LiveBlock& victim) {
+                    self.largestFree = std::max(self.largestFree, victim.usable);
+                    int target = id;
+                    if (threadCount > 1 && static_cast<int>(random.below(100)) < options.crossThreadFreePercent) {
+                        target = (id + 1 + static_cast<int>(random.below(static_cast<uint32_t>(threadCount - 1)))) % threadCount;
+                    }
+                    // A full inbox just means this one is freed locally.
+                    if (target == id || !workers[target]->inbox.push(victim)) {
+                        uintptr_t arena = self.arenaLatency.arenaOf(backend, victim.ptr);
+                        uint64_t ticks = 0;
+                        timedCall(self.freeLatency, [&] { backend.release(victim.ptr); }, &ticks);
+                        self.arenaLatency.recordFree(arena, ticks);
+                    }
+                });
+                handoffDone.arrive_and_wait();
+
+                // Cross-thread frees: release whatever other workers handed to us.
+                LiveBlock received;
+                while (self.inbox.pop(received)) {
+                    uintptr_t arena = self.arenaLatency.arenaOf(backend, received.ptr);
+                    uint64_t ticks = 0;
+                    timedCall(self.freeLatency, [&] { backend.release(received.ptr); }, &ticks);
+                    self.arenaLatency.recordFree(arena, ticks);
+                }
+                stepDone.arrive_and_wait();
+            }
+        }
+
+        // --- Final Cleanup ---
+        for (const LiveBlock& block : self.blocks) {
+            backend.release(block.ptr);
+        }
+        self.blocks.clear();
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadCount; ++i) {
+        threads.emplace_back(work, i);
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
@@ -0,0 +1,35 @@
+#include "tool_options.h"
+
+void parseNames(std::string_view text, std::vector<std::string>& names) {
+    names.clear();
+    while (!text.empty()) {
+        size_t comma = text.find(',');
+        names.emplace_back(text.substr(0, comma));
+        text = comma == std::string_view::npos ? std::string_view() : text.substr(comma + 1);
+    }
+}
+
+std::string joinNames(const std::vector<std::string>& names, char separator) {
+    std::string joined;
+    for (const std::string& name : names) {
+        if (!joined.empty()) {
+            joined += separator;
+        }
+        joined += name;
+    }
+    return joined;
+}
+
+std::string csvField(const std::string& value) {
+    if (value.find_first_of(",\"\n") == std::string::npos) {
+        return value;
+    }
+    std::string quoted = "\"";
+    for (char c : value) {
+        quoted += c;
+        if (c == '"') {
+            quoted += '"';
+        }
+    }
+    return quoted + "\"";
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <charconv>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Command-line and CSV helpers shared by heap_sweep, heap_aggregate and heap_compare.
+
+// The whole of @p text as a number; false on anything else, trailing characters included.
+template <typename T>
+bool parseNumber(std::string_view text, T& value) {
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return ec == std::errc() && end == text.data() + text.size();
+}
+
+// Most values a single range may expand to; a byte range such as 131072-262144
+// is almost certainly a mistake, not a request for 131k runs.
+inline constexpr uint64_t kMaxRangeValues = 4096;
+
+// "1,4,16" or "1-50" (inclusive) or a mix: "0,100-102". False on an empty
+// list, a malformed item or a range of more than kMaxRangeValues values.
+template <typename T>
+bool parseList(std::string_view text, std::vector<T>& values) {
+    values.clear();
+    while (!text.empty()) {
+        size_t comma = text.find(',');
+        std::string_view item = text.substr(0, comma);
+        text = comma == std::string_view::npos ? std::string_view() : text.substr(comma + 1);
+
+        size_t dash = item.find('-', 1);
+        T first{};
+        T last{};
+        if (dash == std::string_view::npos) {
+            if (!parseNumber(item, first)) {
+                return false;
+            }
+            last = first;
+        } else if (!parseNumber(item.substr(0, dash), first) || !parseNumber(item.substr(dash + 1), last) ||
+                   last < first) {
+            return false;
+        }
+        if (static_cast<uint64_t>(last) - static_cast<uint64_t>(first) >= kMaxRangeValues) {
+            return false;
+        }
+        // Stops on value == last so a range ending at the type's maximum ends too.
+        for (T value = first;; ++value) {
+            values.push_back(value);
+            if (value == last) {
+                break;
+            }
+        }
+    }
+    return !values.empty();
+}
+
+// Splits "a,b,c" at every comma into @p names.
+void parseNames(std::string_view text, std::vector<std::string>& names);
+
+// The reverse of parseNames(), with @p separator between the names.
+std::string joinNames(const std::vector<std::string>& names, char separator = ',');
+
+// Quotes a CSV field that holds a comma, a quote or a line break.
+std::string csvField(const std::string& value);
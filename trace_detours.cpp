@@ -0,0 +1,73 @@
+// Detours shim that records HeapAlloc/HeapFree/HeapReAlloc calls of the host
+// process. The CRT's malloc family ends up in these, so this covers both.
+// Inject it with the Detours sample launcher:
+//
+//     set HEAPTRACE_FILE=app.trace
+//     withdll.exe /d:heaptrace.dll app.exe
+
+#include <windows.h>
+
+#include <detours.h>
+
+#include "trace_recorder.h"
+
+namespace {
+
+LPVOID(WINAPI* TrueHeapAlloc)(HANDLE, DWORD, SIZE_T) = HeapAlloc;
+BOOL(WINAPI* TrueHeapFree)(HANDLE, DWORD, LPVOID) = HeapFree;
+LPVOID(WINAPI* TrueHeapReAlloc)(HANDLE, DWORD, LPVOID, SIZE_T) = HeapReAlloc;
+
+LPVOID WINAPI TracedHeapAlloc(HANDLE heap, DWORD flags, SIZE_T bytes) {
+    LPVOID block = TrueHeapAlloc(heap, flags, bytes);
+    trace::recordAlloc(block, bytes, TRACE_CALLER());
+    return block;
+}
+
+BOOL WINAPI TracedHeapFree(HANDLE heap, DWORD flags, LPVOID block) {
+    trace::recordFree(block);
+    return TrueHeapFree(heap, flags, block);
+}
+
+LPVOID WINAPI TracedHeapReAlloc(HANDLE heap, DWORD flags, LPVOID block, SIZE_T bytes) {
+    LPVOID resized = TrueHeapReAlloc(heap, flags, block, bytes);
+    trace::recordRealloc(block, resized, bytes, TRACE_CALLER());
+    return resized;
+}
+
+LONG attachHooks(bool attach) {
+    DetourTransactionBegin();
+    DetourUpdateThread(GetCurrentThread());
+    auto hook = attach ? DetourAttach : DetourDetach;
+    hook(&reinterpret_cast<PVOID&>(TrueHeapAlloc), reinterpret_cast<PVOID>(TracedHeapAlloc));
+    hook(&reinterpret_cast<PVOID&>(TrueHeapFree), reinterpret_cast<PVOID>(TracedHeapFree));
+    hook(&reinterpret_cast<PVOID&>(TrueHeapReAlloc), reinterpret_cast<PVOID>(TracedHeapReAlloc));
+    return DetourTransactionCommit();
+}
+
+} // namespace
+
+// Detours requires injected DLLs to export at least ordinal #1.
+extern "C" __declspec(dllexport) DWORD WINAPI HeapTraceVersion() {
+    return 1;
+}
+
+BOOL WINAPI DllMain(HINSTANCE, DWORD reason, LPVOID) {
+    if (DetourIsHelperProcess()) {
+        return TRUE;
+    }
+    switch (reason) {
+    case DLL_PROCESS_ATTACH:
+        DetourRestoreAfterWith();
+        trace::startRecorder();
+        attachHooks(true);
+        break;
+    case DLL_THREAD_DETACH:
+        trace::flushCurrentThread();
+        break;
+    case DLL_PROCESS_DETACH:
+        attachHooks(false);
+        trace::stopRecorder();
+        break;
+    }
+    return TRUE;
+}
@@ -0,0 +1,324 @@
+#include "trace_file.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <stdexcept>
+#include <string_view>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace trace {
+
+namespace {
+
+#ifdef _WIN32
+size_t pageSize() {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwPageSize;
+}
+#else
+size_t pageSize() { return static_cast<size_t>(sysconf(_SC_PAGESIZE)); }
+#endif
+
+} // namespace
+
+TraceFile::TraceFile(const std::string& path) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        throw std::runtime_error("cannot open trace file " + path);
+    }
+    LARGE_INTEGER fileSize{};
+    GetFileSizeEx(file, &fileSize);
+    size_ = static_cast<size_t>(fileSize.QuadPart);
+    if (size_ >= sizeof(FileHeader)) {
+        mappingHandle_ = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mappingHandle_) {
+            data_ = static_cast<const uint8_t*>(MapViewOfFile(mappingHandle_, FILE_MAP_READ, 0, 0, 0));
+        }
+    }
+    CloseHandle(file);
+#else
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("cannot open trace file " + path);
+    }
+    struct stat info{};
+    fstat(fd, &info);
+    size_ = static_cast<size_t>(info.st_size);
+    if (size_ >= sizeof(FileHeader)) {
+        void* mapped = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapped != MAP_FAILED) {
+            data_ = static_cast<const uint8_t*>(mapped);
+            // Replay reads front to back: ask for aggressive readahead.
+            madvise(mapped, size_, MADV_SEQUENTIAL);
+        }
+    }
+    close(fd);
+#endif
+
+    FileHeader header{};
+    if (data_) {
+        std::memcpy(&header, data_, sizeof(header));
+    }
+    if (!data_ || std::memcmp(header.magic, kMagic, sizeof(kMagic)) != 0) {
+        unmap();
+        throw std::runtime_error(path + " is not a heaptrace file");
+    }
+    if (header.version < kOldestReadableVersion || header.version > kVersion) {
+        unmap();
+        throw std::runtime_error(path + " has unsupported trace version " + std::to_string(header.version) +
+                                 " (expected " + std::to_string(kOldestReadableVersion) + " to " +
+                                 std::to_string(kVersion) + "); record it again");
+    }
+    loadIndex(header);
+
+    // Chunks of different threads overlap in time, so look at all of them.
+    firstTimestamp_ = index_.empty() ? 0 : UINT64_MAX;
+    for (const IndexEntry& entry : index_) {
+        firstTimestamp_ = std::min(firstTimestamp_, entry.firstTimestamp);
+    }
+}
+
+TraceFile::~TraceFile() { unmap(); }
+
+void TraceFile::unmap() {
+#ifdef _WIN32
+    if (data_) {
+        UnmapViewOfFile(data_);
+    }
+    if (mappingHandle_) {
+        CloseHandle(mappingHandle_);
+    }
+#else
+    if (data_) {
+        munmap(const_cast<uint8_t*>(data_), size_);
+    }
+#endif
+    data_ = nullptr;
+    mappingHandle_ = nullptr;
+}
+
+void TraceFile::loadIndex(const FileHeader& header) {
+    // Trust the index only if it fits in the file and agrees with the chunk
+    // headers it points at; anything else means the recording was cut short.
+    size_t indexBytes = header.chunkCount * sizeof(IndexEntry);
+    bool usable = header.indexOffset >= sizeof(FileHeader) && header.indexOffset <= size_ &&
+                  header.chunkCount <= (size_ - header.indexOffset) / sizeof(IndexEntry);
+    if (usable) {
+        index_.resize(header.chunkCount);
+        std::memcpy(index_.data(), data_ + header.indexOffset, indexBytes);
+        for (const IndexEntry& entry : index_) {
+            if (entry.offset + sizeof(ChunkHeader) > header.indexOffset) {
+                usable = false;
+                break;
+            }
+            ChunkHeader chunk;
+            std::memcpy(&chunk, data_ + entry.offset, sizeof(chunk));
+            if (chunk.eventCount != entry.eventCount || chunk.firstTimestamp != entry.firstTimestamp ||
+                entry.offset + sizeof(ChunkHeader) + chunk.payloadBytes > header.indexOffset) {
+                usable = false;
+                break;
+            }
+        }
+    }
+    if (!usable) {
+        rebuildIndex();
+    } else if (header.version >= 3) {
+        loadStacks(header.indexOffset + indexBytes);
+    }
+}
+
+void TraceFile::loadStacks(size_t offset) {
+    StackTableHeader table;
+    if (size_ - offset < sizeof(table)) {
+        return;
+    }
+    std::memcpy(&table, data_ + offset, sizeof(table));
+    offset += sizeof(table);
+    if (std::memcmp(table.magic, kStackMagic, sizeof(kStackMagic)) != 0 || table.stackBytes > size_ - offset ||
+        table.moduleBytes > size_ - offset - table.stackBytes) {
+        return;
+    }
+    stackSampling_ = static_cast<StackSampling>(table.sampling);
+    stackSamplingPeriod_ = table.samplingPeriod;
+    size_t end = offset + table.stackBytes;
+    for (uint32_t i = 0; i < table.stackCount && end - offset >= sizeof(StackRecord); ++i) {
+        StackRecord record;
+        std::memcpy(&record, data_ + offset, sizeof(record));
+        offset += sizeof(record);
+        if (record.depth > kMaxStackDepth || record.depth * sizeof(uint64_t) > end - offset) {
+            break;
+        }
+        std::vector<uint64_t>& frames = stacks_[record.id];
+        frames.resize(record.depth);
+        std::memcpy(frames.data(), data_ + offset, record.depth * sizeof(uint64_t));
+        offset += record.depth * sizeof(uint64_t);
+    }
+
+    // "start end offset path" lines, numbers in hex.
+    std::string_view text(reinterpret_cast<const char*>(data_ + end), table.moduleBytes);
+    while (!text.empty()) {
+        size_t newline = text.find('\n');
+        std::string_view line = text.substr(0, newline);
+        text = newline == std::string_view::npos ? std::string_view() : text.substr(newline + 1);
+        Module module;
+        const char* cursor = line.data();
+        const char* lineEnd = line.data() + line.size();
+        bool ok = true;
+        for (uint64_t* field : {&module.start, &module.end, &module.offset}) {
+            auto [next, ec] = std::from_chars(cursor, lineEnd, *field, 16);
+            ok = ok && ec == std::errc() && next < lineEnd && *next == ' ';
+            cursor = ok ? next + 1 : lineEnd;
+        }
+        if (!ok) {
+            continue;
+        }
+        std::string_view path(cursor, static_cast<size_t>(lineEnd - cursor));
+        size_t slash = path.find_last_of("/\\");
+        module.name = slash == std::string_view::npos ? path : path.substr(slash + 1);
+        modules_.push_back(std::move(module));
+    }
+    std::sort(modules_.begin(), modules_.end(), [](const Module& a, const Module& b) { return a.start < b.start; });
+}
+
+const std::vector<uint64_t>* TraceFile::stack(uint32_t id) const {
+    auto it = stacks_.find(id);
+    return it == stacks_.end() ? nullptr : &it->second;
+}
+
+std::string TraceFile::describeFrame(uint64_t returnAddress) const {
+    uint64_t address = returnAddress - 1;
+    char text[24];
+    auto module = std::upper_bound(modules_.begin(), modules_.end(), address,
+                                   [](uint64_t value, const Module& m) { return value < m.start; });
+    if (module == modules_.begin() || address >= (--module)->end) {
+        text[0] = '0';
+        text[1] = 'x';
+        return std::string(text, std::to_chars(text + 2, text + sizeof(text), address, 16).ptr);
+    }
+    uint64_t fileOffset = address - module->start + module->offset;
+    return module->name + "+0x" + std::string(text, std::to_chars(text, text + sizeof(text), fileOffset, 16).ptr);
+}
+
+void TraceFile::rebuildIndex() {
+    indexRebuilt_ = true;
+    index_.clear();
+    size_t offset = sizeof(FileHeader);
+    while (size_ - offset >= sizeof(ChunkHeader)) {
+        ChunkHeader chunk;
+        std::memcpy(&chunk, data_ + offset, sizeof(chunk));
+        size_t chunkBytes = sizeof(ChunkHeader) + chunk.payloadBytes;
+        if (chunk.eventCount == 0 || chunkBytes > size_ - offset) {
+            break; // Zero-filled tail or a truncated last chunk.
+        }
+        index_.push_back({offset, chunk.firstTimestamp, chunk.lastTimestamp, chunk.eventCount, chunk.thread});
+        offset += chunkBytes;
+    }
+}
+
+ChunkHeader TraceFile::chunkHeader(size_t chunk) const {
+    ChunkHeader header;
+    std::memcpy(&header, data_ + index_[chunk].offset, sizeof(header));
+    return header;
+}
+
+const uint8_t* TraceFile::chunkPayload(size_t chunk) const {
+    return data_ + index_[chunk].offset + sizeof(ChunkHeader);
+}
+
+void TraceFile::prefetch(size_t chunk) const {
+    if (chunk >= index_.size()) {
+        return;
+    }
+    size_t page = pageSize();
+    size_t begin = index_[chunk].offset & ~(page - 1);
+    size_t end = std::min(size_, index_[chunk].offset + sizeof(ChunkHeader) + chunkHeader(chunk).payloadBytes);
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY range{const_cast<uint8_t*>(data_ + begin), end - begin};
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    madvise(const_cast<uint8_t*>(data_ + begin), end - begin, MADV_WILLNEED);
+#endif
+}
+
+EventMerger::EventMerger(const TraceFile& file, uint64_t windowStart, uint64_t windowEnd) : file_(file) {
+    const std::vector<IndexEntry>& index = file.chunks();
+    std::unordered_map<uint32_t, uint32_t> streamOf; // Recorder thread number -> stream.
+    for (size_t chunk = 0; chunk < index.size(); ++chunk) {
+        auto [it, added] = streamOf.try_emplace(index[chunk].thread, static_cast<uint32_t>(streams_.size()));
+        if (added) {
+            streams_.emplace_back();
+        }
+        streams_[it->second].chunks.push_back(chunk);
+    }
+    auto later = [&](uint32_t a, uint32_t b) { return streams_[a].head.timestamp > streams_[b].head.timestamp; };
+    heap_.reserve(streams_.size());
+    for (uint32_t i = 0; i < streams_.size(); ++i) {
+        Stream& stream = streams_[i];
+        std::stable_sort(stream.chunks.begin(), stream.chunks.end(),
+                         [&](size_t a, size_t b) { return index[a].firstTimestamp < index[b].firstTimestamp; });
+        // In time order, a thread's chunks are ordered by their last timestamps too.
+        auto from = std::partition_point(stream.chunks.begin(), stream.chunks.end(),
+                                         [&](size_t chunk) { return index[chunk].lastTimestamp < windowStart; });
+        auto to = std::partition_point(from, stream.chunks.end(),
+                                       [&](size_t chunk) { return index[chunk].firstTimestamp <= windowEnd; });
+        stream.chunks.erase(to, stream.chunks.end());
+        stream.chunks.erase(stream.chunks.begin(), from);
+        if (advance(stream)) {
+            heap_.push_back(i);
+        }
+    }
+    std::make_heap(heap_.begin(), heap_.end(), later);
+}
+
+bool EventMerger::advance(Stream& stream) {
+    while (!stream.decoder.next(stream.head)) {
+        if (stream.decoded != stream.expected) {
+            ++corruptChunks_;
+        }
+        if (stream.nextChunk == stream.chunks.size()) {
+            stream.expected = stream.decoded = 0;
+            return false;
+        }
+        size_t chunk = stream.chunks[stream.nextChunk++];
+        ChunkHeader header = file_.chunkHeader(chunk);
+        stream.decoder = ChunkDecoder(header, file_.chunkPayload(chunk));
+        stream.expected = header.eventCount;
+        stream.decoded = 0;
+        // Fault this thread's next chunk in while this one is being replayed.
+        if (stream.nextChunk < stream.chunks.size()) {
+            file_.prefetch(stream.chunks[stream.nextChunk]);
+        }
+    }
+    ++stream.decoded;
+    return true;
+}
+
+bool EventMerger::next(Event& event) {
+    if (heap_.empty()) {
+        return false;
+    }
+    auto later = [&](uint32_t a, uint32_t b) { return streams_[a].head.timestamp > streams_[b].head.timestamp; };
+    std::pop_heap(heap_.begin(), heap_.end(), later);
+    Stream& stream = streams_[heap_.back()];
+    event = stream.head;
+    if (advance(stream)) {
+        std::push_heap(heap_.begin(), heap_.end(), later);
+    } else {
+        heap_.pop_back();
+    }
+    return true;
+}
+
+} // namespace trace
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "trace_format.h"
+
+namespace trace {
+
+/**
+ * @brief A trace file mapped into memory, with random access to its chunks.
+ *
+ * The whole file is memory-mapped read-only, so chunks are decoded straight
+ * from the page cache and nothing is copied. The chunk index is read from the
+ * end of the file, or rebuilt from the chunk headers if the recorder never got
+ * to write it. Throws std::runtime_error if the file is missing or malformed.
+ */
+class TraceFile {
+public:
+    explicit TraceFile(const std::string& path);
+    ~TraceFile();
+    TraceFile(const TraceFile&) = delete;
+    TraceFile& operator=(const TraceFile&) = delete;
+
+    const std::vector<IndexEntry>& chunks() const { return index_; }
+    ChunkHeader chunkHeader(size_t chunk) const;
+    const uint8_t* chunkPayload(size_t chunk) const;
+
+    // Earliest timestamp in the trace (0 if it is empty).
+    uint64_t firstTimestamp() const { return firstTimestamp_; }
+    // True if the index had to be rebuilt because the recording was cut short.
+    bool indexRebuilt() const { return indexRebuilt_; }
+
+    // Asks the OS to start reading @p chunk in the background.
+    void prefetch(size_t chunk) const;
+
+    // True if the recorder captured call stacks (HEAPTRACE_STACK_*) and wrote them out.
+    bool hasStacks() const { return !stacks_.empty(); }
+    StackSampling stackSampling() const { return stackSampling_; }
+    uint64_t stackSamplingPeriod() const { return stackSamplingPeriod_; }
+
+    // Return addresses of stack @p id, innermost first; nullptr for an unknown ID.
+    const std::vector<uint64_t>* stack(uint32_t id) const;
+
+    // "libfoo.so+0x1a2b", the file offset addr2line wants, or the bare address outside every module.
+    // A return address is moved back one byte first, into the call instruction.
+    std::string describeFrame(uint64_t returnAddress) const;
+
+private:
+    // One executable mapping of the traced process.
+    struct Module {
+        uint64_t start;
+        uint64_t end;
+        uint64_t offset; // File offset of start.
+        std::string name;
+    };
+
+    void loadIndex(const FileHeader& header);
+    void loadStacks(size_t offset);
+    void rebuildIndex();
+    void unmap();
+
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    void* mappingHandle_ = nullptr; // Windows file-mapping handle.
+    std::vector<IndexEntry> index_;
+    uint64_t firstTimestamp_ = 0;
+    bool indexRebuilt_ = false;
+    std::unordered_map<uint32_t, std::vector<uint64_t>> stacks_;
+    std::vector<Module> modules_; // Sorted by start.
+    StackSampling stackSampling_ = StackSampling::Every;
+    uint64_t stackSamplingPeriod_ = 0;
+};
+
+/**
+ * @brief The events of a trace in timestamp order, across all its threads.
+ *
+ * A chunk holds one thread's events in order and a thread's chunks follow
+ * each other in time, but chunks of different threads are flushed in no
+ * particular order. So each thread's chunks are sorted by their index
+ * timestamps and decoded one at a time, and the threads' current events are
+ * merged on a min-heap: one decoder per thread is ever open. The recorder
+ * stamps a free before the block goes back and an allocation after it came
+ * back, so this order has every block allocated before it is freed, whichever
+ * threads did the two.
+ *
+ * Given a time window, each thread's chunks that end before it or start after
+ * it are dropped using the index alone, so they are never decoded; events
+ * outside the window in the chunks that straddle its edges still come out.
+ */
+class EventMerger {
+public:
+    explicit EventMerger(const TraceFile& file, uint64_t windowStart = 0, uint64_t windowEnd = UINT64_MAX);
+
+    // The next event in timestamp order; false once every thread is done.
+    bool next(Event& event);
+
+    // Chunks that held fewer events than their header said.
+    uint64_t corruptChunks() const { return corruptChunks_; }
+
+private:
+    struct Stream {
+        std::vector<size_t> chunks; // This thread's chunks, oldest first.
+        size_t nextChunk = 0;       // The one to open after the current one.
+        ChunkDecoder decoder{ChunkHeader{}, nullptr};
+        uint32_t expected = 0;      // Events the current chunk's header promises,
+        uint32_t decoded = 0;       // and how many it gave so far.
+        Event head;                 // Next event of this thread, while it is on the heap.
+    };
+
+    // Decodes @p stream's next event into its head, opening chunks as needed.
+    bool advance(Stream& stream);
+
+    const TraceFile& file_;
+    std::vector<Stream> streams_;
+    std::vector<uint32_t> heap_; // Streams with a head, earliest head first.
+    uint64_t corruptChunks_ = 0;
+};
+
+} // namespace trace
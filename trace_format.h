@@ -0,0 +1,269 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Binary allocation traces written by the heaptrace recorder and read back by
+// `heap_analyzer --replay`.
+//
+// Layout of a version 2 trace file, designed to be mmap'd and read in place:
+//
+//     FileHeader | chunk 0 | chunk 1 | ... | IndexEntry[chunkCount]
+//
+// Each chunk is one flushed per-thread buffer: a ChunkHeader and a payload of
+// events. Inside a chunk every event is stored relative to the one before it
+// (timestamp delta, zigzag address delta), then varint-encoded, so a typical
+// malloc/free takes 5-8 bytes. Chunks decode independently of each other, and
+// appear in the order they were flushed.
+//
+// The index at the end lists the offset, time range and event count of every
+// chunk, so a reader can jump to a time window without decoding anything
+// before it. The recorder writes the index and patches FileHeader::indexOffset
+// when it stops; if it was killed first, indexOffset is 0 and readers rebuild
+// the index by hopping from chunk header to chunk header.
+//
+// Version 3 adds call sites. An allocation whose call stack was sampled has
+// kStackFlag set in its type byte and a varint stack ID after its size. The
+// stacks themselves follow the index, in a stack table:
+//
+//     StackTableHeader | StackRecord + uint64 frames[depth], ... | module map
+//
+// The module map is text, one "start end offset path" line (hex numbers) per
+// executable mapping, so frames can be turned into module+offset after the
+// process is gone. A recording cut short has no index and so no stacks.
+namespace trace {
+
+enum class EventType : uint8_t {
+    Alloc = 0,   // address = returned block, size = requested bytes
+    Free = 1,    // address = freed block
+    Realloc = 2, // oldAddress -> address, size = new requested bytes
+};
+
+struct Event {
+    EventType type = EventType::Alloc;
+    uint64_t timestamp = 0; // Monotonic nanoseconds.
+    uint64_t address = 0;
+    uint64_t oldAddress = 0;
+    uint64_t size = 0;
+    uint32_t stack = 0;     // Call site of a sampled Alloc or Realloc, 0 if none.
+};
+
+inline constexpr char kMagic[8] = {'H', 'E', 'A', 'P', 'T', 'R', 'C', '\0'};
+inline constexpr uint32_t kVersion = 3;
+inline constexpr uint32_t kOldestReadableVersion = 2; // Version 2 is version 3 without call sites.
+
+// Set in an event's type byte when a stack ID follows the event.
+inline constexpr uint8_t kStackFlag = 0x80;
+
+struct FileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint64_t chunkCount;  // Entries in the index; 0 until the recorder stops.
+    uint64_t indexOffset; // File offset of the index; 0 if it was never written.
+};
+
+struct ChunkHeader {
+    uint32_t thread;         // Recorder-assigned thread number.
+    uint32_t eventCount;
+    uint32_t payloadBytes;
+    uint32_t reserved;
+    uint64_t firstTimestamp; // Base for the first event's timestamp delta.
+    uint64_t lastTimestamp;
+};
+
+struct IndexEntry {
+    uint64_t offset;         // File offset of the ChunkHeader.
+    uint64_t firstTimestamp;
+    uint64_t lastTimestamp;
+    uint32_t eventCount;
+    uint32_t thread;
+};
+
+// How the recorder picked the allocations whose call stacks it captured.
+enum class StackSampling : uint32_t {
+    Every = 1, // Every period-th allocation of each thread.
+    Bytes = 2, // Each allocated byte with probability 1/period (Poisson), so big blocks are picked more often.
+};
+
+inline constexpr char kStackMagic[8] = {'H', 'E', 'A', 'P', 'S', 'T', 'K', '\0'};
+inline constexpr uint32_t kMaxStackDepth = 32;
+
+struct StackTableHeader {
+    char magic[8];
+    uint32_t stackCount;
+    uint32_t sampling;       // StackSampling.
+    uint64_t samplingPeriod;
+    uint64_t stackBytes;     // Size of the StackRecords and their frames.
+    uint64_t moduleBytes;    // Size of the module map after them.
+};
+
+struct StackRecord {
+    uint32_t id;    // As in Event::stack.
+    uint32_t depth; // Return addresses that follow, innermost (the allocation's caller) first.
+};
+
+// Worst case for one encoded event: a type byte and five 10-byte varints.
+inline constexpr size_t kMaxEventBytes = 1 + 5 * 10;
+
+inline uint8_t* writeVarint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = static_cast<uint8_t>(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = static_cast<uint8_t>(value);
+    return out;
+}
+
+// Returns nullptr if the varint runs past @p end.
+inline const uint8_t* readVarint(const uint8_t* in, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (unsigned shift = 0; in < end && shift < 64; shift += 7) {
+        uint8_t byte = *in++;
+        value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return in;
+        }
+    }
+    return nullptr;
+}
+
+inline uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+inline int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+/**
+ * @brief Encodes events into a caller-owned buffer laid out as ChunkHeader + payload.
+ * Does no allocation, so it is safe to use from inside malloc hooks.
+ */
+class ChunkEncoder {
+public:
+    void reset(uint8_t* buffer, size_t capacity, uint32_t thread) {
+        buffer_ = buffer;
+        cursor_ = buffer + sizeof(ChunkHeader);
+        limit_ = buffer + capacity;
+        header_ = ChunkHeader{thread, 0, 0, 0, 0, 0};
+        previousAddress_ = 0;
+    }
+
+    // Returns false, and writes nothing, once the buffer cannot hold another event.
+    bool append(const Event& event) {
+        if (static_cast<size_t>(limit_ - cursor_) < kMaxEventBytes) {
+            return false;
+        }
+        if (header_.eventCount == 0) {
+            header_.firstTimestamp = event.timestamp;
+            previousTimestamp_ = event.timestamp;
+        }
+        uint8_t* out = cursor_;
+        *out++ = static_cast<uint8_t>(static_cast<uint8_t>(event.type) | (event.stack ? kStackFlag : 0));
+        out = writeVarint(out, event.timestamp - previousTimestamp_);
+        if (event.type == EventType::Realloc) {
+            out = writeVarint(out, zigzag(static_cast<int64_t>(event.oldAddress - previousAddress_)));
+            previousAddress_ = event.oldAddress;
+        }
+        out = writeVarint(out, zigzag(static_cast<int64_t>(event.address - previousAddress_)));
+        if (event.type != EventType::Free) {
+            out = writeVarint(out, event.size);
+        }
+        if (event.stack) {
+            out = writeVarint(out, event.stack);
+        }
+        previousTimestamp_ = event.timestamp;
+        previousAddress_ = event.address;
+        header_.lastTimestamp = event.timestamp;
+        cursor_ = out;
+        ++header_.eventCount;
+        return true;
+    }
+
+    uint32_t eventCount() const { return header_.eventCount; }
+    const ChunkHeader& header() const { return header_; }
+
+    // Writes the header in place and returns the total chunk size in bytes.
+    size_t finish() {
+        header_.payloadBytes = static_cast<uint32_t>(cursor_ - buffer_ - sizeof(ChunkHeader));
+        std::memcpy(buffer_, &header_, sizeof(header_));
+        return cursor_ - buffer_;
+    }
+
+private:
+    uint8_t* buffer_ = nullptr;
+    uint8_t* cursor_ = nullptr;
+    uint8_t* limit_ = nullptr;
+    ChunkHeader header_{};
+    uint64_t previousTimestamp_ = 0;
+    uint64_t previousAddress_ = 0;
+};
+
+// Decodes the payload of one chunk, event by event.
+class ChunkDecoder {
+public:
+    ChunkDecoder(const ChunkHeader& header, const uint8_t* payload)
+        : cursor_(payload), end_(payload + header.payloadBytes), remaining_(header.eventCount),
+          previousTimestamp_(header.firstTimestamp) {}
+
+    // Returns false at the end of the chunk or on a corrupt payload.
+    bool next(Event& event) {
+        if (remaining_ == 0 || cursor_ >= end_) {
+            return false;
+        }
+        bool hasStack = (*cursor_ & kStackFlag) != 0;
+        uint8_t type = *cursor_++ & ~kStackFlag;
+        if (type > static_cast<uint8_t>(EventType::Realloc) ||
+            (hasStack && type == static_cast<uint8_t>(EventType::Free))) {
+            return false;
+        }
+        event.type = static_cast<EventType>(type);
+        uint64_t value = 0;
+        if (!(cursor_ = readVarint(cursor_, end_, value))) {
+            return false;
+        }
+        event.timestamp = previousTimestamp_ + value;
+
+        if (event.type == EventType::Realloc) {
+            if (!(cursor_ = readVarint(cursor_, end_, value))) {
+                return false;
+            }
+            event.oldAddress = previousAddress_ + static_cast<uint64_t>(unzigzag(value));
+            previousAddress_ = event.oldAddress;
+        }
+        if (!(cursor_ = readVarint(cursor_, end_, value))) {
+            return false;
+        }
+        event.address = previousAddress_ + static_cast<uint64_t>(unzigzag(value));
+        event.size = 0;
+        if (event.type != EventType::Free) {
+            if (!(cursor_ = readVarint(cursor_, end_, value))) {
+                return false;
+            }
+            event.size = value;
+        }
+        event.stack = 0;
+        if (hasStack) {
+            if (!(cursor_ = readVarint(cursor_, end_, value)) || value == 0 || value > UINT32_MAX) {
+                return false;
+            }
+            event.stack = static_cast<uint32_t>(value);
+        }
+
+        previousTimestamp_ = event.timestamp;
+        previousAddress_ = event.address;
+        --remaining_;
+        return true;
+    }
+
+private:
+    const uint8_t* cursor_;
+    const uint8_t* end_;
+    uint32_t remaining_;
+    uint64_t previousTimestamp_;
+    uint64_t previousAddress_ = 0;
+};
+
+} // namespace trace
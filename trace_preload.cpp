@@ -0,0 +1,97 @@
+// LD_PRELOAD shim that records every malloc-family call of the host process:
+//
+//     HEAPTRACE_FILE=app.trace LD_PRELOAD=./libheaptrace.so ./app
+//
+// The real allocator is reached through glibc's __libc_* entry points, so no
+// dlsym() lookup (which itself allocates) is needed.
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+
+#include <unistd.h>
+
+#include "trace_recorder.h"
+
+extern "C" {
+
+void* __libc_malloc(size_t size);
+void __libc_free(void* block);
+void* __libc_calloc(size_t count, size_t size);
+void* __libc_realloc(void* block, size_t size);
+void* __libc_memalign(size_t alignment, size_t size);
+
+__attribute__((constructor)) static void heaptraceStart() {
+    trace::startRecorder();
+}
+
+__attribute__((destructor)) static void heaptraceStop() {
+    trace::stopRecorder();
+}
+
+void* malloc(size_t size) {
+    void* block = __libc_malloc(size);
+    trace::recordAlloc(block, size, TRACE_CALLER());
+    return block;
+}
+
+void free(void* block) {
+    // Recorded before the block is released, so a concurrent malloc that gets
+    // the same address back is always ordered after this free.
+    trace::recordFree(block);
+    __libc_free(block);
+}
+
+void* calloc(size_t count, size_t size) {
+    void* block = __libc_calloc(count, size);
+    trace::recordAlloc(block, count * size, TRACE_CALLER());
+    return block;
+}
+
+void* realloc(void* block, size_t size) {
+    void* resized = __libc_realloc(block, size);
+    trace::recordRealloc(block, resized, size, TRACE_CALLER());
+    return resized;
+}
+
+void* reallocarray(void* block, size_t count, size_t size) {
+    size_t bytes;
+    if (__builtin_mul_overflow(count, size, &bytes)) {
+        errno = ENOMEM;
+        return nullptr;
+    }
+    return realloc(block, bytes);
+}
+
+void* memalign(size_t alignment, size_t size) {
+    void* block = __libc_memalign(alignment, size);
+    trace::recordAlloc(block, size, TRACE_CALLER());
+    return block;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+int posix_memalign(void** result, size_t alignment, size_t size) {
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    void* block = memalign(alignment, size);
+    if (!block) {
+        return ENOMEM;
+    }
+    *result = block;
+    return 0;
+}
+
+void* valloc(size_t size) {
+    return memalign(static_cast<size_t>(sysconf(_SC_PAGESIZE)), size);
+}
+
+void* pvalloc(size_t size) {
+    size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return memalign(page, (size + page - 1) & ~(page - 1));
+}
+
+} // extern "C"
@@ -0,0 +1,796 @@
+#include "trace_recorder.h"
+
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+#include "trace_format.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#if defined(__GNUC__)
+// Static TLS: touching these never calls into the allocator.
+#define TRACE_TLS_MODEL __attribute__((tls_model("initial-exec")))
+#else
+#define TRACE_TLS_MODEL
+#endif
+
+namespace trace {
+namespace {
+
+constexpr size_t kBufferBytes = size_t{1} << 20;
+
+// One mapped buffer: this header, then the encoded chunk.
+struct Buffer {
+    Buffer* next = nullptr; // Link in the pending stack.
+    ChunkEncoder encoder;
+
+    uint8_t* data() { return reinterpret_cast<uint8_t*>(this + 1); }
+};
+
+struct ThreadState {
+    ThreadState* nextState = nullptr; // Link in the list of every thread seen.
+    Buffer* buffer = nullptr;         // Buffer being filled, or nullptr.
+    uint32_t thread = 0;
+    std::atomic<bool> busy{false};    // Set while this thread is appending.
+
+    // Call stack sampling: allocations, or bytes, left until the next sample.
+    uint64_t untilSample = 0;
+    uint64_t random = 0;    // splitmix64 state for the Poisson sampler.
+    uintptr_t stackEnd = 0; // Highest address of the thread's stack; 0 to not capture (Linux).
+    bool stackEndFound = false;
+};
+
+// One deduplicated call stack. hash is 0 while the slot is free and depth is
+// 0 until the frames are in; both are only accessed through std::atomic_ref.
+struct StackSlot {
+    uint64_t hash;
+    uint32_t depth;
+    uint32_t reserved;
+    uint64_t frames[kMaxStackDepth];
+};
+
+constexpr size_t kStackSlots = size_t{1} << 16; // A power of two; IDs are slot numbers + 1.
+constexpr uint32_t kStackProbes = 64;           // Slots tried before a stack is given up as unknown (ID 0).
+constexpr uint32_t kOwnFrames = 8;              // Room for the recorder's and the hook's frames.
+
+std::atomic<bool> g_active{false};
+std::atomic<bool> g_stopWriter{false};
+std::atomic<Buffer*> g_pending{nullptr};
+std::atomic<ThreadState*> g_threads{nullptr};
+std::atomic<uint32_t> g_nextThread{0};
+
+// The chunk index, appended to by whoever writes chunks (the writer thread,
+// or stopRecorder() once the writer is gone). Grown by remapping, not malloc.
+IndexEntry* g_index = nullptr;
+size_t g_indexCount = 0;
+size_t g_indexCapacity = 0;
+uint64_t g_fileOffset = 0;
+
+// Set by startRecorder() from HEAPTRACE_STACK_*; g_stacks stays null without sampling.
+StackSampling g_sampling = StackSampling::Every;
+uint64_t g_samplingPeriod = 0;
+uint32_t g_stackDepth = 16;
+StackSlot* g_stacks = nullptr;
+
+thread_local ThreadState* t_state TRACE_TLS_MODEL = nullptr;
+thread_local bool t_inRecorder TRACE_TLS_MODEL = false;
+
+// --- Platform layer: memory, time, file and thread primitives ---
+
+#if defined(_WIN32)
+
+HANDLE g_file = INVALID_HANDLE_VALUE;
+HANDLE g_writer = nullptr;
+LARGE_INTEGER g_frequency;
+
+void* mapMemory(size_t bytes) {
+    return VirtualAlloc(nullptr, bytes, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+}
+
+void unmapMemory(void* memory, size_t) {
+    VirtualFree(memory, 0, MEM_RELEASE);
+}
+
+uint64_t nowNanoseconds() {
+    LARGE_INTEGER counter;
+    QueryPerformanceCounter(&counter);
+    uint64_t ticks = static_cast<uint64_t>(counter.QuadPart);
+    uint64_t frequency = static_cast<uint64_t>(g_frequency.QuadPart);
+    return ticks / frequency * 1000000000ull + ticks % frequency * 1000000000ull / frequency;
+}
+
+bool openTraceFile(const char* path) {
+    QueryPerformanceFrequency(&g_frequency);
+    g_file = CreateFileA(path, GENERIC_WRITE, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+    return g_file != INVALID_HANDLE_VALUE;
+}
+
+void writeAll(const void* data, size_t bytes) {
+    const char* p = static_cast<const char*>(data);
+    while (bytes > 0) {
+        DWORD written = 0;
+        DWORD chunk = bytes > 0x40000000 ? 0x40000000 : static_cast<DWORD>(bytes);
+        if (!WriteFile(g_file, p, chunk, &written, nullptr) || written == 0) {
+            return;
+        }
+        p += written;
+        bytes -= written;
+    }
+}
+
+// Overwrites the file header; only used as the last write before closing.
+void writeAtStart(const void* data, size_t bytes) {
+    OVERLAPPED at{};
+    DWORD written = 0;
+    WriteFile(g_file, data, static_cast<DWORD>(bytes), &written, &at);
+}
+
+void closeTraceFile() {
+    CloseHandle(g_file);
+    g_file = INVALID_HANDLE_VALUE;
+}
+
+void sleepBriefly() {
+    Sleep(10);
+}
+
+DWORD WINAPI writerMain(LPVOID);
+
+bool startWriterThread() {
+    g_writer = CreateThread(nullptr, 0, writerMain, nullptr, 0, nullptr);
+    return g_writer != nullptr;
+}
+
+void joinWriterThread() {
+    // stopRecorder() runs from DLL_PROCESS_DETACH, where waiting on another
+    // thread would deadlock on the loader lock. By then the process is exiting
+    // and the writer has been terminated, so the final flush is done inline.
+    CloseHandle(g_writer);
+    g_writer = nullptr;
+}
+
+int processId() {
+    return static_cast<int>(GetCurrentProcessId());
+}
+
+void findStackEnd(ThreadState&) {}
+
+// RtlCaptureStackBackTrace() checks every frame itself, frame pointers or not.
+uint32_t walkStack(uintptr_t* frames, uint32_t capacity, const ThreadState&) {
+    void* raw[kMaxStackDepth + kOwnFrames];
+    USHORT count = RtlCaptureStackBackTrace(0, static_cast<DWORD>(capacity), raw, nullptr);
+    for (USHORT i = 0; i < count; ++i) {
+        frames[i] = reinterpret_cast<uintptr_t>(raw[i]);
+    }
+    return count;
+}
+
+// "start end offset path" per loaded module.
+size_t writeModuleMap(char* out, size_t capacity) {
+    HMODULE modules[1024];
+    DWORD bytes = 0;
+    if (!K32EnumProcessModules(GetCurrentProcess(), modules, sizeof(modules), &bytes)) {
+        return 0;
+    }
+    size_t used = 0;
+    for (DWORD i = 0; i < bytes / sizeof(HMODULE) && i < 1024; ++i) {
+        MODULEINFO info;
+        char path[MAX_PATH];
+        DWORD length = GetModuleFileNameA(modules[i], path, MAX_PATH);
+        if (!K32GetModuleInformation(GetCurrentProcess(), modules[i], &info, sizeof(info)) || length == 0 ||
+            length >= MAX_PATH) {
+            continue;
+        }
+        uintptr_t base = reinterpret_cast<uintptr_t>(info.lpBaseOfDll);
+        int written = std::snprintf(out + used, capacity - used, "%llx %llx 0 %s\n",
+                                    static_cast<unsigned long long>(base),
+                                    static_cast<unsigned long long>(base + info.SizeOfImage), path);
+        if (written < 0 || static_cast<size_t>(written) >= capacity - used) {
+            break;
+        }
+        used += static_cast<size_t>(written);
+    }
+    return used;
+}
+
+#else
+
+int g_file = -1;
+pthread_t g_writer;
+pthread_key_t g_threadKey;
+
+void* mapMemory(size_t bytes) {
+    void* memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    return memory == MAP_FAILED ? nullptr : memory;
+}
+
+void unmapMemory(void* memory, size_t bytes) {
+    munmap(memory, bytes);
+}
+
+uint64_t nowNanoseconds() {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000ull + static_cast<uint64_t>(now.tv_nsec);
+}
+
+bool openTraceFile(const char* path) {
+    g_file = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    return g_file >= 0;
+}
+
+void writeAll(const void* data, size_t bytes) {
+    const char* p = static_cast<const char*>(data);
+    while (bytes > 0) {
+        ssize_t written = write(g_file, p, bytes);
+        if (written <= 0) {
+            return;
+        }
+        p += written;
+        bytes -= static_cast<size_t>(written);
+    }
+}
+
+// Overwrites the file header; only used as the last write before closing.
+void writeAtStart(const void* data, size_t bytes) {
+    pwrite(g_file, data, bytes, 0);
+}
+
+void closeTraceFile() {
+    close(g_file);
+    g_file = -1;
+}
+
+void sleepBriefly() {
+    timespec pause{0, 10 * 1000 * 1000};
+    nanosleep(&pause, nullptr);
+}
+
+void* writerMain(void*);
+
+bool startWriterThread() {
+    return pthread_create(&g_writer, nullptr, writerMain, nullptr) == 0;
+}
+
+void joinWriterThread() {
+    pthread_join(g_writer, nullptr);
+}
+
+int processId() {
+    return static_cast<int>(getpid());
+}
+
+void onThreadExit(void*) {
+    flushCurrentThread();
+}
+
+// Called with t_inRecorder set: pthread_getattr_np() may allocate, and those
+// allocations must not be recorded.
+void findStackEnd(ThreadState& state) {
+    pthread_attr_t attributes;
+    if (pthread_getattr_np(pthread_self(), &attributes) != 0) {
+        return;
+    }
+    void* low = nullptr;
+    size_t size = 0;
+    if (pthread_attr_getstack(&attributes, &low, &size) == 0) {
+        state.stackEnd = reinterpret_cast<uintptr_t>(low) + size;
+    }
+    pthread_attr_destroy(&attributes);
+}
+
+// Follows the chain of saved frame pointers, [previous frame, return address]
+// on both x86-64 and AArch64. A frame must lie above the one before it and
+// inside the thread's stack, so code built without frame pointers ends the
+// walk early instead of sending it off into unmapped memory.
+__attribute__((noinline)) uint32_t walkStack(uintptr_t* frames, uint32_t capacity, const ThreadState& state) {
+    auto frame = reinterpret_cast<uintptr_t>(__builtin_frame_address(0));
+    uint32_t count = 0;
+    while (count < capacity && frame % sizeof(uintptr_t) == 0 && frame + 2 * sizeof(uintptr_t) <= state.stackEnd) {
+        const auto* record = reinterpret_cast<const uintptr_t*>(frame);
+        if (record[1] == 0) {
+            break;
+        }
+        frames[count++] = record[1];
+        if (record[0] <= frame) {
+            break;
+        }
+        frame = record[0];
+    }
+    return count;
+}
+
+uint64_t parseHex(const char*& text, const char* end) {
+    uint64_t value = 0;
+    for (; text < end; ++text) {
+        char c = *text;
+        unsigned digit = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : 16;
+        if (digit == 16) {
+            break;
+        }
+        value = value * 16 + digit;
+    }
+    return value;
+}
+
+// The executable mappings of /proc/self/maps, as "start end offset path" lines.
+size_t writeModuleMap(char* out, size_t capacity) {
+    int fd = open("/proc/self/maps", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+    // The maps are read into the second half of the buffer and rewritten, never longer, into the first.
+    char* maps = out + capacity / 2;
+    size_t length = 0;
+    for (ssize_t got; length < capacity / 2 && (got = read(fd, maps + length, capacity / 2 - length)) > 0;) {
+        length += static_cast<size_t>(got);
+    }
+    close(fd);
+
+    // start-end perms offset dev inode path
+    size_t used = 0;
+    for (const char* line = maps; line < maps + length;) {
+        const char* lineEnd = line;
+        while (lineEnd < maps + length && *lineEnd != '\n') {
+            ++lineEnd;
+        }
+        const char* cursor = line;
+        uint64_t start = parseHex(cursor, lineEnd);
+        ++cursor;
+        uint64_t end = parseHex(cursor, lineEnd);
+        bool executable = cursor + 4 < lineEnd && cursor[3] == 'x';
+        cursor += 6;
+        uint64_t offset = parseHex(cursor, lineEnd);
+        const char* path = cursor;
+        for (int field = 0; field < 2 && path < lineEnd; ++field) { // Skip dev and inode.
+            while (path < lineEnd && *path == ' ') {
+                ++path;
+            }
+            while (path < lineEnd && *path != ' ') {
+                ++path;
+            }
+        }
+        while (path < lineEnd && *path == ' ') {
+            ++path;
+        }
+        if (executable && path < lineEnd) {
+            int written = std::snprintf(out + used, capacity / 2 - used, "%llx %llx %llx %.*s\n",
+                                        static_cast<unsigned long long>(start), static_cast<unsigned long long>(end),
+                                        static_cast<unsigned long long>(offset), static_cast<int>(lineEnd - path),
+                                        path);
+            if (written < 0 || static_cast<size_t>(written) >= capacity / 2 - used) {
+                break;
+            }
+            used += static_cast<size_t>(written);
+        }
+        line = lineEnd + 1;
+    }
+    return used;
+}
+
+#endif
+
+// --- Buffers ---
+
+Buffer* newBuffer(uint32_t thread) {
+    void* memory = mapMemory(kBufferBytes);
+    if (!memory) {
+        return nullptr;
+    }
+    Buffer* buffer = new (memory) Buffer{};
+    buffer->encoder.reset(buffer->data(), kBufferBytes - sizeof(Buffer), thread);
+    return buffer;
+}
+
+void pushPending(Buffer* buffer) {
+    buffer->next = g_pending.load(std::memory_order_relaxed);
+    while (!g_pending.compare_exchange_weak(buffer->next, buffer, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+    }
+}
+
+void addIndexEntry(const ChunkHeader& header) {
+    if (g_indexCount == g_indexCapacity) {
+        size_t capacity = g_indexCapacity ? g_indexCapacity * 2 : 4096;
+        auto* grown = static_cast<IndexEntry*>(mapMemory(capacity * sizeof(IndexEntry)));
+        if (!grown) {
+            return;
+        }
+        for (size_t i = 0; i < g_indexCount; ++i) {
+            grown[i] = g_index[i];
+        }
+        if (g_index) {
+            unmapMemory(g_index, g_indexCapacity * sizeof(IndexEntry));
+        }
+        g_index = grown;
+        g_indexCapacity = capacity;
+    }
+    g_index[g_indexCount++] = {g_fileOffset, header.firstTimestamp, header.lastTimestamp,
+                               header.eventCount, header.thread};
+}
+
+// Writes every pending buffer, oldest first, and unmaps it.
+void drainPending() {
+    Buffer* list = g_pending.exchange(nullptr, std::memory_order_acquire);
+    Buffer* ordered = nullptr;
+    while (list) {
+        Buffer* next = list->next;
+        list->next = ordered;
+        ordered = list;
+        list = next;
+    }
+    while (ordered) {
+        Buffer* next = ordered->next;
+        size_t bytes = ordered->encoder.finish();
+        addIndexEntry(ordered->encoder.header());
+        writeAll(ordered->data(), bytes);
+        g_fileOffset += bytes;
+        unmapMemory(ordered, kBufferBytes);
+        ordered = next;
+    }
+}
+
+void writerLoop() {
+    t_inRecorder = true; // The writer's own allocations are not part of the trace.
+    while (!g_stopWriter.load(std::memory_order_acquire)) {
+        drainPending();
+        sleepBriefly();
+    }
+}
+
+#if defined(_WIN32)
+DWORD WINAPI writerMain(LPVOID) {
+    writerLoop();
+    return 0;
+}
+#else
+void* writerMain(void*) {
+    writerLoop();
+    return nullptr;
+}
+#endif
+
+// --- Call stacks ---
+
+uint64_t nextRandom(uint64_t& state) {
+    uint64_t z = (state += 0x9e3779b97f4a7c15);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+    return z ^ (z >> 31);
+}
+
+// Bytes to the next Poisson sample: exponentially distributed with mean g_samplingPeriod.
+uint64_t nextSampleGap(ThreadState& state) {
+    double uniform = (static_cast<double>(nextRandom(state.random) >> 11) + 1.0) * 0x1p-53;
+    return static_cast<uint64_t>(-std::log(uniform) * static_cast<double>(g_samplingPeriod)) + 1;
+}
+
+bool sampleStack(ThreadState& state, size_t size) {
+    if (!g_stacks) {
+        return false;
+    }
+    if (g_sampling == StackSampling::Every) {
+        if (++state.untilSample < g_samplingPeriod) {
+            return false;
+        }
+        state.untilSample = 0;
+        return true;
+    }
+    if (state.untilSample == 0) {
+        state.untilSample = nextSampleGap(state);
+    }
+    if (state.untilSample > size) {
+        state.untilSample -= size;
+        return false;
+    }
+    state.untilSample = nextSampleGap(state);
+    return true;
+}
+
+// Returns the ID of the stack, adding it to the table if it is new; 0 if the table is full there.
+uint32_t internStack(const uint64_t* frames, uint32_t depth) {
+    uint64_t hash = 0xcbf29ce484222325;
+    for (uint32_t i = 0; i < depth; ++i) {
+        hash = (hash ^ frames[i]) * 0x100000001b3;
+    }
+    hash = hash ? hash : 1;
+    for (uint32_t probe = 0; probe < kStackProbes; ++probe) {
+        size_t index = (hash + probe) & (kStackSlots - 1);
+        StackSlot& slot = g_stacks[index];
+        std::atomic_ref<uint64_t> slotHash(slot.hash);
+        uint64_t seen = slotHash.load(std::memory_order_acquire);
+        if (seen == 0 && slotHash.compare_exchange_strong(seen, hash, std::memory_order_acq_rel)) {
+            for (uint32_t i = 0; i < depth; ++i) {
+                slot.frames[i] = frames[i];
+            }
+            std::atomic_ref<uint32_t>(slot.depth).store(depth, std::memory_order_release);
+            return static_cast<uint32_t>(index + 1);
+        }
+        if (seen == hash) {
+            return static_cast<uint32_t>(index + 1);
+        }
+    }
+    return 0;
+}
+
+// The stack from @p caller (the hook's return address) outwards. If the walk
+// never reaches it, the caller alone is better than the recorder's own frames.
+uint32_t captureStack(ThreadState& state, const void* caller) {
+    // Looked up on first use: the main thread's state exists before startRecorder() has run.
+    if (!state.stackEndFound) {
+        findStackEnd(state);
+        state.stackEndFound = true;
+    }
+    uintptr_t raw[kMaxStackDepth + kOwnFrames];
+    uint32_t count = walkStack(raw, g_stackDepth + kOwnFrames, state);
+    uint32_t first = 0;
+    while (first < count && raw[first] != reinterpret_cast<uintptr_t>(caller)) {
+        ++first;
+    }
+    uint64_t frames[kMaxStackDepth];
+    uint32_t depth = 1;
+    frames[0] = reinterpret_cast<uintptr_t>(caller);
+    if (first < count) {
+        depth = count - first < g_stackDepth ? count - first : g_stackDepth;
+        for (uint32_t i = 0; i < depth; ++i) {
+            frames[i] = raw[first + i];
+        }
+    }
+    return internStack(frames, depth);
+}
+
+// Writes the stack table and the module map; after the index, before the header is patched.
+void writeStackTable() {
+    constexpr size_t kModuleMapBytes = size_t{8} << 20;
+    char* modules = static_cast<char*>(mapMemory(kModuleMapBytes));
+    size_t moduleBytes = modules ? writeModuleMap(modules, kModuleMapBytes) : 0;
+
+    StackTableHeader header{};
+    for (size_t i = 0; i < sizeof(kStackMagic); ++i) {
+        header.magic[i] = kStackMagic[i];
+    }
+    header.sampling = static_cast<uint32_t>(g_sampling);
+    header.samplingPeriod = g_samplingPeriod;
+    header.moduleBytes = moduleBytes;
+    for (size_t i = 0; i < kStackSlots; ++i) {
+        if (uint32_t depth = std::atomic_ref<uint32_t>(g_stacks[i].depth).load(std::memory_order_acquire)) {
+            ++header.stackCount;
+            header.stackBytes += sizeof(StackRecord) + depth * sizeof(uint64_t);
+        }
+    }
+    auto* records = static_cast<uint8_t*>(mapMemory(header.stackBytes ? header.stackBytes : 1));
+    if (!records) {
+        header.stackCount = 0;
+        header.stackBytes = 0;
+    }
+    size_t used = 0;
+    for (size_t i = 0; records && i < kStackSlots; ++i) {
+        if (uint32_t depth = std::atomic_ref<uint32_t>(g_stacks[i].depth).load(std::memory_order_acquire)) {
+            StackRecord record{static_cast<uint32_t>(i + 1), depth};
+            std::memcpy(records + used, &record, sizeof(record));
+            std::memcpy(records + used + sizeof(record), g_stacks[i].frames, depth * sizeof(uint64_t));
+            used += sizeof(record) + depth * sizeof(uint64_t);
+        }
+    }
+    writeAll(&header, sizeof(header));
+    writeAll(records, used);
+    writeAll(modules, moduleBytes);
+    if (records) {
+        unmapMemory(records, header.stackBytes ? header.stackBytes : 1);
+    }
+    if (modules) {
+        unmapMemory(modules, kModuleMapBytes);
+    }
+}
+
+ThreadState* currentState() {
+    if (t_state) {
+        return t_state;
+    }
+    void* memory = mapMemory(sizeof(ThreadState));
+    if (!memory) {
+        return nullptr;
+    }
+    ThreadState* state = new (memory) ThreadState{};
+    state->thread = g_nextThread.fetch_add(1, std::memory_order_relaxed);
+    state->random = nowNanoseconds() ^ (uint64_t{state->thread} << 32);
+    state->nextState = g_threads.load(std::memory_order_relaxed);
+    while (!g_threads.compare_exchange_weak(state->nextState, state, std::memory_order_release,
+                                            std::memory_order_relaxed)) {
+    }
+#if !defined(_WIN32)
+    pthread_setspecific(g_threadKey, state);
+#endif
+    t_state = state;
+    return state;
+}
+
+void append(EventType type, void* block, void* oldBlock, size_t size, const void* caller) {
+    if (t_inRecorder) {
+        return;
+    }
+    t_inRecorder = true;
+    ThreadState* state = currentState();
+    if (state) {
+        // Paired with stopRecorder(): either it sees us busy and waits, or we
+        // see the recorder inactive and back off.
+        state->busy.store(true);
+        if (g_active.load()) {
+            Event event;
+            event.type = type;
+            event.timestamp = nowNanoseconds();
+            event.address = reinterpret_cast<uintptr_t>(block);
+            event.oldAddress = reinterpret_cast<uintptr_t>(oldBlock);
+            event.size = size;
+            if (caller && sampleStack(*state, size)) {
+                event.stack = captureStack(*state, caller);
+            }
+
+            if (!state->buffer) {
+                state->buffer = newBuffer(state->thread);
+            }
+            if (state->buffer && !state->buffer->encoder.append(event)) {
+                pushPending(state->buffer);
+                state->buffer = newBuffer(state->thread);
+                if (state->buffer) {
+                    state->buffer->encoder.append(event);
+                }
+            }
+        }
+        state->busy.store(false);
+    }
+    t_inRecorder = false;
+}
+
+} // namespace
+
+void startRecorder() {
+    if (g_active.load()) {
+        return;
+    }
+    t_inRecorder = true;
+
+    char defaultPath[64];
+    const char* path = std::getenv("HEAPTRACE_FILE");
+    if (!path || !*path) {
+        std::snprintf(defaultPath, sizeof(defaultPath), "heaptrace.%d.bin", processId());
+        path = defaultPath;
+    }
+    if (!openTraceFile(path)) {
+        t_inRecorder = false;
+        return;
+    }
+    FileHeader header{};
+    for (size_t i = 0; i < sizeof(kMagic); ++i) {
+        header.magic[i] = kMagic[i];
+    }
+    header.version = kVersion;
+    writeAll(&header, sizeof(header));
+    g_fileOffset = sizeof(header);
+
+    const char* every = std::getenv("HEAPTRACE_STACK_EVERY");
+    const char* bytes = std::getenv("HEAPTRACE_STACK_BYTES");
+    const char* depth = std::getenv("HEAPTRACE_STACK_DEPTH");
+    if (bytes && *bytes) {
+        g_sampling = StackSampling::Bytes;
+        g_samplingPeriod = std::strtoull(bytes, nullptr, 10);
+    } else if (every && *every) {
+        g_sampling = StackSampling::Every;
+        g_samplingPeriod = std::strtoull(every, nullptr, 10);
+    }
+    if (depth && *depth) {
+        unsigned long frames = std::strtoul(depth, nullptr, 10);
+        g_stackDepth = frames < 1 ? 1 : frames > kMaxStackDepth ? kMaxStackDepth : static_cast<uint32_t>(frames);
+    }
+    if (g_samplingPeriod > 0) {
+        g_stacks = static_cast<StackSlot*>(mapMemory(kStackSlots * sizeof(StackSlot)));
+    }
+
+#if !defined(_WIN32)
+    pthread_key_create(&g_threadKey, onThreadExit);
+#endif
+    if (!startWriterThread()) {
+        closeTraceFile();
+        t_inRecorder = false;
+        return;
+    }
+    g_active.store(true);
+    t_inRecorder = false;
+}
+
+void stopRecorder() {
+    if (!g_active.exchange(false)) {
+        return;
+    }
+    bool wasInRecorder = t_inRecorder;
+    t_inRecorder = true;
+
+    for (ThreadState* state = g_threads.load(); state; state = state->nextState) {
+        while (state->busy.load()) {
+        }
+    }
+    g_stopWriter.store(true, std::memory_order_release);
+    joinWriterThread();
+
+    for (ThreadState* state = g_threads.load(); state; state = state->nextState) {
+        if (state->buffer) {
+            pushPending(state->buffer);
+            state->buffer = nullptr;
+        }
+    }
+    drainPending();
+
+    // Index last, then point the header at it.
+    FileHeader header{};
+    for (size_t i = 0; i < sizeof(kMagic); ++i) {
+        header.magic[i] = kMagic[i];
+    }
+    header.version = kVersion;
+    header.chunkCount = g_indexCount;
+    header.indexOffset = g_fileOffset;
+    writeAll(g_index, g_indexCount * sizeof(IndexEntry));
+    if (g_stacks) {
+        writeStackTable();
+    }
+    writeAtStart(&header, sizeof(header));
+    closeTraceFile();
+    t_inRecorder = wasInRecorder;
+}
+
+void flushCurrentThread() {
+    ThreadState* state = t_state;
+    if (!state || t_inRecorder) {
+        return;
+    }
+    t_inRecorder = true;
+    state->busy.store(true);
+    if (g_active.load() && state->buffer) {
+        if (state->buffer->encoder.eventCount() > 0) {
+            pushPending(state->buffer);
+        } else {
+            unmapMemory(state->buffer, kBufferBytes);
+        }
+        state->buffer = nullptr;
+    }
+    state->busy.store(false);
+    t_inRecorder = false;
+}
+
+void recordAlloc(void* block, size_t size, const void* caller) {
+    if (block) {
+        append(EventType::Alloc, block, nullptr, size, caller);
+    }
+}
+
+void recordFree(void* block) {
+    if (block) {
+        append(EventType::Free, block, nullptr, 0, nullptr);
+    }
+}
+
+void recordRealloc(void* oldBlock, void* newBlock, size_t size, const void* caller) {
+    if (!oldBlock) {
+        recordAlloc(newBlock, size, caller);
+    } else if (newBlock) {
+        append(EventType::Realloc, newBlock, oldBlock, size, caller);
+    } else if (size == 0) {
+        recordFree(oldBlock); // realloc(p, 0) freed the block.
+    }
+}
+
+} // namespace trace
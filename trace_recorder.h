@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define TRACE_CALLER() _ReturnAddress()
+#else
+#define TRACE_CALLER() __builtin_return_address(0)
+#endif
+
+// Core of the heaptrace recorder, shared by the LD_PRELOAD shim on Linux
+// (trace_preload.cpp) and the Detours shim on Windows (trace_detours.cpp).
+//
+// Each thread appends events to its own buffer without any locking. Full
+// buffers are pushed onto a lock-free stack and written to the trace file as
+// chunks by a background writer thread, which also builds the chunk index
+// written at the end (see trace_format.h). Nothing here allocates through
+// malloc: buffers come straight from mmap/VirtualAlloc and the writer uses raw
+// file I/O, so the recorder never observes its own allocations.
+//
+// The trace file name is taken from HEAPTRACE_FILE, defaulting to
+// heaptrace.<pid>.bin in the working directory.
+//
+// With HEAPTRACE_STACK_EVERY=N (every Nth allocation of each thread) or
+// HEAPTRACE_STACK_BYTES=N (each allocated byte with probability 1/N), the
+// call stack of the sampled allocations is captured too, at most
+// HEAPTRACE_STACK_DEPTH frames (default 16, at most kMaxStackDepth). Linux
+// walks frame pointers, so the traced code must keep them
+// (-fno-omit-frame-pointer); Windows uses RtlCaptureStackBackTrace(). Stacks
+// are deduplicated into a lock-free table and written after the index.
+namespace trace {
+
+void startRecorder();
+
+// Flushes every buffer and closes the file. Further events are ignored.
+void stopRecorder();
+
+// Hands the calling thread's partially filled buffer to the writer; called on
+// thread exit.
+void flushCurrentThread();
+
+// @p caller is the hook's return address (TRACE_CALLER()), where a captured
+// call stack starts; without it the stack is not captured.
+void recordAlloc(void* block, size_t size, const void* caller = nullptr);
+void recordFree(void* block);
+void recordRealloc(void* oldBlock, void* newBlock, size_t size, const void* caller = nullptr);
+
+} // namespace trace
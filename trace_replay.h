@@ -0,0 +1,187 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "heap_backend.h"
+#include "simulation.h"
+#include "site_attribution.h"
+#include "trace_file.h"
+
+struct ReplayOptions {
+    std::string path;
+    uint64_t eventsPerStep = 10000; // Events replayed per step; the sampling policy picks the steps sampled.
+    double startSeconds = 0;        // Window to replay, relative to the first event.
+    double endSeconds = -1;         // Negative: to the end of the trace.
+    ProbeOptions probes;
+    SiteAttribution* sites = nullptr; // --sites: charge fragmentation to the recorded call stacks.
+};
+
+// What happened while replaying, for the end-of-run summary.
+struct ReplaySummary {
+    uint64_t events = 0;
+    uint64_t allocations = 0;
+    uint64_t frees = 0;
+    uint64_t reallocations = 0;
+    uint64_t unmatchedFrees = 0; // Frees of addresses the trace never allocated.
+    uint64_t corruptChunks = 0;
+    bool indexRebuilt = false;   // The trace had no usable index (recording cut short).
+};
+
+/**
+ * @brief Drives @p backend from a recorded allocation trace as fast as it will go.
+ *
+ * Recorded addresses are mapped onto the blocks the backend returns, so the
+ * backend sees the same sequence of sizes and lifetimes the traced process
+ * produced. Events are replayed in timestamp order across threads (see
+ * trace::EventMerger), so a block freed by another thread than the one that
+ * allocated it is matched like any other. Reallocations become allocate +
+ * release (contents are not copied).
+ *
+ * With a time window, the chunk index is used to skip every thread's chunks
+ * that end before it, and the replay stops at the first event after it.
+ * Blocks allocated before the window starts are not replayed, so their frees
+ * count as unmatched.
+ *
+ * Every ReplayOptions::eventsPerStep events make a step, and so does whatever
+ * is left at the end. A HeapStats row is written to the sink for each step
+ * the SamplingPolicy picks, the first and last always among them. With
+ * ReplayOptions::sites, those steps are also when the live blocks' call sites
+ * are charged for the fragmentation around them.
+ */
+template <HeapBackend Backend, StatsSink Sink>
+void replayTrace(Backend& backend, const ReplayOptions& options, Sink& sink, ReplaySummary& summary) {
+    trace::TraceFile file(options.path);
+    summary.indexRebuilt = file.indexRebuilt();
+    if (options.sites) {
+        options.sites->start(file);
+    }
+    auto toTimestamp = [&](double seconds) { return file.firstTimestamp() + static_cast<uint64_t>(seconds * 1e9); };
+    uint64_t windowStart = toTimestamp(options.startSeconds);
+    uint64_t windowEnd = options.endSeconds < 0 ? UINT64_MAX : toTimestamp(options.endSeconds);
+
+    int step = 0;
+    std::unordered_map<uint64_t, LiveBlock> liveBlocks; // Recorded address -> our block.
+    size_t totalRequested = 0;
+    size_t totalUsable = 0;
+    LatencyHistogram allocLatency;
+    LatencyHistogram freeLatency;
+    uint64_t eventsThisStep = 0;
+    SamplingPolicy sampling(options.probes.sampling);
+    size_t largestFree = 0;
+    bool stepSampled = false; // Whether the last step got a row.
+
+    auto allocate = [&](uint64_t address, size_t size, uint32_t stack) {
+        void* block = timedCall(allocLatency, [&] { return backend.allocate(size); });
+        if (!block) {
+            return;
+        }
+        if (options.sites) {
+            options.sites->allocated(address, stack, size, step);
+        }
+        LiveBlock entry{block, size, backend.usableSize(block)};
+        auto [it, inserted] = liveBlocks.try_emplace(address, entry);
+        if (!inserted) {
+            // The trace missed a free (e.g. from before the recorder started).
+            totalRequested -= it->second.requested;
+            totalUsable -= it->second.usable;
+            timedCall(freeLatency, [&] { backend.release(it->second.ptr); });
+            it->second = entry;
+        }
+        totalRequested += entry.requested;
+        totalUsable += entry.usable;
+    };
+
+    auto release = [&](uint64_t address) {
+        auto it = liveBlocks.find(address);
+        if (it == liveBlocks.end()) {
+            ++summary.unmatchedFrees;
+            return false;
+        }
+        totalRequested -= it->second.requested;
+        totalUsable -= it->second.usable;
+        largestFree = std::max(largestFree, it->second.usable);
+        timedCall(freeLatency, [&] { backend.release(it->second.ptr); });
+        liveBlocks.erase(it);
+        if (options.sites) {
+            options.sites->released(address);
+        }
+        return true;
+    };
+
+    auto endStep = [&](bool last) {
+        int t = step++;
+        uint32_t trigger = sampling.due(mustSample(options.probes, t, last), largestFree, totalRequested, totalUsable);
+        largestFree = 0;
+        eventsThisStep = 0;
+        stepSampled = trigger != 0;
+        if (!stepSampled) {
+            return;
+        }
+        HeapStats stats = sampleHeap(backend, options.probes, t, totalRequested, totalUsable, allocLatency, freeLatency);
+        stats.sampleTrigger = trigger;
+        sink.write(std::move(stats));
+        if (options.sites) {
+            if constexpr (LayoutHeapBackend<Backend>) {
+                backend.heapLayout(options.sites->spans());
+            }
+            options.sites->sample(liveBlocks, t);
+        }
+        allocLatency.reset();
+        freeLatency.reset();
+    };
+
+    trace::EventMerger events(file, windowStart, windowEnd);
+    trace::Event event;
+    while (events.next(event)) {
+        if (event.timestamp < windowStart) {
+            continue;
+        }
+        if (event.timestamp > windowEnd) {
+            break;
+        }
+        switch (event.type) {
+        case trace::EventType::Alloc:
+            ++summary.allocations;
+            allocate(event.address, event.size, event.stack);
+            break;
+        case trace::EventType::Free:
+            ++summary.frees;
+            release(event.address);
+            break;
+        case trace::EventType::Realloc:
+            ++summary.reallocations;
+            if (event.oldAddress != event.address) {
+                release(event.oldAddress);
+            } else if (auto it = liveBlocks.find(event.address); it != liveBlocks.end()) {
+                totalRequested -= it->second.requested;
+                totalUsable -= it->second.usable;
+                largestFree = std::max(largestFree, it->second.usable);
+                timedCall(freeLatency, [&] { backend.release(it->second.ptr); });
+                liveBlocks.erase(it);
+            }
+            allocate(event.address, event.size, event.stack);
+            break;
+        }
+        ++summary.events;
+        if (++eventsThisStep == options.eventsPerStep) {
+            endStep(false);
+        }
+    }
+    summary.corruptChunks = events.corruptChunks();
+    // The final state always gets a row, in a step of its own if the last full one went unsampled.
+    if (eventsThisStep > 0 || !stepSampled) {
+        endStep(true);
+    }
+    if (options.sites) {
+        options.sites->finish(file);
+    }
+
+    // --- Final Cleanup ---
+    for (auto& [address, block] : liveBlocks) {
+        backend.release(block.ptr);
+    }
+}
@@ -0,0 +1,315 @@
+#include "workload.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <fstream>
+#include <utility>
+
+namespace {
+
+template <typename T>
+bool parseNumber(std::string_view text, T& value) {
+    auto [end, ec] = std::from_chars(text.data(), text.data() + text.size(), value);
+    return ec == std::errc() && end == text.data() + text.size();
+}
+
+std::string_view trim(std::string_view text) {
+    size_t begin = text.find_first_not_of(" \t\r");
+    if (begin == std::string_view::npos) {
+        return {};
+    }
+    size_t end = text.find_last_not_of(" \t\r");
+    return text.substr(begin, end - begin + 1);
+}
+
+std::vector<std::string_view> splitFields(std::string_view spec, char separator) {
+    std::vector<std::string_view> fields;
+    while (true) {
+        size_t comma = spec.find(separator);
+        fields.push_back(trim(spec.substr(0, comma)));
+        if (comma == std::string_view::npos) {
+            return fields;
+        }
+        spec.remove_prefix(comma + 1);
+    }
+}
+
+// Parses fields[1..] as numbers; the spec must have exactly that many.
+template <typename... T>
+bool parseArguments(const std::vector<std::string_view>& fields, T&... values) {
+    if (fields.size() != sizeof...(T) + 1) {
+        return false;
+    }
+    size_t i = 1;
+    return (parseNumber(fields[i++], values) && ...);
+}
+
+// Acklam's rational approximation of the standard normal quantile; relative
+// error below 1.2e-9, far finer than the table it fills.
+double normalQuantile(double p) {
+    static constexpr double a[] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                                   1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+    static constexpr double b[] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+                                   6.680131188771972e+01, -1.328068155288572e+01};
+    static constexpr double c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                                   -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+    static constexpr double d[] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+                                   3.754408661907416e+00};
+    static constexpr double kLow = 0.02425;
+
+    if (p < kLow) {
+        double q = std::sqrt(-2 * std::log(p));
+        return (((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+               ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+    }
+    if (p > 1 - kLow) {
+        double q = std::sqrt(-2 * std::log(1 - p));
+        return -(((((c[0] * q + c[1]) * q + c[2]) * q + c[3]) * q + c[4]) * q + c[5]) /
+               ((((d[0] * q + d[1]) * q + d[2]) * q + d[3]) * q + 1);
+    }
+    double q = p - 0.5;
+    double r = q * q;
+    return (((((a[0] * r + a[1]) * r + a[2]) * r + a[3]) * r + a[4]) * r + a[5]) * q /
+           (((((b[0] * r + b[1]) * r + b[2]) * r + b[3]) * r + b[4]) * r + 1);
+}
+
+// Keeps unbounded tails finite: the table's last edge sits at this quantile.
+constexpr double kTailProbability = 1e-6;
+
+QuantileTable exponentialTable(double mean) {
+    return QuantileTable([mean](double p) { return -mean * std::log1p(-std::min(p, 1 - kTailProbability)); }, true);
+}
+
+} // namespace
+
+SizeDistribution::SizeDistribution() {
+    std::string error;
+    parse("uniform,512,1535", *this, error);
+}
+
+bool SizeDistribution::parse(std::string_view spec, SizeDistribution& out, std::string& error) {
+    std::vector<std::string_view> fields = splitFields(spec, ',');
+    std::string_view kind = fields[0];
+    bool ok = false;
+
+    if (kind == "uniform") {
+        size_t min = 0;
+        size_t max = 0;
+        ok = parseArguments(fields, min, max) && min >= 1 && max >= min;
+        if (ok) {
+            // One past MAX at the top edge, so MAX is as likely as any other size.
+            double low = static_cast<double>(min);
+            double high = static_cast<double>(max) + 1;
+            out.table_ = QuantileTable([=](double p) { return low + (high - low) * p; }, true);
+        }
+    } else if (kind == "lognormal") {
+        double median = 0;
+        double sigma = 0;
+        ok = parseArguments(fields, median, sigma) && median >= 1 && sigma >= 0;
+        if (ok) {
+            double mu = std::log(median);
+            out.table_ = QuantileTable(
+                [=](double p) {
+                    p = std::clamp(p, kTailProbability, 1 - kTailProbability);
+                    return std::clamp(std::exp(mu + sigma * normalQuantile(p)), 1.0, static_cast<double>(kMaxSize));
+                },
+                true);
+        }
+    } else if (kind == "powerlaw") {
+        size_t min = 0;
+        size_t max = 0;
+        double alpha = 0;
+        ok = parseArguments(fields, min, max, alpha) && min >= 1 && max >= min && alpha > 0;
+        if (ok) {
+            // Inverse CDF of the Pareto distribution truncated to [min, max].
+            double lowTerm = std::pow(static_cast<double>(min), -alpha);
+            double highTerm = std::pow(static_cast<double>(max), -alpha);
+            out.table_ = QuantileTable(
+                [=](double p) { return std::pow(lowTerm - p * (lowTerm - highTerm), -1 / alpha); }, true);
+        }
+    } else if (kind == "empirical") {
+        std::vector<std::pair<size_t, double>> bins;
+        double totalWeight = 0;
+        ok = fields.size() >= 2;
+        for (size_t i = 1; ok && i < fields.size(); ++i) {
+            std::vector<std::string_view> bin = splitFields(fields[i], ':');
+            size_t size = 0;
+            double weight = 0;
+            ok = bin.size() == 2 && parseNumber(bin[0], size) && parseNumber(bin[1], weight) && size >= 1 &&
+                 weight >= 0;
+            bins.emplace_back(size, weight);
+            totalWeight += weight;
+        }
+        ok = ok && totalWeight > 0;
+        if (ok) {
+            std::vector<double> cumulative;
+            double running = 0;
+            for (const auto& [size, weight] : bins) {
+                running += weight / totalWeight;
+                cumulative.push_back(running);
+            }
+            out.table_ = QuantileTable(
+                [&](double p) {
+                    size_t bin = std::lower_bound(cumulative.begin(), cumulative.end(), p) - cumulative.begin();
+                    return static_cast<double>(bins[std::min(bin, bins.size() - 1)].first);
+                },
+                false);
+        }
+    } else {
+        error = "unknown size distribution '" + std::string(kind) + "'";
+        return false;
+    }
+
+    if (!ok) {
+        error = "bad parameters for size distribution: " + std::string(spec);
+        return false;
+    }
+    out.spec_ = spec;
+    return true;
+}
+
+bool LifetimeModel::parse(std::string_view spec, LifetimeModel& out, std::string& error) {
+    std::vector<std::string_view> fields = splitFields(spec, ',');
+    std::string_view kind = fields[0];
+    bool ok = true;
+
+    if (kind == "random" || kind == "lifo" || kind == "fifo") {
+        ok = fields.size() == 1;
+        out.kind = kind == "random" ? Kind::Random : kind == "lifo" ? Kind::Lifo : Kind::Fifo;
+    } else if (kind == "exponential") {
+        double mean = 0;
+        ok = parseArguments(fields, mean) && mean > 0;
+        if (ok) {
+            out.kind = Kind::Exponential;
+            out.youngFraction = 1.0;
+            out.young = exponentialTable(mean);
+        }
+    } else if (kind == "generational") {
+        double fraction = 0;
+        double youngMean = 0;
+        double oldMean = 0;
+        ok = parseArguments(fields, fraction, youngMean, oldMean) && fraction >= 0 && fraction <= 1 &&
+             youngMean > 0 && oldMean > 0;
+        if (ok) {
+            out.kind = Kind::Generational;
+            out.youngFraction = fraction;
+            out.young = exponentialTable(youngMean);
+            out.old = exponentialTable(oldMean);
+        }
+    } else {
+        error = "unknown lifetime model '" + std::string(kind) + "'";
+        return false;
+    }
+
+    if (!ok) {
+        error = "bad parameters for lifetime model: " + std::string(spec);
+        return false;
+    }
+    out.spec = spec;
+    return true;
+}
+
+bool isPhaseParameter(std::string_view name) {
+    return name == "steps" || name == "allocs-per-step" || name == "frees-per-step" || name == "min-live-blocks" ||
+           name == "reallocs-per-step" || name == "realloc-growth" || name == "aligned-percent" ||
+           name == "alignment" || name == "sizes" || name == "lifetime";
+}
+
+bool setPhaseParameter(WorkloadPhase& phase, std::string_view name, std::string_view value, std::string& error) {
+    bool ok = true;
+    if (name == "steps") {
+        ok = parseNumber(value, phase.steps) && phase.steps > 0;
+    } else if (name == "allocs-per-step") {
+        ok = parseNumber(value, phase.allocationsPerStep) && phase.allocationsPerStep >= 0;
+    } else if (name == "frees-per-step") {
+        ok = parseNumber(value, phase.freesPerStep) && phase.freesPerStep >= 0;
+    } else if (name == "min-live-blocks") {
+        ok = parseNumber(value, phase.minLiveBlocks);
+    } else if (name == "reallocs-per-step") {
+        ok = parseNumber(value, phase.reallocationsPerStep) && phase.reallocationsPerStep >= 0;
+    } else if (name == "realloc-growth") {
+        ok = parseNumber(value, phase.reallocGrowth) && phase.reallocGrowth > 1.0;
+    } else if (name == "aligned-percent") {
+        ok = parseNumber(value, phase.alignedPercent) && phase.alignedPercent >= 0 && phase.alignedPercent <= 100;
+    } else if (name == "alignment") {
+        ok = parseNumber(value, phase.alignment) && phase.alignment >= sizeof(void*) &&
+             (phase.alignment & (phase.alignment - 1)) == 0 && phase.alignment <= (size_t{1} << 20);
+    } else if (name == "sizes") {
+        return SizeDistribution::parse(value, phase.sizes, error);
+    } else if (name == "lifetime") {
+        return LifetimeModel::parse(value, phase.lifetime, error);
+    } else {
+        error = "unknown workload parameter: " + std::string(name);
+        return false;
+    }
+    if (!ok) {
+        error = "invalid value for " + std::string(name) + ": " + std::string(value);
+    }
+    return ok;
+}
+
+std::vector<size_t> typicalRequestSizes(const WorkloadSpec& spec) {
+    constexpr size_t kSamples = 1 << 16;
+    double totalAllocations = 0;
+    for (const WorkloadPhase& phase : spec.phases) {
+        totalAllocations += static_cast<double>(phase.steps) * phase.allocationsPerStep;
+    }
+    if (totalAllocations <= 0) {
+        return {};
+    }
+    FastRandom random(1);
+    std::vector<size_t> sizes;
+    sizes.reserve(kSamples + spec.phases.size());
+    for (const WorkloadPhase& phase : spec.phases) {
+        double share = static_cast<double>(phase.steps) * phase.allocationsPerStep / totalAllocations;
+        size_t draws = static_cast<size_t>(std::ceil(share * kSamples));
+        for (size_t i = 0; i < draws; ++i) {
+            sizes.push_back(phase.sizes(random));
+        }
+    }
+    std::sort(sizes.begin(), sizes.end());
+    std::vector<size_t> typical;
+    for (double quantile : {0.50, 0.90, 0.99}) {
+        size_t size = sizes[std::min(sizes.size() - 1, static_cast<size_t>(quantile * sizes.size()))];
+        if (size > 0 && std::find(typical.begin(), typical.end(), size) == typical.end()) {
+            typical.push_back(size);
+        }
+    }
+    return typical;
+}
+
+bool loadWorkloadFile(const std::string& path, const WorkloadPhase& defaults, WorkloadSpec& spec,
+                      std::string& error) {
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        error = "cannot open workload file " + path;
+        return false;
+    }
+
+    WorkloadPhase fileDefaults = defaults;
+    spec.phases.clear();
+    std::string line;
+    for (int lineNumber = 1; std::getline(file, line); ++lineNumber) {
+        std::string_view text = trim(std::string_view(line).substr(0, line.find('#')));
+        if (text.empty()) {
+            continue;
+        }
+        if (text == "[phase]") {
+            spec.phases.push_back(fileDefaults);
+            continue;
+        }
+        size_t equals = text.find('=');
+        std::string reason = "expected 'name = value' or '[phase]'";
+        WorkloadPhase& target = spec.phases.empty() ? fileDefaults : spec.phases.back();
+        if (equals == std::string_view::npos ||
+            !setPhaseParameter(target, trim(text.substr(0, equals)), trim(text.substr(equals + 1)), reason)) {
+            error = path + ":" + std::to_string(lineNumber) + ": " + reason;
+            return false;
+        }
+    }
+    if (spec.phases.empty()) {
+        spec.phases.push_back(fileDefaults);
+    }
+    return true;
+}
@@ -0,0 +1,277 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "checkpoint_stream.h"
+#include "fast_random.h"
+#include "live_block_table.h"
+
+/**
+ * @brief Inverse-CDF lookup table for drawing from an arbitrary distribution.
+ *
+ * The quantile function is evaluated once, at construction, on a grid of
+ * 4096 probabilities. A draw takes the top bits of one random number as the
+ * grid cell and, for continuous distributions, the next bits to interpolate
+ * inside it. That is the same cost for every distribution (no log/exp/pow on
+ * the hot path), and the table fits in L1.
+ */
+class QuantileTable {
+public:
+    static constexpr unsigned kBits = 12;
+    static constexpr size_t kCells = size_t{1} << kBits;
+
+    QuantileTable() = default;
+
+    // @p quantile maps a probability in [0, 1] to a value.
+    template <typename Quantile>
+    QuantileTable(Quantile&& quantile, bool interpolate) : interpolate_(interpolate) {
+        for (size_t i = 0; i <= kCells; ++i) {
+            // Discrete tables use the midpoint of each cell, continuous ones its edges.
+            double p = interpolate ? static_cast<double>(i) / kCells : (i + 0.5) / kCells;
+            values_[i] = quantile(p < 1.0 ? p : 1.0);
+        }
+    }
+
+    double operator()(FastRandom& random) const {
+        uint64_t bits = random();
+        size_t cell = static_cast<size_t>(bits >> (64 - kBits));
+        if (!interpolate_) {
+            return values_[cell];
+        }
+        double fraction = static_cast<double>((bits >> (64 - kBits - 20)) & 0xfffff) * 0x1.0p-20;
+        return values_[cell] + (values_[cell + 1] - values_[cell]) * fraction;
+    }
+
+private:
+    std::array<double, kCells + 1> values_{};
+    bool interpolate_ = true;
+};
+
+/**
+ * @brief Distribution of requested block sizes.
+ *
+ * Spec strings, as given to --sizes or `sizes =` in a workload file:
+ *
+ *     uniform,MIN,MAX            every size in [MIN, MAX] equally likely
+ *     lognormal,MEDIAN,SIGMA     log-normal, SIGMA is the std. dev. of ln(size)
+ *     powerlaw,MIN,MAX,ALPHA     bounded Pareto, P(size > x) ~ x^-ALPHA
+ *     empirical,SIZE:WEIGHT,...  a measured histogram; weights need not sum to 1
+ *
+ * Empirical weights are resolved to 1/4096, so a size much rarer than that may
+ * never be drawn.
+ */
+class SizeDistribution {
+public:
+    static constexpr size_t kMaxSize = size_t{1} << 30; // Tail cutoff for lognormal.
+
+    SizeDistribution(); // uniform,512,1535: the original workload.
+
+    /**
+     * @brief Parses a spec string.
+     * @return false on a malformed spec, with the reason in @p error.
+     */
+    static bool parse(std::string_view spec, SizeDistribution& out, std::string& error);
+
+    size_t operator()(FastRandom& random) const {
+        return static_cast<size_t>(table_(random));
+    }
+
+    const std::string& spec() const { return spec_; }
+
+private:
+    QuantileTable table_;
+    std::string spec_;
+};
+
+/**
+ * @brief When blocks are freed.
+ *
+ * Spec strings, as given to --lifetime or `lifetime =` in a workload file:
+ *
+ *     random                     free a random live block (the original workload)
+ *     lifo                       free the most recently allocated block
+ *     fifo                       free the oldest block
+ *     exponential,MEAN           each block lives an exponential number of steps
+ *     generational,F,YOUNG,OLD   a share F of blocks has mean lifetime YOUNG,
+ *                                the rest OLD ("most objects die young")
+ *
+ * The first three free WorkloadPhase::freesPerStep blocks per step; the last
+ * two give each block a deadline when it is allocated and free it when that
+ * step is reached, whatever phase the workload is in by then.
+ */
+struct LifetimeModel {
+    enum class Kind { Random, Lifo, Fifo, Exponential, Generational };
+
+    Kind kind = Kind::Random;
+    double youngFraction = 1.0; // Exponential is generational with a single generation.
+    QuantileTable young;        // Lifetimes in steps.
+    QuantileTable old;
+    std::string spec = "random";
+
+    bool usesDeadlines() const { return kind == Kind::Exponential || kind == Kind::Generational; }
+
+    static bool parse(std::string_view spec, LifetimeModel& out, std::string& error);
+};
+
+// One stretch of the workload with fixed parameters.
+struct WorkloadPhase {
+    int steps = 100;
+    int allocationsPerStep = 10;
+    int freesPerStep = 1;
+    size_t minLiveBlocks = 20; // Count-based lifetimes only free above this many live blocks.
+    int reallocationsPerStep = 0; // Live blocks grown per step, picked at random.
+    double reallocGrowth = 2.0;   // A grown block's new size, as a multiple of its old size.
+    int alignedPercent = 0;       // Share of allocations that ask for an aligned block.
+    size_t alignment = 64;        // Their alignment, a power of two.
+    SizeDistribution sizes;
+    LifetimeModel lifetime;
+};
+
+// The whole synthetic workload: phases run back to back.
+struct WorkloadSpec {
+    std::vector<WorkloadPhase> phases{WorkloadPhase{}};
+
+    int totalSteps() const {
+        int steps = 0;
+        for (const WorkloadPhase& phase : phases) {
+            steps += phase.steps;
+        }
+        return steps;
+    }
+};
+
+/**
+ * @brief Sets one phase parameter from its name (steps, allocs-per-step,
+ * frees-per-step, min-live-blocks, reallocs-per-step, realloc-growth,
+ * aligned-percent, alignment, sizes, lifetime) and a textual value.
+ * The names are shared by the command line (--NAME VALUE) and workload files.
+ * @return false on an unknown name or a bad value, with the reason in @p error.
+ */
+bool setPhaseParameter(WorkloadPhase& phase, std::string_view name, std::string_view value, std::string& error);
+bool isPhaseParameter(std::string_view name);
+
+/**
+ * @brief The request sizes that matter most in @p spec: the median, 90th and
+ * 99th percentile of its sizes, weighted by how many blocks each phase
+ * allocates, estimated from a fixed-seed sample. Duplicates are dropped.
+ * Used as the default sizes for the Allocatable_<size> columns.
+ */
+std::vector<size_t> typicalRequestSizes(const WorkloadSpec& spec);
+
+/**
+ * @brief Reads a workload file into @p spec.
+ *
+ * The file is a list of `name = value` lines; `#` starts a comment. Each
+ * `[phase]` line starts a new phase, which begins as a copy of @p defaults plus
+ * any parameters set above the first `[phase]`. A file without `[phase]`
+ * lines describes a single phase.
+ */
+bool loadWorkloadFile(const std::string& path, const WorkloadPhase& defaults, WorkloadSpec& spec,
+                      std::string& error);
+
+/**
+ * @brief Decides which blocks to free, for one simulation thread.
+ *
+ * Tracks the allocation order of blocks under LIFO/FIFO phases and the
+ * deadlines of blocks under exponential/generational phases. Blocks are tracked
+ * by BlockRef, so a block that was freed some other way (another phase's
+ * model, a cross-thread handoff) is simply skipped when it comes up.
+ */
+class LifetimeScheduler {
+public:
+    explicit LifetimeScheduler(uint64_t seed) : random_(seed) {}
+
+    FastRandom& random() { return random_; }
+
+    void onAllocated(const WorkloadPhase& phase, BlockRef ref, int step) {
+        const LifetimeModel& model = phase.lifetime;
+        if (model.usesDeadlines()) {
+            const QuantileTable& lifetime = random_.uniform() < model.youngFraction ? model.young : model.old;
+            deadlines_.push_back({step + static_cast<int64_t>(lifetime(random_)), ref});
+            std::push_heap(deadlines_.begin(), deadlines_.end(), std::greater<>());
+        } else if (model.kind != LifetimeModel::Kind::Random) {
+            order_.push_back(ref);
+        }
+    }
+
+    /**
+     * @brief Removes this step's victims from @p blocks and passes each one to @p release.
+     */
+    template <typename Release>
+    void freeDue(const WorkloadPhase& phase, int step, LiveBlockTable& blocks, Release&& release) {
+        while (!deadlines_.empty() && deadlines_.front().step <= step) {
+            BlockRef ref = deadlines_.front().ref;
+            std::pop_heap(deadlines_.begin(), deadlines_.end(), std::greater<>());
+            deadlines_.pop_back();
+            if (blocks.contains(ref)) {
+                release(blocks.remove(ref));
+            }
+        }
+
+        if (phase.lifetime.usesDeadlines()) {
+            return;
+        }
+        LifetimeModel::Kind kind = phase.lifetime.kind;
+        for (int i = 0; i < phase.freesPerStep && blocks.size() > phase.minLiveBlocks; ++i) {
+            if (kind == LifetimeModel::Kind::Random) {
+                release(blocks.removeAt(random_.below(static_cast<uint32_t>(blocks.size()))));
+                continue;
+            }
+            BlockRef ref;
+            if (!popOrdered(kind == LifetimeModel::Kind::Lifo, blocks, ref)) {
+                break; // Everything left was allocated under another model.
+            }
+            release(blocks.remove(ref));
+        }
+    }
+
+    // The generator, the order list and the deadline heap as they are, so a
+    // resumed run frees the same blocks in the same order.
+    void save(CheckpointWriter& out) const {
+        random_.save(out);
+        out.putVector(std::vector<BlockRef>(order_.begin(), order_.end()));
+        out.putVector(deadlines_);
+    }
+    void load(CheckpointReader& in) {
+        random_.load(in);
+        std::vector<BlockRef> order = in.getVector<BlockRef>();
+        order_.assign(order.begin(), order.end());
+        deadlines_ = in.getVector<Deadline>();
+    }
+
+private:
+    struct Deadline {
+        int64_t step;
+        BlockRef ref;
+        bool operator>(const Deadline& other) const { return step > other.step; }
+    };
+
+    // Takes the newest (or oldest) block that is still live off the order list.
+    bool popOrdered(bool newest, const LiveBlockTable& blocks, BlockRef& ref) {
+        while (!order_.empty()) {
+            if (newest) {
+                ref = order_.back();
+                order_.pop_back();
+            } else {
+                ref = order_.front();
+                order_.pop_front();
+            }
+            if (blocks.contains(ref)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    FastRandom random_;
+    std::deque<BlockRef> order_;
+    std::vector<Deadline> deadlines_; // A min-heap on the step, as std::priority_queue keeps it.
+};